@@ -165,10 +165,11 @@ uint16_t ads1298_init(ads129x_handle_t handle, ads1298_config_t *config)
     ERROR_CHECK(ads1298_get_reg(handle, ADS1298_REG_ID, (uint8_t *)&partID));
     if(partID != ADS1298_ID) return ERR_INVALID_PARAMETR;
 
-    if(config == NULL) return ERR_NOERROR;
-
     // заливаю конфигурацию (если задана)
-    return ads1298_set_config(handle, config);
+    if(config != NULL) ERROR_CHECK(ads1298_set_config(handle, config));
+
+    // читаю все регистры для заполнения теневой копии
+    return ads129x_load_shadow(handle, ADS1298_REG_LAST + 1, ADS1298_ACCESS_TO_SPI_TIMEOUT_MS);
 }
 
 
@@ -187,7 +188,9 @@ uint16_t ads1298_get_config(ads129x_handle_t handle, ads1298_config_t *config)
 {
     ASSERT((handle != NULL) || (config != NULL));
 
-    return ads129x_read_regs(handle, ADS1298_REG_CONFIG1, 25, (uint8_t *)&config->config1, ADS1298_ACCESS_TO_SPI_TIMEOUT_MS);
+    // регистры LOFF_STATP/LOFF_STATN в структуру конфигурации не входят
+    ERROR_CHECK(ads129x_read_regs(handle, ADS1298_REG_CONFIG1, 17, (uint8_t *)&config->config1, ADS1298_ACCESS_TO_SPI_TIMEOUT_MS));
+    return ads129x_read_regs(handle, ADS1298_REG_GPIO, 6, (uint8_t *)&config->gpio, ADS1298_ACCESS_TO_SPI_TIMEOUT_MS);
 }
 
 
@@ -46,6 +46,7 @@
 /// БИТОВЫЕ МАСКИ, ЗНАЧЕНИЯ ПОЛЕЙ
 #define ADS1298_ID_MASK         0xFF    ///< Маска для выделения ID микросхемы
 #define ADS1298_ID              0x92    ///< ID ADS1298 (8 каналов)
+#define ADS1298R_ID             0xD2    ///< ID ADS1298R (8 каналов, демодулятор дыхания на канале 1)
 
 /// For High-Resolution mode, fMOD = fCLK / 4. For low power mode, fMOD = fCLK / 8
 #define ADS1298_DR_16KSPS       0x00    ///< fMOD / 16 (HR Mode: 32 kSPS, LP Mode: 16 kSPS)
@@ -273,7 +274,7 @@ __packed typedef struct {
 /// Pace Detect Register
 __packed typedef struct {
     uint8_t     pd_pace:1;        ///< Pace detect buffer (0 = Pace detect buffer turned off)
-    uint8_t     paceo:1;          ///< Pace odd channels
+    uint8_t     paceo:2;          ///< Pace odd channels
     uint8_t     pacee:2;          ///< Pace even channels
     uint8_t     bit7:3;           ///< set 0
 } ads1298_pace_t;
@@ -281,7 +282,7 @@ __packed typedef struct {
 /// Respiration Control Register
 __packed typedef struct {
     uint8_t     resp_ctrl:2;       ///< Respiration control
-    uint8_t     resp_ph:2;         ///< Respiration phase
+    uint8_t     resp_ph:3;         ///< Respiration phase
     uint8_t     reserve:1;         ///< Always write 1h
     uint8_t     resp_mod_en1:1;    ///< Enables respiration modulation circuitry (ADS129xR only, for ADS129x always write 0)
     uint8_t     resp_demod_en1:1;  ///< Enables respiration demodulation circuitry (ADS129xR only, for ADS129x always write 0)
@@ -136,11 +136,16 @@ uint16_t ads1299_init(ads129x_handle_t handle, ads1299_config_t *config)
     // перевожу в командный режим
     ERROR_CHECK(ads129x_cmd(handle, ADS129X_CMD_SDATAC, ADS1299_ACCESS_TO_SPI_TIMEOUT_MS));
 
-    if(config == NULL) return ERR_NOERROR;
+    // читаю ID и проверяю ID микросхемы
+    uint8_t partID;
+    ERROR_CHECK(ads1299_get_reg(handle, ADS1299_REG_ID, &partID));
+    if((partID & ADS1299_ID_MASK) != ADS1299_ID) return ERR_INVALID_PARAMETR;
 
     // заливаю конфигурацию (если задана)
-    ERROR_CHECK(ads129x_write_regs(handle, ADS1299_REG_CONFIG1, 17, (uint8_t *)&config->config1, ADS1299_ACCESS_TO_SPI_TIMEOUT_MS));
-    return ads129x_write_regs(handle, ADS1299_REG_GPIO, 4, (uint8_t *)&config->gpio, ADS1299_ACCESS_TO_SPI_TIMEOUT_MS);
+    if(config != NULL) ERROR_CHECK(ads1299_set_config(handle, config));
+
+    // читаю все регистры для заполнения теневой копии
+    return ads129x_load_shadow(handle, ADS1299_REG_LAST + 1, ADS1299_ACCESS_TO_SPI_TIMEOUT_MS);
 }
 
 
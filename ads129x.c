@@ -3,15 +3,26 @@
  * 
  * 
  * ОСОБЕННОСТИ
- * - все функции блокируют поток до их завершения
+ * - все функции, кроме ads129x_read_data_async(), блокируют поток до их завершения
 */
 
 
 #include "ads129x.h"
 #include "spim_freertos.h"
 #include "errors.h"
+#include "settings.h"
 
 #include "FreeRTOS.h"
+#include "task.h"
+
+#include <string.h>
+
+
+// НАСТРОЙКИ МОДУЛЯ ************************************
+#ifndef ADS129X_DEV_MAX
+#define ADS129X_DEV_MAX     2     // максимальное количество устройств на шинах SPI
+#endif // ADS129X_DEV_MAX
+// *****************************************************
 
 
 
@@ -23,10 +34,15 @@
 typedef struct {
   uint8_t csPin;
   uint8_t spiDevID;
-  
+  bool    inUse;    // флаг занятости описания
+  uint8_t regsCnt;  // количество регистров микросхемы в теневой копии (0 - копия не заполнена)
+  uint8_t regs[ADS129X_REG_CNT]; // теневая копия регистров
 } ads129x_t;
 
 
+static ads129x_t m_dev[ADS129X_DEV_MAX]; // описания устройств (память выделяется статически)
+
+
 
 
 
@@ -44,11 +60,25 @@ uint16_t ads129x_add(uint8_t spiDevID, uint8_t csPin, ads129x_handle_t *handle)
 {
   ASSERT(handle != NULL);
   
-  ads129x_t *hdl = (ads129x_t *)pvPortMalloc(sizeof(ads129x_t));
+  ads129x_t *hdl = NULL;
+  
+  // ищу свободное описание
+  taskENTER_CRITICAL();
+  for(uint8_t i = 0; i < ADS129X_DEV_MAX; i++)
+  {
+    if(!m_dev[i].inUse)
+    {
+      hdl = &m_dev[i];
+      hdl->inUse = true;
+      break;
+    }
+  }
+  taskEXIT_CRITICAL();
   if(hdl == NULL) return ERR_OUT_OF_MEMORY;
   
   hdl->csPin = csPin;
   hdl->spiDevID = spiDevID;
+  hdl->regsCnt = 0;
   
   *handle = (uint32_t *)hdl;
   return ERR_NOERROR;
@@ -62,7 +92,8 @@ uint16_t ads129x_add(uint8_t spiDevID, uint8_t csPin, ads129x_handle_t *handle)
 */
 void ads129x_remove(ads129x_handle_t handle)
 {
-  vPortFree(handle);
+  if(handle == NULL) return;
+  ((ads129x_t *)handle)->inUse = false;
 }
 
 
@@ -91,6 +122,23 @@ uint16_t ads129x_cmd(ads129x_handle_t handle, uint8_t cmd, uint32_t timeout_ms)
 }
 
 
+static uint16_t read_regs(ads129x_t *hdl, uint8_t reg_addr, uint8_t cnt, uint8_t *rx_data, uint32_t timeout_ms)
+{ // чтение регистров без обновления теневой копии
+  uint8_t cmdBuff[2];
+  cmdBuff[0] = ADS129X_CMD_RREG + (reg_addr & 0x1F);
+  cmdBuff[1] = cnt - 1;
+  spi_queue_t spi_task = {
+    .cmdBuff = (uint8_t *)cmdBuff,
+    .cmdBuffLen = 2,
+    .rxData = rx_data,
+    .rxDataLen = cnt,
+    .csPin = hdl->csPin
+  };
+        
+  return spiTaskExecute(hdl->spiDevID, &spi_task, pdMS_TO_TICKS(timeout_ms));
+}
+
+
 /*
 * Чтение регистров
 *
@@ -108,18 +156,12 @@ uint16_t ads129x_read_regs(ads129x_handle_t handle, uint8_t reg_addr, uint8_t cn
   
   ads129x_t *hdl = (ads129x_t *)handle;
   
-  uint8_t cmdBuff[2];
-  cmdBuff[0] = ADS129X_CMD_RREG + (reg_addr & 0x1F);
-  cmdBuff[1] = cnt - 1;
-  spi_queue_t spi_task = {
-    .cmdBuff = (uint8_t *)cmdBuff,
-    .cmdBuffLen = 2,
-    .rxData = rx_data,
-    .rxDataLen = cnt,
-    .csPin = hdl->csPin
-  };
-        
-  return spiTaskExecute(hdl->spiDevID, &spi_task, pdMS_TO_TICKS(timeout_ms));
+  uint16_t err = read_regs(hdl, reg_addr, cnt, rx_data, timeout_ms);
+  if((err == ERR_NOERROR) && ((reg_addr + cnt) <= ADS129X_REG_CNT))
+  { // обновляю теневую копию
+    memcpy(&hdl->regs[reg_addr], rx_data, cnt);
+  }
+  return err;
 }
 
 
@@ -151,7 +193,12 @@ uint16_t ads129x_write_regs(ads129x_handle_t handle, uint8_t reg_addr, uint8_t c
     .csPin = hdl->csPin
   };
         
-  return spiTaskExecute(hdl->spiDevID, &spi_task, pdMS_TO_TICKS(timeout_ms));
+  uint16_t err = spiTaskExecute(hdl->spiDevID, &spi_task, pdMS_TO_TICKS(timeout_ms));
+  if((err == ERR_NOERROR) && ((reg_addr + cnt) <= ADS129X_REG_CNT))
+  { // обновляю теневую копию
+    memcpy(&hdl->regs[reg_addr], tx_data, cnt);
+  }
+  return err;
 }
 
 
@@ -201,7 +248,111 @@ uint16_t ads129x_read_data(ads129x_handle_t handle, ads129x_data_t *rx_data, uin
 }
 
 
+/*
+* Асинхронное чтение данных: задание ставится в очередь SPI без ожидания (можно вызывать из прерывания)
+*
+* handle - хендл устройства на шине SPI
+* rx_data - указатель на буфер данных (должен существовать до вызова done)
+* job - память под задание SPI (должна существовать до вызова done)
+* done - функция окончания чтения (вызывается из прерывания SPIM)
+* ctx - аргумент для done
+* Возврат:
+* код ошибки из errors.h или ERR_NOERROR
+*/
+uint16_t ads129x_read_data_async(ads129x_handle_t handle, ads129x_data_t *rx_data, spi_queue_t *job, spi_done_t done, void *ctx)
+{
+  ASSERT((rx_data != NULL)||(handle != NULL)||(job != NULL));
+  
+  ads129x_t *hdl = (ads129x_t *)handle;
+  
+  memset(job, 0, sizeof(spi_queue_t));
+  job->cmd = ADS129X_CMD_RDATA;
+  job->cmdBuffLen = 1;
+  job->rxData = (uint8_t *)rx_data;
+  job->rxDataLen = sizeof(ads129x_data_t);
+  job->csPin = hdl->csPin;
+  job->done = done;
+  job->ctx = ctx;
+  
+  return spiTaskSubmit(hdl->spiDevID, job);
+}
 
 
+/*
+* Заполнение теневой копии: чтение всех регистров микросхемы начиная с адреса 0
+*
+* handle - хендл устройства на шине SPI
+* cnt - количество регистров микросхемы
+* timeout_ms - таймаут ожидания доступа к интерфейсу
+* Возврат:
+* код ошибки из errors.h или ERR_NOERROR
+*/
+uint16_t ads129x_load_shadow(ads129x_handle_t handle, uint8_t cnt, uint32_t timeout_ms)
+{
+  ASSERT(handle != NULL);
+  
+  ads129x_t *hdl = (ads129x_t *)handle;
+  
+  if((cnt == 0) || (cnt > ADS129X_REG_CNT)) return ERR_INVALID_PARAMETR;
+  
+  uint16_t err = read_regs(hdl, 0, cnt, hdl->regs, timeout_ms);
+  hdl->regsCnt = (err == ERR_NOERROR) ? cnt : 0;
+  return err;
+}
 
 
+/*
+* Чтение регистров из теневой копии (без обмена по SPI)
+*
+* handle - хендл устройства на шине SPI
+* reg_addr - адрес первого регистра
+* cnt - количество регистров
+* buff - указатель на буфер
+* Возврат:
+* код ошибки из errors.h или ERR_NOERROR
+*/
+uint16_t ads129x_get_shadow(ads129x_handle_t handle, uint8_t reg_addr, uint8_t cnt, uint8_t *buff)
+{
+  ASSERT((handle != NULL)||(buff != NULL));
+  
+  ads129x_t *hdl = (ads129x_t *)handle;
+  
+  if(hdl->regsCnt == 0) return ERR_INVALID_STATE;
+  if((reg_addr + cnt) > hdl->regsCnt) return ERR_INVALID_PARAMETR;
+  
+  memcpy(buff, &hdl->regs[reg_addr], cnt);
+  return ERR_NOERROR;
+}
+
+
+/*
+* Сверка регистров микросхемы с теневой копией
+*
+* handle - хендл устройства на шине SPI
+* cmp_mask - маски сверяемых битов по адресам регистров (NULL - сверяются все биты)
+* diff_mask - маска регистров, значение которых отличается от теневой копии
+* timeout_ms - таймаут ожидания доступа к интерфейсу
+* Возврат:
+* код ошибки из errors.h или ERR_NOERROR
+*/
+uint16_t ads129x_verify_regs(ads129x_handle_t handle, const uint8_t *cmp_mask, uint32_t *diff_mask, uint32_t timeout_ms)
+{
+  ASSERT((handle != NULL)||(diff_mask != NULL));
+  
+  ads129x_t *hdl = (ads129x_t *)handle;
+  uint8_t regs[ADS129X_REG_CNT];
+  
+  *diff_mask = 0;
+  if(hdl->regsCnt == 0) return ERR_INVALID_STATE;
+  
+  // прочитанные значения в теневую копию не попадают, иначе сбой был бы принят за норму
+  uint16_t err = read_regs(hdl, 0, hdl->regsCnt, regs, timeout_ms);
+  if(err != ERR_NOERROR) return err;
+  
+  for(uint8_t i = 0; i < hdl->regsCnt; i++)
+  {
+    uint8_t m = (cmp_mask == NULL) ? 0xFF : cmp_mask[i];
+    if((regs[i] ^ hdl->regs[i]) & m) *diff_mask |= 1UL << i;
+  }
+  return ERR_NOERROR;
+}
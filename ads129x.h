@@ -7,12 +7,39 @@
  * 
  * ОСОБЕННОСТИ
  * - функции блокируют поток до окончания их выполнения
+ * - для каждого устройства хранится теневая копия регистров: она заполняется ads129x_load_shadow() и затем
+ *   обновляется при каждом успешном чтении и записи регистров
+ * - теневую копию можно периодически сверять с микросхемой (ads129x_verify_regs) для обнаружения сбоев регистров
 */
 
 #include <stdbool.h>
 #include <stdint.h>
+#include "spim_freertos.h"
 
 #define ADS129X_CH_CNT        8       ///< Количество каналов АЦП
+#define ADS129X_REG_CNT       26      ///< Количество регистров в теневой копии (максимальное для серии, адреса 0x00..0x19)
+#define ADS129X_REG_ID        0x00    ///< Адрес регистра ID (общий для серии)
+#define ADS129X_REG_CONFIG1   0x01    ///< Адрес регистра CONFIG1 (общий для серии)
+#define ADS129X_REG_CONFIG2   0x02    ///< Адрес регистра CONFIG2 (общий для серии)
+#define ADS129X_CONFIG2_INT_TEST    0x10 ///< Бит INT_TEST (INT_CAL у ADS1299) в CONFIG2: внутренний тестовый сигнал
+#define ADS129X_CONFIG2_TEST_AMP    0x04 ///< Бит TEST_AMP (CAL_AMP0) в CONFIG2: амплитуда 2 * VREF / 2400 (иначе VREF / 2400)
+#define ADS129X_CONFIG2_TEST_FREQ   0x03 ///< Поле TEST_FREQ (CAL_FREQ) в CONFIG2, значение 0x03 - постоянный ток
+#define ADS129X_REG_CONFIG3   0x03    ///< Адрес регистра CONFIG3 (общий для серии)
+#define ADS129X_REG_CH1SET    0x05    ///< Адрес регистра настроек первого канала (общий для серии)
+#define ADS129X_CHSET_MUX     0x07    ///< Поле MUX в CHnSET (коды общие для серии)
+#define ADS129X_MUX_SHORT     0x01    ///< MUX: входы закорочены (смещение и шум)
+#define ADS129X_MUX_MVDD      0x03    ///< MUX: напряжение питания (каналы 3, 4 - DVDD / 4, остальные - (AVDD - AVSS) / 2)
+#define ADS129X_MUX_TEMP      0x04    ///< MUX: датчик температуры
+#define ADS129X_MUX_TEST      0x05    ///< MUX: тестовый сигнал
+#define ADS129X_REG_CONFIG4   0x17    ///< Адрес регистра CONFIG4 (общий для ADS1298 и ADS1299)
+#define ADS129X_CONFIG4_SINGLE_SHOT 0x08 ///< Бит SINGLE_SHOT в CONFIG4
+#define ADS129X_CONFIG4_PD_LOFF_COMP 0x02 ///< Бит PD_LOFF_COMP в CONFIG4 (компараторы обрыва электродов включены)
+#define ADS129X_REG_LOFF      0x04    ///< Адрес регистра LOFF (общий для серии, коды FLEAD_OFF различаются - см. ads_chip_ops_t)
+#define ADS129X_REG_LOFF_SENSP 0x0F   ///< Адрес регистра LOFF_SENSP (общий для серии)
+#define ADS129X_REG_LOFF_SENSN 0x10   ///< Адрес регистра LOFF_SENSN (общий для серии)
+
+/// Состояние электродов из слова состояния кадра (1100 + LOFF_STATP + LOFF_STATN + GPIO): (LOFF_STATP << 8) | LOFF_STATN
+#define ADS129X_STATUS_LOFF(status)   ((uint16_t)((status) >> 4))
 
 /// Значения команд
 #define ADS129X_CMD_WAKEUP    0x02    ///< Пробуждение из режима пониженного потребления
@@ -143,6 +170,76 @@ uint16_t ads129x_write_reg(ads129x_handle_t handle, uint8_t reg_addr, uint8_t va
 uint16_t ads129x_read_data(ads129x_handle_t handle, ads129x_data_t *rx_data, uint32_t timeout_ms);
 
 
+/**
+ * @brief Асинхронное чтение данных: задание ставится в очередь SPI без ожидания
+ * 
+ * Можно вызывать из прерывания. Чтение выполняется драйвером SPI по очереди с остальными заданиями шины,
+ * об окончании сообщает done (из прерывания SPIM).
+ *
+ * @param handle - хендл устройства на шине SPI
+ * @param rx_data - указатель на буфер данных (должен существовать до вызова done)
+ * @param job - память под задание SPI (должна существовать до вызова done)
+ * @param done - функция окончания чтения
+ * @param ctx - аргумент для done
+ * 
+ * @return
+ *  ERR_NOERROR: ошибок нет
+ *  ERR_NOT_INITED: интерфейс SPI не инициализирован
+ *  ERR_FIFO_OVF: очередь заданий шины SPI заполнена
+*/
+uint16_t ads129x_read_data_async(ads129x_handle_t handle, ads129x_data_t *rx_data, spi_queue_t *job, spi_done_t done, void *ctx);
+
+
+/**
+ * @brief Заполнение теневой копии: чтение всех регистров микросхемы начиная с адреса 0
+ *
+ * @param handle - хендл устройства на шине SPI
+ * @param cnt - количество регистров микросхемы (не больше ADS129X_REG_CNT)
+ * @param timeout_ms - таймаут ожидания доступа к интерфейсу
+ * 
+ * @return
+ *  ERR_NOERROR: ошибок нет
+ *  ERR_INVALID_PARAMETR: ошибка входных данных
+ *  ERR_NOT_INITED: интерфейс SPI не инициализирован
+ *  ERR_TIMEOUT: таймаут ожидания доступа к шине SPI
+*/
+uint16_t ads129x_load_shadow(ads129x_handle_t handle, uint8_t cnt, uint32_t timeout_ms);
+
+
+/**
+ * @brief Чтение регистров из теневой копии (без обмена по SPI)
+ *
+ * @param handle - хендл устройства на шине SPI
+ * @param reg_addr - адрес первого регистра
+ * @param cnt - количество регистров
+ * @param buff - указатель на буфер
+ * 
+ * @return
+ *  ERR_NOERROR: ошибок нет
+ *  ERR_INVALID_PARAMETR: выход за границы теневой копии
+ *  ERR_INVALID_STATE: теневая копия еще не заполнена
+*/
+uint16_t ads129x_get_shadow(ads129x_handle_t handle, uint8_t reg_addr, uint8_t cnt, uint8_t *buff);
+
+
+/**
+ * @brief Сверка регистров микросхемы с теневой копией
+ *
+ * Читает все регистры микросхемы, теневая копия при этом не меняется
+ * @param handle - хендл устройства на шине SPI
+ * @param cmp_mask - маски сверяемых битов по адресам регистров (NULL - сверяются все биты)
+ * @param diff_mask - маска регистров, значение которых отличается от теневой копии
+ * @param timeout_ms - таймаут ожидания доступа к интерфейсу
+ * 
+ * @return
+ *  ERR_NOERROR: ошибок нет (результат сверки в diff_mask)
+ *  ERR_INVALID_STATE: теневая копия еще не заполнена
+ *  ERR_NOT_INITED: интерфейс SPI не инициализирован
+ *  ERR_TIMEOUT: таймаут ожидания доступа к шине SPI
+*/
+uint16_t ads129x_verify_regs(ads129x_handle_t handle, const uint8_t *cmp_mask, uint32_t *diff_mask, uint32_t timeout_ms);
+
+
 
 
 #endif
@@ -0,0 +1,385 @@
+/**
+ * Общий интерфейс микросхем серии ADS129x
+ *
+ * ОСОБЕННОСТИ
+ * - все функции блокируют выполенние потока до их завершения
+ * - структуры конфигурации ads1298_config_t и ads1299_config_t содержат подряд регистры первого и второго
+ *   диапазонов записываемых регистров, поэтому в образ регистров они раскладываются по wr_ranges
+ * - сброс, проверка ID, применение образа, сверка и восстановление регистров общие для всех микросхем,
+ *   от микросхемы зависят только данные в ads_chip_ops_t и несколько функций-переходников
+*/
+
+
+#include "ads_chip.h"
+#include "ads1298.h"
+#include "ads1299.h"
+#include "errors.h"
+#include "nrf_delay.h"
+#include "string.h"
+
+#include "FreeRTOS.h"
+
+
+#define ADS_CHIP_ACCESS_TO_SPI_TIMEOUT_MS   200     // таймаут ожидания доступа к шине SPI
+
+#if((ADS1298_REG_LAST + 1) > ADS129X_REG_CNT) || ((ADS1299_REG_LAST + 1) > ADS129X_REG_CNT)
+#error "ADS129X_REG_CNT is less than chip register count"
+#endif
+
+
+static void cfg_to_image(const ads_chip_ops_t *ops, const uint8_t *cfg, uint8_t *regs)
+{ // раскладка структуры конфигурации микросхемы в образ регистров
+  memset(regs, 0, ADS129X_REG_CNT);
+  for(uint8_t r = 0; r < ADS_CHIP_WR_RANGES; r++)
+  {
+    uint8_t cnt = ops->wr_ranges[r][1] - ops->wr_ranges[r][0] + 1;
+    memcpy(&regs[ops->wr_ranges[r][0]], cfg, cnt);
+    cfg += cnt;
+  }
+}
+
+static int32_t decode_24bit(ads129x_24bit_t sample)
+{ // преобразует сэмпл одного канала АЦП 24 бит (дополнительный код) в int32_t
+  int32_t res = 0;
+  if(sample.val[0] & 0x80) res = 0xFF000000;
+  res += ((int32_t)sample.val[0] << 16) + ((int32_t)sample.val[1] << 8) + sample.val[2];
+  return res;
+}
+
+
+// ADS1298 *****************************************
+static const uint32_t m_ads1298_rates[] = {32000, 16000, 8000, 4000, 2000, 1000, 500}; // режим HR
+static const uint8_t  m_ads1298_gains[] = {6, 1, 2, 3, 4, 8, 12};
+// маски сверяемых битов: RLD_STAT в CONFIG3 и LOFF_STATP/LOFF_STATN - состояние, биты данных GPIO отражают входы
+static const uint8_t  m_ads1298_verify[ADS1298_REG_LAST + 1] = {
+  0xFF, 0xFF, 0xFF, 0xFE, 0xFF,                         // ID, CONFIG1..CONFIG3, LOFF
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,       // CH1SET..CH8SET
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF,                         // RLD_SENSP..LOFF_FLIP
+  0x00, 0x00, 0x0F,                                     // LOFF_STATP, LOFF_STATN, GPIO
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF                          // PACE, RESP, CONFIG4, WCT1, WCT2
+};
+
+static void def_config_ads1298(uint8_t *regs)
+{
+  ads1298_config_t cfg;
+  ads1298_def_config(&cfg);
+  cfg_to_image(&ads_chip_ads1298, (uint8_t *)&cfg, regs);
+}
+
+static uint16_t set_chcfg_ads1298(ads129x_handle_t handle, uint8_t ch_no, uint8_t chset)
+{
+  ads1298_chset_t ch_config;
+  memcpy(&ch_config, &chset, sizeof(ch_config));
+  return ads1298_set_chcfg(handle, ch_no, ch_config);
+}
+
+const ads_chip_ops_t ads_chip_ads1298 = {
+  .name = "ADS1298",
+  .id = ADS1298_ID,
+  .id_mask = ADS1298_ID_MASK,
+  .reg_cnt = ADS1298_REG_LAST + 1,
+  .wr_ranges = {{ADS1298_REG_CONFIG1, ADS1298_REG_LOFF_FLIP}, {ADS1298_REG_GPIO, ADS1298_REG_WCT2}},
+  .verify_mask = m_ads1298_verify,
+  .rates = m_ads1298_rates,
+  .rates_cnt = sizeof(m_ads1298_rates) / sizeof(m_ads1298_rates[0]),
+  .hr_bit = 0x80,
+  .gains = m_ads1298_gains,
+  .gains_cnt = sizeof(m_ads1298_gains),
+  .vref_mv = 2400,
+  .vref_alt_mv = 4000,
+  .vref_alt_bit = 0x20,     // VREF_4V
+  .flead_dc = ADS1298_FLEAD_OFF_DC,
+  .flead_ac = ADS1298_FLEAD_OFF_AC,
+  .resp = false,
+  .def_config = def_config_ads1298,
+  .set_chcfg = set_chcfg_ads1298,
+  .get_data = ads1298_get_data,
+  .decode = decode_24bit
+};
+
+// ADS1298R: карта регистров ADS1298, отличается ID и блоком дыхания
+const ads_chip_ops_t ads_chip_ads1298r = {
+  .name = "ADS1298R",
+  .id = ADS1298R_ID,
+  .id_mask = ADS1298_ID_MASK,
+  .reg_cnt = ADS1298_REG_LAST + 1,
+  .wr_ranges = {{ADS1298_REG_CONFIG1, ADS1298_REG_LOFF_FLIP}, {ADS1298_REG_GPIO, ADS1298_REG_WCT2}},
+  .verify_mask = m_ads1298_verify,
+  .rates = m_ads1298_rates,
+  .rates_cnt = sizeof(m_ads1298_rates) / sizeof(m_ads1298_rates[0]),
+  .hr_bit = 0x80,
+  .gains = m_ads1298_gains,
+  .gains_cnt = sizeof(m_ads1298_gains),
+  .vref_mv = 2400,
+  .vref_alt_mv = 4000,
+  .vref_alt_bit = 0x20,     // VREF_4V
+  .flead_dc = ADS1298_FLEAD_OFF_DC,
+  .flead_ac = ADS1298_FLEAD_OFF_AC,
+  .resp = true,
+  .def_config = def_config_ads1298,
+  .set_chcfg = set_chcfg_ads1298,
+  .get_data = ads1298_get_data,
+  .decode = decode_24bit
+};
+
+
+// ADS1299 *****************************************
+static const uint32_t m_ads1299_rates[] = {16000, 8000, 4000, 2000, 1000, 500, 250};
+static const uint8_t  m_ads1299_gains[] = {1, 2, 4, 6, 8, 12, 24};
+// маски сверяемых битов: BIAS_STAT в CONFIG3 и LOFF_STATP/LOFF_STATN - состояние, биты данных GPIO отражают входы
+static const uint8_t  m_ads1299_verify[ADS1299_REG_LAST + 1] = {
+  0xFF, 0xFF, 0xFF, 0xFE, 0xFF,                         // ID, CONFIG1..CONFIG3, LOFF
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,       // CH1SET..CH8SET
+  0xFF, 0xFF, 0xFF, 0xFF, 0xFF,                         // BIAS_SENSP..LOFF_FLIP
+  0x00, 0x00, 0x0F,                                     // LOFF_STATP, LOFF_STATN, GPIO
+  0xFF, 0xFF, 0xFF                                      // MISC1, MISC2, CONFIG4
+};
+
+static void def_config_ads1299(uint8_t *regs)
+{
+  ads1299_config_t cfg;
+  ads1299_def_config(&cfg);
+  cfg_to_image(&ads_chip_ads1299, (uint8_t *)&cfg, regs);
+}
+
+static uint16_t set_chcfg_ads1299(ads129x_handle_t handle, uint8_t ch_no, uint8_t chset)
+{
+  ads1299_chset_t ch_config;
+  memcpy(&ch_config, &chset, sizeof(ch_config));
+  return ads1299_set_chcfg(handle, ch_no, ch_config);
+}
+
+const ads_chip_ops_t ads_chip_ads1299 = {
+  .name = "ADS1299",
+  .id = ADS1299_ID,
+  .id_mask = ADS1299_ID_MASK,
+  .reg_cnt = ADS1299_REG_LAST + 1,
+  .wr_ranges = {{ADS1299_REG_CONFIG1, ADS1299_REG_LOFF_FLIP}, {ADS1299_REG_GPIO, ADS1299_REG_CONFIG4}},
+  .verify_mask = m_ads1299_verify,
+  .rates = m_ads1299_rates,
+  .rates_cnt = sizeof(m_ads1299_rates) / sizeof(m_ads1299_rates[0]),
+  .hr_bit = 0,
+  .gains = m_ads1299_gains,
+  .gains_cnt = sizeof(m_ads1299_gains),
+  .vref_mv = 4500,
+  .vref_alt_mv = 0,
+  .vref_alt_bit = 0,
+  .flead_dc = ADS1299_FLEAD_OFF_DC,
+  .flead_ac = ADS1299_FLEAD_OFF_DR_4HZ,
+  .resp = false,
+  .def_config = def_config_ads1299,
+  .set_chcfg = set_chcfg_ads1299,
+  .get_data = ads1299_get_data,
+  .decode = decode_24bit
+};
+
+
+// поддерживаемые микросхемы
+static const ads_chip_ops_t * const m_chips[] = {
+  &ads_chip_ads1298,
+  &ads_chip_ads1298r,
+  &ads_chip_ads1299
+};
+
+
+// %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+/**
+ * Определение типа микросхемы по регистру ID
+*/
+uint16_t ads_chip_detect(ads129x_handle_t handle, const ads_chip_ops_t **ops)
+{
+    ASSERT((handle != NULL) || (ops != NULL));
+
+    *ops = NULL;
+
+    // ID читается только в командном режиме
+    ERROR_CHECK(ads129x_cmd(handle, ADS129X_CMD_SDATAC, ADS_CHIP_ACCESS_TO_SPI_TIMEOUT_MS));
+
+    uint8_t id;
+    ERROR_CHECK(ads129x_read_regs(handle, ADS129X_REG_ID, 1, &id, ADS_CHIP_ACCESS_TO_SPI_TIMEOUT_MS));
+
+    for(uint8_t i = 0; i < sizeof(m_chips) / sizeof(m_chips[0]); i++)
+    {
+        if((id & m_chips[i]->id_mask) == m_chips[i]->id)
+        {
+            *ops = m_chips[i];
+            return ERR_NOERROR;
+        }
+    }
+    return ERR_BUSY;
+}
+
+
+/**
+ * Начальная инициализация микросхемы
+*/
+uint16_t ads_chip_init(const ads_chip_ops_t *ops, ads129x_handle_t handle, const uint8_t *regs)
+{
+    ASSERT((handle != NULL) || (ops != NULL));
+
+    // перевожу в командный режим
+    ERROR_CHECK(ads129x_cmd(handle, ADS129X_CMD_SDATAC, ADS_CHIP_ACCESS_TO_SPI_TIMEOUT_MS));
+
+    // делаю программный сброс
+    ERROR_CHECK(ads129x_cmd(handle, ADS129X_CMD_RESET, ADS_CHIP_ACCESS_TO_SPI_TIMEOUT_MS));
+    nrf_delay_us(10);
+
+    // перевожу в командный режим
+    ERROR_CHECK(ads129x_cmd(handle, ADS129X_CMD_SDATAC, ADS_CHIP_ACCESS_TO_SPI_TIMEOUT_MS));
+
+    // читаю ID и проверяю ID микросхемы
+    uint8_t id;
+    ERROR_CHECK(ads129x_read_regs(handle, ADS129X_REG_ID, 1, &id, ADS_CHIP_ACCESS_TO_SPI_TIMEOUT_MS));
+    if((id & ops->id_mask) != ops->id) return ERR_INVALID_PARAMETR;
+
+    // заливаю конфигурацию (если задана)
+    if(regs != NULL)
+    {
+        for(uint8_t r = 0; r < ADS_CHIP_WR_RANGES; r++)
+        {
+            uint8_t first = ops->wr_ranges[r][0];
+            ERROR_CHECK(ads129x_write_regs(handle, first, ops->wr_ranges[r][1] - first + 1, (uint8_t *)&regs[first], ADS_CHIP_ACCESS_TO_SPI_TIMEOUT_MS));
+        }
+    }
+
+    // читаю все регистры для заполнения теневой копии
+    return ads129x_load_shadow(handle, ops->reg_cnt, ADS_CHIP_ACCESS_TO_SPI_TIMEOUT_MS);
+}
+
+
+/**
+ * Применение образа регистров
+*/
+uint16_t ads_chip_apply_image(const ads_chip_ops_t *ops, ads129x_handle_t handle, const uint8_t *regs, uint32_t mask, uint8_t *wr_cnt)
+{
+    ASSERT((handle != NULL) || (ops != NULL) || (regs != NULL));
+
+    uint8_t shadow[ADS129X_REG_CNT];
+    uint8_t cnt = 0;
+
+    if(wr_cnt != NULL) *wr_cnt = 0;
+    if(mask >> ops->reg_cnt) return ERR_INVALID_PARAMETR;
+    ERROR_CHECK(ads129x_get_shadow(handle, ADS129X_REG_ID, ops->reg_cnt, shadow));
+
+    for(uint8_t r = 0; r < ADS_CHIP_WR_RANGES; r++)
+    {
+        int16_t first = -1, last = -1;
+        for(uint8_t addr = ops->wr_ranges[r][0]; addr <= ops->wr_ranges[r][1]; addr++)
+        { // ищу границы измененных регистров
+            if(((mask & (1UL << addr)) == 0) || (regs[addr] == shadow[addr])) continue;
+            if(first < 0) first = addr;
+            last = addr;
+        }
+        if(first < 0) continue;
+
+        // неизмененные регистры внутри пакета записываются значениями из теневой копии
+        for(int16_t addr = first; addr <= last; addr++)
+        {
+            if(mask & (1UL << addr)) shadow[addr] = regs[addr];
+        }
+        ERROR_CHECK(ads129x_write_regs(handle, (uint8_t)first, (uint8_t)(last - first + 1), &shadow[first], ADS_CHIP_ACCESS_TO_SPI_TIMEOUT_MS));
+        cnt += (uint8_t)(last - first + 1);
+    }
+
+    if(wr_cnt != NULL) *wr_cnt = cnt;
+    return ERR_NOERROR;
+}
+
+
+/**
+ * Сверка регистров микросхемы с теневой копией
+*/
+uint16_t ads_chip_verify(const ads_chip_ops_t *ops, ads129x_handle_t handle, uint32_t *diff_mask)
+{
+    ASSERT((handle != NULL) || (ops != NULL) || (diff_mask != NULL));
+
+    return ads129x_verify_regs(handle, ops->verify_mask, diff_mask, ADS_CHIP_ACCESS_TO_SPI_TIMEOUT_MS);
+}
+
+
+/**
+ * Восстановление регистров микросхемы из теневой копии
+*/
+uint16_t ads_chip_restore(const ads_chip_ops_t *ops, ads129x_handle_t handle)
+{
+    ASSERT((handle != NULL) || (ops != NULL));
+
+    uint8_t shadow[ADS129X_REG_CNT];
+    ERROR_CHECK(ads129x_get_shadow(handle, ADS129X_REG_ID, ops->reg_cnt, shadow));
+    ERROR_CHECK(ads129x_cmd(handle, ADS129X_CMD_SDATAC, ADS_CHIP_ACCESS_TO_SPI_TIMEOUT_MS));
+
+    for(uint8_t r = 0; r < ADS_CHIP_WR_RANGES; r++)
+    {
+        uint8_t first = ops->wr_ranges[r][0];
+        ERROR_CHECK(ads129x_write_regs(handle, first, ops->wr_ranges[r][1] - first + 1, &shadow[first], ADS_CHIP_ACCESS_TO_SPI_TIMEOUT_MS));
+    }
+    return ERR_NOERROR;
+}
+
+
+/**
+ * Формирование значения регистра CHnSET
+*/
+uint8_t ads_chip_chset(uint8_t mux, uint8_t gain_code, bool pd)
+{
+    return (pd ? 0x80 : 0x00) | ((gain_code & 0x07) << 4) | (mux & 0x07);
+}
+
+
+/**
+ * Поиск кода усиления PGA
+*/
+int8_t ads_chip_gain_code(const ads_chip_ops_t *ops, uint8_t gain)
+{
+    for(uint8_t i = 0; i < ops->gains_cnt; i++)
+    {
+        if(ops->gains[i] == gain) return (int8_t)i;
+    }
+    return -1;
+}
+
+
+/**
+ * Поиск кода DR (для ADS1298 - в режиме HR)
+*/
+int8_t ads_chip_rate_code(const ads_chip_ops_t *ops, uint32_t sps)
+{
+    for(uint8_t i = 0; i < ops->rates_cnt; i++)
+    {
+        if(ops->rates[i] == sps) return (int8_t)i;
+    }
+    return -1;
+}
+
+
+/**
+ * Частота выборки по образу регистров
+*/
+uint32_t ads_chip_rate(const ads_chip_ops_t *ops, const uint8_t *regs)
+{
+    uint8_t cfg1 = regs[ADS129X_REG_CONFIG1];
+    uint8_t code = cfg1 & 0x07;
+
+    if(code >= ops->rates_cnt) return 0;
+    uint32_t sps = ops->rates[code];
+    if(ops->hr_bit && ((cfg1 & ops->hr_bit) == 0)) sps /= 2; // режим пониженного потребления
+    return sps;
+}
+
+
+/**
+ * Вес младшего разряда канала в микровольтах
+*/
+float ads_chip_lsb_uv(const ads_chip_ops_t *ops, const uint8_t *regs, uint8_t ch_no)
+{
+    if(ch_no >= ADS129X_CH_CNT) return 0;
+
+    uint8_t code = (regs[ADS129X_REG_CH1SET + ch_no] >> 4) & 0x07;
+    if(code >= ops->gains_cnt) return 0;
+
+    uint16_t vref_mv = ops->vref_mv;
+    if(ops->vref_alt_bit && (regs[ADS129X_REG_CONFIG3] & ops->vref_alt_bit)) vref_mv = ops->vref_alt_mv;
+
+    return (2.0f * vref_mv * 1000.0f) / ((float)ops->gains[code] * 16777216.0f);
+}
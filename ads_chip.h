@@ -0,0 +1,209 @@
+#ifndef ADS_CHIP_H
+#define ADS_CHIP_H
+
+/**
+ * Общий интерфейс микросхем серии ADS129x
+ *
+ * Различия микросхем (ID, карта регистров, таблицы частот и усилений, опорное напряжение,
+ * конфигурация по умолчанию) описываются таблицей ads_chip_ops_t. Тип микросхемы определяется
+ * по регистру ID (ads_chip_detect), дальше все обращения идут через найденную таблицу,
+ * поэтому на одной плате могут стоять разные микросхемы серии.
+ *
+ * Конфигурация передается образом регистров: массив ADS129X_REG_CNT байт, индекс - адрес регистра.
+*/
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ads129x.h"
+
+
+#define ADS_CHIP_WR_RANGES      2       ///< Количество диапазонов записываемых регистров
+
+
+/// Описание микросхемы
+typedef struct {
+  const char      *name;                          ///< название микросхемы
+  uint8_t         id;                             ///< значение регистра ID после наложения маски
+  uint8_t         id_mask;                        ///< маска регистра ID
+  uint8_t         reg_cnt;                        ///< количество регистров (адреса 0..reg_cnt-1)
+  uint8_t         wr_ranges[ADS_CHIP_WR_RANGES][2]; ///< диапазоны записываемых регистров (первый, последний)
+  const uint8_t   *verify_mask;                   ///< маски сверяемых с теневой копией битов по адресам регистров (биты состояния не сверяются)
+  const uint32_t  *rates;                         ///< частота выборки, SPS, по коду DR в CONFIG1
+  uint8_t         rates_cnt;                      ///< количество элементов в rates
+  uint8_t         hr_bit;                         ///< маска бита HR в CONFIG1: при сброшенном бите частота вдвое ниже (0 - режима нет)
+  const uint8_t   *gains;                         ///< усиление PGA по коду GAIN в CHnSET
+  uint8_t         gains_cnt;                      ///< количество элементов в gains
+  uint16_t        vref_mv;                        ///< опорное напряжение, мВ
+  uint16_t        vref_alt_mv;                    ///< опорное напряжение при установленном бите vref_alt_bit в CONFIG3, мВ
+  uint8_t         vref_alt_bit;                   ///< маска бита выбора опорного напряжения в CONFIG3 (0 - выбора нет)
+  uint8_t         flead_dc;                       ///< код FLEAD_OFF в регистре LOFF: обнаружение обрыва электродов на постоянном токе
+  uint8_t         flead_ac;                       ///< код FLEAD_OFF в регистре LOFF: обнаружение обрыва на переменном токе (fDR / 4)
+  bool            resp;                           ///< есть модулятор и демодулятор дыхания на канале 1 (исполнение R, регистр RESP)
+
+  void      (*def_config)(uint8_t *regs);                                           ///< образ регистров по умолчанию
+  uint16_t  (*set_chcfg)(ads129x_handle_t handle, uint8_t ch_no, uint8_t chset);    ///< изменение настроек канала
+  uint16_t  (*get_data)(ads129x_handle_t handle, ads129x_data_t *data);             ///< чтение данных
+  int32_t   (*decode)(ads129x_24bit_t sample);                                      ///< преобразование отсчета канала в int32_t
+} ads_chip_ops_t;
+
+
+extern const ads_chip_ops_t ads_chip_ads1298;   ///< ADS1298 (ЭКГ, 8 каналов)
+extern const ads_chip_ops_t ads_chip_ads1298r;  ///< ADS1298R (ЭКГ и дыхание, 8 каналов)
+extern const ads_chip_ops_t ads_chip_ads1299;   ///< ADS1299 (ЭЭГ, 8 каналов)
+
+
+
+/**
+ * @brief Определение типа микросхемы по регистру ID
+ *
+ * @param handle - Хендл микросхемы на шине SPI
+ * @param ops - найденное описание микросхемы
+ *
+ * @return
+ *  ERR_NOERROR - если ошибок нет
+ *  ERR_BUSY - микросхема не поддерживается или отсутствует (ID не найден в таблице)
+ *  ERR_NOT_INITED: интерфейс SPI не инициализирован
+ *  ERR_TIMEOUT: таймаут ожидания доступа к шине SPI
+ *
+ * Перед чтением ID микросхема переводится в командный режим (SDATAC)
+*/
+uint16_t ads_chip_detect(ads129x_handle_t handle, const ads_chip_ops_t **ops);
+
+
+/**
+ * @brief Начальная инициализация микросхемы: сброс, проверка ID, загрузка образа и заполнение теневой копии
+ *
+ * @param ops - описание микросхемы
+ * @param handle - Хендл микросхемы на шине SPI
+ * @param regs - образ регистров (может быть NULL, тогда остается конфигурация после сброса)
+ *
+ * @return
+ *  ERR_NOERROR - если ошибок нет
+ *  ERR_INVALID_PARAMETR - ID микросхемы не совпадает с описанием
+ *  ERR_NOT_INITED: интерфейс SPI не инициализирован
+ *  ERR_TIMEOUT: таймаут ожидания доступа к шине SPI
+*/
+uint16_t ads_chip_init(const ads_chip_ops_t *ops, ads129x_handle_t handle, const uint8_t *regs);
+
+
+/**
+ * @brief Применение образа регистров: запись только измененных регистров пакетами WREG
+ *
+ * @param ops - описание микросхемы
+ * @param handle - Хендл микросхемы на шине SPI
+ * @param regs - образ регистров (индекс - адрес регистра)
+ * @param mask - маска заданных регистров (бит n - регистр n), остальные регистры не меняются
+ * @param wr_cnt - количество записанных регистров (может быть NULL)
+ *
+ * @return
+ *  ERR_NOERROR - если ошибок нет
+ *  ERR_INVALID_PARAMETR - в маске есть регистры за пределами карты регистров микросхемы
+ *  ERR_INVALID_STATE - теневая копия регистров не заполнена (микросхема не инициализирована)
+ *  ERR_NOT_INITED: интерфейс SPI не инициализирован
+ *  ERR_TIMEOUT: таймаут ожидания доступа к шине SPI
+ *
+ * Образ сравнивается с теневой копией, в каждом диапазоне записываемых регистров от первого до последнего
+ * измененного регистра делается одна пакетная запись. Регистры только для чтения пропускаются.
+*/
+uint16_t ads_chip_apply_image(const ads_chip_ops_t *ops, ads129x_handle_t handle, const uint8_t *regs, uint32_t mask, uint8_t *wr_cnt);
+
+
+/**
+ * @brief Сверка регистров микросхемы с теневой копией (обнаружение сбоев регистров)
+ *
+ * @param ops - описание микросхемы
+ * @param handle - Хендл микросхемы на шине SPI
+ * @param diff_mask - маска регистров, отличающихся от теневой копии (бит n - регистр n)
+ *
+ * @return
+ *  ERR_NOERROR - если ошибок нет (результат сверки в diff_mask)
+ *  ERR_INVALID_STATE - теневая копия регистров не заполнена
+ *  ERR_NOT_INITED: интерфейс SPI не инициализирован
+ *  ERR_TIMEOUT: таймаут ожидания доступа к шине SPI
+*/
+uint16_t ads_chip_verify(const ads_chip_ops_t *ops, ads129x_handle_t handle, uint32_t *diff_mask);
+
+
+/**
+ * @brief Восстановление всех записываемых регистров микросхемы из теневой копии
+ *
+ * @param ops - описание микросхемы
+ * @param handle - Хендл микросхемы на шине SPI
+ *
+ * @return
+ *  ERR_NOERROR - если ошибок нет
+ *  ERR_INVALID_STATE - теневая копия регистров не заполнена
+ *  ERR_NOT_INITED: интерфейс SPI не инициализирован
+ *  ERR_TIMEOUT: таймаут ожидания доступа к шине SPI
+ *
+ * После сброса по питанию микросхема находится в режиме RDATAC, поэтому перед записью подается SDATAC
+*/
+uint16_t ads_chip_restore(const ads_chip_ops_t *ops, ads129x_handle_t handle);
+
+
+/**
+ * @brief Формирование значения регистра CHnSET (раскладка битов общая для серии)
+ *
+ * @param mux - источник сигнала канала
+ * @param gain_code - код усиления (см. ads_chip_gain_code)
+ * @param pd - true, если канал выключен
+ *
+ * @return
+ *  значение регистра CHnSET
+*/
+uint8_t ads_chip_chset(uint8_t mux, uint8_t gain_code, bool pd);
+
+
+/**
+ * @brief Поиск кода усиления PGA по значению усиления
+ *
+ * @param ops - описание микросхемы
+ * @param gain - усиление
+ *
+ * @return
+ *  код усиления или -1, если микросхема не поддерживает такое усиление
+*/
+int8_t ads_chip_gain_code(const ads_chip_ops_t *ops, uint8_t gain);
+
+
+/**
+ * @brief Поиск кода DR по частоте выборки
+ *
+ * @param ops - описание микросхемы
+ * @param sps - частота выборки, SPS
+ *
+ * @return
+ *  код DR или -1, если микросхема не поддерживает такую частоту
+*/
+int8_t ads_chip_rate_code(const ads_chip_ops_t *ops, uint32_t sps);
+
+
+/**
+ * @brief Частота выборки по образу регистров
+ *
+ * @param ops - описание микросхемы
+ * @param regs - образ регистров
+ *
+ * @return
+ *  частота выборки, SPS (0 - неизвестный код DR)
+*/
+uint32_t ads_chip_rate(const ads_chip_ops_t *ops, const uint8_t *regs);
+
+
+/**
+ * @brief Вес младшего разряда канала в микровольтах по образу регистров
+ *
+ * LSB = 2 * VREF / (GAIN * 2^24)
+ * @param ops - описание микросхемы
+ * @param regs - образ регистров
+ * @param ch_no - номер канала (0..ADS129X_CH_CNT-1)
+ *
+ * @return
+ *  вес младшего разряда, мкВ (0 - неизвестный код усиления)
+*/
+float ads_chip_lsb_uv(const ads_chip_ops_t *ops, const uint8_t *regs, uint8_t ch_no);
+
+
+#endif
@@ -0,0 +1,362 @@
+/*
+Аппаратный запуск чтения кадров АЦП по сигналу DRDY
+
+ЦЕПОЧКА PPI (c0..c5 - каналы от PPI_CH_ADS129X, TRIG и NEXT - группы от PPI_GROUP_ADS129X)
+- c0: DRDY -> CS0 = 0, SPIM START                 (группа TRIG)
+- c1: SPIM END -> CS0 = 1, CS1 переключить          (переключение - только при двух АЦП)
+- c2: SPIM END -> TIMER COUNT
+- c3: TIMER COMPARE0 -> TRIG выключить             (пачка набрана, ждем прерывание)
+- c4: DRDY -> NEXT включить                        (группа TRIG, только при двух АЦП)
+- c5: SPIM END -> SPIM START, NEXT выключить        (группа NEXT, только при двух АЦП)
+- c6: DRDY -> TIMER COUNT                          (только во время простоя: счет пропущенных отсчетов)
+
+При двух АЦП CS1 переключается по каждому END: после кадра первого АЦП он опускается, после кадра второго -
+поднимается. Канал c5 включается по DRDY и выключается после первого END, поэтому SPIM перезапускается
+ровно один раз на отсчет.
+
+ОСОБЕННОСТИ
+- таймер в режиме счетчика считает кадры, по COMPARE0 (batch * cs_cnt кадров) выключает запуск чтения
+  и вызывает прерывание; в прерывании RXD.PTR переставляется на вторую половину кольца и запуск включается снова
+- если вторая половина еще не обработана потоком, чтение стоит до вызова ads_stream_release(); на время простоя
+  таймер считает DRDY (c6), при возобновлении чтения снимок счетчика добавляется к потерянным отсчетам
+- TXD.MAXCNT = 0: во время чтения передается байт ORC (0x00), в режиме RDATAC он игнорируется
+- размер пачки задается при запуске (не больше ADS_STREAM_BATCH): между пробуждениями процессора отсчеты
+  копятся в кольце, поэтому пачку удобно подгонять под интервал соединения BLE
+
+*/
+
+#include "ads_stream.h"
+#include "custom_board.h"
+#include "errors.h"
+#include "sys.h"
+#include "nrf_nvic.h"
+#include "string.h"
+
+// FreeRTOS
+#include "FreeRTOS.h"
+#include "task.h"
+
+
+#if(ADS_STREAM_BATCH < 1)
+#error "ADS_STREAM_BATCH must be at least 1"
+#endif
+
+
+#define PPI_CH_CNT              7   // количество используемых каналов PPI
+#define PPI_GROUP_TRIG          (PPI_GROUP_ADS129X)     // запуск чтения по DRDY
+#define PPI_GROUP_NEXT          (PPI_GROUP_ADS129X + 1) // перезапуск SPIM для второго АЦП
+#define PPI_CH(n)               (PPI_CH_ADS129X + (n))
+#define PPI_CH_MASK(n)          (1UL << PPI_CH(n))
+#define PPI_CH_ALL              (((1UL << PPI_CH_CNT) - 1) << PPI_CH_ADS129X)
+#define STOP_WAIT_TICKS         2   // время окончания уже запущенного чтения кадров (не меньше 1 мс при любой частоте тиков)
+
+
+static ads129x_data_t   m_ring[2][ADS_STREAM_BATCH * ADS_STREAM_CS_MAX]; // кольцо кадров из двух половин
+static const uint8_t    m_cs_ch[ADS_STREAM_CS_MAX] = GPIOTE_CH_ADS129X_CS; // каналы GPIOTE выводов CS
+static NRF_SPIM_Type    *m_spim = NULL;           // порт SPIM (NULL - чтение не запущено)
+static uint8_t          m_cs_pin[ADS_STREAM_CS_MAX]; // выводы CS
+static uint8_t          m_cs_cnt = 0;             // количество АЦП
+static uint8_t          m_batch = ADS_STREAM_BATCH; // количество отсчетов в пачке
+static ads_stream_cb_t  m_cb = NULL;              // функция окончания пачки
+static volatile uint8_t m_half = 0;               // половина кольца, в которую идет чтение
+static volatile uint8_t m_busy[2];                // половина передана потоку и еще не обработана
+static volatile bool    m_stalled = false;        // чтение стоит: обе половины заняты
+static volatile bool    m_armed = false;          // запуск чтения по DRDY включен (выводы CS под управлением GPIOTE)
+static volatile uint32_t m_lost_cnt = 0;          // количество потерянных отсчетов
+static volatile uint32_t m_pos_base = 0;          // количество отсчетов в пачках, набранных с запуска
+
+
+
+static void cs_gpiote(uint8_t n, bool en)
+{ // передача вывода CS под управление GPIOTE (исходное состояние - 1) или возврат GPIO
+  uint8_t pin = m_cs_pin[n];
+  if(pin >= 32) NRF_P1->OUTSET = (1UL << (pin - 32));
+  else NRF_P0->OUTSET = (1UL << pin);
+
+  if(en)
+  {
+    NRF_GPIOTE->CONFIG[m_cs_ch[n]] = (GPIOTE_CONFIG_MODE_Task << GPIOTE_CONFIG_MODE_Pos)
+                                   | ((pin & 0x1F) << GPIOTE_CONFIG_PSEL_Pos)
+                                   | ((pin >> 5) << GPIOTE_CONFIG_PORT_Pos)
+                                   | (GPIOTE_CONFIG_POLARITY_Toggle << GPIOTE_CONFIG_POLARITY_Pos)
+                                   | (GPIOTE_CONFIG_OUTINIT_High << GPIOTE_CONFIG_OUTINIT_Pos);
+  }else{
+    NRF_GPIOTE->CONFIG[m_cs_ch[n]] = 0; // вывод остается в 1 через регистр OUT
+  }
+}
+
+static void ring_arm(uint8_t half)
+{ // запуск чтения в половину кольца (из потока под маской или из прерывания таймера)
+  m_spim->RXD.PTR = (uint32_t)&m_ring[half][0];
+  NRF_PPI->TASKS_CHG[PPI_GROUP_TRIG].EN = 1;
+}
+
+static void stall_begin(void)
+{ // простой: таймер (только что сброшен по COMPARE0 или при запуске) считает DRDY вместо кадров
+  ADS129X_TIMER->CC[0] = 0xFFFFFFFF; // пачка за время простоя не набирается
+  NRF_PPI->CHENSET = PPI_CH_MASK(6);
+}
+
+static void stall_end(void)
+{ // конец простоя: пропущенные DRDY - потерянные отсчеты, таймер снова считает кадры
+  NRF_PPI->CHENCLR = PPI_CH_MASK(6);
+  ADS129X_TIMER->TASKS_CAPTURE[1] = 1;
+  m_lost_cnt += ADS129X_TIMER->CC[1];
+  ADS129X_TIMER->TASKS_CLEAR = 1;
+  ADS129X_TIMER->CC[0] = m_batch * m_cs_cnt;
+}
+
+static void hw_arm(void)
+{ // настройка порта, выводов CS и таймера и включение запуска чтения по DRDY
+  m_spim->INTENCLR = 0xFFFFFFFF;
+  m_spim->SHORTS = 0;
+  m_spim->EVENTS_END = 0;
+  m_spim->TXD.PTR = (uint32_t)&m_ring[0][0]; // не используется: TXD.MAXCNT = 0
+  m_spim->TXD.MAXCNT = 0;
+  m_spim->TXD.LIST = 0;
+  m_spim->RXD.MAXCNT = sizeof(ads129x_data_t);
+  m_spim->RXD.LIST = 1; // следующий кадр ложится сразу за предыдущим
+
+  for(uint8_t i = 0; i < m_cs_cnt; i++) cs_gpiote(i, true);
+
+  ADS129X_TIMER->TASKS_STOP = 1;
+  ADS129X_TIMER->TASKS_CLEAR = 1;
+  ADS129X_TIMER->EVENTS_COMPARE[0] = 0;
+  ADS129X_TIMER->TASKS_START = 1;
+
+  // каналы вне групп включаются сразу, каналы групп - задачами групп
+  NRF_PPI->CHENSET = PPI_CH_MASK(1) | PPI_CH_MASK(2) | PPI_CH_MASK(3);
+
+  UBaseType_t key = portSET_INTERRUPT_MASK_FROM_ISR();
+  m_armed = true;
+  m_stalled = m_busy[m_half];
+  if(m_stalled) stall_begin();
+  else ring_arm(m_half);
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(key);
+}
+
+static void hw_disarm(void)
+{ // выключение запуска чтения и возврат выводов CS (поток)
+  UBaseType_t key = portSET_INTERRUPT_MASK_FROM_ISR();
+  m_armed = false; // прерывание таймера и ads_stream_release() больше не включают запуск
+  NRF_PPI->TASKS_CHG[PPI_GROUP_TRIG].DIS = 1;
+  if(m_stalled)
+  { // отсчеты, пропущенные за простой
+    stall_end();
+    m_stalled = false;
+  }
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(key);
+  vTaskDelay(STOP_WAIT_TICKS); // уже запущенное чтение кадров заканчивается само
+
+  NRF_PPI->TASKS_CHG[PPI_GROUP_NEXT].DIS = 1;
+  NRF_PPI->CHENCLR = PPI_CH_ALL;
+
+  // недочитанная пачка отбрасывается
+  ADS129X_TIMER->TASKS_CAPTURE[1] = 1;
+  m_lost_cnt += ADS129X_TIMER->CC[1] / m_cs_cnt;
+  ADS129X_TIMER->TASKS_STOP = 1;
+  ADS129X_TIMER->TASKS_CLEAR = 1;
+
+  for(uint8_t i = 0; i < m_cs_cnt; i++) cs_gpiote(i, false);
+}
+
+static void timer_isr(void)
+{ // набрана пачка: запуск чтения уже выключен каналом c3
+  if(m_spim == NULL) return;
+
+  uint8_t done = m_half;
+  m_pos_base += m_batch;
+  m_busy[done] = 1;
+  m_half = done ^ 1;
+  if(!m_armed)
+  { // пачка дочитана во время выключения: запуск включит hw_arm()
+  }else if(m_busy[m_half]){ // поток не обработал вторую половину: чтение стоит до ads_stream_release()
+    m_stalled = true;
+    stall_begin();
+  }else{
+    ring_arm(m_half);
+  }
+
+  if(m_cb) m_cb(done);
+}
+
+
+// %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+/*
+* Запуск аппаратного чтения кадров по DRDY
+*/
+uint16_t ads_stream_start(NRF_SPIM_Type *spim, const uint8_t *cs_pins, uint8_t cs_cnt, uint8_t batch, ads_stream_cb_t cb)
+{
+  if((spim == NULL) || (cs_pins == NULL) || (cb == NULL)) return ERR_INVALID_PARAMETR;
+  if((cs_cnt == 0) || (cs_cnt > ADS_STREAM_CS_MAX)) return ERR_INVALID_PARAMETR;
+  if((batch == 0) || (batch > ADS_STREAM_BATCH)) return ERR_INVALID_PARAMETR;
+  if(m_spim != NULL) return ERR_INVALID_STATE;
+
+  memcpy(m_cs_pin, cs_pins, cs_cnt);
+  m_cs_cnt = cs_cnt;
+  m_batch = batch;
+  m_cb = cb;
+  m_half = 0;
+  m_busy[0] = m_busy[1] = 0;
+  m_stalled = false;
+  m_pos_base = 0;
+
+  // таймер считает кадры
+  ADS129X_TIMER->TASKS_STOP = 1;
+  ADS129X_TIMER->MODE = TIMER_MODE_MODE_LowPowerCounter << TIMER_MODE_MODE_Pos;
+  ADS129X_TIMER->BITMODE = TIMER_BITMODE_BITMODE_32Bit << TIMER_BITMODE_BITMODE_Pos;
+  ADS129X_TIMER->CC[0] = batch * cs_cnt;
+  ADS129X_TIMER->SHORTS = TIMER_SHORTS_COMPARE0_CLEAR_Msk;
+  ADS129X_TIMER->INTENCLR = 0xFFFFFFFF;
+  ADS129X_TIMER->INTENSET = TIMER_INTENSET_COMPARE0_Msk;
+
+  // цепочка PPI
+  uint32_t drdy = (uint32_t)&NRF_GPIOTE->EVENTS_IN[GPIOTE_CH_ADS129X];
+  NRF_PPI->CHENCLR = PPI_CH_ALL;
+
+  NRF_PPI->CH[PPI_CH(0)].EEP = drdy;
+  NRF_PPI->CH[PPI_CH(0)].TEP = (uint32_t)&NRF_GPIOTE->TASKS_CLR[m_cs_ch[0]];
+  NRF_PPI->FORK[PPI_CH(0)].TEP = (uint32_t)&spim->TASKS_START;
+
+  NRF_PPI->CH[PPI_CH(1)].EEP = (uint32_t)&spim->EVENTS_END;
+  NRF_PPI->CH[PPI_CH(1)].TEP = (uint32_t)&NRF_GPIOTE->TASKS_SET[m_cs_ch[0]];
+  NRF_PPI->FORK[PPI_CH(1)].TEP = (cs_cnt > 1) ? (uint32_t)&NRF_GPIOTE->TASKS_OUT[m_cs_ch[1]] : 0;
+
+  NRF_PPI->CH[PPI_CH(2)].EEP = (uint32_t)&spim->EVENTS_END;
+  NRF_PPI->CH[PPI_CH(2)].TEP = (uint32_t)&ADS129X_TIMER->TASKS_COUNT;
+  NRF_PPI->FORK[PPI_CH(2)].TEP = 0;
+
+  NRF_PPI->CH[PPI_CH(3)].EEP = (uint32_t)&ADS129X_TIMER->EVENTS_COMPARE[0];
+  NRF_PPI->CH[PPI_CH(3)].TEP = (uint32_t)&NRF_PPI->TASKS_CHG[PPI_GROUP_TRIG].DIS;
+  NRF_PPI->FORK[PPI_CH(3)].TEP = 0;
+
+  NRF_PPI->CH[PPI_CH(4)].EEP = drdy;
+  NRF_PPI->CH[PPI_CH(4)].TEP = (uint32_t)&NRF_PPI->TASKS_CHG[PPI_GROUP_NEXT].EN;
+  NRF_PPI->FORK[PPI_CH(4)].TEP = 0;
+
+  NRF_PPI->CH[PPI_CH(5)].EEP = (uint32_t)&spim->EVENTS_END;
+  NRF_PPI->CH[PPI_CH(5)].TEP = (uint32_t)&spim->TASKS_START;
+  NRF_PPI->FORK[PPI_CH(5)].TEP = (uint32_t)&NRF_PPI->TASKS_CHG[PPI_GROUP_NEXT].DIS;
+
+  NRF_PPI->CH[PPI_CH(6)].EEP = drdy;
+  NRF_PPI->CH[PPI_CH(6)].TEP = (uint32_t)&ADS129X_TIMER->TASKS_COUNT;
+  NRF_PPI->FORK[PPI_CH(6)].TEP = 0;
+
+  NRF_PPI->CHG[PPI_GROUP_TRIG] = (cs_cnt > 1) ? (PPI_CH_MASK(0) | PPI_CH_MASK(4)) : PPI_CH_MASK(0);
+  NRF_PPI->CHG[PPI_GROUP_NEXT] = (cs_cnt > 1) ? PPI_CH_MASK(5) : 0;
+
+  // прерывание таймера
+  sysSetAdsTimerHook(timer_isr);
+  sd_nvic_SetPriority(ADS129X_TIMER_IRQn, ADS129X_TIMER_PRIORITY);
+  sd_nvic_ClearPendingIRQ(ADS129X_TIMER_IRQn);
+  sd_nvic_EnableIRQ(ADS129X_TIMER_IRQn);
+
+  m_spim = spim;
+  hw_arm();
+  return ERR_NOERROR;
+}
+
+
+/*
+* Останов аппаратного чтения
+*/
+void ads_stream_stop(void)
+{
+  if(m_spim == NULL) return;
+
+  hw_disarm();
+  sd_nvic_DisableIRQ(ADS129X_TIMER_IRQn);
+  ADS129X_TIMER->INTENCLR = 0xFFFFFFFF;
+  sysSetAdsTimerHook(NULL);
+  NRF_PPI->CHG[PPI_GROUP_TRIG] = 0;
+  NRF_PPI->CHG[PPI_GROUP_NEXT] = 0;
+  m_spim = NULL;
+}
+
+
+/*
+* Приостановка чтения
+*/
+void ads_stream_pause(void)
+{
+  if(m_spim == NULL) return;
+  hw_disarm();
+}
+
+
+/*
+* Возобновление чтения
+*/
+void ads_stream_resume(void)
+{
+  if(m_spim == NULL) return;
+  hw_arm();
+}
+
+
+/*
+* Кадры половины кольца
+*/
+const ads129x_data_t *ads_stream_frames(uint8_t half)
+{
+  return &m_ring[half & 1][0];
+}
+
+
+/*
+* Количество отсчетов в пачке
+*/
+uint8_t ads_stream_get_batch(void)
+{
+  return m_batch;
+}
+
+
+/*
+* Освобождение половины кольца
+*/
+void ads_stream_release(uint8_t half)
+{
+  half &= 1;
+  UBaseType_t key = portSET_INTERRUPT_MASK_FROM_ISR();
+  m_busy[half] = 0;
+  if(m_armed && m_stalled && (half == m_half))
+  { // чтение стояло из-за этой половины
+    m_stalled = false;
+    stall_end();
+    ring_arm(half);
+  }
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(key);
+}
+
+
+/*
+* Номер отсчета, который читается сейчас
+*/
+uint32_t ads_stream_get_pos(void)
+{
+  if(m_spim == NULL) return ADS_STREAM_POS_NONE;
+
+  UBaseType_t key = portSET_INTERRUPT_MASK_FROM_ISR();
+  uint32_t pend, cnt;
+  do
+  { // COMPARE0 сбрасывает счетчик сразу (SHORTS), событие и снимок счетчика должны относиться к одной пачке
+    pend = ADS129X_TIMER->EVENTS_COMPARE[0];
+    ADS129X_TIMER->TASKS_CAPTURE[1] = 1;
+    cnt = ADS129X_TIMER->CC[1];
+  }while(pend != ADS129X_TIMER->EVENTS_COMPARE[0]);
+  uint32_t pos = m_pos_base + (m_stalled ? 0 : cnt / m_cs_cnt); // в простое счетчик считает пропущенные DRDY
+  if(pend) pos += m_batch; // пачка набрана, но прерывание таймера еще не обработано
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(key);
+  return pos;
+}
+
+
+/*
+* Количество потерянных отсчетов
+*/
+uint32_t ads_stream_get_lost_cnt(void)
+{
+  return m_lost_cnt;
+}
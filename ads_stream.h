@@ -0,0 +1,130 @@
+#ifndef ADS_STREAM_H
+#define ADS_STREAM_H
+
+/**
+ * Аппаратный запуск чтения кадров АЦП по сигналу DRDY
+ *
+ * Событие GPIOTE от DRDY через PPI опускает CS и запускает SPIM, кадры АЦП (режим RDATAC) складываются DMA
+ * в кольцо в ОЗУ подряд (RXD.LIST), процессор просыпается один раз на пачку отсчетов (не больше ADS_STREAM_BATCH).
+ * Кольцо состоит из двух половин: пока поток обрабатывает одну, в другую читаются следующие отсчеты.
+ *
+ * Кадры двух АЦП на одной шине читаются цепочкой: окончание кадра первого АЦП поднимает его CS, опускает CS
+ * второго и перезапускает SPIM. Поэтому модуль поддерживает не больше ADS_STREAM_CS_MAX АЦП на одной шине.
+ *
+ * Ресурсы (каналы GPIOTE и PPI, группы PPI, таймер) задаются в файле платы.
+*/
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nrf.h"
+#include "ads129x.h"
+#include "settings.h"
+
+
+// НАСТРОЙКИ МОДУЛЯ ************************************
+#ifndef ADS_STREAM_BATCH
+#define ADS_STREAM_BATCH        10      // максимальное количество отсчетов в пачке (емкость половины кольца)
+#endif // ADS_STREAM_BATCH
+// *****************************************************
+
+#define ADS_STREAM_CS_MAX       2       ///< Максимальное количество АЦП, читаемых цепочкой по одному DRDY
+#define ADS_STREAM_POS_NONE     0xFFFFFFFF ///< Номер отсчета неизвестен (чтение не запущено)
+
+
+/// @brief Функция окончания пачки (вызывается из прерывания таймера, half - номер заполненной половины кольца)
+typedef void (*ads_stream_cb_t)(uint8_t half);
+
+
+
+/**
+ * @brief Запуск аппаратного чтения кадров по DRDY
+ *
+ * @param spim - порт SPIM (должен быть захвачен spiHwAcquire())
+ * @param cs_pins - выводы CS АЦП в порядке чтения
+ * @param cs_cnt - количество АЦП (1..ADS_STREAM_CS_MAX)
+ * @param batch - количество отсчетов в пачке (1..ADS_STREAM_BATCH), одно пробуждение процессора на пачку
+ * @param cb - функция окончания пачки
+ *
+ * @return
+ *  ERR_NOERROR - если ошибок нет
+ *  ERR_INVALID_PARAMETR - ошибка входных данных
+ *  ERR_INVALID_STATE - чтение уже запущено
+ *
+ * АЦП к этому моменту должны быть переведены в режим RDATAC, прерывание DRDY должно быть запрещено
+*/
+uint16_t ads_stream_start(NRF_SPIM_Type *spim, const uint8_t *cs_pins, uint8_t cs_cnt, uint8_t batch, ads_stream_cb_t cb);
+
+
+/**
+ * @brief Останов аппаратного чтения и освобождение выводов CS, каналов PPI и таймера
+ *
+ * Вызывается из потока: функция ждет окончания уже запущенного чтения кадров
+*/
+void ads_stream_stop(void);
+
+
+/**
+ * @brief Приостановка чтения для обмена с АЦП через очередь заданий SPI (выводы CS возвращаются GPIO)
+ *
+ * Вызывается из потока: функция ждет окончания уже запущенного чтения кадров. Недочитанная пачка отбрасывается.
+*/
+void ads_stream_pause(void);
+
+
+/**
+ * @brief Возобновление чтения после ads_stream_pause() (порт SPIM перенастраивается заново)
+*/
+void ads_stream_resume(void);
+
+
+/**
+ * @brief Кадры половины кольца
+ *
+ * @param half - номер половины кольца
+ *
+ * @return
+ *  кадры batch отсчетов, в каждом отсчете cs_cnt кадров по порядку выводов CS
+*/
+const ads129x_data_t *ads_stream_frames(uint8_t half);
+
+
+/**
+ * @brief Количество отсчетов в пачке, заданное при запуске
+*/
+uint8_t ads_stream_get_batch(void);
+
+
+/**
+ * @brief Освобождение половины кольца после обработки (можно вызывать из прерывания)
+ *
+ * @param half - номер половины кольца
+ *
+ * Если чтение стояло из-за того, что половина была занята, оно возобновляется
+*/
+void ads_stream_release(uint8_t half);
+
+
+/**
+ * @brief Номер отсчета, который читается сейчас (считается от запуска, первый отсчет - 0)
+ *
+ * Нумерация совпадает с порядком отсчетов, которые получает поток: отсчеты, потерянные при паузах и простоях,
+ * не нумеруются. Можно вызывать из прерывания с приоритетом не выше ADS129X_TIMER_PRIORITY.
+ *
+ * @return
+ *  номер отсчета или ADS_STREAM_POS_NONE, если чтение не запущено
+*/
+uint32_t ads_stream_get_pos(void);
+
+
+/**
+ * @brief Количество потерянных отсчетов
+ *
+ * Считаются отсчеты недочитанных пачек при паузах и остановах и все DRDY, пропущенные за простой
+ * из-за занятой половины кольца (на время простоя таймер считает DRDY)
+*/
+uint32_t ads_stream_get_lost_cnt(void);
+
+
+#endif
@@ -1,18 +1,48 @@
 /**
- * Модуль реализует логику работы с двумя АЦП
+ * Модуль реализует логику работы с ADS129X_CNT АЦП на общей шине SPI
  * 
  * 
  * ЛОГИКА РАБОТЫ
  * 
  * 
- * СДЕЛАТЬ
- * - прикрутить режим Power Down
- * - добавить возможность работы с АЦП ADS1298
+ * Тип каждого АЦП (ADS1298 или ADS1299) определяется по регистру ID при инициализации, дальше
+ * работа с ним идет через описание микросхемы ads_chip_ops_t. АЦП работают от общих сигналов START и DRDY,
+ * поэтому частота выборки у них должна быть одинаковой.
+ * 
+ * Количество АЦП, их выводы CS и шины SPI задаются в файле платы (ADS129X_CNT, ADS129X_CS_PINS, ADS129X_BUSES,
+ * ADS129X_CS_BUS). АЦП на разных шинах читаются одновременно (DMA разных портов SPIM работает параллельно),
+ * АЦП на одной шине - по очереди. Ведущий АЦП (номер 0)
+ * обязателен, остальные АЦП, не найденные при инициализации, пропускаются: в отсчет попадают каналы только
+ * найденных АЦП, количество каналов передается в adstask_data_t.ch_cnt.
+ * 
+ * При непрерывных измерениях, если все найденные АЦП стоят на одной шине и их не больше ADS_STREAM_CS_MAX,
+ * кадры читаются аппаратно (ads_stream): DRDY через PPI запускает SPIM, АЦП работают в режиме RDATAC,
+ * поток просыпается раз на пачку отсчетов. Размер пачки подбирается при запуске под период, заданный
+ * ads_task_set_batch_ms() (обычно интервал соединения BLE: отсчеты все равно уходят одной пачкой на событие
+ * соединения), но не больше ADS_STREAM_BATCH. Иначе, а также для одиночного измерения,
+ * чтение ставится в очередь SPI из прерывания DRDY. В режиме RDATAC АЦП не принимает RREG/WREG, поэтому
+ * применение конфига приостанавливает аппаратное чтение, а периодическая сверка регистров откладывается до останова.
+ * 
+ * ПИТАНИЕ
+ * 
+ * OFF -> STANDBY -> READY -> STREAMING. Вне измерений АЦП держатся на уровне, заданном ads_task_set_idle_power()
+ * (верхний уровень привязывает его к подключению BLE). В OFF аналоговое питание выключено и АЦП в Power Down,
+ * при включении АЦП сбрасываются и регистры восстанавливаются из теневой копии. В STANDBY регистры сохраняются,
+ * пробуждение - командой WAKEUP. Сверка регистров в OFF не выполняется.
+ * 
+ * Готовность АЦП после подачи питания определяется опросом регистра ID, а не фиксированной задержкой.
+ * Питание подается как можно раньше (ads_task_pwr_on() из main до запуска SoftDevice), поэтому установление
+ * аналоговой части идет параллельно с запуском BLE; запуск измерений только дожидается ADSTASK_ANA_SETTLE_MS
+ * от подачи питания. Если перед программным сбросом питание было включено (флаг SYS_RETAINED_ANA_PWR),
+ * старт считается теплым и ожидание установления пропускается.
 */
 
 #include "nrf.h"
 #include "ads_task.h"
 #include "ads129x.h"
+#include "ads_chip.h"
+#include "ads_stream.h"
+#include "cal.h"
 #include "ads1298.h"
 #include "settings.h"
 #include "custom_board.h"
@@ -22,6 +52,16 @@
 #include "spim_freertos.h"
 #include "sys.h"
 
+#if(ADS129X_CNT < 1)
+#error "ADS129X_CNT must be at least 1"
+#endif
+#if defined(ADS129X_DEV_MAX) && (ADS129X_DEV_MAX < ADS129X_CNT)
+#error "ADS129X_DEV_MAX is less than ADS129X_CNT"
+#endif
+#if(ADS129X_BUS_CNT > SPIM_INSTANCE_CNT)
+#error "ADS129X_BUS_CNT is more than SPIM_INSTANCE_CNT"
+#endif
+
 // FreeRTOS
 #include "FreeRTOS.h"
 #include "task.h"
@@ -43,6 +83,71 @@
 #ifndef ADSTASK_CMD_QUEUE_SIZE
 #define ADSTASK_CMD_QUEUE_SIZE              5     // длина очереди управляющих команд
 #endif // ADSTASK_CMD_QUEUE_SIZE
+#ifndef ADSTASK_CH_GAIN
+#define ADSTASK_CH_GAIN                     12    // усиление PGA каналов после инициализации
+#endif // ADSTASK_CH_GAIN
+#ifndef ADSTASK_SCRUB_PERIOD_MS
+#define ADSTASK_SCRUB_PERIOD_MS             1000  // период сверки регистров АЦП с теневой копией (0 - сверка выключена)
+#endif // ADSTASK_SCRUB_PERIOD_MS
+#ifndef ADSTASK_HW_TRIG_EN
+#define ADSTASK_HW_TRIG_EN                  1     // если =1, при непрерывных измерениях кадры читаются аппаратно по DRDY (ads_stream)
+#endif // ADSTASK_HW_TRIG_EN
+#ifndef ADSTASK_PWRUP_TIMEOUT_MS
+#define ADSTASK_PWRUP_TIMEOUT_MS            1000  // максимальное время ожидания ответа АЦП после подачи аналогового питания
+#endif // ADSTASK_PWRUP_TIMEOUT_MS
+#ifndef ADSTASK_PWRUP_POLL_MS
+#define ADSTASK_PWRUP_POLL_MS               5     // период опроса регистра ID при ожидании готовности АЦП
+#endif // ADSTASK_PWRUP_POLL_MS
+#ifndef ADSTASK_ANA_SETTLE_MS
+#define ADSTASK_ANA_SETTLE_MS               200   // установление аналоговой части (VCAP, опорное напряжение) после подачи питания до запуска измерений
+#endif // ADSTASK_ANA_SETTLE_MS
+#ifndef ADSTASK_LOFF_EN
+#define ADSTASK_LOFF_EN                     1     // если =1, включено обнаружение обрыва электродов (компараторы LOFF)
+#endif // ADSTASK_LOFF_EN
+#ifndef ADSTASK_LOFF_AC
+#define ADSTASK_LOFF_AC                     0     // если =1, обрыв определяется на переменном токе (fDR / 4), иначе на постоянном
+#endif // ADSTASK_LOFF_AC
+#ifndef ADSTASK_LOFF_ILEAD
+#define ADSTASK_LOFF_ILEAD                  0     // код тока обнаружения ILEAD_OFF (0 - 6 нА у ADS1298 и ADS1299)
+#endif // ADSTASK_LOFF_ILEAD
+#ifndef ADSTASK_LOFF_COMP_TH
+#define ADSTASK_LOFF_COMP_TH                0     // код порога компараторов COMP_TH (0 - 95% / 5%)
+#endif // ADSTASK_LOFF_COMP_TH
+#ifndef ADSTASK_LOFF_SENSP
+#define ADSTASK_LOFF_SENSP                  0xFF  // маска каналов, у которых проверяются положительные входы
+#endif // ADSTASK_LOFF_SENSP
+#ifndef ADSTASK_LOFF_SENSN
+#define ADSTASK_LOFF_SENSN                  0xFF  // маска каналов, у которых проверяются отрицательные входы
+#endif // ADSTASK_LOFF_SENSN
+#ifndef ADSTASK_LOFF_DEBOUNCE
+#define ADSTASK_LOFF_DEBOUNCE               50    // количество отсчетов подряд с одинаковым состоянием электродов для смены состояния
+#endif // ADSTASK_LOFF_DEBOUNCE
+#ifndef ADSTASK_PACE_EN
+#define ADSTASK_PACE_EN                     0     // если =1, у ведущего АЦП (ADS1298) включен буфер PACE для обнаружения импульсов стимулятора
+#endif // ADSTASK_PACE_EN
+#ifndef ADSTASK_PACE_EVEN
+#define ADSTASK_PACE_EVEN                   ADS1298_PACE_EVEN_CH2 // четный канал на выходе PACE_OUT1
+#endif // ADSTASK_PACE_EVEN
+#ifndef ADSTASK_PACE_ODD
+#define ADSTASK_PACE_ODD                    ADS1298_PACE_ODD_CH1  // нечетный канал на выходе PACE_OUT2
+#endif // ADSTASK_PACE_ODD
+#ifndef ADSTASK_RESP_EN
+#define ADSTASK_RESP_EN                     0     // если =1 и ведущий АЦП - исполнение R, на канале 1 измеряется дыхание (импедансная пневмография)
+#endif // ADSTASK_RESP_EN
+#ifndef ADSTASK_RESP_SPS
+#define ADSTASK_RESP_SPS                    25    // частота отсчетов канала дыхания после децимации
+#endif // ADSTASK_RESP_SPS
+#ifndef ADSTASK_RESP_FREQ
+#define ADSTASK_RESP_FREQ                   ADS1298_RESP_FREQ_32K  // частота модуляции (поле RESP_FREQ в CONFIG4)
+#endif // ADSTASK_RESP_FREQ
+#ifndef ADSTASK_RESP_PH
+#define ADSTASK_RESP_PH                     ADS1298_RESP_PH_112_5  // фаза демодулятора (поле RESP_PH в RESP)
+#endif // ADSTASK_RESP_PH
+#define ADSTASK_RESP_BASE_SHIFT             7     // постоянная времени изолинии дыхания: 2^7 отсчетов (5 с при 25 SPS)
+#define ADSTASK_RESP_AMP_SHIFT              5     // постоянная времени оценки амплитуды дыхания: 2^5 отсчетов
+#define ADSTASK_RESP_PERIOD_MIN             (ADSTASK_RESP_SPS)      // минимальный период дыхания в отсчетах (60 вдохов/мин)
+#define ADSTASK_RESP_PERIOD_MAX             (ADSTASK_RESP_SPS * 20) // максимальный период дыхания в отсчетах (3 вдоха/мин), дольше - частота не определена
+#define ADSTASK_ACCESS_TO_SPI_TIMEOUT_MS    200   // таймаут ожидания доступа к шине SPI
 
 
 #if(RTTLOG_EN)
@@ -71,15 +176,18 @@ typedef enum {
     ADS_TASK_CMD_STOP,      // команда на остановку измерений
     ADS_TASK_CMD_SINGLE,    // команда на запуск одиночного измерения
     ADS_TASK_CMD_TERMINATE, // завершение работы задачи
-    ADS_TASK_CMD_GET_CFG,   // запрос конфига
     ADS_TASK_CMD_SET_CFG,   // установка нового конфига
+    ADS_TASK_CMD_BATCH,     // пачка отсчетов прочитана аппаратно (ads_stream)
+    ADS_TASK_CMD_POWER,     // установка уровня питания вне измерений
 } ads_task_cmd_e;
 
-// структрура для команд чтения и записи кофигурации из вне
+// описание шины SPI, на которой стоят АЦП (из файла платы)
 typedef struct {
-  adstask_adc_no_e  adc_no; // номер АЦП
-  uint8_t           *buff;  // указатель на буфер
-} ads_cmd_cfg_t;
+  NRF_SPIM_Type   *spim;    // порт SPIM
+  IRQn_Type       irqn;     // номер прерывания
+  uint8_t         prior;    // приоритет прерывания
+  uint32_t        freq;     // скорость обмена
+} ads_bus_t;
 
 // формат очереди заданий
 typedef struct {
@@ -93,24 +201,131 @@ typedef struct {
 
 
 static QueueHandle_t m_q_cmd = NULL; // очередь команд управления
-static ads129x_handle_t m_adc0_handle = NULL; // хендл для работы с АЦП0
-static ads129x_handle_t m_adc1_handle = NULL; // хендл для работы с АЦП1
+static ads129x_handle_t m_adc_handle[ADS129X_CNT]; // хендлы для работы с АЦП (NULL - не добавлен на шину)
+static const uint8_t m_adc_cs_pin[ADS129X_CNT] = ADS129X_CS_PINS; // выводы CS АЦП
+static const uint8_t m_adc_bus[ADS129X_CNT] = ADS129X_CS_BUS; // номера шин SPI АЦП (индекс в m_bus)
+static const ads_bus_t m_bus[ADS129X_BUS_CNT] = ADS129X_BUSES; // шины SPI АЦП
 static TaskHandle_t m_ads_task = NULL; // управляющая задача
-static uint8_t m_spiDevID = 0xFF; // ID интерефейса SPI
+static uint8_t m_spiDevID[ADS129X_BUS_CNT]; // ID интерефейсов SPI по номерам шин (0xFF - не инициализирован)
 static ads_task_callback_t m_callback = NULL; // функция верхнего уровня, в которую передаются принятые данные
 static QueueHandle_t m_q_res = NULL; // очередь для передачи результата выполнения команды (используется в некоторых командах)
 static bool m_is_started = false;
 static SemaphoreHandle_t m_mutex = NULL; // мьютекс для ограничения множественных вызовов некоторых функций
-
-
-
+static TickType_t m_scrub_tick = 0; // время последней сверки регистров
+static uint32_t m_reg_err_cnt = 0; // количество обнаруженных сбоев регистров
+static const ads_chip_ops_t *m_ops[ADS129X_CNT]; // описания микросхем АЦП (NULL - АЦП не найден)
+static uint8_t m_adc_cnt = 0; // количество найденных АЦП
+static ads129x_data_t m_frames[2][ADS129X_CNT]; // двойной буфер кадров: пока поток обрабатывает один отсчет, в другой читается следующий
+static spi_queue_t m_rd_job[ADS129X_CNT]; // задания SPI чтения кадров
+static volatile uint8_t m_rd_pend = 0; // количество незавершенных чтений текущего отсчета
+static volatile bool m_rd_err = false; // ошибка постановки чтения в очередь SPI (отсчет пропускается)
+static volatile uint8_t m_rd_buf = 0; // буфер, в который читается текущий отсчет
+static volatile uint8_t m_buf_busy[2]; // буфер передан потоку и еще не обработан
+static volatile uint32_t m_overrun_cnt = 0; // количество пропущенных отсчетов (поток или шина не успевают)
+static bool m_hw_stream = false; // кадры читаются аппаратно по DRDY (ads_stream), шина захвачена
+static volatile uint16_t m_batch_ms = 0; // желаемый период пробуждений при аппаратном чтении, мс (0 - максимальная пачка)
+static volatile uint32_t m_wakeup_cnt = 0; // количество пробуждений потока по данным АЦП
+static volatile ads_task_pwr_e m_pwr = ADS_TASK_PWR_OFF; // текущий уровень питания АЦП
+static ads_task_pwr_e m_pwr_idle = ADS_TASK_PWR_OFF; // уровень питания вне измерений
+static TickType_t m_wake_tick = 0; // время команды запуска измерений
+static bool m_wake_pend = false; // ждем первый отсчет после запуска
+static volatile uint32_t m_wake_latency_ms = 0; // время от запуска до первого отсчета
+static bool m_single_pend = false; // идет одиночное измерение: останов после первого отсчета
+static TickType_t m_ana_ready_tick = 0; // время окончания установления аналоговой части
+static uint16_t m_loff[ADS129X_CNT]; // состояние электродов после антидребезга
+static uint16_t m_loff_raw[ADS129X_CNT]; // состояние электродов на последнем отсчете
+static uint16_t m_loff_stable = 0; // количество отсчетов подряд с неизменным m_loff_raw
+static bool m_loff_valid = false; // m_loff установлено после запуска
+static bool m_warm_start = false; // теплый старт: аналоговое питание не выключалось при программном сбросе
+static bool m_resp_en = false; // канал дыхания обрабатывается (ведущий АЦП - исполнение R)
+static uint16_t m_resp_decim = 1; // отсчетов АЦП на один отсчет дыхания
+static uint16_t m_resp_n = 0; // накоплено отсчетов АЦП
+static int64_t m_resp_sum = 0; // сумма накопленных отсчетов
+static int32_t m_resp_base = 0; // изолиния дыхания (медленное среднее)
+static int32_t m_resp_amp = 0; // средний модуль отклонения от изолинии (порог перехода - половина)
+static bool m_resp_low = false; // сигнал опускался ниже нижнего порога (ждем переход вверх - вдох)
+static uint32_t m_resp_idx = 0; // номер отсчета дыхания
+static uint32_t m_resp_last = 0; // номер отсчета последнего вдоха
+static bool m_resp_last_valid = false; // m_resp_last задан
+static uint16_t m_resp_rate = 0; // частота дыхания, вдохов/мин * 10
+
+// статически выделенная память под объекты FreeRTOS
+static StackType_t        m_ads_task_stack[ADSTASK_STACK_SIZE]; // стек управляющей задачи
+static StaticTask_t       m_ads_task_tcb;
+static uint8_t            m_q_cmd_storage[ADSTASK_CMD_QUEUE_SIZE * sizeof(ads_task_cmd_t)]; // буфер очереди команд
+static StaticQueue_t      m_q_cmd_static;
+static uint8_t            m_q_res_storage[sizeof(uint16_t)]; // буфер очереди результата
+static StaticQueue_t      m_q_res_static;
+const uint32_t            ads_task_ram_size = sizeof(m_q_cmd_storage) + sizeof(m_q_res_storage);
+static StaticSemaphore_t  m_mutex_static;
+
+
+
+
+static void rd_done(void *ctx)
+{ // окончание чтения кадра одного АЦП (из прерывания SPIM или при ошибке постановки в очередь)
+  UBaseType_t key = portSET_INTERRUPT_MASK_FROM_ISR();
+  uint8_t left = --m_rd_pend;
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(key);
+  if(left) return; // прочитаны еще не все АЦП
+  
+  if(m_rd_err)
+  { // часть кадров не читалась, отсчет пропускается
+    m_overrun_cnt++;
+    return;
+  }
+  
+  // отсчет прочитан целиком: отдаю буфер потоку, следующий отсчет читается в другой буфер
+  uint8_t buf = m_rd_buf;
+  m_buf_busy[buf] = 1;
+  m_rd_buf = buf ^ 1;
+  ads_task_cmd_t cmd = {
+    .cmd = ADS_TASK_CMD_DATA,
+    .args = (void *)(uint32_t)buf
+  };
+  if(pdTRUE != xQueueSendFromISR(m_q_cmd, &cmd, NULL))
+  {
+    m_buf_busy[buf] = 0;
+    m_overrun_cnt++;
+  }
+}
 
 static void ads_rdy_isr(void)
-{ // обработчик перывания от RDY
+{ // обработчик перывания от RDY: чтение кадров всех АЦП ставится в очереди SPI прямо из прерывания,
+  // поэтому поток в это время обрабатывает предыдущий отсчет, а не ждет окончания DMA
+  if((m_adc_cnt == 0) || m_rd_pend || m_buf_busy[m_rd_buf])
+  { // предыдущий отсчет еще читается или поток не успел его обработать
+    m_overrun_cnt++;
+    return;
+  }
+  
+  m_rd_err = false;
+  m_rd_pend = m_adc_cnt; // до постановки первого задания, т.к. прерывание SPIM приоритетнее
+  uint8_t n = 0;
+  for(uint8_t i = 0; i < ADS129X_CNT; i++)
+  {
+    if(m_ops[i] == NULL) continue; // АЦП не найден при инициализации
+    // команда RDATA общая для серии, поэтому чтение идет напрямую через ads129x, а не через ops->get_data
+    if(ERR_NOERROR != ads129x_read_data_async(m_adc_handle[i], &m_frames[m_rd_buf][n], &m_rd_job[i], rd_done, NULL))
+    {
+      m_rd_err = true;
+      rd_done(NULL);
+    }
+    n++;
+  }
+}
+
+static void batch_done(uint8_t half)
+{ // пачка отсчетов прочитана в половину кольца ads_stream (из прерывания таймера)
   ads_task_cmd_t cmd = {
-    .cmd = ADS_TASK_CMD_DATA
+    .cmd = ADS_TASK_CMD_BATCH,
+    .args = (void *)(uint32_t)half
   };
-  xQueueSendFromISR(m_q_cmd, &cmd, NULL);
+  if(pdTRUE != xQueueSendFromISR(m_q_cmd, &cmd, NULL))
+  {
+    ads_stream_release(half);
+    m_overrun_cnt += ads_stream_get_batch();
+  }
 }
 
 // отправка команды в ads_task без дополнительных данных
@@ -138,113 +353,506 @@ static bool ads_send_cmd_args(ads_task_cmd_e cmd, void *args)
     return xQueueSend(m_q_cmd, &command, 0);
 }
 
-static int32_t sample24bitToInt32(ads129x_24bit_t sample)
-{ // преобразует сэмпл одного канала АЦП 24 бит в int32_t
-  int32_t res = 0;
-  if(sample.val[0] & 0x80) res = 0xFF000000;
-  res += ((int32_t)sample.val[0] << 16) + ((int32_t)sample.val[1] << 8) + sample.val[2];
-  return res;
-}
-
 static uint32_t sample24bitToUint32(ads129x_24bit_t sample)
 { // преобразует сэмпл одного канала АЦП 24 бит в int32_t
   uint32_t res = ((int32_t)sample.val[0] << 16) + ((int32_t)sample.val[1] << 8) + sample.val[2];
   return res;
 }
 
-static void setupChannel(ads1298_chset_t *ch, uint8_t mux, uint8_t gain, uint8_t pd)
-{ // настройка канала АЦП
-   ch->gain = gain;
-   ch->mux = mux;
-   ch->pd = pd;
+static ads129x_handle_t adc_handle(adstask_adc_no_e adc_no)
+{ // хендл АЦП по его номеру
+  if((uint8_t)adc_no >= ADS129X_CNT) return NULL;
+  return m_adc_handle[adc_no];
+}
+
+static void sample_decode(adstask_data_t *data, const ads129x_data_t *frames)
+{ // разбор кадров одного отсчета (кадры найденных АЦП идут подряд по возрастанию номера)
+  uint8_t n = 0;
+  for(uint8_t i = 0; i < ADS129X_CNT; i++)
+  {
+    if(m_ops[i] == NULL) continue;
+    data->status[n] = sample24bitToUint32(frames[n].status);
+    for(uint8_t j = 0; j < ADS129X_CH_CNT; j++)
+    {
+      data->ch[n * ADS129X_CH_CNT + j] = m_ops[i]->decode(frames[n].ch[j]);
+    }
+    n++;
+  }
+  data->adc_cnt = n;
+  data->ch_cnt = n * ADS129X_CH_CNT;
+  cal_apply(data->ch, data->ch_cnt); // калибровка каналов (смещение и усиление, см. cal.h)
+}
+
+static void loff_update(adstask_data_t *data)
+{ // антидребезг состояния электродов из слов состояния отсчета: новое состояние принимается,
+  // если оно держится ADSTASK_LOFF_DEBOUNCE отсчетов подряд
+  bool same = true;
+  for(uint8_t n = 0; n < data->adc_cnt; n++)
+  {
+    uint16_t raw = ADS129X_STATUS_LOFF(data->status[n]);
+    if(raw != m_loff_raw[n]) same = false;
+    m_loff_raw[n] = raw;
+  }
+  if(!same) m_loff_stable = 0;
+  else if(m_loff_stable < ADSTASK_LOFF_DEBOUNCE) m_loff_stable++;
+  
+  data->loff_changed = false;
+  if((m_loff_stable >= ADSTASK_LOFF_DEBOUNCE) && (!m_loff_valid || memcmp(m_loff, m_loff_raw, sizeof(m_loff))))
+  {
+    memcpy(m_loff, m_loff_raw, sizeof(m_loff));
+    m_loff_valid = true;
+    data->loff_changed = true;
+  }
+  memcpy(data->loff, m_loff, sizeof(m_loff));
+}
+
+static void resp_start(void)
+{ // подготовка канала дыхания к запуску измерений: коэффициент децимации по текущей частоте выборки
+  const ads_chip_ops_t *ops = m_ops[ADSTASK_ADC_MASTER];
+  m_resp_en = ADSTASK_RESP_EN && (ops != NULL) && ops->resp;
+  if(!m_resp_en) return;
+  
+  uint8_t regs[ADS129X_REG_CNT];
+  uint32_t rate = 0;
+  if(ERR_NOERROR == ads129x_get_shadow(adc_handle(ADSTASK_ADC_MASTER), ADS129X_REG_ID, ops->reg_cnt, regs)) {
+    rate = ads_chip_rate(ops, regs);
+  }
+  m_resp_decim = (rate > ADSTASK_RESP_SPS) ? (uint16_t)(rate / ADSTASK_RESP_SPS) : 1;
+  m_resp_n = 0;
+  m_resp_sum = 0;
+  m_resp_idx = 0;
+  m_resp_amp = 0;
+  m_resp_low = false;
+  m_resp_last_valid = false;
+  m_resp_rate = 0;
+}
+
+static void resp_update(adstask_data_t *data)
+{ // децимация канала дыхания (среднее за m_resp_decim отсчетов) и оценка частоты дыхания
+  // по переходам через изолинию вверх с гистерезисом в половину средней амплитуды
+  data->resp_ready = false;
+  if(!m_resp_en) return;
+  
+  m_resp_sum += data->ch[0];
+  if(++m_resp_n < m_resp_decim) return;
+  int32_t x = (int32_t)(m_resp_sum / m_resp_n);
+  m_resp_sum = 0;
+  m_resp_n = 0;
+  
+  if(m_resp_idx == 0) m_resp_base = x; // первый отсчет после запуска
+  m_resp_idx++;
+  m_resp_base += (x - m_resp_base) >> ADSTASK_RESP_BASE_SHIFT;
+  int32_t d = x - m_resp_base;
+  m_resp_amp += (((d < 0) ? -d : d) - m_resp_amp) >> ADSTASK_RESP_AMP_SHIFT;
+  
+  int32_t th = m_resp_amp / 2;
+  if(d < -th) {
+    m_resp_low = true;
+  }else if(m_resp_low && (d > th)) { // вдох
+    m_resp_low = false;
+    uint32_t period = m_resp_idx - m_resp_last;
+    if(m_resp_last_valid && (period >= ADSTASK_RESP_PERIOD_MIN) && (period <= ADSTASK_RESP_PERIOD_MAX))
+    {
+      uint16_t rate = (uint16_t)(600UL * ADSTASK_RESP_SPS / period);
+      m_resp_rate = m_resp_rate ? (uint16_t)((m_resp_rate * 3 + rate) / 4) : rate;
+    }
+    m_resp_last = m_resp_idx;
+    m_resp_last_valid = true;
+  }
+  if(m_resp_last_valid && ((m_resp_idx - m_resp_last) > ADSTASK_RESP_PERIOD_MAX)) {
+    m_resp_rate = 0; // дыхания нет слишком долго
+  }
+  
+  data->resp = x;
+  data->resp_rate = m_resp_rate;
+  data->resp_ready = true;
+}
+
+static uint16_t hw_cmd(uint8_t cmd)
+{ // команда всем найденным АЦП (RDATAC/SDATAC)
+  uint16_t err = ERR_NOERROR;
+  for(uint8_t i = 0; i < ADS129X_CNT; i++)
+  {
+    if(m_ops[i] == NULL) continue;
+    err = ads129x_cmd(adc_handle((adstask_adc_no_e)i), cmd, ADSTASK_ACCESS_TO_SPI_TIMEOUT_MS);
+    if(err != ERR_NOERROR) break;
+  }
+  return err;
+}
+
+static uint8_t hw_batch(void)
+{ // размер пачки аппаратного чтения: отсчеты за m_batch_ms при текущей частоте выборки
+  uint8_t regs[ADS129X_REG_CNT];
+  const ads_chip_ops_t *ops = m_ops[ADSTASK_ADC_MASTER];
+  uint32_t rate = 0;
+  if(ERR_NOERROR == ads129x_get_shadow(adc_handle(ADSTASK_ADC_MASTER), ADS129X_REG_ID, ops->reg_cnt, regs)) {
+    rate = ads_chip_rate(ops, regs);
+  }
+  
+  uint32_t batch = (uint32_t)m_batch_ms * rate / 1000;
+  if((m_batch_ms == 0) || (batch > ADS_STREAM_BATCH)) batch = ADS_STREAM_BATCH;
+  if(batch == 0) batch = 1; // период короче интервала между отсчетами
+  return (uint8_t)batch;
+}
+
+static uint16_t hw_start(void)
+{ // запуск аппаратного чтения кадров по DRDY
+  if((ADS129X_BUS_CNT != 1) || (m_adc_cnt == 0) || (m_adc_cnt > ADS_STREAM_CS_MAX)) return ERR_DISABLED;
+  
+  uint8_t cs[ADS_STREAM_CS_MAX];
+  uint8_t n = 0;
+  for(uint8_t i = 0; i < ADS129X_CNT; i++)
+  {
+    if(m_ops[i] != NULL) cs[n++] = m_adc_cs_pin[i];
+  }
+  
+  ADS129X_INT_DISABLE(); // прерывание DRDY не нужно: событие GPIOTE формируется и без него
+  NRF_SPIM_Type *spim;
+  uint16_t err = hw_cmd(ADS129X_CMD_RDATAC);
+  if(err == ERR_NOERROR) {
+    err = spiHwAcquire(m_spiDevID[0], &spim, pdMS_TO_TICKS(ADSTASK_ACCESS_TO_SPI_TIMEOUT_MS));
+    if(err == ERR_NOERROR) {
+      err = ads_stream_start(spim, cs, n, hw_batch(), batch_done);
+      if(err != ERR_NOERROR) spiHwRelease(m_spiDevID[0]);
+    }
+  }
+  if(err != ERR_NOERROR) {
+    hw_cmd(ADS129X_CMD_SDATAC);
+    RTT_LOG_INFO("ADSTASK: HW read start error 0x%04X", err);
+    return err;
+  }
+  m_hw_stream = true;
+  RTT_LOG_INFO("ADSTASK: HW read started, batch %d samples", ads_stream_get_batch());
+  return ERR_NOERROR;
+}
+
+static void hw_stop(void)
+{ // останов аппаратного чтения и возврат АЦП в командный режим
+  if(!m_hw_stream) return;
+  ads_stream_stop();
+  spiHwRelease(m_spiDevID[0]);
+  hw_cmd(ADS129X_CMD_SDATAC);
+  NRF_GPIOTE->EVENTS_IN[GPIOTE_CH_ADS129X] = 0; // событие не сбрасывалось, пока прерывание было запрещено
+  m_hw_stream = false;
+  RTT_LOG_INFO("ADSTASK: HW read stopped, %d samples lost", ads_stream_get_lost_cnt());
+}
+
+static void hw_pause(void)
+{ // приостановка аппаратного чтения для обмена с АЦП через очередь SPI
+  if(!m_hw_stream) return;
+  ads_stream_pause();
+  spiHwRelease(m_spiDevID[0]);
+  hw_cmd(ADS129X_CMD_SDATAC);
+}
+
+static void hw_resume(void)
+{ // возобновление аппаратного чтения после hw_pause()
+  if(!m_hw_stream) return;
+  NRF_SPIM_Type *spim;
+  uint16_t err = hw_cmd(ADS129X_CMD_RDATAC);
+  if(err == ERR_NOERROR) err = spiHwAcquire(m_spiDevID[0], &spim, pdMS_TO_TICKS(ADSTASK_ACCESS_TO_SPI_TIMEOUT_MS));
+  if(err == ERR_NOERROR) {
+    ads_stream_resume();
+    return;
+  }
+  // шина недоступна: чтение остается остановленным до следующего запуска измерений
+  ads_stream_stop();
+  hw_cmd(ADS129X_CMD_SDATAC);
+  m_hw_stream = false;
+  RTT_LOG_INFO("ADSTASK: HW read resume error 0x%04X", err);
+}
+
+static uint16_t apply_image(const ads_task_cfg_image_t *image)
+{ // применение образа конфигурации ко всем АЦП (выполняется в ads_task)
+  uint16_t err = ERR_NOERROR;
+  uint8_t wr_cnt = 0, cnt;
+  
+  // во время измерений запрещаю прерывание DRDY: иначе команды DATA, накопившиеся в очереди
+  // за время записи, прочитали бы один и тот же отсчет несколько раз;
+  // аппаратное чтение приостанавливается: в режиме RDATAC АЦП не принимает WREG
+  if(m_is_started) ADS129X_INT_DISABLE();
+  hw_pause();
+  
+  for(uint8_t i = 0; i < ADS129X_CNT; i++)
+  {
+    if(image->mask[i] == 0) continue;
+    ads129x_handle_t handle = adc_handle((adstask_adc_no_e)i);
+    if((handle == NULL) || (m_ops[i] == NULL))
+    {
+      err = ERR_INVALID_STATE;
+      break;
+    }
+    err = ads_chip_apply_image(m_ops[i], handle, image->regs[i], image->mask[i], &cnt);
+    if(err != ERR_NOERROR)
+    {
+      RTT_LOG_INFO("ADSTASK: Apply config ADC %d error 0x%04X", i, err);
+      break;
+    }
+    wr_cnt += cnt;
+  }
+  
+  hw_resume();
+  if(m_is_started && !m_hw_stream) ADS129X_INT_ENABLE();
+  
+  RTT_LOG_INFO("ADSTASK: Apply config, %d regs written", wr_cnt);
+  return err;
+}
+
+static uint16_t set_single_shot(uint8_t single_shot)
+{ // установка режима одиночного измерения в CONFIG4 всех найденных АЦП по текущему состоянию регистров из теневой копии
+  ads_task_cfg_image_t image;
+  memset(&image, 0, sizeof(image));
+  
+  for(uint8_t i = 0; i < ADS129X_CNT; i++)
+  { // адрес CONFIG4 и бит SINGLE_SHOT у ADS1298 и ADS1299 совпадают
+    if(m_ops[i] == NULL) continue;
+    uint8_t cfg4;
+    uint16_t err = ads129x_get_shadow(adc_handle((adstask_adc_no_e)i), ADS129X_REG_CONFIG4, 1, &cfg4);
+    if(err != ERR_NOERROR) return err;
+    cfg4 = single_shot ? (cfg4 | ADS129X_CONFIG4_SINGLE_SHOT) : (cfg4 & ~ADS129X_CONFIG4_SINGLE_SHOT);
+    image.regs[i][ADS129X_REG_CONFIG4] = cfg4;
+    image.mask[i] = 1UL << ADS129X_REG_CONFIG4;
+  }
+  return apply_image(&image); // регистр записывается, только если значение изменилось
+}
+
+static void regs_scrub(void)
+{ // сверка регистров АЦП с теневой копией и восстановление при сбое
+  m_scrub_tick = xTaskGetTickCount();
+  // при аппаратном чтении АЦП в режиме RDATAC не отвечают на RREG, а пауза чтения теряет отсчеты,
+  // поэтому сверка откладывается до останова измерений
+  if(m_hw_stream || (m_pwr == ADS_TASK_PWR_OFF)) return;
+  
+  for(uint8_t i = 0; i < ADS129X_CNT; i++)
+  {
+    ads129x_handle_t handle = adc_handle((adstask_adc_no_e)i);
+    if((handle == NULL) || (m_ops[i] == NULL)) continue;
+    
+    uint32_t diff = 0;
+    uint16_t err = ads_chip_verify(m_ops[i], handle, &diff);
+    if((err != ERR_NOERROR) || (diff == 0)) continue; // АЦП еще не инициализирован или регистры в порядке
+    
+    m_reg_err_cnt++;
+    RTT_LOG_INFO("ADSTASK: ADC %d regs corrupted, mask 0x%08X", i, diff);
+    
+    if(m_is_started) ADS129X_INT_DISABLE();
+    err = ads_chip_restore(m_ops[i], handle);
+    if(m_is_started) ADS129X_INT_ENABLE();
+    if(err != ERR_NOERROR) {
+      RTT_LOG_INFO("ADSTASK: Restore ADC %d regs error 0x%04X", i, err);
+    }
+  }
+}
+
+static void ana_pwr_on(bool warm)
+{ // подача аналогового питания и выход из Power Down (без ожидания)
+  ADS129X_PWDN_OFF();
+  ADS129X_RESET_OFF();
+  ANA_PWR_ON();
+  m_ana_ready_tick = xTaskGetTickCount() + (warm ? 0 : pdMS_TO_TICKS(ADSTASK_ANA_SETTLE_MS));
+  m_pwr = ADS_TASK_PWR_READY;
+  sysRetainedSet(SYS_RETAINED_ANA_PWR, true);
+  sysBootMark(SYS_BOOT_ANA_PWR);
+}
+
+static void ana_settle_wait(void)
+{ // ожидание установления аналоговой части перед запуском измерений
+  TickType_t left = m_ana_ready_tick - xTaskGetTickCount();
+  if((left != 0) && (left <= pdMS_TO_TICKS(ADSTASK_ANA_SETTLE_MS))) vTaskDelay(left);
+}
+
+static uint16_t adc_wait_ready(void)
+{ // ожидание готовности ведущего АЦП после подачи питания: опрос регистра ID вместо фиксированной задержки
+  const ads_chip_ops_t *ops;
+  TickType_t start = xTaskGetTickCount();
+  for(;;)
+  {
+    uint16_t err = ads_chip_detect(adc_handle(ADSTASK_ADC_MASTER), &ops);
+    if(err == ERR_NOERROR) {
+      RTT_LOG_INFO("ADSTASK: ADC ready in %d ms", (xTaskGetTickCount() - start) * 1000 / configTICK_RATE_HZ);
+      return ERR_NOERROR;
+    }
+    if((err != ERR_BUSY) && (err != ERR_TIMEOUT)) return err; // шина не работает, ждать бесполезно
+    if((xTaskGetTickCount() - start) >= pdMS_TO_TICKS(ADSTASK_PWRUP_TIMEOUT_MS)) return ERR_TIMEOUT;
+    vTaskDelay(pdMS_TO_TICKS(ADSTASK_PWRUP_POLL_MS));
+  }
+}
+
+static uint16_t pwr_up(void)
+{ // включение аналогового питания, сброс АЦП и восстановление регистров из теневой копии
+  ana_pwr_on(false);
+  uint16_t err = adc_wait_ready();
+  if(err != ERR_NOERROR) return err;
+  ADS129X_RESET_ON(); // после выхода из Power Down даташит рекомендует сброс
+  nrf_delay_us(10);
+  ADS129X_RESET_OFF();
+  nrf_delay_us(20);
+  
+  for(uint8_t i = 0; i < ADS129X_CNT; i++)
+  { // после сброса АЦП в режиме RDATAC, ads_chip_restore сама подает SDATAC
+    if(m_ops[i] == NULL) continue;
+    uint16_t err = ads_chip_restore(m_ops[i], adc_handle((adstask_adc_no_e)i));
+    if(err != ERR_NOERROR) {
+      RTT_LOG_INFO("ADSTASK: Restore ADC %d after power up error 0x%04X", i, err);
+      return err;
+    }
+  }
+  return ERR_NOERROR;
+}
+
+static void pwr_down(void)
+{ // перевод АЦП в Power Down и выключение аналогового питания
+  ADS129X_PWDN_ON();
+  ANA_PWR_OFF();
+  sysRetainedSet(SYS_RETAINED_ANA_PWR, false);
+}
+
+static uint16_t pwr_set(ads_task_pwr_e pwr)
+{ // переход на уровень питания OFF, STANDBY или READY (выполняется в ads_task вне измерений)
+  uint16_t err = ERR_NOERROR;
+  if(pwr == m_pwr) return ERR_NOERROR;
+  
+  if(pwr == ADS_TASK_PWR_OFF) {
+    pwr_down();
+  }else{
+    if(m_pwr == ADS_TASK_PWR_OFF) err = pwr_up(); // после включения АЦП работают (READY)
+    else if(m_pwr == ADS_TASK_PWR_STANDBY) err = hw_cmd(ADS129X_CMD_WAKEUP);
+    if((err == ERR_NOERROR) && (pwr == ADS_TASK_PWR_STANDBY)) err = hw_cmd(ADS129X_CMD_STANDBY);
+    if(err != ERR_NOERROR) {
+      RTT_LOG_INFO("ADSTASK: Power %d -> %d error 0x%04X", m_pwr, pwr, err);
+      pwr_down(); // состояние АЦП неизвестно, следующий переход начнется с включения питания
+      pwr = ADS_TASK_PWR_OFF;
+    }
+  }
+  m_pwr = pwr;
+  return err;
+}
+
+static void pwr_idle(void)
+{ // возврат на уровень питания вне измерений
+  if(!m_is_started) pwr_set(m_pwr_idle);
+}
+
+static void wake_done(void)
+{ // получен отсчет: фиксирую время от запуска до первого отсчета
+  if(!m_wake_pend) return;
+  m_wake_pend = false;
+  m_wake_latency_ms = (uint32_t)(xTaskGetTickCount() - m_wake_tick) * 1000 / configTICK_RATE_HZ;
+  sysBootMark(SYS_BOOT_FIRST_SAMPLE);
+  RTT_LOG_INFO("ADSTASK: First sample %d ms after start", m_wake_latency_ms);
+}
+
+static void board_config(adstask_adc_no_e adc_no, const ads_chip_ops_t *ops, uint8_t *regs)
+{ // изменение конфигурации по умолчанию под плату
+  int8_t gain = ads_chip_gain_code(ops, ADSTASK_CH_GAIN);
+  if(gain < 0) gain = (regs[ADS129X_REG_CH1SET] >> 4) & 0x07; // усиление не поддерживается, оставляю по умолчанию
+  for(uint8_t ch = 0; ch < ADS129X_CH_CNT; ch++)
+  {
+    regs[ADS129X_REG_CH1SET + ch] = ads_chip_chset(ADS1298_MUX_NORMAL, (uint8_t)gain, false);
+  }
+  
+#if(ADSTASK_LOFF_EN)
+  // обнаружение обрыва электродов: состояние приходит в слове состояния каждого кадра
+  // раскладка LOFF общая для серии (COMP_TH[7:5], ILEAD_OFF[3:2], FLEAD_OFF[1:0]), коды FLEAD_OFF различаются
+  regs[ADS129X_REG_LOFF] = ((ADSTASK_LOFF_COMP_TH & 0x07) << 5) | ((ADSTASK_LOFF_ILEAD & 0x03) << 2) |
+                           ((ADSTASK_LOFF_AC ? ops->flead_ac : ops->flead_dc) & 0x03);
+  regs[ADS129X_REG_LOFF_SENSP] = ADSTASK_LOFF_SENSP;
+  regs[ADS129X_REG_LOFF_SENSN] = ADSTASK_LOFF_SENSN;
+  regs[ADS129X_REG_CONFIG4] |= ADS129X_CONFIG4_PD_LOFF_COMP;
+#endif // ADSTASK_LOFF_EN
+  
+  if((adc_no != ADSTASK_ADC_MASTER) || ((ops != &ads_chip_ads1298) && (ops != &ads_chip_ads1298r))) return;
+  
+  // настройка точки Вилсона (только ADS1298)
+  ads1298_wct1_t wct1;
+  ads1298_wct2_t wct2;
+  memcpy(&wct1, &regs[ADS1298_REG_WCT1], 1);
+  memcpy(&wct2, &regs[ADS1298_REG_WCT2], 1);
+  wct1.wcta = ADS1298_WCTA_CH1P;
+  wct1.pd_wcta = 1;
+  wct2.wctb = ADS1298_WCTB_CH1N;
+  wct2.wctc = ADS1298_WCTC_CH2P;
+  wct2.pd_wctb = 1;
+  wct2.pd_wctc = 1;
+  memcpy(&regs[ADS1298_REG_WCT1], &wct1, 1);
+  memcpy(&regs[ADS1298_REG_WCT2], &wct2, 1);
+  
+  // настройка RLD
+  regs[ADS1298_REG_RLD_SENSN] = 0x03;
+  regs[ADS1298_REG_RLD_SENSP] = 0x03;
+  
+#if(ADSTASK_PACE_EN)
+  // буфер PACE: сигнал каналов выводится на TESTP_PACE_OUT1/TESTN_PACE_OUT2 для внешнего обнаружения импульсов (см. pace.h)
+  ads1298_pace_t pace;
+  memcpy(&pace, &regs[ADS1298_REG_PACE], 1);
+  pace.pacee = ADSTASK_PACE_EVEN;
+  pace.paceo = ADSTASK_PACE_ODD;
+  pace.pd_pace = 1;
+  memcpy(&regs[ADS1298_REG_PACE], &pace, 1);
+#endif // ADSTASK_PACE_EN
+  
+#if(ADSTASK_RESP_EN)
+  if(ops->resp)
+  { // дыхание на канале 1: внутренний модулятор и демодулятор, на выходе канала - огибающая импеданса
+    ads1298_resp_t resp;
+    ads1298_config4_t cfg4;
+    memcpy(&resp, &regs[ADS1298_REG_RESP], 1);
+    memcpy(&cfg4, &regs[ADS1298_REG_CONFIG4], 1);
+    resp.resp_ctrl = ADS1298_RESP_CTRL_INT;
+    resp.resp_ph = ADSTASK_RESP_PH;
+    resp.reserve = 1;
+    resp.resp_mod_en1 = 1;
+    resp.resp_demod_en1 = 1;
+    cfg4.resp_freq = ADSTASK_RESP_FREQ;
+    memcpy(&regs[ADS1298_REG_RESP], &resp, 1);
+    memcpy(&regs[ADS1298_REG_CONFIG4], &cfg4, 1);
+  }
+#endif // ADSTASK_RESP_EN
 }
 
 
-// в этом потоке осуществляется прием и обработка данных с двух АЦП
+// в этом потоке осуществляется прием и обработка данных со всех АЦП
 static void ads_task(void *args)
 {
     ads_task_cmd_t cmd;
     adstask_data_t ads_data;
-    ads1298_config_t adc0_cfg;
-    ads1298_config_t adc1_cfg;
     bool single_shot = false;
   
     uint32_t sample_cnt = 0; // TEST
-  
-    // TEST
-//    ads129x_data_t data_const;
-//    memset(&data_const, 0, sizeof(data_const));
-//    for(uint8_t i=0; i < 8; i++)
-//    {
-//      data_const.ch[i].val[0] = 0xFC;
-//      data_const.ch[i].val[1] = 0x18;
-//      data_const.ch[i].val[2] = 0xAA;
-//    }
 
     ads_send_cmd(ADS_TASK_CMD_INIT);
+  
+#if(ADSTASK_SCRUB_PERIOD_MS)
+    const TickType_t cmd_wait = pdMS_TO_TICKS(ADSTASK_SCRUB_PERIOD_MS);
+#else
+    const TickType_t cmd_wait = portMAX_DELAY;
+#endif
 
     for(;;) {
-        if(pdTRUE != xQueueReceive(m_q_cmd, &cmd, portMAX_DELAY)) {
-            RTT_LOG_INFO("ADSTASK: Cmd timeout");
-            break;
+#if(ADSTASK_SCRUB_PERIOD_MS)
+        // сверка регистров выполняется между командами: и в простое, и во время измерений
+        if((xTaskGetTickCount() - m_scrub_tick) >= cmd_wait) regs_scrub();
+#endif
+        if(pdTRUE != xQueueReceive(m_q_cmd, &cmd, cmd_wait)) {
+            continue; // команд нет, пора сверять регистры
         }
 
         switch (cmd.cmd) {
-            case ADS_TASK_CMD_DATA: // требуется прочитать очередную порцию данных
+            case ADS_TASK_CMD_DATA: // кадры очередного отсчета прочитаны в буфер cmd.args
             {
-                memset(&ads_data, 0, sizeof(ads_data));
-                ads129x_data_t data;
-
-                // читаю данных из АЦП 0
-                uint16_t err = ads1298_get_data(m_adc0_handle, &data);
-                if(err != ERR_NOERROR) {
-                    RTT_LOG_INFO("ADSTASK: Read ADC 0 error 0x%04X", err);
-                    break;
-                }
+                uint8_t buf = (uint8_t)(uint32_t)cmd.args;
                 
-//                if(sample_cnt == 3)
-//                {
-//                  NRF_LOG_INFO("adc_data0:");
-//                  NRF_LOG_HEXDUMP_INFO(&data, sizeof(data)); 
-//                }
-
                 // сохраняю прочитанные данные в буфер
-                ads_data.adc0_status = sample24bitToUint32(data.status);
-                for(uint8_t i = 0; i < ADS129X_CH_CNT; i++)
-                {
-                  ads_data.adc0[i] = sample24bitToInt32(data.ch[i]);
-                }
-//                ads_data.adc0_status = sample24bitToUint32(data.status);
-//                for(uint8_t i = 0; i < ADS129X_CH_CNT; i++)
-//                {
-//                  ads_data.adc0[i] = sample24bitToInt32(data_const.ch[i]);
-//                }
-
-                // читаю данные из АЦП 1
-                err = ads1298_get_data(m_adc1_handle, &data);
-                if(err != ERR_NOERROR) {
-                    RTT_LOG_INFO("ADSTASK: Read ADC 1 error 0x%04X", err);
-                    break;
-                }
-                
-//                if(sample_cnt == 3)
-//                {
-//                  NRF_LOG_INFO("adc_data1:");
-//                  NRF_LOG_HEXDUMP_INFO(&data, sizeof(data)); 
-//                }
-
-                // сохраняю прочитанные данные в буфер
-                ads_data.adc1_status = sample24bitToUint32(data.status);
-                for(uint8_t i = 0; i < ADS129X_CH_CNT; i++)
-                {
-                  ads_data.adc1[i] = sample24bitToInt32(data.ch[i]);
+                sample_decode(&ads_data, m_frames[buf]);
+                loff_update(&ads_data);
+                resp_update(&ads_data);
+                m_buf_busy[buf] = 0; // буфер свободен для следующего отсчета
+                m_wakeup_cnt++;
+                wake_done();
+                if(m_single_pend) { // одиночное измерение закончено
+                    m_single_pend = false;
+                    ads_send_cmd(ADS_TASK_CMD_STOP);
                 }
-//                ads_data.adc1_status = sample24bitToUint32(data.status);
-//                for(uint8_t i = 0; i < ADS129X_CH_CNT; i++)
-//                {
-//                  ads_data.adc1[i] = sample24bitToInt32(data_const.ch[i]);
-//                }
-
                 
                 // === сюда можно вставить какую-либо обработку данных ===
                 
@@ -259,21 +867,69 @@ static void ads_task(void *args)
             }
             break;
 
+            case ADS_TASK_CMD_BATCH: // пачка отсчетов прочитана аппаратно в половину кольца cmd.args
+            {
+                uint8_t half = (uint8_t)(uint32_t)cmd.args;
+                const ads129x_data_t *frames = ads_stream_frames(half);
+                uint8_t batch = ads_stream_get_batch();
+                m_wakeup_cnt++;
+                wake_done();
+                
+                // отсчеты передаются наверх по одному, как и при чтении по прерыванию
+                for(uint8_t s = 0; s < batch; s++)
+                {
+                    sample_decode(&ads_data, &frames[s * m_adc_cnt]);
+                    loff_update(&ads_data);
+                    resp_update(&ads_data);
+                    if(m_callback) {
+                        m_callback(&ads_data);
+                    }
+                    sample_cnt++;
+                }
+                ads_stream_release(half); // половина кольца свободна для следующей пачки
+            }
+            break;
+
             case ADS_TASK_CMD_START:
                 RTT_LOG_INFO("ADS_TASK_CMD_START");
                 sample_cnt = 0;
+                if(!m_is_started)
+                { // прерывание DRDY запрещено и чтения прошлого сеанса закончены, сбрасываю двойной буфер
+                    m_rd_pend = 0;
+                    m_buf_busy[0] = m_buf_busy[1] = 0;
+                    m_wake_tick = xTaskGetTickCount();
+                    m_wake_pend = true;
+                    m_loff_valid = false; // состояние электродов после запуска сообщается заново
+                    m_loff_stable = 0;
+                    m_wake_latency_ms = 0;
+                    resp_start();
+                    if(ERR_NOERROR != pwr_set(ADS_TASK_PWR_READY)) {
+                        m_wake_pend = false;
+                        single_shot = false;
+                        break;
+                    }
+                    ana_settle_wait();
+                }
+                if(!single_shot) set_single_shot(0); // после одиночного измерения возвращаю непрерывный режим
+#if(ADSTASK_HW_TRIG_EN)
+                if(!single_shot && (m_hw_stream || (hw_start() == ERR_NOERROR)))
+                { // кадры читаются аппаратно, прерывание DRDY не нужно
+                    ADS129X_START();
+                    m_is_started = true;
+                    m_pwr = ADS_TASK_PWR_STREAMING;
+                    break;
+                }
+#endif // ADSTASK_HW_TRIG_EN
                 // разрешаю прерывания от АЦП
                 ADS129X_INT_ENABLE();
                 ADS129X_START(); // запускаю измерения
-                //ads129x_cmd(m_adc0_handle, ADS129X_CMD_START, pdMS_TO_TICKS(100)); // TEST
-                //ads129x_cmd(m_adc1_handle, ADS129X_CMD_START, pdMS_TO_TICKS(100)); // TEST
             
-                if(single_shot) {
-                    // TODO установить глобальный флаг, по которому выполнить команду ADS_TASK_CMD_STOP после получения данных
-                    ads_send_cmd(ADS_TASK_CMD_STOP);
+                if(single_shot) { // останов - после получения отсчета
+                    m_single_pend = true;
                     single_shot = false;
                 }
                 m_is_started = true;
+                m_pwr = ADS_TASK_PWR_STREAMING;
             break;
 
             case ADS_TASK_CMD_STOP:
@@ -282,25 +938,23 @@ static void ads_task(void *args)
                 // запрещаю прерывания от АЦП
                 ADS129X_INT_DISABLE();
                 ADS129X_STOP(); // останавливаю измерения
+                hw_stop();
+                if(m_is_started) m_pwr = ADS_TASK_PWR_READY;
                 m_is_started = false;
+                m_single_pend = false;
+                m_wake_pend = false;
+                pwr_idle();
             break;
 
             case ADS_TASK_CMD_SINGLE:
             {
                 RTT_LOG_INFO("ADS_TASK_CMD_SINGLE");
-                // установить бит "single_shot" и запустить измерения
-                ads1298_config4_t cfg4 = adc0_cfg.config4;
-                cfg4.single_shot = 1;
-                uint16_t err = ads1298_set_reg(m_adc0_handle, ADS1298_REG_CONFIG4, *(uint8_t *)&cfg4);
-                if(err != ERR_NOERROR) {
-                    RTT_LOG_INFO("ADSTASK: Write to config4 ADC 0 error 0x%04X", err);
-                    break;
-                }
-                cfg4 = adc1_cfg.config4;
-                cfg4.single_shot = 1;
-                err = ads1298_set_reg(m_adc1_handle, ADS1298_REG_CONFIG4, *(uint8_t *)&cfg4);
+                // установить бит "single_shot" (остальные биты CONFIG4 берутся из теневой копии) и запустить измерения
+                uint16_t err = pwr_set(ADS_TASK_PWR_READY);
+                if(err == ERR_NOERROR) err = set_single_shot(1);
                 if(err != ERR_NOERROR) {
-                    RTT_LOG_INFO("ADSTASK: Write to config4 ADC 1 error 0x%04X", err);
+                    RTT_LOG_INFO("ADSTASK: Write to config4 error 0x%04X", err);
+                    pwr_idle();
                     break;
                 }
                 single_shot = true;
@@ -310,102 +964,76 @@ static void ads_task(void *args)
 
             case ADS_TASK_CMD_TERMINATE:
                 RTT_LOG_INFO("ADS_TASK_CMD_TERMINATE");
+                hw_stop();
             break;
 
             case ADS_TASK_CMD_INIT:
             {
                 RTT_LOG_INFO("ADS_TASK_CMD_INIT");
                 single_shot = false;
-                // начальное конфигурирование АЦП
-                // создаю дефолтный конфиг
-                ads1298_def_config(&adc0_cfg); 
-                ads1298_def_config(&adc1_cfg);
-              
-                // ИЗМЕНЕНИЕ ДЕФОЛТНОЙ КОНФИГУРАЦИИ
-                uint8_t mux = ADS1298_MUX_NORMAL;
-                uint8_t gain = ADS1298_GAIN_12;
-                setupChannel(&adc0_cfg.ch1set, mux, gain, ADS1298_PD_NORMAL);
-                setupChannel(&adc0_cfg.ch2set, mux, gain, ADS1298_PD_NORMAL);
-                setupChannel(&adc0_cfg.ch3set, mux, gain, ADS1298_PD_NORMAL);
-                setupChannel(&adc0_cfg.ch4set, mux, gain, ADS1298_PD_NORMAL);
-                setupChannel(&adc0_cfg.ch5set, mux, gain, ADS1298_PD_NORMAL);
-                setupChannel(&adc0_cfg.ch6set, mux, gain, ADS1298_PD_NORMAL);
-                setupChannel(&adc0_cfg.ch7set, mux, gain, ADS1298_PD_NORMAL);
-                setupChannel(&adc0_cfg.ch8set, mux, gain, ADS1298_PD_NORMAL);
-              
-                setupChannel(&adc1_cfg.ch1set, mux, gain, ADS1298_PD_NORMAL);
-                setupChannel(&adc1_cfg.ch2set, mux, gain, ADS1298_PD_NORMAL);
-                setupChannel(&adc1_cfg.ch3set, mux, gain, ADS1298_PD_NORMAL);
-                setupChannel(&adc1_cfg.ch4set, mux, gain, ADS1298_PD_NORMAL);
-                setupChannel(&adc1_cfg.ch5set, mux, gain, ADS1298_PD_NORMAL);
-                setupChannel(&adc1_cfg.ch6set, mux, gain, ADS1298_PD_NORMAL);
-                setupChannel(&adc1_cfg.ch7set, mux, gain, ADS1298_PD_NORMAL);
-                setupChannel(&adc1_cfg.ch8set, mux, gain, ADS1298_PD_NORMAL);
-                
-                // настройка точки Вилсона
-                adc0_cfg.wct1.wcta = ADS1298_WCTA_CH1P;
-                adc0_cfg.wct1.pd_wcta = 1;
-                adc0_cfg.wct2.wctb = ADS1298_WCTB_CH1N;
-                adc0_cfg.wct2.wctc = ADS1298_WCTC_CH2P;
-                adc0_cfg.wct2.pd_wctb = 1;
-                adc0_cfg.wct2.pd_wctc = 1;
-                
-                // настройка RLD
-                adc0_cfg.rld_sensn = 0x03;
-                adc0_cfg.rld_sensp = 0x03;
-
-                // заливаю новые конфиги в АЦП
-                uint16_t err = ads1298_init(m_adc0_handle, &adc0_cfg);
+                // начальное конфигурирование АЦП: определяю тип микросхемы, создаю дефолтный конфиг,
+                // изменяю его под плату и заливаю в АЦП
+                // ведущий АЦП обязателен, остальные не найденные АЦП пропускаются
+                uint16_t err = ERR_NOERROR;
+                m_adc_cnt = 0;
+                err = adc_wait_ready();
                 if(err != ERR_NOERROR) {
-                    RTT_LOG_INFO("ADSTASK: Init ADC 0 error 0x%04X", err)
+                    RTT_LOG_INFO("ADSTASK: ADC not ready after power up, error 0x%04X", err);
+                    break;
                 }
-                err = ads1298_init(m_adc1_handle, &adc1_cfg);
-                if(err != ERR_NOERROR) {
-                    RTT_LOG_INFO("ADSTASK: Init ADC 1 error 0x%04X", err)
+                sysBootMark(SYS_BOOT_ADC_READY);
+                for(uint8_t i = 0; i < ADS129X_CNT; i++)
+                {
+                    uint8_t regs[ADS129X_REG_CNT];
+                    ads129x_handle_t handle = adc_handle((adstask_adc_no_e)i);
+                  
+                    m_ops[i] = NULL;
+                    // при теплом старте АЦП могут остаться в STANDBY с прошлого сеанса, при холодном команда ничего не меняет
+                    ads129x_cmd(handle, ADS129X_CMD_WAKEUP, ADSTASK_ACCESS_TO_SPI_TIMEOUT_MS);
+                    err = ads_chip_detect(handle, &m_ops[i]);
+                    if(err == ERR_NOERROR) {
+                        m_ops[i]->def_config(regs);
+                        board_config((adstask_adc_no_e)i, m_ops[i], regs);
+                        err = ads_chip_init(m_ops[i], handle, regs);
+                    }
+                    if(err != ERR_NOERROR) {
+                        RTT_LOG_INFO("ADSTASK: Init ADC %d error 0x%04X", i, err);
+                        m_ops[i] = NULL;
+                        if(i == ADSTASK_ADC_MASTER) break;
+                        continue;
+                    }
+                    m_adc_cnt++;
+                    RTT_LOG_INFO("ADSTASK: ADC %d is %s, %d SPS", i, m_ops[i]->name, ads_chip_rate(m_ops[i], regs));
+                }
+                if(m_ops[ADSTASK_ADC_MASTER] == NULL) {
+                    m_adc_cnt = 0;
                     break;
                 }
-                RTT_LOG_INFO("ADSTASK: Init ADC 0 and ADC 1 COMPLETE");
+                RTT_LOG_INFO("ADSTASK: Init COMPLETE, %d of %d ADC, %d channels", m_adc_cnt, ADS129X_CNT, m_adc_cnt * ADS129X_CH_CNT);
+                m_scrub_tick = xTaskGetTickCount();
+                sysBootMark(SYS_BOOT_ADC_CFG);
+                pwr_idle(); // АЦП включены при инициализации модуля
             }
             break;
             
-            case ADS_TASK_CMD_GET_CFG:   // запрос конфига
+            case ADS_TASK_CMD_SET_CFG:   // установка нового конфига
             {
-              ads_cmd_cfg_t *cmd_args = (ads_cmd_cfg_t *)cmd.args;
-              uint16_t err = ERR_UNKNOWN;
-              do{
-                if(cmd_args == NULL) break;
-                
-                ads129x_handle_t handle = NULL;
-                switch(cmd_args->adc_no)
-                {
-                  case ADSTASK_ADC_MASTER:
-                    handle = m_adc0_handle;
-                  break;
-                  
-                  case ADSTASK_ADC_SLAVE:
-                    handle = m_adc1_handle;
-                  break;
-                  
-                  default:
-                    err = ERR_INVALID_PARAMETR;
-                    break;
-                }
-                if(handle == NULL) break;
-                
-                err = ads1298_get_regs(handle, ADS1298_REG_ID, ADS1298_REG_LAST + 1, (uint8_t *)cmd_args->buff);
-                if(err != ERR_NOERROR)
-                {
-                  RTT_LOG_INFO("ADSTASK: Read regs error 0x%04X", err);
-                  break;
-                }
-              }while(0);
-              
+              uint16_t err = ERR_INVALID_PARAMETR;
+              if(cmd.args != NULL) {
+                  // выключенные АЦП не принимают WREG: включаю на время записи
+                  if(m_pwr == ADS_TASK_PWR_OFF) err = pwr_set(ADS_TASK_PWR_READY);
+                  else err = ERR_NOERROR;
+                  if(err == ERR_NOERROR) err = apply_image((const ads_task_cfg_image_t *)cmd.args);
+                  pwr_idle();
+              }
               xQueueSend(m_q_res, &err, 0);
             }
             break;
             
-            case ADS_TASK_CMD_SET_CFG:   // установка нового конфига
-              
+            case ADS_TASK_CMD_POWER: // уровень питания вне измерений
+                m_pwr_idle = (ads_task_pwr_e)(uint32_t)cmd.args;
+                RTT_LOG_INFO("ADS_TASK_CMD_POWER %d", m_pwr_idle);
+                if(m_adc_cnt) pwr_idle(); // до инициализации уровень применится в ADS_TASK_CMD_INIT
             break;
             
             default:    
@@ -443,26 +1071,31 @@ uint16_t ads_task_init(ads_task_callback_t callback)
     uint16_t err;
 
     do{
-        err = spiInit(&m_spiDevID, SPIM3, SPIM3_IRQn, SPIM3_PRIORITY, SPIM3_FREQUENCY);
+        memset(m_spiDevID, 0xFF, sizeof(m_spiDevID));
+        for(uint8_t i = 0; i < ADS129X_BUS_CNT; i++)
+        {
+            err = spiInit(&m_spiDevID[i], m_bus[i].spim, m_bus[i].irqn, m_bus[i].prior, m_bus[i].freq);
+            if(err != ERR_NOERROR) {
+                m_spiDevID[i] = 0xFF;
+                break;
+            }
+        }
         if(err != ERR_NOERROR)
         {
-          RTT_LOG_INFO("ADSTASK: Can't init SPIM3!");
+          RTT_LOG_INFO("ADSTASK: Can't init SPI bus!");
           break;
         }
         
-        ADS129X_PWDN_OFF(); // режим пониженного потребления выключен
-        ADS129X_RESET_OFF(); // сброс выключен
-
-        ANA_PWR_ON(); // подаю напряжение на аналоговую часть
-        
-        vTaskDelay(pdMS_TO_TICKS(1000)); // требование по даташиту после подачи питания
+        // подаю напряжение на аналоговую часть, если это не сделано раньше из main
+        // готовность АЦП ждет управляющая задача опросом регистра ID, поэтому здесь задержки нет
+        ads_task_pwr_on();
 
         // инициализация устройств на шине
-        err = ads129x_add(m_spiDevID, ADS129X_CS0_PIN, &m_adc0_handle);
-        if(err != ERR_NOERROR) {
-            break;
+        for(uint8_t i = 0; i < ADS129X_CNT; i++)
+        {
+            err = ads129x_add(m_spiDevID[m_adc_bus[i]], m_adc_cs_pin[i], &m_adc_handle[i]);
+            if(err != ERR_NOERROR) break;
         }
-        err = ads129x_add(m_spiDevID, ADS129X_CS1_PIN, &m_adc1_handle);
         if(err != ERR_NOERROR) {
             break;
         }
@@ -472,25 +1105,26 @@ uint16_t ads_task_init(ads_task_callback_t callback)
         sysSetGpioteHook(GPIOTE_CH_ADS129X, ads_rdy_isr);
         
         // создаю задачу для реализации логики работы
-        if(pdTRUE != xTaskCreate(ads_task, "ADS TASK", ADSTASK_STACK_SIZE, NULL, ADSTASK_PRIORITY, &m_ads_task)) {
+        m_ads_task = xTaskCreateStatic(ads_task, "ADS TASK", ADSTASK_STACK_SIZE, NULL, ADSTASK_PRIORITY, m_ads_task_stack, &m_ads_task_tcb);
+        if(m_ads_task == NULL) {
             err = ERR_OUT_OF_MEMORY;
             break;
         }
 
         // создаю очередь для управляющих команд
-        m_q_cmd = xQueueCreate(ADSTASK_CMD_QUEUE_SIZE, sizeof(ads_task_cmd_t));
+        m_q_cmd = xQueueCreateStatic(ADSTASK_CMD_QUEUE_SIZE, sizeof(ads_task_cmd_t), m_q_cmd_storage, &m_q_cmd_static);
         if(m_q_cmd == NULL) {
             err = ERR_OUT_OF_MEMORY;
             break;
         }
         
-        m_q_res = xQueueCreate(1, sizeof(uint16_t));
+        m_q_res = xQueueCreateStatic(1, sizeof(uint16_t), m_q_res_storage, &m_q_res_static);
         if(m_q_res == NULL) {
             err = ERR_OUT_OF_MEMORY;
             break;
         }
         
-        m_mutex = xSemaphoreCreateMutex();
+        m_mutex = xSemaphoreCreateMutexStatic(&m_mutex_static);
         if(m_mutex == NULL) {
             err = ERR_OUT_OF_MEMORY;
             break;
@@ -528,17 +1162,22 @@ uint16_t ads_task_deinit(void)
     // TODO запрещаю прерывания от АЦП
     // удаляю используемые ресурсы
     ANA_PWR_OFF();
-    if(m_adc0_handle) {
-        ads129x_remove(m_adc0_handle);
-        m_adc0_handle = NULL;
-    }
-    if(m_adc1_handle) {
-        ads129x_remove(m_adc1_handle);
-        m_adc1_handle = NULL;
+    m_pwr = ADS_TASK_PWR_OFF;
+    for(uint8_t i = 0; i < ADS129X_CNT; i++)
+    {
+        if(m_adc_handle[i]) {
+            ads129x_remove(m_adc_handle[i]);
+            m_adc_handle[i] = NULL;
+        }
+        m_ops[i] = NULL;
     }
-    if(m_spiDevID != 0xFF) {
-        spiDeInit(m_spiDevID);
-        m_spiDevID = 0xFF;
+    m_adc_cnt = 0;
+    for(uint8_t i = 0; i < ADS129X_BUS_CNT; i++)
+    {
+        if(m_spiDevID[i] != 0xFF) {
+            spiDeInit(m_spiDevID[i]);
+            m_spiDevID[i] = 0xFF;
+        }
     }
     if(m_ads_task) {
         vTaskDelete(m_ads_task);
@@ -601,6 +1240,44 @@ uint16_t ads_task_stop(void)
 }
 
 
+/**
+ * Чтение всех регистров АЦП в двоичном виде
+ * 
+ * adc_no - номер АЦП
+ * regs - буфер под значения регистров (адрес регистра равен индексу в буфере)
+ * regs_len - размер буфера (не меньше ADS129X_REG_CNT, регистры за пределами карты микросхемы заполняются нулями)
+ * timeout_ms - максимальное время ожидания доступа
+ * return
+ *  ERR_NOERROR - если ошибок нет
+ *  ERR_NOT_INITED - модуль не инициализирован
+ *  ERR_INVALID_PARAMETR - ошибка входных данных
+ *  ERR_TIMEOUT - таймаут ожидания доступа
+ *  ERR_INVALID_STATE - АЦП не инициализирован
+*/
+uint16_t ads_task_get_regs(adstask_adc_no_e adc_no, uint8_t *regs, uint8_t regs_len, uint32_t timeout_ms)
+{
+  // проверяю, была ли начальная инициализация
+  if(m_ads_task == NULL) return ERR_NOT_INITED;
+  if((regs == NULL) || (regs_len < ADS129X_REG_CNT)) return ERR_INVALID_PARAMETR;
+  if((uint8_t)adc_no >= ADS129X_CNT) return ERR_INVALID_PARAMETR;
+  
+  // значения берутся из теневой копии без обмена по SPI, поэтому запрос допустим и во время измерений;
+  // мьютекс не дает прочитать копию посреди применения нового конфига
+  if(pdTRUE != xSemaphoreTake(m_mutex, pdMS_TO_TICKS(timeout_ms))) return ERR_TIMEOUT;
+  
+  uint16_t err = ERR_INVALID_STATE;
+  ads129x_handle_t handle = adc_handle(adc_no);
+  if((handle != NULL) && (m_ops[adc_no] != NULL))
+  {
+    memset(regs, 0, ADS129X_REG_CNT);
+    err = ads129x_get_shadow(handle, ADS129X_REG_ID, m_ops[adc_no]->reg_cnt, regs);
+  }
+  
+  xSemaphoreGive(m_mutex);
+  return err;
+}
+
+
 /**
  * Запрос конфига
  * 
@@ -614,56 +1291,28 @@ uint16_t ads_task_stop(void)
  *  ERR_FIFO_OVF - переполнение очереди команд
  *  ERR_INVALID_PARAMETR - ошибка входных данных
  *  ERR_TIMEOUT - таймаут ожидания доступа
- *  ERR_INVALID_STATE - АЦП в процессе измерения
+ *  ERR_INVALID_STATE - АЦП не инициализирован
 */
 uint16_t ads_task_get_config(adstask_adc_no_e adc_no, char *cfg_str, uint8_t cfg_len_max, uint32_t timeout_ms)
 {
-  // проверяю, была ли начальная инициализация
-  if(m_ads_task == NULL) return ERR_NOT_INITED;
   if((cfg_str == NULL) || (cfg_len_max < 7)) return ERR_INVALID_PARAMETR;
-  if(m_is_started) return ERR_INVALID_STATE; // идет процесс измерений
-  if((uint8_t)adc_no >= ADS129X_CNT) return ERR_INVALID_PARAMETR;
-  
-  if(pdTRUE != xSemaphoreTake(m_mutex, pdMS_TO_TICKS(timeout_ms))) return ERR_TIMEOUT;
   
-  uint8_t buff[ADS1298_REG_LAST + 1]; // буфер под конфиг
+  uint8_t buff[ADS129X_REG_CNT]; // буфер под конфиг
   char regval[6]; // буфер для очередного значения
-  uint16_t err = ERR_NOERROR;
   
-  do{
-    
-    ads_cmd_cfg_t args = {
-      .adc_no = adc_no,
-      .buff = buff
-    };
-    
-    // отправляю задание на получение конфига
-    if(!ads_send_cmd_args(ADS_TASK_CMD_GET_CFG, &args)) 
-    {
-      err = ERR_FIFO_OVF;
-      break; // на выход, если очередь переоплнена
-    }
-    
-    if(pdTRUE != xQueueReceive(m_q_res, &err, pdMS_TO_TICKS(timeout_ms)))
-    {
-      err = ERR_TIMEOUT;
-      break;
-    }
-    
-    if(err != ERR_NOERROR) break; // чтение регистров не было выполнено
-    
-    snprintf(cfg_str, cfg_len_max, "%d", (uint8_t)adc_no);
-    // конфигурация прочитана в буфер, преобразую ее в заданный вид
-    for(uint8_t i = 0; i <= ADS1298_REG_LAST; i++)
-    {
-      snprintf(regval, sizeof(regval), ",%02X%02X", i, buff[i]);
-      if((strlen(cfg_str) + strlen(regval)) >= cfg_len_max) break;
-      strcat(cfg_str, regval);
-    }
-  }while(0);
+  uint16_t err = ads_task_get_regs(adc_no, buff, sizeof(buff), timeout_ms);
+  if(err != ERR_NOERROR) return err; // чтение регистров не было выполнено
   
-  xSemaphoreGive(m_mutex);
-  return err;
+  snprintf(cfg_str, cfg_len_max, "%d", (uint8_t)adc_no);
+  // конфигурация прочитана в буфер, преобразую ее в заданный вид
+  for(uint8_t i = 0; i < ads_task_get_reg_cnt(adc_no); i++)
+  {
+    snprintf(regval, sizeof(regval), ",%02X%02X", i, buff[i]);
+    if((strlen(cfg_str) + strlen(regval)) >= cfg_len_max) break;
+    strcat(cfg_str, regval);
+  }
+  
+  return ERR_NOERROR;
 }
 
 /**
@@ -687,33 +1336,176 @@ uint16_t ads_task_set_reg(adstask_adc_no_e adc_no, uint8_t reg_addr, uint8_t reg
   if(m_ads_task == NULL) return ERR_NOT_INITED;
   if(m_is_started) return ERR_INVALID_STATE; // идет процесс измерений
   if((uint8_t)adc_no >= ADS129X_CNT) return ERR_INVALID_PARAMETR;
-  if(reg_addr > ADS1298_REG_LAST) return ERR_INVALID_PARAMETR;
+  if(reg_addr >= ADS129X_REG_CNT) return ERR_INVALID_PARAMETR; // регистры за пределами карты микросхемы отклонит ads_chip_apply_image
+  
+  ads_task_cfg_image_t image;
+  memset(&image, 0, sizeof(image));
+  image.regs[adc_no][reg_addr] = reg_val;
+  image.mask[adc_no] = 1UL << reg_addr;
+  
+  return ads_task_apply_config(&image, timeout_ms);
+}
+
+
+/**
+ * Применение образа конфигурации к обоим АЦП одним заданием
+ * 
+ * image - образ конфигурации (значения и маска заданных регистров для каждого АЦП)
+ * timeout_ms - максимальное время ожидания начала выполенния задания
+ * return
+ *  ERR_NOERROR - если ошибок нет
+ *  ERR_NOT_INITED - модуль не инициализирован
+ *  ERR_FIFO_OVF - переполнение очереди команд
+ *  ERR_INVALID_PARAMETR - ошибка входных данных
+ *  ERR_TIMEOUT - таймаут ожидания доступа
+ *  ERR_INVALID_STATE - АЦП не инициализирован
+*/
+uint16_t ads_task_apply_config(const ads_task_cfg_image_t *image, uint32_t timeout_ms)
+{
+  // проверяю, была ли начальная инициализация
+  if(m_ads_task == NULL) return ERR_NOT_INITED;
+  if(image == NULL) return ERR_INVALID_PARAMETR;
+  
+  for(uint8_t i = 0; i < ADS129X_CNT; i++)
+  { // регистры за пределами карты конкретной микросхемы проверяются при применении образа
+    if(image->mask[i] >> ADS129X_REG_CNT) return ERR_INVALID_PARAMETR;
+  }
   
   if(pdTRUE != xSemaphoreTake(m_mutex, pdMS_TO_TICKS(timeout_ms))) return ERR_TIMEOUT;
   
   uint16_t err = ERR_NOERROR;
   
   do{
-    ads129x_handle_t handle = NULL;
-    switch(adc_no)
+    // отправляю задание на применение конфига (образ остается на стеке вызывающего до получения результата)
+    if(!ads_send_cmd_args(ADS_TASK_CMD_SET_CFG, (void *)image)) 
     {
-      case ADSTASK_ADC_MASTER:
-        handle = m_adc0_handle;
-      break;
-                  
-      case ADSTASK_ADC_SLAVE:
-        handle = m_adc1_handle;
+      err = ERR_FIFO_OVF;
+      break; // на выход, если очередь переоплнена
+    }
+    
+    if(pdTRUE != xQueueReceive(m_q_res, &err, pdMS_TO_TICKS(timeout_ms)))
+    {
+      err = ERR_TIMEOUT;
       break;
-                  
-      default:
-        err = ERR_INVALID_PARAMETR;
-        break;
-      }
-    if(handle == NULL) break;
-    err = ads1298_set_reg(handle, reg_addr, reg_val);
+    }
   }while(0);
   
   xSemaphoreGive(m_mutex);
-  return err;  
+  return err;
+}
+
+
+/**
+ * Количество сбоев регистров АЦП, обнаруженных при периодической сверке с теневой копией
+*/
+uint32_t ads_task_get_reg_err_cnt(void)
+{
+  return m_reg_err_cnt;
+}
+
+
+/**
+ * Описание микросхемы АЦП
+*/
+const ads_chip_ops_t *ads_task_get_chip(adstask_adc_no_e adc_no)
+{
+  if((uint8_t)adc_no >= ADS129X_CNT) return NULL;
+  return m_ops[adc_no];
 }
 
+
+/**
+ * Количество регистров АЦП
+*/
+uint8_t ads_task_get_reg_cnt(adstask_adc_no_e adc_no)
+{
+  const ads_chip_ops_t *ops = ads_task_get_chip(adc_no);
+  return (ops == NULL) ? 0 : ops->reg_cnt;
+}
+
+
+/**
+ * Количество каналов в отсчете
+*/
+uint8_t ads_task_get_ch_cnt(void)
+{
+  return m_adc_cnt * ADS129X_CH_CNT;
+}
+
+
+/**
+ * Количество пропущенных отсчетов
+*/
+uint32_t ads_task_get_overrun_cnt(void)
+{
+  return m_overrun_cnt + ads_stream_get_lost_cnt();
+}
+
+
+/**
+ * Период пробуждений потока при аппаратном чтении
+*/
+void ads_task_set_batch_ms(uint16_t period_ms)
+{
+  m_batch_ms = period_ms;
+}
+
+
+/**
+ * Количество пробуждений потока по данным АЦП
+*/
+uint32_t ads_task_get_wakeup_cnt(void)
+{
+  return m_wakeup_cnt;
+}
+
+
+/**
+ * Уровень питания АЦП вне измерений
+*/
+uint16_t ads_task_set_idle_power(ads_task_pwr_e pwr)
+{
+  if(m_ads_task == NULL) return ERR_NOT_INITED;
+  if(pwr > ADS_TASK_PWR_READY) return ERR_INVALID_PARAMETR;
+  if(!ads_send_cmd_args(ADS_TASK_CMD_POWER, (void *)(uint32_t)pwr)) return ERR_FIFO_OVF;
+  return ERR_NOERROR;
+}
+
+
+/**
+ * Ранняя подача аналогового питания
+*/
+void ads_task_pwr_on(void)
+{
+  if(m_pwr != ADS_TASK_PWR_OFF) return;
+  // программный сброс при включенном питании: АЦП не выключались, установление не нужно
+  m_warm_start = (NRF_POWER->RESETREAS & POWER_RESETREAS_SREQ_Msk) && (sysRetainedGet() & SYS_RETAINED_ANA_PWR);
+  ana_pwr_on(m_warm_start);
+}
+
+
+/**
+ * Теплый старт
+*/
+bool ads_task_is_warm_start(void)
+{
+  return m_warm_start;
+}
+
+
+/**
+ * Текущий уровень питания АЦП
+*/
+ads_task_pwr_e ads_task_get_power(void)
+{
+  return m_pwr;
+}
+
+
+/**
+ * Время от запуска до первого отсчета
+*/
+uint32_t ads_task_get_wake_latency_ms(void)
+{
+  return m_wake_latency_ms;
+}
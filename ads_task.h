@@ -2,24 +2,34 @@
 #define ADS_TASK_H
 
 /**
- * Модуль реализует логику работы с двумя АЦП
+ * Модуль реализует логику работы с ADS129X_CNT АЦП на общей шине SPI
 */
 
 
 #include <stdbool.h>
 #include <stdint.h>
 #include "ads129x.h"
-//#include "ads1299.h"
+#include "ads_chip.h"
+#include "custom_board.h" // ADS129X_CNT
 
 
-/// формат выходных данных от двух АЦП
+#define ADSTASK_CH_MAX      (ADS129X_CNT * ADS129X_CH_CNT)  ///< максимальное количество каналов в одном отсчете
+
+
+/// формат выходных данных от всех найденных АЦП (один отсчет)
 typedef struct {
-  uint32_t   adc0_status;
-  uint32_t   adc1_status;
-  int32_t    adc0[ADS129X_CH_CNT];
-  int32_t    adc1[ADS129X_CH_CNT];
+  uint8_t    adc_cnt;                 ///< количество АЦП, от которых получены данные
+  uint8_t    ch_cnt;                  ///< количество каналов в ch (adc_cnt * ADS129X_CH_CNT)
+  uint32_t   status[ADS129X_CNT];     ///< слова состояния АЦП в порядке следования в ch
+  int32_t    ch[ADSTASK_CH_MAX];      ///< каналы: сначала все каналы первого найденного АЦП, затем следующего и т.д.
+  uint16_t   loff[ADS129X_CNT];       ///< состояние электродов после антидребезга в порядке следования в ch: (LOFF_STATP << 8) | LOFF_STATN, 1 - электрод отключен
+  bool       loff_changed;            ///< loff изменилось на этом отсчете (первое состояние после запуска тоже считается изменением)
+  bool       resp_ready;              ///< на этом отсчете готов отсчет канала дыхания (resp, resp_rate)
+  int32_t    resp;                    ///< отсчет канала дыхания: канал 1 ведущего АЦП, усредненный за период децимации (ADSTASK_RESP_SPS)
+  uint16_t   resp_rate;               ///< оценка частоты дыхания, вдохов в минуту * 10 (0 - не определена)
 } adstask_data_t;
 
+/// номер АЦП (0..ADS129X_CNT-1), ведущий АЦП всегда нулевой
 typedef enum {
   ADSTASK_ADC_MASTER = 0,
   ADSTASK_ADC_SLAVE = 1
@@ -28,6 +38,20 @@ typedef enum {
 
 typedef void (*ads_task_callback_t)(adstask_data_t *args);
 
+/// уровень питания АЦП
+typedef enum {
+  ADS_TASK_PWR_OFF = 0,     ///< аналоговое питание выключено, АЦП в режиме Power Down (при включении регистры восстанавливаются из теневой копии)
+  ADS_TASK_PWR_STANDBY,     ///< АЦП в режиме STANDBY (регистры и опорное напряжение сохраняются, пробуждение командой WAKEUP)
+  ADS_TASK_PWR_READY,       ///< АЦП включены, измерения не идут
+  ADS_TASK_PWR_STREAMING,   ///< идут измерения
+} ads_task_pwr_e;
+
+/// образ конфигурации всех АЦП для ads_task_apply_config()
+typedef struct {
+  uint8_t   regs[ADS129X_CNT][ADS129X_REG_CNT]; ///< значения регистров (индекс - адрес регистра)
+  uint32_t  mask[ADS129X_CNT];                  ///< маска заданных регистров (бит n - регистр n), незаданные регистры не меняются
+} ads_task_cfg_image_t;
+
 
 
 
@@ -75,6 +99,25 @@ uint16_t ads_task_start(bool single_shot);
 uint16_t ads_task_stop(void);
 
 
+/**
+ * @brief Чтение всех регистров АЦП в двоичном виде
+ * 
+ * Значения берутся из теневой копии регистров без обмена по SPI, поэтому запрос допустим и во время измерений
+ * (регистры LOFF_STATP/LOFF_STATN отражают состояние на момент последнего чтения из микросхемы)
+ * @param adc_no - номер АЦП
+ * @param regs - буфер под значения регистров (адрес регистра равен индексу в буфере)
+ * @param regs_len - размер буфера (не меньше ADS129X_REG_CNT, регистры за пределами карты микросхемы заполняются нулями)
+ * @param timeout_ms - максимальное время ожидания доступа
+ * @return
+ *  ERR_NOERROR - если ошибок нет
+ *  ERR_NOT_INITED - модуль не инициализирован
+ *  ERR_INVALID_PARAMETR - ошибка входных данных
+ *  ERR_TIMEOUT - таймаут ожидания доступа
+ *  ERR_INVALID_STATE - АЦП не инициализирован
+*/
+uint16_t ads_task_get_regs(adstask_adc_no_e adc_no, uint8_t *regs, uint8_t regs_len, uint32_t timeout_ms);
+
+
 /**
  * @brief Запрос конфига
  * 
@@ -88,7 +131,7 @@ uint16_t ads_task_stop(void);
  *  ERR_FIFO_OVF - переполнение очереди команд
  *  ERR_INVALID_PARAMETR - ошибка входных данных
  *  ERR_TIMEOUT - таймаут ожидания доступа
- *  ERR_INVALID_STATE - АЦП в процессе измерения
+ *  ERR_INVALID_STATE - АЦП не инициализирован
 */
 uint16_t ads_task_get_config(adstask_adc_no_e adc_no, char *cfg_str, uint8_t cfg_len_max, uint32_t timeout_ms);
 
@@ -106,10 +149,156 @@ uint16_t ads_task_get_config(adstask_adc_no_e adc_no, char *cfg_str, uint8_t cfg
  *  ERR_FIFO_OVF - переполнение очереди команд
  *  ERR_INVALID_PARAMETR - ошибка входных данных
  *  ERR_TIMEOUT - таймаут ожидания доступа
- *  ERR_INVALID_STATE - АЦП в процессе измерения
+ *  ERR_INVALID_STATE - АЦП не инициализирован
+ * 
+ * Выполняется через ads_task_apply_config(), поэтому допускается во время измерений
 */
 uint16_t ads_task_set_reg(adstask_adc_no_e adc_no, uint8_t reg_addr, uint8_t reg_val, uint32_t timeout_ms);
 
 
+/**
+ * @brief Применение образа конфигурации ко всем АЦП одним заданием
+ * 
+ * @param image - образ конфигурации (значения и маска заданных регистров для каждого АЦП)
+ * @param timeout_ms - максимальное время ожидания начала выполенния задания
+ * @return
+ *  ERR_NOERROR - если ошибок нет
+ *  ERR_NOT_INITED - модуль не инициализирован
+ *  ERR_FIFO_OVF - переполнение очереди команд
+ *  ERR_INVALID_PARAMETR - ошибка входных данных
+ *  ERR_TIMEOUT - таймаут ожидания доступа
+ *  ERR_INVALID_STATE - АЦП не инициализирован
+ * 
+ * Образ сравнивается с теневой копией регистров, записываются только измененные регистры пакетами WREG.
+ * Допускается во время измерений: на время записи обслуживание DRDY приостанавливается.
+*/
+uint16_t ads_task_apply_config(const ads_task_cfg_image_t *image, uint32_t timeout_ms);
+
+
+/**
+ * @brief Количество сбоев регистров АЦП
+ * 
+ * Регистры периодически (ADSTASK_SCRUB_PERIOD_MS) сверяются с теневой копией, при расхождении
+ * (сбой по питанию, одиночный сбой) регистры восстанавливаются из теневой копии и счетчик увеличивается
+ * @return
+ *  количество обнаруженных сбоев с момента запуска
+*/
+uint32_t ads_task_get_reg_err_cnt(void);
+
+
+/**
+ * @brief Описание микросхемы АЦП, определенной по регистру ID при инициализации
+ * 
+ * @param adc_no - номер АЦП
+ * @return
+ *  описание микросхемы или NULL, если АЦП не инициализирован
+*/
+const ads_chip_ops_t *ads_task_get_chip(adstask_adc_no_e adc_no);
+
+
+/**
+ * @brief Количество регистров АЦП (размер карты регистров микросхемы)
+ * 
+ * @param adc_no - номер АЦП
+ * @return
+ *  количество регистров или 0, если АЦП не инициализирован
+*/
+uint8_t ads_task_get_reg_cnt(adstask_adc_no_e adc_no);
+
+
+/**
+ * @brief Количество каналов в отсчете (по числу найденных при инициализации АЦП)
+ * 
+ * Нужен для разметки пакетов до прихода первого отсчета
+ * @return
+ *  количество каналов или 0, если АЦП еще не инициализированы
+*/
+uint8_t ads_task_get_ch_cnt(void);
+
+
+/**
+ * @brief Количество пропущенных отсчетов
+ * 
+ * Кадры АЦП читаются по DRDY из прерывания в двойной буфер. Отсчет пропускается, если к следующему DRDY
+ * предыдущий отсчет еще читается по SPI или поток еще не обработал буфер, в который нужно читать.
+ * При аппаратном чтении (ads_stream) добавляются отсчеты, потерянные при паузах и простоях кольца
+ * @return
+ *  количество пропущенных отсчетов с момента запуска
+*/
+uint32_t ads_task_get_overrun_cnt(void);
+
+
+/**
+ * @brief Период пробуждений потока при аппаратном чтении кадров
+ * 
+ * Отсчеты копятся в кольце ads_stream, поток просыпается раз на пачку. Пачка считается при запуске измерений
+ * по частоте выборки: period_ms * SPS / 1000 отсчетов, от 1 до ADS_STREAM_BATCH. Удобно задавать интервал
+ * соединения BLE, чтобы на каждое событие соединения приходилось одно пробуждение.
+ * Новое значение действует со следующего запуска измерений.
+ * @param period_ms - период, мс (0 - максимальная пачка ADS_STREAM_BATCH)
+*/
+void ads_task_set_batch_ms(uint16_t period_ms);
+
+
+/**
+ * @brief Количество пробуждений потока по данным АЦП (по отсчету при чтении по прерыванию, по пачке при аппаратном)
+ * @return
+ *  количество пробуждений с момента запуска
+*/
+uint32_t ads_task_get_wakeup_cnt(void);
+
+
+/**
+ * @brief Уровень питания АЦП вне измерений
+ * 
+ * Запуск измерений включает АЦП из любого уровня (OFF -> READY с восстановлением регистров из теневой копии,
+ * STANDBY -> READY командой WAKEUP), останов возвращает АЦП на заданный уровень. Изменение конфига
+ * при выключенных АЦП временно их включает. После инициализации уровень - ADS_TASK_PWR_OFF.
+ * @param pwr - уровень питания (ADS_TASK_PWR_OFF, ADS_TASK_PWR_STANDBY или ADS_TASK_PWR_READY)
+ * @return
+ *  ERR_NOERROR - если ошибок нет
+ *  ERR_NOT_INITED - модуль не инициализирован
+ *  ERR_INVALID_PARAMETR - ошибка входных данных
+ *  ERR_FIFO_OVF - переполнение очереди команд
+*/
+uint16_t ads_task_set_idle_power(ads_task_pwr_e pwr);
+
+
+/**
+ * @brief Ранняя подача аналогового питания АЦП (можно вызывать до запуска планировщика и SoftDevice)
+ * 
+ * Аналоговая часть устанавливается, пока запускаются остальные задачи и стек BLE. Если не вызвана,
+ * питание подается в ads_task_init(). Повторные вызовы ничего не делают.
+*/
+void ads_task_pwr_on(void);
+
+
+/**
+ * @brief Теплый старт: программный сброс при включенном аналоговом питании АЦП
+ * 
+ * При теплом старте запуск измерений не ждет установления аналоговой части (ADSTASK_ANA_SETTLE_MS)
+*/
+bool ads_task_is_warm_start(void);
+
+
+/**
+ * @brief Текущий уровень питания АЦП
+*/
+ads_task_pwr_e ads_task_get_power(void);
+
+
+/**
+ * @brief Время от команды запуска до первого отсчета в последнем запуске измерений
+ * 
+ * Включает пробуждение АЦП (восстановление регистров при выходе из OFF) и при аппаратном чтении - набор первой пачки
+ * @return
+ *  время, мс (0 - отсчетов после запуска еще не было)
+*/
+uint32_t ads_task_get_wake_latency_ms(void);
+
+
+/// @brief Размер очередей команд и результата в байтах (бюджет ОЗУ)
+extern const uint32_t ads_task_ram_size;
+
 
 #endif
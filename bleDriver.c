@@ -1,7 +1,7 @@
 /*
 Драйвер для работы с BLE
 Поддерживает одно входящее соединение
-Поддерживаются сервисы NUS, BAS и DIS
+Поддерживаются сервисы NUS, ECGS, BAS и DIS
 Управление соединениями происходит через conn_handle
 
 
@@ -9,12 +9,15 @@
 
 
 ОГРАНИЧЕНИЯ
-- пока поддерживается только одно соединение (NRF_SDH_BLE_TOTAL_LINK_COUNT должно быть равно 1)
+- поддерживаются только входящие соединения (NRF_SDH_BLE_TOTAL_LINK_COUNT равно NRF_SDH_BLE_PERIPHERAL_LINK_COUNT)
+- буферы SoftDevice делятся между соединениями по очереди, не больше BLE_TX_QUANTUM нотификаций соединения за проход
 
 
 ВОЗМОЖНОСТИ
 - для всех соединений поддерживается NUS
 - для каждого установленного соединения верхний уровень может задать приемный и/или передающий буфер для обмена через NUS
+- сервис ECGS (ble_ecgs.c): кадры ECGS передаются через его характеристику DATA (формат блока и путь выбирает верхний уровень),
+  команды, записанные в характеристику CTRL, попадают в тот же приемный буфер, что и команды NUS, а ответы уходят туда, откуда пришла последняя команда
 
 ОСОБЕННОСТИ
 - в целях безопасности, ребондинг запрещен (повторный бондинг ранее забинденных устройств, если они потеряли информацию о бондинге)
@@ -25,6 +28,7 @@
 - на верхнем уровне, в обработчике события BLE_EVENT_TYPE_CONNECT необходимо задать приемный и передающий буферы сервиса NUS (с помощью bleSetNusBuffers), иначе даже событий не будет
 - при возникновении события PM_EVT_STORAGE_FULL, на уровне SDK происходит запуск функции очистки флеша от мусора и удаление самого редко используемого бондинга (если включено ранжирование
 подключающихся устройств)
+- поток передачи не крутится в цикле при заполненных буферах SoftDevice: он ждет BLE_GATTS_EVT_HVN_TX_COMPLETE, по которому ведется учет отправленных нотификаций
 - количество передающих буферов определяется константой NRF_SDH_BLE_GAP_EVENT_LENGTH (задается в sdk_config.h), больше 40 ставить не имеет смысла на битовой скорости 1М (при таких
 настройках скорость передачи получилась около 670 кБит/сек)
 
@@ -53,6 +57,7 @@
 #include "ble_db_discovery.h"
 #include "ble_nus.h"
 #include "ble_nus_c.h"
+#include "ble_ecgs.h"
 #include "ble_dis.h"
 #include "ble_bas.h"
 #include "ble_conn_state.h"
@@ -73,6 +78,7 @@
 // НАСТРОЙКИ МОДУЛЯ ************************************
 #define BLE_TX_ERROR_MAX          10    // максимальное количество ошибок в процессе передачи
 #define BLE_TX_ERROR_TIMEOUT_MS   100   // таймаут следующей попытки передачи при возникновении ошибки (скорость передачи по другим открытым соединениям также замедлится)
+#define BLE_TX_QUANTUM            4     // нотификаций одного соединения за проход по соединениям (чтобы быстрое соединение не занимало все буферы SoftDevice)
 #define PASS_KEY_DEF              "123456" // дефолтный ключ для аутентификации при сопряжении (если выбран этот режим)
 
 #if(RTTLOG_EN)
@@ -114,6 +120,10 @@
 #define NUSTX_STACK_SIZE                256                                             // стек для процесса передачи данных по BLE
 #endif
 
+#ifndef BLE_TX_BLK_QUEUE_SIZE
+#define BLE_TX_BLK_QUEUE_SIZE           16                                              // длина очереди блоков на передачу для каждого соединения
+#endif
+
 
 // Информация об устройстве находится в settings.h
 
@@ -162,15 +172,29 @@ typedef struct
   bool                    is_connected;                   // флаг текущего подключения
   ble_gap_addr_t          address;                        // МАК адрес подключенного устройства (только для исходящих)
   uint16_t                nus_max_data_len;               /**< Maximum length of data (in bytes) that can be transmitted to the peer by the Nordic UART service module. */
+  uint16_t                conn_interval;                  // интервал соединения в единицах 1.25 мс
   uint8_t                 tx_data[BLE_NUS_MAX_DATA_LEN];  // буфер для временного хранения данных во время передачи
   uint16_t                tx_data_len;                    // длина данных во временном буфере
   bool                    is_bonded;                      // флаг предварительно забинденного устройства
+  pm_peer_id_t            peer_id;                        // идентификатор сопряженного устройства в Peer Manager (при is_bonded)
   StreamBufferHandle_t    tx_stream_buff_handle;          // хендл буфера для передачи
   StreamBufferHandle_t    rx_stream_buff_handle;          // хендл буфера для приема
   SemaphoreHandle_t       tx_done_sema;                   // семафор окончания передачи
   uint32_t                tx_error_cnt;                   // счетчик ошибок передачи
+  blk_t                   *tx_blk;                        // блок из пула, который передается в данный момент
+  bool                    tx_blk_stream;                  // tx_blk - кадр ECGS (одна нотификация характеристики DATA)
+  uint16_t                tx_blk_offset;                  // смещение еще не переданной части блока
+  uint16_t                tx_inflight;                    // количество нотификаций, отданных в SoftDevice, но еще не переданных (нет BLE_GATTS_EVT_HVN_TX_COMPLETE)
+  bool                    tx_pending;                     // флаг, что с момента последнего BLE_EVENT_TYPE_TX_DONE были переданы новые данные
+  bool                    rsp_via_ecgs;                   // последняя команда пришла через характеристику CTRL сервиса ECGS, ответы передаются туда же
 } ble_conn_t;
 
+typedef struct
+{ // элемент очереди блоков на передачу
+  blk_t                   *blk;                           // блок из пула
+  bool                    stream;                         // блок - кадр ECGS (иначе передается через NUS)
+} tx_blk_item_t;
+
 typedef struct // НАСТРАИВАЕМЫЕ ПАРАМЕТРЫ ЭДВЕРТАЙЗИНГА
 {
   char          device_name[15];  // имя при эдвертайзинге (размер с потолка: чем меньше, тем больше войдет другой инфы)
@@ -181,8 +205,20 @@ typedef struct // НАСТРАИВАЕМЫЕ ПАРАМЕТРЫ ЭДВЕРТАЙ
   uint32_t      max_conn_interval_ms; // максимальный интервал после подключения
   blePwr_t      pwrConn;          // мощность после установления соединения
   bool          conn_en;          // флаг разрешения подключения
+  bool          ext;              // расширенный эдвертайзинг (Bluetooth 5)
+  uint8_t       primary_phy;      // PHY первичных каналов расширенного эдвертайзинга (BLE_GAP_PHY_1MBPS или BLE_GAP_PHY_CODED)
+  uint8_t       secondary_phy;    // PHY вторичного канала с данными (BLE_GAP_PHY_1MBPS, BLE_GAP_PHY_2MBPS или BLE_GAP_PHY_CODED)
+  uint8_t       manuf_data[BLE_ADV_EXT_MANUF_DATA_MAX]; // данные производителя (сохраняются для перезапуска эдвертайзинга по таймауту)
+  uint8_t       manuf_data_len;   // длина данных производителя
 } adv_params_t;
 
+typedef enum
+{ // фазы эдвертайзинга после отключения (быстрое переподключение)
+  ADV_PHASE_NORMAL = 0,   // обычный эдвертайзинг с параметрами m_adv_params
+  ADV_PHASE_DIRECTED,     // высокоскоростной направленный последнему сопряженному устройству
+  ADV_PHASE_WHITELIST,    // частый ненаправленный, подключение только из белого списка
+} adv_phase_e;
+
 
 
 // NRF_BLE_GQ_DEF(m_ble_gatt_queue,                          /**< BLE GATT Queue instance. */
@@ -193,12 +229,20 @@ NRF_BLE_QWRS_DEF(m_qwr, NRF_SDH_BLE_TOTAL_LINK_COUNT);    /**< Context for the Q
 // ***** ADVERTISING *****
 static ble_gap_adv_params_t m_gap_adv_params;               /**< Parameters to be passed to the stack when starting advertising. */
 static uint8_t              m_adv_handle = BLE_GAP_ADV_SET_HANDLE_NOT_SET; /**< Advertising handle used to identify an advertising set. */
-static uint8_t              m_enc_advdata[BLE_GAP_ADV_SET_DATA_SIZE_MAX];  /**< Buffer for storing an encoded advertising set. */
-static uint8_t              m_enc_srdata[BLE_GAP_ADV_SET_DATA_SIZE_MAX];  /**< Buffer for storing an encoded scan set. */ 
+// буферы двойные: обновить данные во время эдвертайзинга SoftDevice разрешает только с новыми буферами
+static uint8_t              m_enc_advdata[2][BLE_GAP_ADV_SET_DATA_SIZE_EXTENDED_MAX_SUPPORTED];  /**< Buffer for storing an encoded advertising set. */
+static uint8_t              m_enc_srdata[2][BLE_GAP_ADV_SET_DATA_SIZE_MAX];  /**< Buffer for storing an encoded scan set. */ 
+static uint8_t              m_adv_buf = 0;              // индекс буферов, переданных SoftDevice (меняется только после успешной настройки)
+static bool                 m_adv_data_valid = false;   // буферы m_adv_data собраны по текущим параметрам (перезапуск без пересборки)
+static bool                 m_adv_gap_valid = false;    // параметры GAP установлены по текущим параметрам
+static adv_phase_e          m_adv_phase = ADV_PHASE_NORMAL; // фаза эдвертайзинга
+static pm_peer_id_t         m_last_peer_id = PM_PEER_ID_INVALID; // последнее отключившееся сопряженное устройство
+static uint32_t             m_adv_peer_cnt = 0;         // устройств в белом списке
 // ***********************
 // BLE_DB_DISCOVERY_DEF(m_db_disc);                          /**< Database discovery module instance. */
 BLE_BAS_DEF(m_bas);                                       /**< Battery service instance. */
 BLE_NUS_DEF(m_nus, NRF_SDH_BLE_PERIPHERAL_LINK_COUNT);    // NUS Perephiral
+BLE_ECGS_DEF(m_ecgs);                                     // сервис потоковой передачи данных ЭКГ
 
 
 static ble_conn_t     m_connected_peers[NRF_BLE_LINK_COUNT];    /**< Array of connected peers. */
@@ -206,6 +250,13 @@ static ble_conn_t     m_connected_peers[NRF_BLE_LINK_COUNT];    /**< Array of co
 static TaskHandle_t   m_nus_tx_thread = NULL;                   // хендлер задачи передачи данных по каналам NUS
 static bool           m_paring_en = false;                      // флаг разрешения спаривания с новыми устройствами
 static adv_params_t   m_adv_params;                             // параметры эдвертайзинга
+static StackType_t    m_nus_tx_stack[NUSTX_STACK_SIZE];         // стек задачи передачи данных (выделяется статически)
+static StaticTask_t   m_nus_tx_tcb;
+// очереди блоков на передачу (живут отдельно от m_connected_peers, так как структура пира обнуляется при отключении)
+static QueueHandle_t  m_tx_blk_queue[NRF_BLE_LINK_COUNT];
+static uint8_t        m_tx_blk_queue_storage[NRF_BLE_LINK_COUNT][BLE_TX_BLK_QUEUE_SIZE * sizeof(tx_blk_item_t)];
+static StaticQueue_t  m_tx_blk_queue_static[NRF_BLE_LINK_COUNT];
+const uint32_t        bleDriverRamSize = sizeof(m_tx_blk_queue_storage);
 
 
 /**@brief Struct that contains pointers to the encoded advertising data. */
@@ -213,12 +264,12 @@ static ble_gap_adv_data_t m_adv_data =
 {
     .adv_data =
     {
-        .p_data = m_enc_advdata,
+        .p_data = m_enc_advdata[0],
         .len    = BLE_GAP_ADV_SET_DATA_SIZE_MAX
     },
     .scan_rsp_data =
     {
-        .p_data = m_enc_srdata,
+        .p_data = m_enc_srdata[0],
         .len    = BLE_GAP_ADV_SET_DATA_SIZE_MAX
 
     }
@@ -259,12 +310,20 @@ static ret_code_t battery_service_init(void);                 // инициал
 // объекты NUS
 static ret_code_t nus_init(void);                             // инициализация сервиса NUS perephiral
 static void nus_data_handler(ble_nus_evt_t * p_evt);          // Function for handling the data from the Nordic UART Service
+static ret_code_t ecgs_init(void);                            // инициализация сервиса ECGS
+static void ecgs_evt_handler(ble_ecgs_evt_t * p_evt);         // обработчик событий сервиса ECGS
+static void rx_data_push(uint16_t conn_handle, uint8_t const *p_data, uint16_t length); // передача принятых команд в приемный буфер соединения
+static ret_code_t blk_data_send(uint16_t conn_handle, bool stream, uint8_t *p_data, uint16_t *p_length); // передача части блока через ECGS или NUS
+static ret_code_t stream_data_send(uint16_t conn_handle, uint8_t *p_data, uint16_t *p_length); // передача данных потокового буфера через ECGS или NUS
 static ret_code_t services_init(void);                        // инициализация ВСЕХ сервисов
 // вспомогательные функции
 static bool is_already_connected(ble_gap_addr_t const * p_connected_adr); // возвращает TRUE, если устройство с таким адресом уже подключено
 static void multi_qwr_conn_handle_assign(uint16_t conn_handle); // Function for assigning new connection handle to the available instance of QWR module
 static ret_code_t qwr_init(void); // Function for initializing the Queued Write instances
 static uint16_t setDefPassKey(const char *passKey); // установка дефолтного пароля для сопряжения
+static void tx_blk_release(uint16_t conn_handle); // возврат в пул всех блоков соединения, ожидающих передачи
+static void tx_inflight_add(uint16_t conn_handle); // учет нотификации, отданной в SoftDevice
+static void tx_done_check(uint16_t conn_handle); // проверка окончания передачи всех данных соединения
 // обработчики событий от BLE
 static void on_ble_evt(uint16_t conn_handle, ble_evt_t const * p_ble_evt); // обработчик BLE Stack эвентов
 static void on_ble_peripheral_evt(ble_evt_t const * p_ble_evt); // обработчик BLE Stack эвентов относящихся к перефирийному устройству
@@ -272,6 +331,13 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context); // F
 // стек BLE, GAP, GATT
 static ret_code_t ble_stack_init(void); // инициализация BLE стека
 static ret_code_t gap_params_init(const char *deviceName, uint32_t min_conn_interval, uint32_t max_conn_interval); // Function for initializing the GAP
+static ret_code_t adv_data_encode(void); // сборка данных эдвертайзинга и scan response в свободные буферы
+static ret_code_t adv_set_configure(ble_gap_adv_data_t const *p_adv_data, ble_gap_adv_params_t const *p_adv_params); // настройка набора эдвертайзинга
+static uint8_t adv_manuf_data_max(bool conn_en); // максимальная длина данных производителя в текущем режиме эдвертайзинга
+static ret_code_t adv_undirected_start(uint32_t interval_ms, uint32_t duration_ms, uint8_t filter_policy); // запуск ненаправленного эдвертайзинга с готовыми данными
+static uint32_t adv_peers_load(void); // белый список из сопряженных устройств
+static ret_code_t adv_directed_start(void); // направленный эдвертайзинг последнему сопряженному устройству
+static ret_code_t adv_phase_start(adv_phase_e phase); // запуск фазы быстрого переподключения
 static void gatt_evt_handler(nrf_ble_gatt_t * p_gatt, nrf_ble_gatt_evt_t const * p_evt); // Function for handling events from the GATT library
 static ret_code_t gatt_init(void); // Function for initializing the GATT module
 static void on_conn_params_evt(ble_conn_params_evt_t * p_evt); // Function for handling the Connection Parameters Module
@@ -366,6 +432,11 @@ static void pm_evt_handler(pm_evt_t const * p_evt)
         case PM_EVT_CONN_SEC_SUCCEEDED:
           // установлено защищенное соединение с ранее забинденным устройством
           RTT_LOG_DEBUG("PM_EVT: PM_EVT_CONN_SEC_SUCCEEDED");
+          if(p_evt->peer_id != PM_PEER_ID_INVALID)
+          { // новое сопряжение: устройство попадет в быстрое переподключение
+            m_connected_peers[p_evt->conn_handle].is_bonded = true;
+            m_connected_peers[p_evt->conn_handle].peer_id = p_evt->peer_id;
+          }
           // успешное подключение в качестве перефирийного
           // вызываю дополнительный обработчик
           if(m_callback)
@@ -382,6 +453,7 @@ static void pm_evt_handler(pm_evt_t const * p_evt)
         case PM_EVT_BONDED_PEER_CONNECTED:
           RTT_LOG_DEBUG("PM_EVT: PM_EVT_BONDED_PEER_CONNECTED");
           m_connected_peers[p_evt->conn_handle].is_bonded = true; // флаг сбрасывается при отключении устройства (вся структура заполняется нулями)
+          m_connected_peers[p_evt->conn_handle].peer_id = p_evt->peer_id;
         break;
         
         case PM_EVT_STORAGE_FULL: // переполнение хранилища информации о бондинге
@@ -491,36 +563,16 @@ static void nus_data_handler(ble_nus_evt_t * p_evt)
       {
         RTT_LOG_DEBUG("BLE_NUS_EVT_RX_DATA, conn_handle = %d", conn_handle);
         if(conn_handle >= NRF_BLE_LINK_COUNT) break;
-        if(m_connected_peers[conn_handle].rx_stream_buff_handle != NULL)
-        { // приемный буфер был задан
-         // отправляю полученные данные в очередь
-          if(xStreamBufferSpacesAvailable(m_connected_peers[conn_handle].rx_stream_buff_handle) >= p_evt->params.rx_data.length)
-          {
-            xStreamBufferSendFromISR(m_connected_peers[conn_handle].rx_stream_buff_handle, p_evt->params.rx_data.p_data, p_evt->params.rx_data.length, NULL);
-          }else{
-            RTT_LOG_INFO("BLE: rx data stream ofv");
-          }
-
-          //RTT_LOG_DEBUG("BLE: RX data %d bytes", p_evt->params.rx_data.length);
-          // вызываю callback
-          if(m_callback)
-          {
-            bleCallback_t args;
-            memset(&args, 0, sizeof(args));
-            args.conn_handle = conn_handle;
-            args.evtType = BLE_EVENT_TYPE_NUS_RX;
-            args.evtSrc = BLE_EVENT_SRC_PERIPHERAL;
-            m_callback(&args);
-          }
-        } // if
+        m_connected_peers[conn_handle].rsp_via_ecgs = false; // отвечаю через NUS
+        rx_data_push(conn_handle, p_evt->params.rx_data.p_data, p_evt->params.rx_data.length);
       }
       break;
       
       case BLE_NUS_EVT_TX_RDY: // данные переданы
       {
         // отправляю эвент окончания передачи
+        // поток передачи будится по BLE_GATTS_EVT_HVN_TX_COMPLETE в on_ble_evt() вместе с учетом счетчика tx_inflight
         RTT_LOG_DEBUG("BLE_NUS_EVT_TX_RDY, conn_handle = %d", conn_handle);
-        vTaskNotifyGiveFromISR(m_nus_tx_thread, NULL); // данные могут еще быть, отправляю нотификатор
       }       
       break;
       
@@ -530,9 +582,63 @@ static void nus_data_handler(ble_nus_evt_t * p_evt)
     }
 }
 
+static ret_code_t ecgs_init(void)
+{ // инициализация сервиса потоковой передачи данных ЭКГ
+  ble_ecgs_init_t     ecgs_init;
+  
+  memset(&ecgs_init, 0, sizeof(ecgs_init));
+
+  ecgs_init.evt_handler = ecgs_evt_handler;
+
+  return ble_ecgs_init(&m_ecgs, &ecgs_init);
+}
+
+static void ecgs_evt_handler(ble_ecgs_evt_t * p_evt)
+{ // обработчик событий сервиса ECGS
+  uint16_t conn_handle = p_evt->conn_handle;
+  switch(p_evt->type)
+  {
+    case BLE_ECGS_EVT_CTRL_RX: // принята команда через характеристику CTRL
+      RTT_LOG_DEBUG("BLE_ECGS_EVT_CTRL_RX, conn_handle = %d", conn_handle);
+      if(conn_handle >= NRF_BLE_LINK_COUNT) break;
+      m_connected_peers[conn_handle].rsp_via_ecgs = true; // отвечаю через CTRL
+      rx_data_push(conn_handle, p_evt->p_data, p_evt->length);
+    break;
+    
+    default:
+      break;
+  }
+}
+
+static void rx_data_push(uint16_t conn_handle, uint8_t const *p_data, uint16_t length)
+{ // передача принятых команд (из NUS или ECGS) в приемный буфер соединения и уведомление верхнего уровня
+  if(m_connected_peers[conn_handle].rx_stream_buff_handle == NULL) return; // приемный буфер не задан
+  
+  // отправляю полученные данные в очередь
+  if(xStreamBufferSpacesAvailable(m_connected_peers[conn_handle].rx_stream_buff_handle) >= length)
+  {
+    xStreamBufferSendFromISR(m_connected_peers[conn_handle].rx_stream_buff_handle, p_data, length, NULL);
+  }else{
+    RTT_LOG_INFO("BLE: rx data stream ofv");
+  }
+
+  //RTT_LOG_DEBUG("BLE: RX data %d bytes", length);
+  // вызываю callback
+  if(m_callback)
+  {
+    bleCallback_t args;
+    memset(&args, 0, sizeof(args));
+    args.conn_handle = conn_handle;
+    args.evtType = BLE_EVENT_TYPE_NUS_RX;
+    args.evtSrc = BLE_EVENT_SRC_PERIPHERAL;
+    m_callback(&args);
+  }
+}
+
 static ret_code_t services_init(void)
 { // инициализация сервисов
   ERROR_CHECK(battery_service_init());
+  ERROR_CHECK(ecgs_init());
 
   return nus_init();
 }
@@ -622,6 +728,62 @@ static uint16_t setDefPassKey(const char *passKey)
   return(sd_ble_opt_set(BLE_GAP_OPT_PASSKEY, &ble_opt));
 }
 
+static void tx_blk_release(uint16_t conn_handle)
+{ // возврат в пул всех блоков соединения, ожидающих передачи
+  if(conn_handle >= NRF_BLE_LINK_COUNT) return;
+  
+  blk_pool_free(m_connected_peers[conn_handle].tx_blk);
+  m_connected_peers[conn_handle].tx_blk = NULL;
+  m_connected_peers[conn_handle].tx_blk_offset = 0;
+  
+  if(m_tx_blk_queue[conn_handle] == NULL) return;
+  tx_blk_item_t item;
+  while(pdTRUE == xQueueReceive(m_tx_blk_queue[conn_handle], &item, 0)) blk_pool_free(item.blk);
+}
+
+static ret_code_t blk_data_send(uint16_t conn_handle, bool stream, uint8_t *p_data, uint16_t *p_length)
+{ // кадры ECGS идут через характеристику DATA сервиса ECGS, остальные блоки - через NUS (формат блока выбирает верхний уровень)
+  if(stream) return ble_ecgs_data_send(&m_ecgs, p_data, p_length, conn_handle);
+  return ble_nus_data_send(&m_nus, p_data, p_length, conn_handle);
+}
+
+static ret_code_t stream_data_send(uint16_t conn_handle, uint8_t *p_data, uint16_t *p_length)
+{ // ответы на команды идут туда, откуда пришла последняя команда
+  if(m_connected_peers[conn_handle].rsp_via_ecgs && ble_ecgs_ctrl_enabled(&m_ecgs, conn_handle)) return ble_ecgs_ctrl_send(&m_ecgs, p_data, p_length, conn_handle);
+  return ble_nus_data_send(&m_nus, p_data, p_length, conn_handle);
+}
+
+static void tx_inflight_add(uint16_t conn_handle)
+{ // учет нотификации, отданной в SoftDevice (вызывается из nus_tx_data_thread)
+  taskENTER_CRITICAL();
+  m_connected_peers[conn_handle].tx_inflight++;
+  m_connected_peers[conn_handle].tx_pending = true;
+  taskEXIT_CRITICAL();
+}
+
+static void tx_done_check(uint16_t conn_handle)
+{ // проверка окончания передачи всех данных соединения: выдается семафор окончания передачи и событие на верхний уровень
+  if(m_connected_peers[conn_handle].tx_inflight != 0) return; // еще есть непереданные нотификации, проверю после TX_COMPLETE
+  if(!m_connected_peers[conn_handle].tx_pending) return; // новых данных не было
+  
+  m_connected_peers[conn_handle].tx_pending = false;
+  if(m_connected_peers[conn_handle].tx_done_sema)
+  {
+    xSemaphoreGive(m_connected_peers[conn_handle].tx_done_sema);
+    m_connected_peers[conn_handle].tx_done_sema = NULL;
+  }
+  
+  if(m_callback)
+  {
+    bleCallback_t args;
+    memset(&args, 0, sizeof(args));
+    args.conn_handle = conn_handle;
+    args.evtType = BLE_EVENT_TYPE_TX_DONE;
+    args.evtSrc = BLE_EVENT_SRC_PERIPHERAL;
+    m_callback(&args);
+  }
+}
+
 // <<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<
 
 // >>>>>>>>>>>>>>> ОБРАБОЧИКИ СОБЫТИЙ ОТ BLE >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
@@ -642,8 +804,11 @@ static void on_ble_evt(uint16_t conn_handle, ble_evt_t const * p_ble_evt)
     {
         case BLE_GAP_EVT_CONNECTED: // подключено новое устройство
             RTT_LOG_INFO("BLE: %s: on_ble_evt: BLE_GAP_EVT_CONNECTED, conn_handle = %d", nrf_log_push(roles_str[role]), conn_handle);
+            tx_blk_release(conn_handle); // блоки от предыдущего соединения не передаю
+            m_adv_phase = ADV_PHASE_NORMAL; // эдвертайзинг остановлен подключением
             m_connected_peers[conn_handle].is_connected = true; // устанавливаю флаг подключения в массиве подключенных устройств
             m_connected_peers[conn_handle].address = p_ble_evt->evt.gap_evt.params.connected.peer_addr; // копирую адрес подключенного устройства
+            m_connected_peers[conn_handle].conn_interval = p_ble_evt->evt.gap_evt.params.connected.conn_params.max_conn_interval;
             multi_qwr_conn_handle_assign(conn_handle); 
             // вызываю дополнительный обработчик
             if(m_callback)
@@ -658,9 +823,18 @@ static void on_ble_evt(uint16_t conn_handle, ble_evt_t const * p_ble_evt)
             }
             break;
 
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE: // изменились параметры соединения
+            if(conn_handle >= NRF_BLE_LINK_COUNT) break;
+            m_connected_peers[conn_handle].conn_interval = p_ble_evt->evt.gap_evt.params.conn_param_update.conn_params.max_conn_interval;
+            RTT_LOG_INFO("BLE: conn_handle = %d, connection interval %d x 1.25 ms", conn_handle, m_connected_peers[conn_handle].conn_interval);
+            break;
+
         case BLE_GAP_EVT_DISCONNECTED: // отключение устройства
             RTT_LOG_INFO("BLE: %s: on_ble_evt: BLE_GAP_EVT_DISCONNECTED, conn_handle = %d", nrf_log_push(roles_str[role]), conn_handle);
             // "удаляю" устройство из массива подключенных вместе со всеми настройками буферов
+            tx_blk_release(conn_handle);
+            // сопряженному - направленный эдвертайзинг, после несопряженного направленная фаза пропускается
+            m_last_peer_id = m_connected_peers[conn_handle].is_bonded ? m_connected_peers[conn_handle].peer_id : PM_PEER_ID_INVALID;
             memset(&m_connected_peers[conn_handle], 0x00, sizeof(m_connected_peers[0]));
             break;
 
@@ -700,6 +874,18 @@ static void on_ble_evt(uint16_t conn_handle, ble_evt_t const * p_ble_evt)
          
             break;
 
+        case BLE_GATTS_EVT_HVN_TX_COMPLETE: // нотификации переданы в эфир (освободились буферы SoftDevice)
+        {
+            uint16_t cnt = p_ble_evt->evt.gatts_evt.params.hvn_tx_complete.count;
+            if(conn_handle >= NRF_BLE_LINK_COUNT) break;
+            taskENTER_CRITICAL();
+            if(m_connected_peers[conn_handle].tx_inflight > cnt) m_connected_peers[conn_handle].tx_inflight -= cnt;
+            else m_connected_peers[conn_handle].tx_inflight = 0;
+            taskEXIT_CRITICAL();
+            xTaskNotifyGive(m_nus_tx_thread); // освободились слоты, бужу поток передачи
+        }
+        break;
+
         case BLE_GAP_EVT_PHY_UPDATE_REQUEST:
         {
             RTT_LOG_DEBUG("PHY update request.");
@@ -772,6 +958,12 @@ static void on_ble_peripheral_evt(ble_evt_t const * p_ble_evt)
         case BLE_GAP_EVT_ADV_SET_TERMINATED: // таймаут эдвертайзинга
         {
           RTT_LOG_DEBUG("PERIPHERAL: BLE_GAP_EVT_ADV_SET_TERMINATED");
+          if(m_adv_phase != ADV_PHASE_NORMAL)
+          { // фаза быстрого переподключения закончилась без подключения, запускаю следующую (наверх не передаю)
+            err_code = adv_phase_start((m_adv_phase == ADV_PHASE_DIRECTED) ? ADV_PHASE_WHITELIST : ADV_PHASE_NORMAL);
+            if(err_code != NRF_SUCCESS) RTT_LOG_INFO("ERR: fast advertising phase err = %d", err_code);
+            break;
+          }
         
           // вызываю дополнительный обработчик
           if(m_callback)
@@ -935,6 +1127,200 @@ ret_code_t gap_params_init(const char *deviceName, uint32_t min_conn_interval, u
     return(err_code);
 }
 
+/**
+ * Максимальная длина данных производителя в текущем режиме эдвертайзинга
+ * conn_en - подключение разрешено (расширенный эдвертайзинг с подключением SoftDevice ограничивает 238 байтами данных)
+ */
+static uint8_t adv_manuf_data_max(bool conn_en)
+{
+  if(!m_adv_params.ext) return BLE_ADV_MANUF_DATA_MAX;
+  return conn_en ? BLE_ADV_EXT_CONN_MANUF_DATA_MAX : BLE_ADV_EXT_MANUF_DATA_MAX;
+}
+
+/**
+ * Сборка данных эдвертайзинга и scan response в буферы, не занятые SoftDevice (после сборки m_adv_data указывает на них)
+ * Индекс m_adv_buf здесь не меняется: буферы считаются переданными SoftDevice только после успешной adv_set_configure(),
+ * поэтому повторная сборка до нее (ошибка настройки, направленная фаза) пишет в те же свободные буферы
+ *
+ * Данные производителя берутся из m_adv_params. В обычном эдвертайзинге вместе с ними appearance в пакет не помещается
+ * (31 байт: флаги, имя, данные производителя), поэтому appearance передается только без данных производителя.
+ * В расширенном эдвертайзинге scan response нет, UUID сервисов идут в основном пакете.
+ */
+static ret_code_t adv_data_encode(void)
+{
+  ble_advdata_t advdata;  // данные в эдвертайзинге
+  ble_advdata_t srdata;   // данные в scan request ответе
+  
+  uint8_t buf = m_adv_buf ^ 1;
+  m_adv_data.adv_data.p_data = m_enc_advdata[buf];
+  // на входе ble_advdata_encode - размер буфера
+  if(m_adv_params.ext)
+  {
+    m_adv_data.adv_data.len = m_adv_params.conn_en ? BLE_GAP_ADV_SET_DATA_SIZE_EXTENDED_CONNECTABLE_MAX_SUPPORTED :
+                                                     BLE_GAP_ADV_SET_DATA_SIZE_EXTENDED_MAX_SUPPORTED;
+  }else{
+    m_adv_data.adv_data.len = BLE_GAP_ADV_SET_DATA_SIZE_MAX;
+  }
+  m_adv_data.scan_rsp_data.p_data = m_enc_srdata[buf];
+  m_adv_data.scan_rsp_data.len = BLE_GAP_ADV_SET_DATA_SIZE_MAX;
+
+  ble_advdata_manuf_data_t manuf_specific_data = {0}; // структура для размещения данных производителя
+  // заполняю данные производителя
+  manuf_specific_data.company_identifier = APP_COMPANY_IDENTIFIER; // идентификатор фирмы-изготовителя 
+  manuf_specific_data.data.p_data = m_adv_params.manuf_data; // указатель на структуру данных
+  manuf_specific_data.data.size = m_adv_params.manuf_data_len;
+
+  // Build and set advertising data.
+  memset(&advdata, 0, sizeof(advdata));
+    
+  advdata.name_type             = BLE_ADVDATA_FULL_NAME;
+  advdata.flags                 = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE; // эдвертайзинг с возможностью подключения
+  advdata.p_manuf_specific_data = &manuf_specific_data;
+  advdata.include_appearance    = m_adv_params.ext || (m_adv_params.manuf_data_len == 0);
+  if(m_adv_params.ext)
+  {
+    advdata.uuids_complete.uuid_cnt = sizeof(m_adv_uuids) / sizeof(m_adv_uuids[0]);
+    advdata.uuids_complete.p_uuids  = m_adv_uuids;
+  }
+        
+  ERROR_CHECK(ble_advdata_encode(&advdata, m_adv_data.adv_data.p_data, &m_adv_data.adv_data.len));
+  
+  if(m_adv_params.ext)
+  { // расширенный эдвертайзинг без запроса сканирования
+    m_adv_data.scan_rsp_data.p_data = NULL;
+    m_adv_data.scan_rsp_data.len = 0;
+    m_adv_data_valid = true;
+    return NRF_SUCCESS;
+  }
+  
+  // Build and set scan response data.
+  // прикручиваю Universally unique service identifier в scan responce data (эти данные будут переданы только по запросу от центрального устройства)
+  // эти данные могут быть получены центральным устройством при активном сканировании
+  memset(&srdata, 0, sizeof(srdata));
+  srdata.uuids_complete.uuid_cnt = sizeof(m_adv_uuids) / sizeof(m_adv_uuids[0]);
+  srdata.uuids_complete.p_uuids  = m_adv_uuids;
+
+  ERROR_CHECK(ble_advdata_encode(&srdata, m_adv_data.scan_rsp_data.p_data, &m_adv_data.scan_rsp_data.len));
+  m_adv_data_valid = true;
+  return NRF_SUCCESS;
+}
+
+/**
+ * Настройка набора эдвертайзинга; после успешной настройки с данными их буферы становятся занятыми SoftDevice
+ * (p_adv_data = NULL - данные не меняются)
+ */
+static ret_code_t adv_set_configure(ble_gap_adv_data_t const *p_adv_data, ble_gap_adv_params_t const *p_adv_params)
+{
+  ERROR_CHECK(sd_ble_gap_adv_set_configure(&m_adv_handle, p_adv_data, p_adv_params));
+  if(p_adv_data != NULL) m_adv_buf = (p_adv_data->adv_data.p_data == m_enc_advdata[1]) ? 1 : 0;
+  return NRF_SUCCESS;
+}
+
+/**
+ * Запуск ненаправленного эдвертайзинга с готовыми данными m_adv_data
+ *
+ * interval_ms - периодичность пакетов в мс
+ * duration_ms - длительность эдвертайзинга в мс (если =0, значит бессрочно)
+ * filter_policy - BLE_GAP_ADV_FP_ANY или BLE_GAP_ADV_FP_FILTER_CONNREQ (подключение только из белого списка)
+ */
+static ret_code_t adv_undirected_start(uint32_t interval_ms, uint32_t duration_ms, uint8_t filter_policy)
+{
+  // Initialize advertising parameters (used when starting advertising).
+  memset(&m_gap_adv_params, 0, sizeof(m_gap_adv_params));
+
+  if(m_adv_params.ext)
+  { // РАСШИРЕННЫЙ ЭДВЕРТАЙЗИНГ: на первичных каналах только указатель, данные - на вторичном канале, scan response нет
+    m_gap_adv_params.properties.type = m_adv_params.conn_en ? BLE_GAP_ADV_TYPE_EXTENDED_CONNECTABLE_NONSCANNABLE_UNDIRECTED :
+                                                              BLE_GAP_ADV_TYPE_EXTENDED_NONCONNECTABLE_NONSCANNABLE_UNDIRECTED;
+    m_gap_adv_params.primary_phy     = m_adv_params.primary_phy;
+    m_gap_adv_params.secondary_phy   = m_adv_params.secondary_phy;
+  }else{
+    m_gap_adv_params.properties.type = m_adv_params.conn_en ? BLE_GAP_ADV_TYPE_CONNECTABLE_SCANNABLE_UNDIRECTED :
+                                                              BLE_GAP_ADV_TYPE_NONCONNECTABLE_SCANNABLE_UNDIRECTED;
+  }
+  m_gap_adv_params.p_peer_addr     = NULL;    // Undirected advertisement.
+  m_gap_adv_params.filter_policy   = filter_policy;
+  m_gap_adv_params.interval        = MSEC_TO_UNITS(interval_ms, UNIT_0_625_MS); // интервал между пакетами эдвертайзинга
+  m_gap_adv_params.duration        = MSEC_TO_UNITS(duration_ms, UNIT_10_MS); // длительность эдвертайзинга
+
+  ERROR_CHECK(adv_set_configure(&m_adv_data, &m_gap_adv_params));
+  ERROR_CHECK(sd_ble_gap_adv_start(m_adv_handle, APP_BLE_CONN_CFG_TAG));
+  RTT_LOG_DEBUG("BLE: Advertising started (ext %d, conn %d, fp %d)", m_adv_params.ext, m_adv_params.conn_en, filter_policy);
+  
+  // выставляю выходную мощность в процессе эдвертайзинга
+  sd_ble_gap_tx_power_set(BLE_GAP_TX_POWER_ROLE_ADV, m_adv_handle, (int8_t)m_adv_params.pwrAdv);
+  return NRF_SUCCESS;
+}
+
+/**
+ * Белый список и список идентификаторов SoftDevice из сопряженных устройств
+ * (список идентификаторов нужен, чтобы узнавать устройства со случайными адресами)
+ * возвращает количество устройств в белом списке
+ */
+static uint32_t adv_peers_load(void)
+{
+  pm_peer_id_t  ids[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
+  uint32_t      cnt = BLE_GAP_WHITELIST_ADDR_MAX_COUNT;
+  
+  if(NRF_SUCCESS != pm_peer_id_list(ids, &cnt, PM_PEER_ID_INVALID, PM_PEER_ID_LIST_SKIP_NO_ID_ADDR)) return 0;
+  if(cnt == 0) return 0;
+  if(NRF_SUCCESS != pm_whitelist_set(ids, cnt)) return 0;
+  ret_code_t err = pm_device_identities_list_set(ids, cnt);
+  if((err != NRF_SUCCESS) && (err != NRF_ERROR_NOT_SUPPORTED)) return 0; // без поддержки приватности список не нужен
+  return cnt;
+}
+
+/**
+ * Высокоскоростной направленный эдвертайзинг последнему отключившемуся сопряженному устройству
+ * (длительность ограничена SoftDevice: BLE_GAP_ADV_TIMEOUT_HIGH_DUTY_MAX)
+ */
+static ret_code_t adv_directed_start(void)
+{
+  static ble_gap_addr_t   peer_addr;
+  pm_peer_data_bonding_t  bonding;
+  
+  if(m_last_peer_id == PM_PEER_ID_INVALID) return NRF_ERROR_NOT_FOUND;
+  ERROR_CHECK(pm_peer_data_bonding_load(m_last_peer_id, &bonding));
+  peer_addr = bonding.peer_ble_id.id_addr_info;
+  
+  memset(&m_gap_adv_params, 0, sizeof(m_gap_adv_params));
+  m_gap_adv_params.properties.type = BLE_GAP_ADV_TYPE_CONNECTABLE_NONSCANNABLE_DIRECTED_HIGH_DUTY_CYCLE;
+  m_gap_adv_params.p_peer_addr     = &peer_addr;
+  m_gap_adv_params.filter_policy   = BLE_GAP_ADV_FP_ANY;
+  m_gap_adv_params.duration        = BLE_GAP_ADV_TIMEOUT_HIGH_DUTY_MAX;
+  
+  // у направленного эдвертайзинга нет данных, готовые буферы остаются для следующих фаз
+  ERROR_CHECK(adv_set_configure(NULL, &m_gap_adv_params));
+  ERROR_CHECK(sd_ble_gap_adv_start(m_adv_handle, APP_BLE_CONN_CFG_TAG));
+  RTT_LOG_DEBUG("BLE: Directed advertising started, peer %d", m_last_peer_id);
+  
+  sd_ble_gap_tx_power_set(BLE_GAP_TX_POWER_ROLE_ADV, m_adv_handle, (int8_t)m_adv_params.pwrAdv);
+  return NRF_SUCCESS;
+}
+
+/**
+ * Запуск фазы быстрого переподключения; если фаза невозможна (нет сопряженных устройств, ошибка), запускается следующая
+ * ADV_PHASE_DIRECTED -> ADV_PHASE_WHITELIST -> ADV_PHASE_NORMAL
+ */
+static ret_code_t adv_phase_start(adv_phase_e phase)
+{
+  if(phase == ADV_PHASE_DIRECTED)
+  {
+    m_adv_phase = phase;
+    if(adv_directed_start() == NRF_SUCCESS) return NRF_SUCCESS;
+    phase = ADV_PHASE_WHITELIST;
+  }
+  
+  if((phase == ADV_PHASE_WHITELIST) && m_adv_peer_cnt)
+  { // частый эдвертайзинг, подключиться могут только сопряженные устройства (сканировать - все)
+    m_adv_phase = phase;
+    if(adv_undirected_start(BLE_ADV_FAST_INTERVAL_MS, BLE_ADV_FAST_DURATION_MS, BLE_GAP_ADV_FP_FILTER_CONNREQ) == NRF_SUCCESS) return NRF_SUCCESS;
+  }
+  
+  m_adv_phase = ADV_PHASE_NORMAL;
+  return adv_undirected_start(m_adv_params.interval_ms, m_adv_params.duration_ms, BLE_GAP_ADV_FP_ANY);
+}
+
 /**
  * Function for handling events from the GATT library. 
 */
@@ -1013,6 +1399,9 @@ static void nus_tx_data_thread(void *args)
   Процесс передачи идет по очереди до опустошения потоковых буферов; сначала данные начинают передаваться из временных буферов (на случай, если предыдущая передача завершилась ошибкой)
   За один проход основного цикла передается одна порция данных очередного пира
   Процесс стартует после приема нотификатора
+  Если все буферы SoftDevice заняты (NRF_ERROR_RESOURCES), поток засыпает до нотификатора от BLE_GATTS_EVT_HVN_TX_COMPLETE,
+  а не крутится в цикле. Каждая успешно отданная в SoftDevice нотификация увеличивает счетчик tx_inflight, событие TX_COMPLETE уменьшает его.
+  Когда передавать больше нечего и tx_inflight = 0, все данные соединения реально переданы: выдается семафор tx_done_sema и событие BLE_EVENT_TYPE_TX_DONE
   */
   
   xTaskNotifyGive(m_nus_tx_thread); // отправляю нотификатор для старта процесса
@@ -1021,17 +1410,74 @@ static void nus_tx_data_thread(void *args)
   {
     ulTaskNotifyTake(true, portMAX_DELAY); // жду нотификатор, сброс после выхода
     
-    bool all_tx_done; // флаг окончания передачи данных из всех буферов всех открытых соединений
+    bool tx_progress; // флаг, что за проход хотя бы одна порция данных была отдана в SoftDevice (или требуется повтор после ошибки)
     do{
-      all_tx_done = true;
+      tx_progress = false;
       for(uint8_t i=0; i < NRF_BLE_LINK_COUNT; i++)
       { // перебираю массив пиров
         if(m_connected_peers[i].is_connected)
         { // есть подключение
           
-          while(1)
-          { // цикл заполнения всех передающих буферов softdevice для увеличения скорости передачи
-            // вряд ли это будет хорошо работать, если есть несколько соединений
+          for(uint8_t q = 0; q < BLE_TX_QUANTUM; q++)
+          { // цикл заполнения передающих буферов softdevice: за проход соединение отдает не больше BLE_TX_QUANTUM порций,
+            // остаток передается на следующих проходах по очереди с другими соединениями
+
+            if((m_connected_peers[i].tx_data_len == 0) && (m_connected_peers[i].tx_blk == NULL) && (m_tx_blk_queue[i] != NULL))
+            { // данных во временном буфере нет, беру очередной блок из очереди (если он есть)
+              tx_blk_item_t item;
+              if(pdTRUE == xQueueReceive(m_tx_blk_queue[i], &item, 0))
+              {
+                m_connected_peers[i].tx_blk = item.blk;
+                m_connected_peers[i].tx_blk_stream = item.stream;
+                m_connected_peers[i].tx_blk_offset = 0;
+              }
+            }
+            
+            if(m_connected_peers[i].tx_blk != NULL)
+            { // передаю блок из пула (частями, если MTU меньше длины блока)
+              blk_t *blk = m_connected_peers[i].tx_blk;
+              if(m_connected_peers[i].nus_max_data_len == 0) break; // MTU еще не согласован
+              
+              uint16_t len = blk->len - m_connected_peers[i].tx_blk_offset;
+              if(len > m_connected_peers[i].nus_max_data_len)
+              {
+                if(m_connected_peers[i].tx_blk_stream)
+                { // кадр ECGS на части не делится (приемник потеряет разметку), кадр будет потерян
+                  RTT_LOG_INFO("BLE: conn_handle = %d, ECGS frame %d > MTU, dropped", i, blk->len);
+                  blk_pool_free(blk);
+                  m_connected_peers[i].tx_blk = NULL;
+                  continue;
+                }
+                len = m_connected_peers[i].nus_max_data_len;
+              }
+              
+              ret_code_t ret_val = NRF_SUCCESS;
+              if(len != 0) ret_val = blk_data_send(i, m_connected_peers[i].tx_blk_stream, &blk->data[m_connected_peers[i].tx_blk_offset], &len);
+              
+              if(ret_val == NRF_SUCCESS)
+              { // SoftDevice скопировал данные в свой буфер
+                if(len != 0) tx_inflight_add(i);
+                m_connected_peers[i].tx_blk_offset += len;
+                if(m_connected_peers[i].tx_blk_offset >= blk->len)
+                { // блок передан полностью, возвращаю его в пул
+                  blk_pool_free(blk);
+                  m_connected_peers[i].tx_blk = NULL;
+                }
+              }else{
+                if(ret_val == NRF_ERROR_RESOURCES) break; // все передающие буфера заполнены, жду TX_COMPLETE
+                
+                if(m_connected_peers[i].tx_error_cnt >= BLE_TX_ERROR_MAX)
+                { // превышено число допустимых ошибок, блок будет потерян
+                  blk_pool_free(blk);
+                  m_connected_peers[i].tx_blk = NULL;
+                }
+                m_connected_peers[i].tx_error_cnt++;
+                vTaskDelay(pdMS_TO_TICKS(BLE_TX_ERROR_TIMEOUT_MS));
+              }
+              
+              tx_progress = true;
+              continue;
+            }
 
             if(m_connected_peers[i].tx_data_len == 0)
             { // данных во временном буфере нет
@@ -1049,16 +1495,17 @@ static void nus_tx_data_thread(void *args)
               ret_code_t ret_val;
               
               // вызываю функцию передачи данных
-              ret_val = ble_nus_data_send(&m_nus, m_connected_peers[i].tx_data, &m_connected_peers[i].tx_data_len, i); // передаю данные
+              ret_val = stream_data_send(i, m_connected_peers[i].tx_data, &m_connected_peers[i].tx_data_len); // передаю данные
               
               if(ret_val == NRF_SUCCESS)
               {
+                tx_inflight_add(i);
                 m_connected_peers[i].tx_data_len = 0; // данные успешно переданы
               }else{ // в процессе передачи произошла ошибка (этот кейс нужен, чтобы работа этого потока была прервана в случае ошибок связи)
                 
                 if(ret_val == NRF_ERROR_RESOURCES) 
                 { // процесс передачи идет, все передающие буфера заполнены полностью
-                  break; // переходим к следующему устройству из списка m_connected_peers
+                  break; // переходим к следующему устройству из списка m_connected_peers, продолжу после TX_COMPLETE
                 }
 
                 if(m_connected_peers[i].tx_error_cnt >= BLE_TX_ERROR_MAX)
@@ -1069,20 +1516,19 @@ static void nus_tx_data_thread(void *args)
                 vTaskDelay(pdMS_TO_TICKS(BLE_TX_ERROR_TIMEOUT_MS)); // без этого таймаута для проблемных соединений, управление из этой задачи никогда не будет передано другим
               }
               
-              all_tx_done = false;
+              tx_progress = true;
             }else{
-              // все данные переданы
-              if(m_connected_peers[i].tx_done_sema)
-                    xSemaphoreGive(m_connected_peers[i].tx_done_sema);
+              // все данные отданы в SoftDevice, проверяю, переданы ли они в эфир
+              tx_done_check(i);
               break; // выход из цикла заполнения передающих буферов
             } 
 
-          } // while
+          } // for
 
         } // if
       } // for
-      taskYIELD(); // для защиты от "зависания" в этом потоке при передаче больших объемов данных или ошибках
-    }while(!all_tx_done);
+      if(tx_progress) taskYIELD(); // для защиты от "зависания" в этом потоке при передаче больших объемов данных или ошибках
+    }while(tx_progress);
   }
 }
 
@@ -1100,8 +1546,8 @@ static void nus_tx_data_thread(void *args)
 */
 ret_code_t bleInit(bleDriverCallback_t callback, bool useDefaultPass)
 {
-  // проверка ограничения: только один линк как перефирийное устройство
-  ASSERT((NRF_SDH_BLE_TOTAL_LINK_COUNT != 1) || (NRF_SDH_BLE_PERIPHERAL_LINK_COUNT != 1))
+  // проверка ограничения: только входящие соединения (устройство - перефирийное)
+  ASSERT(NRF_SDH_BLE_TOTAL_LINK_COUNT == NRF_SDH_BLE_PERIPHERAL_LINK_COUNT)
 
   ret_code_t err_code;
   
@@ -1148,12 +1594,21 @@ ret_code_t bleInit(bleDriverCallback_t callback, bool useDefaultPass)
   m_paring_en = false; // запрещаю паринг новый устройств
   
   // создаю задачу по передаче данных по каналам NUS
-  if(pdPASS != xTaskCreate(nus_tx_data_thread, "NUSTX", 
-                            NUSTX_STACK_SIZE,
-                            NULL,
-                            NUSTX_PRIORITY,
-                            &m_nus_tx_thread
-                          )) return NRF_ERROR_NO_MEM;
+  m_nus_tx_thread = xTaskCreateStatic(nus_tx_data_thread, "NUSTX", 
+                                      NUSTX_STACK_SIZE,
+                                      NULL,
+                                      NUSTX_PRIORITY,
+                                      m_nus_tx_stack,
+                                      &m_nus_tx_tcb
+                                     );
+  if(m_nus_tx_thread == NULL) return NRF_ERROR_NO_MEM;
+  
+  // создаю очереди блоков на передачу
+  for(uint8_t i = 0; i < NRF_BLE_LINK_COUNT; i++)
+  {
+    m_tx_blk_queue[i] = xQueueCreateStatic(BLE_TX_BLK_QUEUE_SIZE, sizeof(tx_blk_item_t), m_tx_blk_queue_storage[i], &m_tx_blk_queue_static[i]);
+    if(m_tx_blk_queue[i] == NULL) return NRF_ERROR_NO_MEM;
+  }
   
   // Create a FreeRTOS task for the BLE stack.
   nrf_sdh_freertos_init(NULL, NULL);
@@ -1190,17 +1645,32 @@ ret_code_t blePMInit(void)
 
 Алгоритм работы:
 - если имя устройства не задано (NULL), то в качестве параметров будут использованы ранее сохраненные в m_adv_params
+- данные производителя сохраняются и меняются, только если manuf_data не NULL (пустые данные - manuf_data_len = 0),
+  поэтому перезапуск эдвертайзинга не затирает данные, выставленные через bleAdvManufDataUpdate()
+- параметры GAP и данные эдвертайзинга пересобираются только после изменений, иначе используются готовые буферы
 - если эдвертайзинг уже запущен, то сначала его останавливаю, а потом запускаю с новыми параметрами
 - эдвертайзинг останавливается либо по таймауту либо после подключения
 */
 ret_code_t bleAdvStart(const char *device_name, uint32_t interval_ms, uint32_t duration_ms, blePwr_t pwrAdv, uint32_t min_conn_interval_ms, uint32_t max_conn_interval_ms, blePwr_t pwrConn, 
                         void *manuf_data, uint8_t manuf_data_len, bool conn_en)
 {
-  ble_advdata_t advdata;  // данные в эдвертайзинге
-  ble_advdata_t srdata;   // данные в scan request ответе
+  // длина проверяется по новому разрешению подключения (device_name = NULL - параметры прежние)
+  if(manuf_data_len > adv_manuf_data_max((device_name != NULL) ? conn_en : m_adv_params.conn_en)) return NRF_ERROR_INVALID_LENGTH;
+  if(manuf_data != NULL)
+  { // сохраняю данные производителя (NULL означает "оставить прежние")
+    m_adv_params.manuf_data_len = manuf_data_len;
+    if(manuf_data_len) memcpy(m_adv_params.manuf_data, manuf_data, manuf_data_len);
+    m_adv_data_valid = false;
+  }
   
   if(device_name != NULL)
   { // сохраняю новые параметры эдвертайзинга
+    if(strncmp(m_adv_params.device_name, device_name, sizeof(m_adv_params.device_name)) ||
+       (m_adv_params.min_conn_interval_ms != min_conn_interval_ms) || (m_adv_params.max_conn_interval_ms != max_conn_interval_ms))
+    { // имя входит в данные эдвертайзинга, имя и интервалы - в параметры GAP
+      m_adv_gap_valid = false;
+      m_adv_data_valid = false;
+    }
     // преобразую имя устройства к виду DEVICE_NAME_ABCD, где ABCD - это последние 4 знака МАК-адреса
     // TEST
     //char buff[strlen(device_name) + 6]; // +5 - для добавления окончания _XXXX, где XXXX - это последние 2 байта МАК-адреса
@@ -1209,7 +1679,9 @@ ret_code_t bleAdvStart(const char *device_name, uint32_t interval_ms, uint32_t d
     //memcpy(m_adv_params.device_name, buff, sizeof(m_adv_params.device_name));
     memcpy(m_adv_params.device_name, device_name, sizeof(m_adv_params.device_name)); // TEST
     
+    if(m_adv_params.conn_en != conn_en) m_adv_data_valid = false; // от подключения зависит допустимая длина данных
     m_adv_params.conn_en = conn_en;
+    if(m_adv_params.manuf_data_len > adv_manuf_data_max(conn_en)) m_adv_params.manuf_data_len = 0; // сохраненные данные не поместятся
     m_adv_params.duration_ms = duration_ms;
     m_adv_params.interval_ms = interval_ms;
     m_adv_params.max_conn_interval_ms = max_conn_interval_ms;
@@ -1219,78 +1691,61 @@ ret_code_t bleAdvStart(const char *device_name, uint32_t interval_ms, uint32_t d
   }
   
   bleAdvStop();
+  m_adv_phase = ADV_PHASE_NORMAL;
   
-  // преобразую входные параметры к нужным величинам
-  interval_ms = MSEC_TO_UNITS(m_adv_params.interval_ms, UNIT_0_625_MS);
-  duration_ms = MSEC_TO_UNITS(m_adv_params.duration_ms, UNIT_10_MS);
-  min_conn_interval_ms = MSEC_TO_UNITS(m_adv_params.min_conn_interval_ms, UNIT_1_25_MS);
-  max_conn_interval_ms = MSEC_TO_UNITS(m_adv_params.max_conn_interval_ms, UNIT_1_25_MS);
+  if(!m_adv_gap_valid)
+  { // устанавливаю параметры после установления соединения (внешнее подключение, если разрешено)
+    ERROR_CHECK(gap_params_init(m_adv_params.device_name, MSEC_TO_UNITS(m_adv_params.min_conn_interval_ms, UNIT_1_25_MS),
+                                MSEC_TO_UNITS(m_adv_params.max_conn_interval_ms, UNIT_1_25_MS)));
+    m_adv_gap_valid = true;
+  }
   
-  // устанавливаю параметры после установления соединения (внешнее подключение, если разрешено)
-  ERROR_CHECK(gap_params_init(m_adv_params.device_name, min_conn_interval_ms, max_conn_interval_ms));
+  // данные эдвертайзинга собираются заново только после изменений, перезапуск использует готовые буферы
+  if(!m_adv_data_valid) ERROR_CHECK(adv_data_encode());
   
-  // устанавливаю новые параметры и запускаю эдвертайзинг
+  return adv_undirected_start(m_adv_params.interval_ms, m_adv_params.duration_ms, BLE_GAP_ADV_FP_ANY);
+}
 
-  ble_advdata_manuf_data_t manuf_specific_data = {0}; // структура для размещения данных производителя
-  // заполняю данные производителя
-  manuf_specific_data.company_identifier = APP_COMPANY_IDENTIFIER; // идентификатор фирмы-изготовителя 
-  manuf_specific_data.data.p_data = (uint8_t *)manuf_data; // указатель на структуру данных
-  manuf_specific_data.data.size = manuf_data_len;
 
-  // Build and set advertising data.
-  memset(&advdata, 0, sizeof(advdata));
-    
-  advdata.name_type             = BLE_ADVDATA_FULL_NAME;
-  advdata.flags                 = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE; // эдвертайзинг с возможностью подключения
-  advdata.p_manuf_specific_data = &manuf_specific_data;
-  advdata.include_appearance    = true;
-        
-  ERROR_CHECK(ble_advdata_encode(&advdata, m_adv_data.adv_data.p_data, &m_adv_data.adv_data.len));
-  
-  // Build and set scan response data.
-  // прикручиваю Universally unique service identifier в scan responce data (эти данные будут переданы только по запросу от центрального устройства)
-  // эти данные могут быть получены центральным устройством при активном сканировании
-  memset(&srdata, 0, sizeof(srdata));
-  srdata.uuids_complete.uuid_cnt = sizeof(m_adv_uuids) / sizeof(m_adv_uuids[0]);
-  srdata.uuids_complete.p_uuids  = m_adv_uuids;
-
-  ERROR_CHECK(ble_advdata_encode(&srdata, m_adv_data.scan_rsp_data.p_data, &m_adv_data.scan_rsp_data.len));
+/*
+Быстрое переподключение после разрыва связи
+- эдвертайзинг запускается с сохраненными параметрами и готовыми буферами (без пересборки данных)
+- сначала высокоскоростной направленный эдвертайзинг последнему отключившемуся сопряженному устройству (до 1,28 с)
+- затем частый эдвертайзинг BLE_ADV_FAST_INTERVAL_MS в течение BLE_ADV_FAST_DURATION_MS, подключение только из белого списка
+- затем обычный эдвертайзинг, как после bleAdvStart(NULL, ...)
+- фазы без сопряженных устройств пропускаются; BLE_GAP_EVT_ADV_SET_TERMINATED наверх передается только после обычной фазы
+*/
+ret_code_t bleAdvFastStart(void)
+{
+  if(!m_adv_params.conn_en || !m_adv_gap_valid || !m_adv_data_valid) // подключение запрещено или эдвертайзинг еще не запускался
+    return bleAdvStart(NULL, 0, 0, BLE_PWR_0, 0, 0, BLE_PWR_0, NULL, 0, false);
   
-  // Initialize advertising parameters (used when starting advertising).
-  memset(&m_gap_adv_params, 0, sizeof(m_gap_adv_params));
-
-  m_gap_adv_params.properties.type = BLE_GAP_ADV_TYPE_CONNECTABLE_SCANNABLE_UNDIRECTED;  // Эдвертайзинг для всех
-
-  m_gap_adv_params.p_peer_addr     = NULL;    // Undirected advertisement.
-  m_gap_adv_params.filter_policy   = BLE_GAP_ADV_FP_ANY; // возможно подключение любых устройств, а не только из белого списка
-  m_gap_adv_params.interval        = interval_ms; // интервал между пакетами эдвертайзинга
-  m_gap_adv_params.duration        = duration_ms; // длительность эдвертайзинга
-
-  ERROR_CHECK(sd_ble_gap_adv_set_configure(&m_adv_handle, &m_adv_data, &m_gap_adv_params));
-    
-  if(m_adv_params.conn_en)
-  { // ПОДКЛЮЧЕНИЯ РАЗРЕШЕНЫ
-    ERROR_CHECK(sd_ble_gap_adv_start(m_adv_handle, APP_BLE_CONN_CFG_TAG));
-    RTT_LOG_DEBUG("BLE: Advertising started");
-  }else{
-    // ПОДКЛЮЧЕНИЯ ЗАПРЕЩЕНЫ
-    // Initialize advertising parameters (used when starting advertising).
-    memset(&m_gap_adv_params, 0, sizeof(m_gap_adv_params));
-
-    m_gap_adv_params.properties.type = BLE_GAP_ADV_TYPE_NONCONNECTABLE_SCANNABLE_UNDIRECTED;  // Эдвертайзинг для всех
-    m_gap_adv_params.p_peer_addr     = NULL;    // Undirected advertisement.
-    m_gap_adv_params.filter_policy   = BLE_GAP_ADV_FP_ANY; // возможно подключение любых устройств, а не только из белого списка
-    m_gap_adv_params.interval        = interval_ms; // интервал между пакетами эдвертайзинга
-    m_gap_adv_params.duration        = duration_ms; // длительность эдвертайзинга
+  bleAdvStop();
+  m_adv_peer_cnt = adv_peers_load();
+  return adv_phase_start(ADV_PHASE_DIRECTED);
+}
 
-    ERROR_CHECK(sd_ble_gap_adv_set_configure(&m_adv_handle, &m_adv_data, &m_gap_adv_params));
 
-    ERROR_CHECK(sd_ble_gap_adv_start(m_adv_handle, APP_BLE_CONN_CFG_TAG));
-    RTT_LOG_DEBUG("BLE: Advertising no connection started...");
+/*
+* Выбор обычного или расширенного эдвертайзинга (действует со следующего bleAdvStart)
+* ext - true, если расширенный эдвертайзинг
+* primary_phy - PHY первичных каналов (BLE_GAP_PHY_1MBPS или BLE_GAP_PHY_CODED)
+* secondary_phy - PHY вторичного канала (BLE_GAP_PHY_1MBPS, BLE_GAP_PHY_2MBPS или BLE_GAP_PHY_CODED)
+* возвращает код ошибки из nrf_errors.h
+*/
+ret_code_t bleAdvSetExt(bool ext, uint8_t primary_phy, uint8_t secondary_phy)
+{
+  if(ext)
+  {
+    if((primary_phy != BLE_GAP_PHY_1MBPS) && (primary_phy != BLE_GAP_PHY_CODED)) return NRF_ERROR_INVALID_PARAM;
+    if((secondary_phy != BLE_GAP_PHY_1MBPS) && (secondary_phy != BLE_GAP_PHY_2MBPS) && (secondary_phy != BLE_GAP_PHY_CODED)) return NRF_ERROR_INVALID_PARAM;
   }
-  
-  // выставляю выходную мощность в процессе эдвертайзинга
-  sd_ble_gap_tx_power_set(BLE_GAP_TX_POWER_ROLE_ADV, m_adv_handle, (int8_t)m_adv_params.pwrAdv);
+  m_adv_data_valid = false;
+  m_adv_params.ext = ext;
+  m_adv_params.primary_phy = primary_phy;
+  m_adv_params.secondary_phy = secondary_phy;
+  // большие данные в обычный пакет (или в расширенный с подключением) не поместятся
+  if(m_adv_params.manuf_data_len > adv_manuf_data_max(m_adv_params.conn_en)) m_adv_params.manuf_data_len = 0;
   return NRF_SUCCESS;
 }
 
@@ -1301,6 +1756,7 @@ ret_code_t bleAdvStart(const char *device_name, uint32_t interval_ms, uint32_t d
 void bleAdvStop(void)
 {
   RTT_LOG_DEBUG("BLE: Advertising stopped");
+  m_adv_phase = ADV_PHASE_NORMAL;
   sd_ble_gap_adv_stop(m_adv_handle);
 }
 
@@ -1314,9 +1770,16 @@ void bleAdvStop(void)
 ret_code_t bleAdvManufDataUpdate(void *manuf_data, uint8_t manuf_data_len)
 {
   VERIFY_PARAM_NOT_NULL(manuf_data);
-  // перезапускаю эдвертайзинг с новыми данными производителя
-  // имеют значение только новые парамерты данных производителя, остальные - не используются
-  return bleAdvStart(NULL, 0, 0, BLE_PWR_0, 0, 0, BLE_PWR_0, manuf_data, manuf_data_len, false);  
+  if(manuf_data_len > adv_manuf_data_max(m_adv_params.conn_en)) return NRF_ERROR_INVALID_LENGTH;
+  memcpy(m_adv_params.manuf_data, manuf_data, manuf_data_len);
+  m_adv_params.manuf_data_len = manuf_data_len;
+  if(m_adv_handle == BLE_GAP_ADV_SET_HANDLE_NOT_SET) return NRF_SUCCESS; // эдвертайзинг еще не настроен, данные уйдут при запуске
+  
+  // эдвертайзинг не перезапускается: SoftDevice получает новые буферы, параметры остаются прежними
+  ret_code_t err = adv_data_encode();
+  if(err != NRF_SUCCESS) return err;
+  if(m_adv_phase == ADV_PHASE_DIRECTED) return NRF_SUCCESS; // у направленного эдвертайзинга данных нет, буферы уйдут в следующей фазе
+  return adv_set_configure(&m_adv_data, NULL);
 }
 
 
@@ -1454,12 +1917,13 @@ ret_code_t bleNusTx(uint16_t conn_handle, void *p_data, uint32_t data_size, Sema
   
   if(m_connected_peers[conn_handle].tx_stream_buff_handle == NULL) return NRF_ERROR_INVALID_ADDR;
   
-  xTaskNotifyGive(m_nus_tx_thread); // отправляю нотификатор для старта процесса передачи
-  
   if(xStreamBufferSpacesAvailable(m_connected_peers[conn_handle].tx_stream_buff_handle) < data_size) return NRF_ERROR_NO_MEM;
   
-  xStreamBufferSend(m_connected_peers[conn_handle].tx_stream_buff_handle, p_data, data_size, 0);
+  // семафор будет выдан, когда все данные соединения будут переданы в эфир (подтверждено BLE_GATTS_EVT_HVN_TX_COMPLETE)
   m_connected_peers[conn_handle].tx_done_sema = sema;
+  xStreamBufferSend(m_connected_peers[conn_handle].tx_stream_buff_handle, p_data, data_size, 0);
+  
+  xTaskNotifyGive(m_nus_tx_thread); // отправляю нотификатор для старта процесса передачи
   
   return NRF_SUCCESS;
 }
@@ -1487,6 +1951,65 @@ ret_code_t bleNusTxWait(uint16_t conn_handle, void *p_data, uint32_t data_size,
 }
 
 
+/*
+* Отправка блока данных из пула через NUS или ECGS без копирования
+* conn_handle - ID соединения
+* blk - указатель на заполненный блок (при успехе владение блоком переходит драйверу)
+* stream - true, если блок - кадр ECGS
+* возвращает код ошибки из nrf_errors.h
+*/
+ret_code_t bleNusTxBlock(uint16_t conn_handle, blk_t *blk, bool stream)
+{
+  if(conn_handle >= NRF_BLE_LINK_COUNT) return NRF_ERROR_CONN_COUNT;
+  if(blk == NULL) return NRF_ERROR_NULL;
+  if((m_tx_blk_queue[conn_handle] == NULL) || (!m_connected_peers[conn_handle].is_connected)) return NRF_ERROR_INVALID_STATE;
+  if(stream && !ble_ecgs_data_enabled(&m_ecgs, conn_handle)) return NRF_ERROR_INVALID_STATE; // пир не подписан на DATA
+  
+  tx_blk_item_t item = {.blk = blk, .stream = stream};
+  if(pdTRUE != xQueueSend(m_tx_blk_queue[conn_handle], &item, 0)) return NRF_ERROR_NO_MEM; // очередь переполнена
+  
+  xTaskNotifyGive(m_nus_tx_thread); // отправляю нотификатор для старта процесса передачи
+  return NRF_SUCCESS;
+}
+
+
+/*
+ * Проверка, подписан ли пир на характеристику данных сервиса ECGS
+ * conn_handle - ID соединения
+ * возвращает true, если блоки данных будут передаваться через ECGS
+ */
+bool bleStreamEnabled(uint16_t conn_handle)
+{
+  if(conn_handle >= NRF_BLE_LINK_COUNT) return false;
+  if(!m_connected_peers[conn_handle].is_connected) return false;
+  return ble_ecgs_data_enabled(&m_ecgs, conn_handle);
+}
+
+
+/*
+ * Запрос максимальной длины данных одной нотификации для соединения
+ * conn_handle - ID соединения
+ * возвращает 0, если соединения нет или MTU еще не согласован
+ */
+uint16_t bleGetMaxDataLen(uint16_t conn_handle)
+{
+  if(conn_handle >= NRF_BLE_LINK_COUNT) return 0;
+  if(!m_connected_peers[conn_handle].is_connected) return 0;
+  return m_connected_peers[conn_handle].nus_max_data_len;
+}
+
+
+/*
+ * Интервал соединения в мс
+ */
+uint16_t bleGetConnIntervalMs(uint16_t conn_handle)
+{
+  if(conn_handle >= NRF_BLE_LINK_COUNT) return 0;
+  if(!m_connected_peers[conn_handle].is_connected) return 0;
+  return (uint16_t)(((uint32_t)m_connected_peers[conn_handle].conn_interval * 5) / 4); // единицы 1.25 мс
+}
+
+
 /*
  * Обновление информации о заряде батареи
  * battery_level - уровень заряда батареи
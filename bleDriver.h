@@ -15,9 +15,14 @@
 #include "stream_buffer.h"
 #include "semphr.h"
 
+#include "blk_pool.h"
+
 
 /// @brief Максимальное количество линков входящих соединений
 #define NRF_BLE_LINK_COUNT    NRF_SDH_BLE_PERIPHERAL_LINK_COUNT // задаются в sdk_config.h
+#define BLE_ADV_MANUF_DATA_MAX  10  // максимальная длина данных производителя (31 байт пакета минус флаги, имя и заголовок данных производителя)
+#define BLE_ADV_EXT_MANUF_DATA_MAX  200 // то же для расширенного эдвертайзинга (255 байт минус флаги, имя, appearance, UUID сервисов)
+#define BLE_ADV_EXT_CONN_MANUF_DATA_MAX 183 // то же для расширенного эдвертайзинга с подключением (SoftDevice ограничивает данные 238 байтами)
 
 /// @brief Тип сообщения
 typedef enum
@@ -29,6 +34,7 @@ typedef enum
   BLE_EVENT_TYPE_GAP,         ///< различные эвенты от GAP (enum BLE_GAP_EVTS)
   BLE_EVENT_TYPE_PASSWORD,    ///< передача пароля для сопряжения на верхний уровень
   BLE_EVENT_TYPE_NEW_BONDING, ///< сообщение о новом бондинге
+  BLE_EVENT_TYPE_TX_DONE,     ///< все данные соединения переданы (подтверждено BLE_GATTS_EVT_HVN_TX_COMPLETE)
 } bleEvtType_t;
 
 /// @brief Тип источника сообщения
@@ -160,7 +166,8 @@ ret_code_t blePMInit(void);
  * @param min_conn_interval_ms - минимальный интервал после подключения
  * @param max_conn_interval_ms - максимальный интервал после подключения
  * @param pwrConn - мощность после установления соединения
- * @param manuf_data - указатель на данных производителя (есть ограничение по длине!)
+ * @param manuf_data - указатель на данных производителя (не длиннее BLE_ADV_MANUF_DATA_MAX, в расширенном эдвертайзинге
+ *                     BLE_ADV_EXT_MANUF_DATA_MAX, с подключением - BLE_ADV_EXT_CONN_MANUF_DATA_MAX; NULL оставляет прежние данные)
  * @param manuf_data_len - длина данных производителя
  * @param conn_en - флаг разрешения подключения
  * @return 
@@ -170,6 +177,34 @@ ret_code_t bleAdvStart(const char *device_name, uint32_t interval_ms, uint32_t d
                         void *manuf_data, uint8_t manuf_data_len, bool conn_en);
 
 
+/**
+ * @brief Выбор обычного или расширенного (Bluetooth 5) эдвертайзинга
+ * 
+ * Расширенный эдвертайзинг несет до BLE_ADV_EXT_MANUF_DATA_MAX байт данных производителя на вторичном канале (2M или Coded PHY),
+ * с разрешенным подключением - до BLE_ADV_EXT_CONN_MANUF_DATA_MAX, scan response в нем нет. Центральные устройства без Bluetooth 5 такой эдвертайзинг не видят.
+ * Режим действует со следующего вызова bleAdvStart().
+ * @param ext - true, если расширенный эдвертайзинг
+ * @param primary_phy - PHY первичных каналов: BLE_GAP_PHY_1MBPS или BLE_GAP_PHY_CODED (дальность)
+ * @param secondary_phy - PHY вторичного канала с данными: BLE_GAP_PHY_1MBPS, BLE_GAP_PHY_2MBPS или BLE_GAP_PHY_CODED
+ * @return 
+ *  код ошибки из nrf_errors.h
+*/
+ret_code_t bleAdvSetExt(bool ext, uint8_t primary_phy, uint8_t secondary_phy);
+
+
+/**
+ * @brief Эдвертайзинг для быстрого переподключения после разрыва связи
+ * 
+ * Используются сохраненные параметры и готовые буферы данных. Фазы: высокоскоростной направленный эдвертайзинг
+ * последнему отключившемуся сопряженному устройству (до 1,28 с), затем частый эдвертайзинг BLE_ADV_FAST_INTERVAL_MS
+ * в течение BLE_ADV_FAST_DURATION_MS с подключением только из белого списка сопряженных устройств, затем обычный.
+ * Фазы без сопряженных устройств пропускаются. Если эдвертайзинг еще не запускался, работает как bleAdvStart(NULL, ...).
+ * @return 
+ *  код ошибки из nrf_errors.h
+*/
+ret_code_t bleAdvFastStart(void);
+
+
 /*
 * Принудительная остановка эдвертайзинга
 */
@@ -179,8 +214,12 @@ void bleAdvStop(void);
 /**
  * @brief Обновление данных производителя в процессе эдвертайзинга
  * 
+ * Эдвертайзинг не останавливается: данные собираются заново и передаются SoftDevice в свободных буферах.
+ * Данные сохраняются и используются при следующих запусках эдвертайзинга. Функция пересобирает пакет целиком,
+ * поэтому частоту вызовов ограничивает верхний уровень.
  * @param manuf_data - данные производителя
- * @param manuf_data_len - длина данных производителя
+ * @param manuf_data_len - длина данных производителя (не больше BLE_ADV_MANUF_DATA_MAX, BLE_ADV_EXT_MANUF_DATA_MAX или
+ *                         BLE_ADV_EXT_CONN_MANUF_DATA_MAX, смотря по режиму эдвертайзинга)
  * @return 
  *  код ошибки из nrf_errors.h
 */
@@ -241,7 +280,7 @@ ret_code_t bleSetNusBuffers(uint16_t conn_handle, StreamBufferHandle_t rx_stream
  * @param conn_handle - ID соединения
  * @param p_data - указатель на буфер с данными для передачи
  * @param data_size - размер даных для передачи
- * @param sema - семафор окончания передачи
+ * @param sema - семафор окончания передачи (выдается, когда все данные соединения переданы в эфир, может быть NULL)
  * @return
  *  код ошибки из nrf_errors.h
 */
@@ -261,6 +300,54 @@ ret_code_t bleNusTx(uint16_t conn_handle, void *p_data, uint32_t data_size, Sema
 ret_code_t bleNusTxWait(uint16_t conn_handle, void *p_data, uint32_t data_size, uint32_t wait_ms);
 
 
+/**
+ * @brief Отправка блока данных из пула через NUS или ECGS без копирования
+ * 
+ * При успешном выполнении владение блоком переходит драйверу: блок будет возвращен в пул после передачи в SoftDevice
+ * или при разрыве соединения. При ошибке владение остается у вызывающей стороны.
+ * Блоки передаются раньше данных из потокового буфера. Если MTU меньше длины блока, блок NUS передается несколькими
+ * нотификациями; кадр ECGS на части не делится и в этом случае теряется.
+ * @param conn_handle - ID соединения
+ * @param blk - указатель на заполненный блок
+ * @param stream - true: блок - кадр ECGS, передается одной нотификацией характеристики DATA (пир должен быть подписан,
+ *                 длина не больше bleGetMaxDataLen()); false: блок передается через NUS
+ * @return
+ *  код ошибки из nrf_errors.h
+*/
+ret_code_t bleNusTxBlock(uint16_t conn_handle, blk_t *blk, bool stream);
+
+
+/**
+ * @brief Проверка, подписан ли пир на характеристику данных сервиса ECGS
+ * 
+ * Если подписан, кадры ECGS можно передавать через bleNusTxBlock(..., true) (один кадр - одна нотификация)
+ * @param conn_handle - ID соединения
+ * @return
+ *  true, если блоки данных передаются через ECGS
+*/
+bool bleStreamEnabled(uint16_t conn_handle);
+
+
+/**
+ * @brief Запрос максимальной длины данных одной нотификации для соединения (зависит от согласованного MTU)
+ * 
+ * @param conn_handle - ID соединения
+ * @return
+ *  длина в байтах или 0, если соединения нет или MTU еще не согласован
+*/
+uint16_t bleGetMaxDataLen(uint16_t conn_handle);
+
+
+/**
+ * @brief Запрос интервала соединения (согласованного при подключении или после обновления параметров)
+ * 
+ * @param conn_handle - ID соединения
+ * @return
+ *  интервал в мс или 0, если соединения нет
+*/
+uint16_t bleGetConnIntervalMs(uint16_t conn_handle);
+
+
 /**
  * @brief Обновление информации о заряде батареи
  * 
@@ -323,6 +410,10 @@ uint16_t blePrintFlashStats(ble_fds_stat_t *stat);
  *  Возвращает ошибку из nrf_errors.h
 */
 uint16_t bleGarbageCollector(void);
+
+
+/// @brief Размер очередей блоков на передачу всех соединений в байтах (бюджет ОЗУ)
+extern const uint32_t bleDriverRamSize;
   
 
 #endif
@@ -20,7 +20,8 @@
 - в manufacturer data сначала идет байт-идентификатор, по которому определяю стурктуру остальных данных
 
 ОГРАНИЧЕНИЯ
-- поддерживается только один канал связи в качестве перефирийного устройства (подключение с телефона), иначе нужно делать отдельную задачу по менеджменту
+- устройство работает только как перефирийное, соединений может быть несколько (NRF_BLE_LINK_COUNT, например телефон и шлюз);
+  после каждого подключения эдвертайзинг перезапускает верхний уровень, пока есть свободные соединения
 
 
 */
@@ -94,6 +95,7 @@ typedef struct
   int16_t      conn_handle;        // хендл подключения (= -1, если подключение не установлено)
   StreamBufferHandle_t nusStreamTx; // фифо NUS для передачи, обслуживающее этот канал связи
   StreamBufferHandle_t nusStreamRx; // фифо NUS для приема, обслуживающее этот канал связи
+  volatile bool tx_pend;           // сообщение BLE_TASK_TX уже в очереди (повторные не ставятся)
 } conn_table_t;
 
 typedef struct
@@ -105,11 +107,20 @@ typedef struct
 static QueueHandle_t        m_evtQueueHandle; // очередь событий для верхнего уровня
 static conn_table_t         m_connTable[NRF_BLE_LINK_COUNT]; // таблица соединений (в качестве индекса используется conn_handle_t)
 
+// статически выделенная память под очередь и потоковые буферы
+static uint8_t              m_evtQueueStorage[UNIT_NUS_EVT_QUEUE_SIZE * sizeof(bleTaskEvtData_t)];
+static StaticQueue_t        m_evtQueueStatic;
+static uint8_t              m_nusRxStorage[NRF_BLE_LINK_COUNT][NUS_RX_SIZE_MAX + 1]; // +1 байт требуется реализации потокового буфера
+static StaticStreamBuffer_t m_nusRxStatic[NRF_BLE_LINK_COUNT];
+static uint8_t              m_nusTxStorage[NRF_BLE_LINK_COUNT][NUS_TX_SIZE_MAX + 1];
+static StaticStreamBuffer_t m_nusTxStatic[NRF_BLE_LINK_COUNT];
+const uint32_t              bleTaskRamSize = sizeof(m_evtQueueStorage) + sizeof(m_nusRxStorage) + sizeof(m_nusTxStorage);
+
 
 // ##################################### ВСПОМОГАТЕЛЬНЫЕ ФУНКЦИИ ######################################################
 
-static void sendMsg(bleTaskEvents_t evtID, conn_handle_t conn_handle, void *data)
-{ // отправка сообщения на верх
+static bool sendMsg(bleTaskEvents_t evtID, conn_handle_t conn_handle, void *data)
+{ // отправка сообщения на верх, возвращает false при переполнении очереди
     bleTaskEvtData_t evt = {
       .evtID = evtID,
       .conn_handle = conn_handle
@@ -121,8 +132,10 @@ static void sendMsg(bleTaskEvents_t evtID, conn_handle_t conn_handle, void *data
       if(pdPASS != xQueueSendFromISR(m_evtQueueHandle, (const void *)&evt, NULL))
       { // переполнение очередь
         RTT_LOG_INFO("BLE TASK msg queue ovf");
+        return false;
       }
     }
+    return true;
 }
 
 // ##################################### ОБРАБОТЧИКИ СОБЫТИЙ НИЖНЕГО УРОВНЯ ######################################################
@@ -162,6 +175,18 @@ static void  nusBlePerepheralEvtHandler(bleCallback_t *data)
     }
     break;
     
+    case BLE_EVENT_TYPE_TX_DONE: // все данные соединения переданы
+    {
+      RTT_LOG_DEBUG("BLE TASK: BLE_EVENT_TYPE_TX_DONE");
+      if(p_data->conn_handle == BLE_CONN_HANDLE_INVALID) break;
+      // окончания передачи объединяются: пока верхний уровень занят, в очереди не больше одного BLE_TASK_TX на соединение
+      // и они не вытесняют подключения и прием данных
+      if(m_connTable[p_data->conn_handle].tx_pend) break;
+      m_connTable[p_data->conn_handle].tx_pend = true;
+      if(!sendMsg(BLE_TASK_TX, p_data->conn_handle, NULL)) m_connTable[p_data->conn_handle].tx_pend = false; // отправляю сообщение на верхний уровень
+    }
+    break;
+    
     case BLE_EVENT_TYPE_NUS_RX: // приняты данные по каналу NUS
     {
       RTT_LOG_DEBUG("BLE TASK: BLE_EVENT_TYPE_NUS_RX");
@@ -247,19 +272,24 @@ ret_code_t bleTaskInit(void)
   ERROR_CHECK(bleDeviceInfoInit(MANUFACTURER_NAME, FW_VER, HW_VER, MANUFACTURER_ID, ORG_UNIQUE_ID));
   
   // инициализирую очередь сообщений для верхнего уровня
-  m_evtQueueHandle = xQueueCreate(UNIT_NUS_EVT_QUEUE_SIZE, sizeof(bleTaskEvtData_t));
+  m_evtQueueHandle = xQueueCreateStatic(UNIT_NUS_EVT_QUEUE_SIZE, sizeof(bleTaskEvtData_t), m_evtQueueStorage, &m_evtQueueStatic);
   if(m_evtQueueHandle == NULL) return NRF_ERROR_NO_MEM;
   
   memset(&m_connTable, 0, sizeof(m_connTable)); // очищаю таблицу поддерживаемых устройств
   for(uint8_t i = 0; i < NRF_BLE_LINK_COUNT; i++)
   {
     m_connTable[i].conn_handle = BLE_CONN_HANDLE_INVALID;
-    m_connTable[i].nusStreamRx = xStreamBufferCreate(NUS_RX_SIZE_MAX, 1); // создаю потоковый буфер с триггером в 1 байт
+    m_connTable[i].nusStreamRx = xStreamBufferCreateStatic(NUS_RX_SIZE_MAX, 1, m_nusRxStorage[i], &m_nusRxStatic[i]); // создаю потоковый буфер с триггером в 1 байт
     if(m_connTable[i].nusStreamRx == NULL) return NRF_ERROR_NO_MEM;
-    m_connTable[i].nusStreamTx = xStreamBufferCreate(NUS_TX_SIZE_MAX, 1); // создаю потоковый буфер с триггером в 1 байт
+    m_connTable[i].nusStreamTx = xStreamBufferCreateStatic(NUS_TX_SIZE_MAX, 1, m_nusTxStorage[i], &m_nusTxStatic[i]); // создаю потоковый буфер с триггером в 1 байт
     if(m_connTable[i].nusStreamTx == NULL) return NRF_ERROR_NO_MEM;
   }
   
+#if(BLE_ADV_EXT_EN)
+  // расширенный эдвертайзинг: данные производителя до BLE_ADV_EXT_CONN_MANUF_DATA_MAX байт (подключения разрешены)
+  ERROR_CHECK(bleAdvSetExt(true, BLE_ADV_EXT_PRIMARY_PHY, BLE_ADV_EXT_SECONDARY_PHY));
+#endif // BLE_ADV_EXT_EN
+
 #if(BLE_NO_ADV == 0)
   // запускаю эдвертайзинг (данные производителя не используются, подключения разрешены)
   vTaskDelay(pdMS_TO_TICKS(10)); // задержка нужна для запуска задачи из bleInit()
@@ -279,7 +309,12 @@ bool bleTaskWaitEvt(bleTaskEvtData_t *evt, uint32_t wait_ms)
   // возвращает false, если вышли по таймауту
   if(m_evtQueueHandle == NULL) return false;
   if(evt == NULL) return false;
-  return (pdTRUE == xQueueReceive(m_evtQueueHandle, (void *)evt, pdMS_TO_TICKS(wait_ms)));
+  if(pdTRUE != xQueueReceive(m_evtQueueHandle, (void *)evt, pdMS_TO_TICKS(wait_ms))) return false;
+  if((evt->evtID == BLE_TASK_TX) && (evt->conn_handle >= 0) && (evt->conn_handle < NRF_BLE_LINK_COUNT))
+  { // следующее окончание передачи снова будет передано
+    m_connTable[evt->conn_handle].tx_pend = false;
+  }
+  return true;
 }
 
 
@@ -290,6 +325,7 @@ void bleTaskEvtClear(void)
 {
   if(m_evtQueueHandle == NULL) return;
   xQueueReset(m_evtQueueHandle);
+  for(conn_handle_t i = 0; i < NRF_BLE_LINK_COUNT; i++) m_connTable[i].tx_pend = false;
 }
 
 
@@ -297,10 +333,13 @@ bool bleTaskTxData(conn_handle_t conn_handle, uint8_t *buff, uint16_t size, Sema
 { // передача бинарных данных, данные собираются в пакет
   // соединение с приемником данных должно быть уже установлено, иначе данные будут потеряны
   // возвращает false, если не удалось добавить в буфер
-
+  // функция не ждет: окончание передачи сигнализируется семафором sema (если задан) и сообщением BLE_TASK_TX
+  if(buff == NULL) return false;
+  if((conn_handle < 0) || (conn_handle >= NRF_BLE_LINK_COUNT)) return false;
   
+  if(sema != NULL) xSemaphoreTake(sema, 0); // сбрасываю семафор от предыдущей передачи
   
-  return false;
+  return (NRF_SUCCESS == bleNusTx(m_connTable[conn_handle].conn_handle, buff, size, sema));
 }
 
 
@@ -322,6 +361,51 @@ bool bleTaskTxDataWait(conn_handle_t conn_handle, uint8_t *buff, uint16_t size,
 }
 
 
+/*
+* Передача блока данных из пула через NUS без копирования и без ожидания
+* conn_handle - хендл устройства, которому нужно передать данные
+* blk - указатель на заполненный блок
+* Возвращает false, если блок не принят драйвером (тогда блок остается у вызывающей стороны)
+*/
+bool bleTaskTxBlock(conn_handle_t conn_handle, blk_t *blk, bool stream)
+{
+  if(blk == NULL) return false;
+  if((conn_handle < 0) || (conn_handle >= NRF_BLE_LINK_COUNT)) return false;
+  
+  return (NRF_SUCCESS == bleNusTxBlock(m_connTable[conn_handle].conn_handle, blk, stream));
+}
+
+
+/*
+* Проверка подписки на характеристику данных сервиса ECGS
+*/
+bool bleTaskStreamEnabled(conn_handle_t conn_handle)
+{
+  if((conn_handle < 0) || (conn_handle >= NRF_BLE_LINK_COUNT)) return false;
+  return bleStreamEnabled(m_connTable[conn_handle].conn_handle);
+}
+
+
+/*
+* Запрос максимальной длины данных одной нотификации
+*/
+uint16_t bleTaskGetMaxDataLen(conn_handle_t conn_handle)
+{
+  if((conn_handle < 0) || (conn_handle >= NRF_BLE_LINK_COUNT)) return 0;
+  return bleGetMaxDataLen(m_connTable[conn_handle].conn_handle);
+}
+
+
+/*
+* Запрос интервала соединения
+*/
+uint16_t bleTaskGetConnIntervalMs(conn_handle_t conn_handle)
+{
+  if((conn_handle < 0) || (conn_handle >= NRF_BLE_LINK_COUNT)) return 0;
+  return bleGetConnIntervalMs(m_connTable[conn_handle].conn_handle);
+}
+
+
 /*
 * Запрос количества данных в приемном буфере
 * возвращает количество данных
@@ -27,7 +27,7 @@ typedef enum
   BLE_TASK_CONNECTED =1,  // устройство подключено
   BLE_TASK_DISCONNECTED,  // устройство отключено
   BLE_TASK_RX,            // поступили новые данные
-  BLE_TASK_TX,            // данные переданы (НЕ РЕАЛИЗОВАНО)
+  BLE_TASK_TX,            // все данные соединения переданы
 } bleTaskEvents_t;
 
 /// @brief Cтруктура передаваемого сообщения (можно изменять без ограничений)
@@ -68,10 +68,12 @@ void bleTaskEvtClear(void);
 /**
  * @brief Передача бинарных данных через NUS, данные собираются в пакет
  * 
+ * Функция не ждет окончания передачи. Семафор sema выдается, когда все данные соединения переданы в эфир, 
+ * одновременно на верхний уровень приходит сообщение BLE_TASK_TX (пока оно не прочитано, новые по этому соединению не ставятся)
  * @param conn_handle - хендл устройства, которому нужно передать данные
  * @param buff - указатель на буфер с данными
  * @param size - размер данных в буфере
- * @param sema - семафор окончания передачи данных
+ * @param sema - семафор окончания передачи данных (может быть NULL)
  * @return
  *  Возвращает false, если данные по каким-либо причинам (переполение буфера, ни одного сборщика не подключено) не могут быть переданы
 */
@@ -91,6 +93,49 @@ bool bleTaskTxData(conn_handle_t conn_handle, uint8_t *buff, uint16_t size, Sema
 bool bleTaskTxDataWait(conn_handle_t conn_handle, uint8_t *buff, uint16_t size, uint32_t wait_ms);
 
 
+/**
+ * @brief Передача блока данных из пула через NUS или ECGS без копирования и без ожидания
+ * 
+ * @param conn_handle - хендл устройства, которому нужно передать данные
+ * @param blk - указатель на заполненный блок
+ * @param stream - true, если блок - кадр ECGS (одна нотификация характеристики DATA), иначе блок передается через NUS
+ * @return 
+ * Возвращает true, если блок принят драйвером (владение передано драйверу)
+ * Возвращает false, если блок не может быть передан (владение остается у вызывающей стороны, блок нужно освободить)
+*/
+bool bleTaskTxBlock(conn_handle_t conn_handle, blk_t *blk, bool stream);
+
+
+/**
+ * @brief Проверка, подписано ли приложение на характеристику данных сервиса ECGS
+ * 
+ * @param conn_handle - хендл устройства
+ * @return
+ *  true, если блоки передаются через ECGS (формат кадров без маркеров), false - через NUS (старый формат)
+*/
+bool bleTaskStreamEnabled(conn_handle_t conn_handle);
+
+
+/**
+ * @brief Запрос максимальной длины данных одной нотификации
+ * 
+ * @param conn_handle - хендл устройства
+ * @return
+ *  длина в байтах или 0, если MTU еще не согласован
+*/
+uint16_t bleTaskGetMaxDataLen(conn_handle_t conn_handle);
+
+
+/**
+ * @brief Запрос интервала соединения
+ * 
+ * @param conn_handle - хендл устройства
+ * @return
+ *  интервал в мс или 0, если соединения нет
+*/
+uint16_t bleTaskGetConnIntervalMs(conn_handle_t conn_handle);
+
+
 /**
  * @brief Запрос количества данных в приемном буфере
  * 
@@ -160,4 +205,8 @@ void bleDisconnectUnit(conn_handle_t conn_handle);
 */
 uint16_t bleGetConnHandle(conn_handle_t conn_handle);
 
+
+/// @brief Размер очереди событий и потоковых буферов NUS всех соединений в байтах (бюджет ОЗУ)
+extern const uint32_t bleTaskRamSize;
+
 #endif
@@ -0,0 +1,177 @@
+/*
+Сервис потоковой передачи данных ЭКГ (ECGS)
+
+ОСОБЕННОСТИ
+- кадры данных передаются по отдельной характеристике DATA и не смешиваются с текстовыми ответами на команды,
+  поэтому телефону не нужно искать маркер начала посылки
+- состояние подписки на нотификации не хранится в сервисе, а читается из CCCD: так оно остается верным после восстановления бондинга
+- требует отдельного vendor specific UUID (NRF_SDH_BLE_VS_UUID_COUNT в sdk_config.h учитывает NUS и ECGS)
+
+*/
+
+#include "ble_ecgs.h"
+
+#include <string.h>
+#include "sdk_common.h"
+#include "ble_gatts.h"
+
+
+static ret_code_t notify(uint16_t conn_handle, uint16_t value_handle, uint8_t *p_data, uint16_t *p_length)
+{ // передача нотификации
+  ble_gatts_hvx_params_t hvx_params;
+
+  if((p_data == NULL) || (p_length == NULL)) return NRF_ERROR_NULL;
+  if(conn_handle == BLE_CONN_HANDLE_INVALID) return NRF_ERROR_NOT_FOUND;
+  if(*p_length > BLE_ECGS_MAX_DATA_LEN) return NRF_ERROR_INVALID_PARAM;
+
+  memset(&hvx_params, 0, sizeof(hvx_params));
+  hvx_params.handle = value_handle;
+  hvx_params.p_data = p_data;
+  hvx_params.p_len  = p_length;
+  hvx_params.type   = BLE_GATT_HVX_NOTIFICATION;
+
+  return sd_ble_gatts_hvx(conn_handle, &hvx_params);
+}
+
+static bool notif_enabled(uint16_t conn_handle, uint16_t cccd_handle)
+{ // чтение CCCD: true, если нотификации разрешены
+  uint8_t           cccd[BLE_CCCD_VALUE_LEN];
+  ble_gatts_value_t gatts_val;
+
+  if(conn_handle == BLE_CONN_HANDLE_INVALID) return false;
+
+  memset(&gatts_val, 0, sizeof(gatts_val));
+  gatts_val.len     = sizeof(cccd);
+  gatts_val.offset  = 0;
+  gatts_val.p_value = cccd;
+
+  if(NRF_SUCCESS != sd_ble_gatts_value_get(conn_handle, cccd_handle, &gatts_val)) return false;
+  return ble_srv_is_notification_enabled(cccd);
+}
+
+
+// %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+/*
+* Инициализация сервиса
+*/
+ret_code_t ble_ecgs_init(ble_ecgs_t *p_ecgs, ble_ecgs_init_t const *p_init)
+{
+  ret_code_t            err_code;
+  ble_uuid_t            ble_uuid;
+  ble_uuid128_t         ecgs_base_uuid = {BLE_ECGS_UUID_BASE};
+  ble_add_char_params_t add_char_params;
+
+  VERIFY_PARAM_NOT_NULL(p_ecgs);
+  VERIFY_PARAM_NOT_NULL(p_init);
+
+  p_ecgs->evt_handler = p_init->evt_handler;
+
+  // базовый UUID сервиса
+  err_code = sd_ble_uuid_vs_add(&ecgs_base_uuid, &p_ecgs->uuid_type);
+  VERIFY_SUCCESS(err_code);
+
+  ble_uuid.type = p_ecgs->uuid_type;
+  ble_uuid.uuid = BLE_ECGS_UUID_SERVICE;
+
+  err_code = sd_ble_gatts_service_add(BLE_GATTS_SRVC_TYPE_PRIMARY, &ble_uuid, &p_ecgs->service_handle);
+  VERIFY_SUCCESS(err_code);
+
+  // характеристика DATA: только нотификации
+  memset(&add_char_params, 0, sizeof(add_char_params));
+  add_char_params.uuid              = BLE_ECGS_UUID_DATA_CHAR;
+  add_char_params.uuid_type         = p_ecgs->uuid_type;
+  add_char_params.max_len           = BLE_ECGS_MAX_DATA_LEN;
+  add_char_params.init_len          = sizeof(uint8_t);
+  add_char_params.is_var_len        = true;
+  add_char_params.char_props.notify = 1;
+  add_char_params.read_access       = SEC_OPEN;
+  add_char_params.write_access      = SEC_OPEN;
+  add_char_params.cccd_write_access = SEC_OPEN;
+
+  err_code = characteristic_add(p_ecgs->service_handle, &add_char_params, &p_ecgs->data_handles);
+  VERIFY_SUCCESS(err_code);
+
+  // характеристика CTRL: запись команд и нотификации с ответами
+  memset(&add_char_params, 0, sizeof(add_char_params));
+  add_char_params.uuid                     = BLE_ECGS_UUID_CTRL_CHAR;
+  add_char_params.uuid_type                = p_ecgs->uuid_type;
+  add_char_params.max_len                  = BLE_ECGS_MAX_DATA_LEN;
+  add_char_params.init_len                 = sizeof(uint8_t);
+  add_char_params.is_var_len               = true;
+  add_char_params.char_props.write         = 1;
+  add_char_params.char_props.write_wo_resp = 1;
+  add_char_params.char_props.notify        = 1;
+  add_char_params.read_access              = SEC_OPEN;
+  add_char_params.write_access             = SEC_OPEN;
+  add_char_params.cccd_write_access        = SEC_OPEN;
+
+  return characteristic_add(p_ecgs->service_handle, &add_char_params, &p_ecgs->ctrl_handles);
+}
+
+
+/*
+* Обработчик событий BLE стека
+*/
+void ble_ecgs_on_ble_evt(ble_evt_t const *p_ble_evt, void *p_context)
+{
+  ble_ecgs_t *p_ecgs = (ble_ecgs_t *)p_context;
+
+  if((p_ble_evt == NULL) || (p_ecgs == NULL)) return;
+
+  if(p_ble_evt->header.evt_id == BLE_GATTS_EVT_WRITE)
+  {
+    ble_gatts_evt_write_t const *p_write = &p_ble_evt->evt.gatts_evt.params.write;
+
+    if((p_write->handle == p_ecgs->ctrl_handles.value_handle) && (p_ecgs->evt_handler != NULL))
+    { // принята команда
+      ble_ecgs_evt_t evt;
+      memset(&evt, 0, sizeof(evt));
+      evt.type        = BLE_ECGS_EVT_CTRL_RX;
+      evt.conn_handle = p_ble_evt->evt.gatts_evt.conn_handle;
+      evt.p_data      = p_write->data;
+      evt.length      = p_write->len;
+      p_ecgs->evt_handler(&evt);
+    }
+  }
+}
+
+
+/*
+* Передача кадра данных
+*/
+ret_code_t ble_ecgs_data_send(ble_ecgs_t *p_ecgs, uint8_t *p_data, uint16_t *p_length, uint16_t conn_handle)
+{
+  VERIFY_PARAM_NOT_NULL(p_ecgs);
+  return notify(conn_handle, p_ecgs->data_handles.value_handle, p_data, p_length);
+}
+
+
+/*
+* Передача ответа на команду
+*/
+ret_code_t ble_ecgs_ctrl_send(ble_ecgs_t *p_ecgs, uint8_t *p_data, uint16_t *p_length, uint16_t conn_handle)
+{
+  VERIFY_PARAM_NOT_NULL(p_ecgs);
+  return notify(conn_handle, p_ecgs->ctrl_handles.value_handle, p_data, p_length);
+}
+
+
+/*
+* Проверка подписки на нотификации DATA
+*/
+bool ble_ecgs_data_enabled(ble_ecgs_t *p_ecgs, uint16_t conn_handle)
+{
+  if(p_ecgs == NULL) return false;
+  return notif_enabled(conn_handle, p_ecgs->data_handles.cccd_handle);
+}
+
+
+/*
+* Проверка подписки на нотификации CTRL
+*/
+bool ble_ecgs_ctrl_enabled(ble_ecgs_t *p_ecgs, uint16_t conn_handle)
+{
+  if(p_ecgs == NULL) return false;
+  return notif_enabled(conn_handle, p_ecgs->ctrl_handles.cccd_handle);
+}
@@ -0,0 +1,153 @@
+#ifndef BLE_ECGS_H
+#define BLE_ECGS_H
+
+/*
+Сервис потоковой передачи данных ЭКГ (ECGS, vendor specific)
+Содержит две характеристики:
+- DATA - только нотификации, по ней передаются кадры данных АЦП (один кадр = одна нотификация)
+- CTRL - запись команд и нотификации с ответами на них
+NUS остается для старых приложений, новые приложения работают через ECGS
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "ble.h"
+#include "sdk_config.h"
+#include "nrf_sdh_ble.h"
+#include "sdk_errors.h"
+#include "ble_srv_common.h"
+
+
+// НАСТРОЙКИ МОДУЛЯ ************************************
+#ifndef BLE_ECGS_BLE_OBSERVER_PRIO
+#define BLE_ECGS_BLE_OBSERVER_PRIO      2   // приоритет обработчика событий BLE сервиса
+#endif // BLE_ECGS_BLE_OBSERVER_PRIO
+// *****************************************************
+
+
+/// @brief Базовый 128-битный UUID сервиса (байты 12 и 13 заменяются 16-битными UUID ниже)
+#define BLE_ECGS_UUID_BASE              {0x3C, 0x1A, 0x5E, 0x72, 0x84, 0x9B, 0x4D, 0x11, \
+                                         0xA6, 0x2F, 0x0B, 0xD3, 0x00, 0x00, 0xC7, 0x8E}
+#define BLE_ECGS_UUID_SERVICE           0x0001  ///< UUID сервиса
+#define BLE_ECGS_UUID_DATA_CHAR         0x0002  ///< UUID характеристики данных
+#define BLE_ECGS_UUID_CTRL_CHAR         0x0003  ///< UUID характеристики команд и ответов
+
+/// @brief Максимальная длина данных одной нотификации
+#define BLE_ECGS_MAX_DATA_LEN           (NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3)
+
+
+/**
+ * @brief Макрос объявления экземпляра сервиса и регистрации его обработчика событий BLE
+ *
+ * @param _name - имя экземпляра
+*/
+#define BLE_ECGS_DEF(_name)                                                                         \
+static ble_ecgs_t _name;                                                                            \
+NRF_SDH_BLE_OBSERVER(_name ## _obs, BLE_ECGS_BLE_OBSERVER_PRIO, ble_ecgs_on_ble_evt, &_name)
+
+
+/// @brief Тип события сервиса
+typedef enum
+{
+  BLE_ECGS_EVT_CTRL_RX,       ///< в характеристику CTRL записаны данные
+} ble_ecgs_evt_type_t;
+
+/// @brief Событие сервиса
+typedef struct
+{
+  ble_ecgs_evt_type_t   type;         ///< тип события
+  uint16_t              conn_handle;  ///< номер соединения
+  uint8_t const         *p_data;      ///< принятые данные
+  uint16_t              length;       ///< длина принятых данных
+} ble_ecgs_evt_t;
+
+/// @brief Тип обработчика событий сервиса
+typedef void (*ble_ecgs_evt_handler_t)(ble_ecgs_evt_t *p_evt);
+
+/// @brief Параметры инициализации сервиса
+typedef struct
+{
+  ble_ecgs_evt_handler_t  evt_handler;  ///< обработчик событий сервиса
+} ble_ecgs_init_t;
+
+/// @brief Экземпляр сервиса
+typedef struct
+{
+  uint8_t                   uuid_type;      ///< тип UUID, выданный SoftDevice для базового UUID
+  uint16_t                  service_handle; ///< хендл сервиса
+  ble_gatts_char_handles_t  data_handles;   ///< хендлы характеристики DATA
+  ble_gatts_char_handles_t  ctrl_handles;   ///< хендлы характеристики CTRL
+  ble_ecgs_evt_handler_t    evt_handler;    ///< обработчик событий сервиса
+} ble_ecgs_t;
+
+
+/**
+ * @brief Инициализация сервиса: регистрация базового UUID, добавление сервиса и характеристик в таблицу GATT
+ *
+ * @param p_ecgs - экземпляр сервиса
+ * @param p_init - параметры инициализации
+ * @return
+ *  код ошибки из nrf_errors.h
+*/
+ret_code_t ble_ecgs_init(ble_ecgs_t *p_ecgs, ble_ecgs_init_t const *p_init);
+
+
+/**
+ * @brief Обработчик событий BLE стека (регистрируется макросом BLE_ECGS_DEF)
+ *
+ * @param p_ble_evt - событие
+ * @param p_context - экземпляр сервиса
+*/
+void ble_ecgs_on_ble_evt(ble_evt_t const *p_ble_evt, void *p_context);
+
+
+/**
+ * @brief Передача кадра данных нотификацией характеристики DATA
+ *
+ * @param p_ecgs - экземпляр сервиса
+ * @param p_data - данные
+ * @param p_length - длина данных (на выходе - фактически переданная длина)
+ * @param conn_handle - номер соединения
+ * @return
+ *  код ошибки из nrf_errors.h (NRF_ERROR_RESOURCES, если заняты все передающие буферы SoftDevice)
+*/
+ret_code_t ble_ecgs_data_send(ble_ecgs_t *p_ecgs, uint8_t *p_data, uint16_t *p_length, uint16_t conn_handle);
+
+
+/**
+ * @brief Передача ответа нотификацией характеристики CTRL
+ *
+ * @param p_ecgs - экземпляр сервиса
+ * @param p_data - данные
+ * @param p_length - длина данных (на выходе - фактически переданная длина)
+ * @param conn_handle - номер соединения
+ * @return
+ *  код ошибки из nrf_errors.h
+*/
+ret_code_t ble_ecgs_ctrl_send(ble_ecgs_t *p_ecgs, uint8_t *p_data, uint16_t *p_length, uint16_t conn_handle);
+
+
+/**
+ * @brief Проверка, подписан ли пир на нотификации характеристики DATA
+ *
+ * Значение читается из CCCD, поэтому учитывает и подписки, восстановленные из бондинга
+ * @param p_ecgs - экземпляр сервиса
+ * @param conn_handle - номер соединения
+ * @return
+ *  true, если нотификации разрешены
+*/
+bool ble_ecgs_data_enabled(ble_ecgs_t *p_ecgs, uint16_t conn_handle);
+
+
+/**
+ * @brief Проверка, подписан ли пир на нотификации характеристики CTRL
+ *
+ * @param p_ecgs - экземпляр сервиса
+ * @param conn_handle - номер соединения
+ * @return
+ *  true, если нотификации разрешены
+*/
+bool ble_ecgs_ctrl_enabled(ble_ecgs_t *p_ecgs, uint16_t conn_handle);
+
+
+#endif
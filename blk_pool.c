@@ -0,0 +1,138 @@
+/*
+Пул блоков фиксированного размера
+
+ОСОБЕННОСТИ
+- память под блоки выделяется статически
+- выделение и освобождение выполняются за O(1): свободные блоки хранятся в стеке индексов
+- критические секции сделаны через маску прерываний FreeRTOS, поэтому все функции можно вызывать как из задач, так и из прерываний
+  с приоритетом не выше configMAX_SYSCALL_INTERRUPT_PRIORITY
+
+ОГРАНИЧЕНИЯ
+- количество блоков не более 255
+
+*/
+
+#include "blk_pool.h"
+#include "errors.h"
+
+// FreeRTOS
+#include "FreeRTOS.h"
+#include "task.h"
+
+
+#if(BLK_POOL_BLOCK_CNT > 255)
+#error "BLK_POOL_BLOCK_CNT must be less than 256"
+#endif
+
+
+static blk_t      m_blocks[BLK_POOL_BLOCK_CNT];   // блоки данных
+static uint8_t    m_refcnt[BLK_POOL_BLOCK_CNT];   // счетчики ссылок на блоки
+static uint8_t    m_free_idx[BLK_POOL_BLOCK_CNT]; // стек индексов свободных блоков
+const uint32_t    blk_pool_ram_size = sizeof(m_blocks) + sizeof(m_refcnt) + sizeof(m_free_idx);
+static uint16_t   m_free_cnt = 0;                 // количество свободных блоков (вершина стека)
+static uint16_t   m_hwm = 0;                      // максимальное количество одновременно занятых блоков
+static uint32_t   m_alloc_fail = 0;               // счетчик отказов в выделении блока
+
+
+
+static int16_t blk_index(blk_t *blk)
+{ // возвращает номер блока в пуле или -1, если указатель не принадлежит пулу
+  if((blk < &m_blocks[0]) || (blk > &m_blocks[BLK_POOL_BLOCK_CNT - 1])) return -1;
+  return (int16_t)(blk - &m_blocks[0]);
+}
+
+
+// %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+/*
+* Начальная инициализация пула
+*/
+uint16_t blk_pool_init(void)
+{
+  UBaseType_t key = portSET_INTERRUPT_MASK_FROM_ISR();
+  for(uint16_t i = 0; i < BLK_POOL_BLOCK_CNT; i++)
+  {
+    m_free_idx[i] = (uint8_t)i;
+    m_refcnt[i] = 0;
+  }
+  m_free_cnt = BLK_POOL_BLOCK_CNT;
+  m_hwm = 0;
+  m_alloc_fail = 0;
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(key);
+
+  return ERR_NOERROR;
+}
+
+
+/*
+* Выделение блока из пула
+* возвращает указатель на блок или NULL
+*/
+blk_t *blk_pool_alloc(void)
+{
+  blk_t *blk = NULL;
+
+  UBaseType_t key = portSET_INTERRUPT_MASK_FROM_ISR();
+  if(m_free_cnt != 0)
+  {
+    uint8_t idx = m_free_idx[--m_free_cnt];
+    m_refcnt[idx] = 1;
+    blk = &m_blocks[idx];
+    uint16_t used = BLK_POOL_BLOCK_CNT - m_free_cnt;
+    if(used > m_hwm) m_hwm = used;
+  }else{
+    m_alloc_fail++;
+  }
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(key);
+
+  if(blk) blk->len = 0;
+  return blk;
+}
+
+
+/*
+* Увеличение счетчика ссылок на блок
+*/
+void blk_pool_ref(blk_t *blk)
+{
+  int16_t idx = blk_index(blk);
+  if(idx < 0) return;
+
+  UBaseType_t key = portSET_INTERRUPT_MASK_FROM_ISR();
+  if(m_refcnt[idx] != 0) m_refcnt[idx]++;
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(key);
+}
+
+
+/*
+* Освобождение блока: уменьшает счетчик ссылок и возвращает блок в пул, если ссылок больше нет
+*/
+void blk_pool_free(blk_t *blk)
+{
+  int16_t idx = blk_index(blk);
+  if(idx < 0) return;
+
+  UBaseType_t key = portSET_INTERRUPT_MASK_FROM_ISR();
+  if(m_refcnt[idx] != 0)
+  { // повторное освобождение свободного блока игнорирую
+    m_refcnt[idx]--;
+    if(m_refcnt[idx] == 0) m_free_idx[m_free_cnt++] = (uint8_t)idx;
+  }
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(key);
+}
+
+
+/*
+* Запрос статистики использования пула
+*/
+void blk_pool_get_stat(blk_pool_stat_t *stat)
+{
+  if(stat == NULL) return;
+
+  UBaseType_t key = portSET_INTERRUPT_MASK_FROM_ISR();
+  stat->total = BLK_POOL_BLOCK_CNT;
+  stat->free = m_free_cnt;
+  stat->hwm = m_hwm;
+  stat->alloc_fail = m_alloc_fail;
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(key);
+}
@@ -0,0 +1,90 @@
+#ifndef BLK_POOL_H
+#define BLK_POOL_H
+
+/*
+Пул блоков фиксированного размера для передачи данных между задачами (АЦП -> BLE)
+Производитель заполняет блок и передает владение дальше по цепочке, последний владелец возвращает блок в пул
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "settings.h"
+
+
+// НАСТРОЙКИ МОДУЛЯ ************************************
+#ifndef BLK_POOL_BLOCK_SIZE
+#define BLK_POOL_BLOCK_SIZE       244   // размер данных одного блока (одна нотификация BLE при MTU 247)
+#endif // BLK_POOL_BLOCK_SIZE
+#ifndef BLK_POOL_BLOCK_CNT
+#define BLK_POOL_BLOCK_CNT        32    // количество блоков в пуле (не более 255)
+#endif // BLK_POOL_BLOCK_CNT
+// *****************************************************
+
+
+/// @brief Блок данных
+typedef struct
+{
+  uint16_t    len;                        ///< длина полезных данных в блоке
+  uint8_t     data[BLK_POOL_BLOCK_SIZE];  ///< данные
+} blk_t;
+
+/// @brief Статистика использования пула
+typedef struct
+{
+  uint16_t    total;      ///< общее количество блоков
+  uint16_t    free;       ///< количество свободных блоков в данный момент
+  uint16_t    hwm;        ///< максимальное количество одновременно занятых блоков (для подбора BLK_POOL_BLOCK_CNT)
+  uint32_t    alloc_fail; ///< количество отказов в выделении блока
+} blk_pool_stat_t;
+
+
+/**
+ * @brief Начальная инициализация пула (все блоки свободны, статистика сброшена)
+ *
+ * @return
+ *  ERR_NOERROR
+*/
+uint16_t blk_pool_init(void);
+
+
+/**
+ * @brief Выделение блока из пула (можно вызывать из прерывания)
+ *
+ * Счетчик ссылок выделенного блока равен 1, длина данных равна 0
+ * @return
+ *  указатель на блок или NULL, если свободных блоков нет
+*/
+blk_t *blk_pool_alloc(void);
+
+
+/**
+ * @brief Увеличение счетчика ссылок на блок (можно вызывать из прерывания)
+ *
+ * Используется, если один блок нужно передать нескольким потребителям, каждый из которых вызовет blk_pool_free()
+ * @param blk - указатель на блок
+*/
+void blk_pool_ref(blk_t *blk);
+
+
+/**
+ * @brief Освобождение блока (можно вызывать из прерывания)
+ *
+ * Уменьшает счетчик ссылок, при достижении нуля блок возвращается в пул
+ * @param blk - указатель на блок (NULL игнорируется)
+*/
+void blk_pool_free(blk_t *blk);
+
+
+/**
+ * @brief Запрос статистики использования пула
+ *
+ * @param stat - указатель на структуру для статистики
+*/
+void blk_pool_get_stat(blk_pool_stat_t *stat);
+
+
+/// @brief Размер пула со служебными массивами в байтах (бюджет ОЗУ)
+extern const uint32_t blk_pool_ram_size;
+
+
+#endif
@@ -15,11 +15,30 @@
 #define GPIOTE_IRQ_PRIORITY     7
 /* распределение каналов прерываний GPIOTE (всего их 8)
 0 - ADS129X
-
+1 - ADS129X CS0 (режим задачи, аппаратный запуск чтения по DRDY)
+2 - ADS129X CS1 (режим задачи, аппаратный запуск чтения по DRDY)
 
 */
 #define GPIOTE_CH_ADS129X      0
 #define GPIOTE_INT_ADS129X     GPIOTE_INTENSET_IN0_Msk
+#define GPIOTE_CH_ADS129X_CS   {1, 2} // каналы GPIOTE для выводов CS по порядку найденных АЦП (ads_stream)
+
+/* распределение каналов PPI (каналы 17..19 и группы 4..5 заняты SoftDevice)
+0..6 - ADS129X (ads_stream)
+группы 0..1 - ADS129X (ads_stream)
+*/
+#define PPI_CH_ADS129X         0 // первый из 7 каналов PPI под аппаратный запуск чтения АЦП
+#define PPI_GROUP_ADS129X      0 // первая из 2 групп PPI под аппаратный запуск чтения АЦП
+
+// таймер-счетчик прочитанных кадров АЦП (TIMER0 занят SoftDevice, TIMER2 - драйвером nrfx_timer, TIMER4 - debug_monitor)
+#define ADS129X_TIMER            NRF_TIMER3
+#define ADS129X_TIMER_IRQn       TIMER3_IRQn
+#define ADS129X_TIMER_IRQHandler TIMER3_IRQHandler
+#define ADS129X_TIMER_PRIORITY   6
+
+// компаратор COMP: выход PACE ведущего АЦП (TESTP_PACE_OUT1) на AIN0 (P0.02) - разводка не подтверждена по схеме (PACE_EN выключен)
+#define ADS129X_PACE_AIN         COMP_PSEL_PSEL_AnalogInput0
+#define PACE_COMP_PRIORITY       ADS129X_TIMER_PRIORITY // не выше приоритета таймера кадров (номер отсчета берется из ads_stream)
 
 
 // GPIOTE PORT >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
@@ -60,9 +79,13 @@
                                   NRF_P0->DIRSET = (1UL << SPIM3_CS1_PIN); \
                                 }while(0)
 
-#define ADS129X_CNT             2 // число АЦП на плате
+#define ADS129X_CNT             2 // число АЦП на плате (при изменении дополнить ADS129X_CS_PINS и SPIM3_PINS_INIT)
 #define ADS129X_CS0_PIN         SPIM3_CS0_PIN
 #define ADS129X_CS1_PIN         SPIM3_CS1_PIN
+#define ADS129X_CS_PINS         {ADS129X_CS0_PIN, ADS129X_CS1_PIN} // выводы CS по номерам АЦП (первый - ведущий АЦП)
+#define ADS129X_CS_BUS          {0, 0} // номера шин SPI по номерам АЦП (индекс в ADS129X_BUSES)
+#define ADS129X_BUS_CNT         1 // число шин SPI под АЦП (для второй шины описать выводы SPIM2_* по образцу SPIM3_*)
+#define ADS129X_BUSES           {{SPIM3, SPIM3_IRQn, SPIM3_PRIORITY, SPIM3_FREQUENCY}} // шины SPI: порт, прерывание, приоритет, скорость
 #define ADS129X_RESET_PIN       32 // P1.00 (активный 0) сброс
 #define ADS129X_PWDN_PIN        (32+11) // P1.11 (активный 0) переход в режим энергосбереженеия
 #define ADS129X_RDY_PIN         (32+10) // P1.10 (активный 0) готовность данных
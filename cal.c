@@ -0,0 +1,568 @@
+/*
+Калибровка каналов АЦП
+
+АВТОМАТИЧЕСКАЯ КАЛИБРОВКА
+1. Входы всех каналов закорачиваются (MUX = SHORT), среднее за CAL_SAMPLES отсчетов - смещение канала.
+2. На входы подается внутренний тестовый сигнал постоянного тока амплитудой VREF / 2400 (MUX = TEST, CONFIG2:
+   INT_TEST = 1, TEST_AMP = 0, TEST_FREQ = DC). Номинальный код сигнала не зависит от VREF:
+   (VREF / 2400) / (2 * VREF / (GAIN * 2^24)) = GAIN * 2^23 / 2400.
+   Коэффициент усиления - отношение номинального кода к измеренному (за вычетом смещения).
+3. Регистры CHnSET и CONFIG2 восстанавливаются из копии, снятой перед калибровкой.
+
+САМОПРОВЕРКА
+Те же переключения входов, все каналы на время проверки включаются:
+1. SHORT - шум: СКЗ и размах отсчетов, пересчитанные во входное напряжение по весу младшего разряда.
+2. TEST, постоянный ток, амплитуда VREF / 2400 и 2 * VREF / 2400 - отклики m1 и m2 за вычетом смещения.
+   Ошибка усиления - отклонение m1 от номинального кода, нелинейность - отклонение m2 от 2 * m1.
+   Тестовый сигнал постоянного тока вместо прямоугольного: серия короче периода прямоугольного сигнала
+   (fCLK / 2^21, около 1 Гц), а уровни постоянного тока измеряются средним без поиска фронтов.
+3. MVDD и TEMP при усилении 1: AVDD = 2 * U(канал 1), DVDD = 4 * U(канал 3),
+   T = (U(канал 1) - 145300 мкВ) / 490 мкВ/°C + 25 °C.
+
+Во время калибровки и самопроверки отсчеты забираются через cal_feed() и поправка к ним не применяется.
+Суммы серии считаются от первого отсчета: дисперсия по разностям не теряет точность при большом смещении.
+
+*/
+
+#include "cal.h"
+#include "ads129x.h"
+#include "ads_chip.h"
+#include "errors.h"
+#include "fds.h"
+#include "string.h"
+#include <math.h>
+
+// FreeRTOS
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
+
+#if(RTTLOG_EN)
+#include "logger_freertos.h"
+#define RTT_LOG_EN                1     // включить лог через RTT
+#else
+#define RTT_LOG_EN 0
+#endif // RTTLOG_EN
+
+#if(RTT_LOG_EN)
+#define RTT_LOG_INFO(...)       \
+                                \
+  {                             \
+    NRF_LOG_INFO(__VA_ARGS__);  \
+  }
+#else
+  #define RTT_LOG_INFO(...) {}
+#endif // RTT_LOG_EN
+
+
+#define CAL_REC_VERSION     ((ADSTASK_CH_MAX << 8) | 1) // версия записи: количество каналов и формат
+#define CAL_CMD_TIMEOUT_MS  500     // таймаут команд ads_task
+#define CAL_WAIT_MS         5000    // ожидание серии отсчетов (с учетом включения питания АЦП)
+#define CAL_TEST_FREQ_DC    0x03    // код TEST_FREQ: постоянный ток
+#define CAL_TEST_DIV        2400    // амплитуда тестового сигнала VREF / CAL_TEST_DIV
+#define CAL_TEMP_OFFSET_UV  145300  // выход датчика температуры при 25 °C, мкВ
+#define CAL_TEMP_SLOPE_UV   490     // крутизна датчика температуры, мкВ/°C
+
+
+/// запись таблицы во флеше
+typedef struct {
+  uint32_t  version;                  // CAL_REC_VERSION
+  cal_ch_t  ch[ADSTASK_CH_MAX];       // калибровка каналов
+} cal_rec_t;
+
+/// шаг переключения входов
+typedef struct {
+  uint8_t   mux;      // источник сигнала каналов (MUX в CHnSET)
+  uint8_t   test;     // TEST_AMP и TEST_FREQ тестового сигнала в CONFIG2 (0 - CONFIG2 не меняется)
+  uint8_t   gain;     // усиление PGA (0 - не меняется)
+  bool      pwr_on;   // включить выключенные каналы
+} cal_step_t;
+
+/// шум канала за серию
+typedef struct {
+  float     rms;      // СКЗ, коды АЦП
+  uint32_t  pp;       // размах, коды АЦП
+} cal_noise_t;
+
+static const cal_step_t m_cal_steps[] =
+{ // автоматическая калибровка: смещение, усиление
+  {ADS129X_MUX_SHORT, 0,                                          0, false},
+  {ADS129X_MUX_TEST,  CAL_TEST_FREQ_DC,                           0, false},
+};
+
+enum {CAL_ST_SHORT, CAL_ST_TEST1, CAL_ST_TEST2, CAL_ST_MVDD, CAL_ST_TEMP, CAL_ST_CNT}; // шаги самопроверки
+static const cal_step_t m_st_steps[CAL_ST_CNT] =
+{ // самопроверка
+  {ADS129X_MUX_SHORT, 0,                                          0, true},
+  {ADS129X_MUX_TEST,  CAL_TEST_FREQ_DC,                           0, true},
+  {ADS129X_MUX_TEST,  CAL_TEST_FREQ_DC | ADS129X_CONFIG2_TEST_AMP, 0, true},
+  {ADS129X_MUX_MVDD,  0,                                          1, true},
+  {ADS129X_MUX_TEMP,  0,                                          1, true},
+};
+
+
+static cal_rec_t            m_table;              // рабочая таблица
+static cal_rec_t            m_flash;              // копия таблицы, записываемая во флеш (должна жить до окончания записи)
+static volatile bool        m_active = false;     // в таблице есть каналы с поправкой
+static volatile bool        m_busy = false;       // идет автоматическая калибровка
+static volatile bool        m_saving = false;     // идет запись во флеш
+static volatile bool        m_save_pend = false;  // таблица изменилась во время записи
+static bool                 m_loaded = false;     // таблица загружена из флеша (или записи нет)
+static volatile uint16_t    m_cnt = 0;            // набрано отсчетов серии
+static volatile uint16_t    m_skip = 0;           // осталось отбросить отсчетов серии
+static int32_t              m_ref[ADSTASK_CH_MAX]; // первый отсчет серии
+static int64_t              m_sum[ADSTASK_CH_MAX]; // суммы отклонений от первого отсчета
+static uint64_t             m_sq[ADSTASK_CH_MAX];  // суммы квадратов отклонений
+static int32_t              m_min[ADSTASK_CH_MAX]; // минимумы серии
+static int32_t              m_max[ADSTASK_CH_MAX]; // максимумы серии
+static uint8_t              m_saved[ADS129X_CNT][ADS129X_REG_CNT]; // регистры АЦП до калибровки
+static ads_task_cfg_image_t m_image;              // образ переключения входов
+static SemaphoreHandle_t    m_done = NULL;        // серия набрана
+static StaticSemaphore_t    m_done_static;
+
+
+
+static void table_reset(uint8_t ch_no)
+{ // смещение 0, усиление 1.0
+  m_table.ch[ch_no].offset = 0;
+  m_table.ch[ch_no].gain = CAL_GAIN_ONE;
+}
+
+static void table_update_active(void)
+{ // поправку применяю, только если в таблице есть ненулевые смещения или усиления, отличные от 1.0
+  bool active = false;
+  for(uint8_t i = 0; i < ADSTASK_CH_MAX; i++)
+  {
+    if((m_table.ch[i].offset != 0) || (m_table.ch[i].gain != CAL_GAIN_ONE)) active = true;
+  }
+  m_active = active;
+}
+
+static void cal_load(void)
+{ // загрузка таблицы из флеша
+  fds_record_desc_t desc;
+  fds_find_token_t token;
+  fds_flash_record_t rec;
+  memset(&token, 0, sizeof(token));
+  
+  ret_code_t rc = fds_record_find(CAL_FDS_FILE_ID, CAL_FDS_REC_KEY, &desc, &token);
+  if(rc == FDS_ERR_NOT_INITIALIZED) return; // загружу по FDS_EVT_INIT
+  m_loaded = true;
+  if(rc != NRF_SUCCESS)
+  {
+    RTT_LOG_INFO("CAL: No calibration in flash");
+    return;
+  }
+  if(NRF_SUCCESS != fds_record_open(&desc, &rec)) return;
+  
+  const cal_rec_t *p = (const cal_rec_t *)rec.p_data;
+  if(((rec.p_header->length_words * sizeof(uint32_t)) >= sizeof(cal_rec_t)) && (p->version == CAL_REC_VERSION))
+  {
+    taskENTER_CRITICAL();
+    memcpy(m_table.ch, p->ch, sizeof(m_table.ch));
+    taskEXIT_CRITICAL();
+    table_update_active();
+    RTT_LOG_INFO("CAL: Calibration loaded");
+  }else{
+    RTT_LOG_INFO("CAL: Calibration record version mismatch, ignored");
+  }
+  fds_record_close(&desc);
+}
+
+static uint16_t cal_save(void)
+{ // запись таблицы во флеш (в фоне, окончание - по событию FDS)
+  taskENTER_CRITICAL();
+  bool saving = m_saving;
+  if(saving) m_save_pend = true; // запишу заново после окончания текущей записи
+  else m_saving = true;
+  memcpy(&m_flash, &m_table, sizeof(m_flash));
+  taskEXIT_CRITICAL();
+  if(saving) return ERR_NOERROR;
+  
+  fds_record_t rec;
+  rec.file_id = CAL_FDS_FILE_ID;
+  rec.key = CAL_FDS_REC_KEY;
+  rec.data.p_data = &m_flash;
+  rec.data.length_words = (sizeof(m_flash) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+  
+  fds_record_desc_t desc;
+  fds_find_token_t token;
+  memset(&token, 0, sizeof(token));
+  ret_code_t rc;
+  if(NRF_SUCCESS == fds_record_find(CAL_FDS_FILE_ID, CAL_FDS_REC_KEY, &desc, &token)) rc = fds_record_update(&desc, &rec);
+  else rc = fds_record_write(NULL, &rec);
+  
+  if(rc == FDS_ERR_NO_SPACE_IN_FLASH)
+  { // место освободит сборщик мусора, запись повторится по FDS_EVT_GC
+    m_save_pend = true;
+    rc = fds_gc();
+  }
+  if(rc != NRF_SUCCESS)
+  {
+    m_saving = false;
+    RTT_LOG_INFO("CAL: Save error 0x%X", rc);
+    return ERR_WRITE;
+  }
+  return ERR_NOERROR;
+}
+
+static void fds_evt_handler(fds_evt_t const *p_evt)
+{ // события FDS (приходят всем зарегистрированным модулям, в том числе Peer Manager)
+  switch(p_evt->id)
+  {
+    case FDS_EVT_INIT:
+      if((p_evt->result == NRF_SUCCESS) && !m_loaded) cal_load();
+    break;
+    
+    case FDS_EVT_WRITE:
+    case FDS_EVT_UPDATE:
+      if(p_evt->write.file_id != CAL_FDS_FILE_ID) break;
+      if(p_evt->result != NRF_SUCCESS) RTT_LOG_INFO("CAL: Save error 0x%X", p_evt->result);
+      // no break
+    case FDS_EVT_GC:
+      if(!m_saving) break;
+      m_saving = false;
+      if(m_save_pend)
+      {
+        m_save_pend = false;
+        cal_save();
+      }
+    break;
+    
+    default:
+      break;
+  }
+}
+
+static uint16_t inputs_save(void)
+{ // копия регистров найденных АЦП перед переключением входов
+  for(uint8_t i = 0; i < ADS129X_CNT; i++)
+  {
+    if(ads_task_get_chip((adstask_adc_no_e)i) == NULL) continue;
+    ERROR_CHECK(ads_task_get_regs((adstask_adc_no_e)i, m_saved[i], ADS129X_REG_CNT, CAL_CMD_TIMEOUT_MS));
+  }
+  return ERR_NOERROR;
+}
+
+static void image_inputs(const cal_step_t *step)
+{ // образ CHnSET и CONFIG2 всех АЦП: переключение входов по шагу step или копия до переключения (step == NULL)
+  memset(&m_image, 0, sizeof(m_image));
+  for(uint8_t i = 0; i < ADS129X_CNT; i++)
+  {
+    const ads_chip_ops_t *ops = ads_task_get_chip((adstask_adc_no_e)i);
+    if(ops == NULL) continue;
+    for(uint8_t j = 0; j < ADS129X_CH_CNT; j++)
+    {
+      uint8_t reg = ADS129X_REG_CH1SET + j;
+      uint8_t chset = m_saved[i][reg];
+      if(step)
+      {
+        int8_t code = step->gain ? ads_chip_gain_code(ops, step->gain) : -1;
+        if(code < 0) code = (chset >> 4) & 0x07;
+        chset = ads_chip_chset(step->mux, (uint8_t)code, !step->pwr_on && (chset & 0x80));
+      }
+      m_image.regs[i][reg] = chset;
+      m_image.mask[i] |= 1UL << reg;
+    }
+    uint8_t cfg2 = m_saved[i][ADS129X_REG_CONFIG2];
+    if(step && step->test)
+    {
+      cfg2 = (cfg2 & ~(ADS129X_CONFIG2_TEST_AMP | ADS129X_CONFIG2_TEST_FREQ)) | ADS129X_CONFIG2_INT_TEST | step->test;
+    }
+    m_image.regs[i][ADS129X_REG_CONFIG2] = cfg2;
+    m_image.mask[i] |= 1UL << ADS129X_REG_CONFIG2;
+  }
+}
+
+static uint16_t measure(const cal_step_t *step, int32_t *avg, cal_noise_t *noise)
+{ // серия отсчетов на входах шага step: среднее по каналам и шум (noise может быть NULL)
+  image_inputs(step);
+  ERROR_CHECK(ads_task_apply_config(&m_image, CAL_CMD_TIMEOUT_MS));
+  
+  taskENTER_CRITICAL();
+  m_cnt = 0;
+  m_skip = CAL_SKIP;
+  taskEXIT_CRITICAL();
+  xSemaphoreTake(m_done, 0);
+  
+  ERROR_CHECK(ads_task_start(false));
+  bool done = (pdTRUE == xSemaphoreTake(m_done, pdMS_TO_TICKS(CAL_WAIT_MS)));
+  uint16_t err = ads_task_stop();
+  if(!done) return ERR_TIMEOUT;
+  if(err != ERR_NOERROR) return err;
+  
+  for(uint8_t i = 0; i < ADSTASK_CH_MAX; i++)
+  {
+    avg[i] = m_ref[i] + (int32_t)(m_sum[i] / CAL_SAMPLES);
+    if(noise == NULL) continue;
+    float mean = (float)m_sum[i] / CAL_SAMPLES;
+    float var = (float)m_sq[i] / CAL_SAMPLES - mean * mean;
+    noise[i].rms = (var > 0) ? sqrtf(var) : 0;
+    noise[i].pp = (uint32_t)(m_max[i] - m_min[i]);
+  }
+  return ERR_NOERROR;
+}
+
+static uint16_t inputs_restore(void)
+{ // возврат входов и CONFIG2
+  image_inputs(NULL);
+  return ads_task_apply_config(&m_image, CAL_CMD_TIMEOUT_MS);
+}
+
+static uint16_t sat_u16(float v)
+{ // насыщение до uint16_t
+  if(v >= 65535.0f) return 0xFFFF;
+  return (v > 0) ? (uint16_t)(v + 0.5f) : 0;
+}
+
+static int16_t sat_i16(int64_t v)
+{ // насыщение до int16_t
+  if(v > INT16_MAX) return INT16_MAX;
+  if(v < INT16_MIN) return INT16_MIN;
+  return (int16_t)v;
+}
+
+
+// %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+/*
+* Инициализация модуля
+*/
+uint16_t cal_init(void)
+{
+  for(uint8_t i = 0; i < ADSTASK_CH_MAX; i++) table_reset(i);
+  m_table.version = CAL_REC_VERSION;
+  m_active = false;
+  
+  if(m_done == NULL) m_done = xSemaphoreCreateBinaryStatic(&m_done_static);
+  if(NRF_SUCCESS != fds_register(fds_evt_handler)) return ERR_NOT_INITED;
+  cal_load(); // если FDS еще не готов, таблица загрузится по FDS_EVT_INIT
+  return ERR_NOERROR;
+}
+
+
+/*
+* Применение калибровки
+*/
+void cal_apply(int32_t *ch, uint8_t cnt)
+{
+  if(!m_active || m_busy) return;
+  if(cnt > ADSTASK_CH_MAX) cnt = ADSTASK_CH_MAX;
+  
+  // Q2.30: произведение 64-битное (SMULL), сдвиг берет старшие разряды
+  const cal_ch_t *cal = m_table.ch;
+  for(uint8_t i = 0; i < cnt; i++)
+  {
+    ch[i] = (int32_t)(((int64_t)(ch[i] - cal[i].offset) * cal[i].gain) >> CAL_GAIN_SHIFT);
+  }
+}
+
+
+/*
+* Чтение калибровки канала
+*/
+uint16_t cal_get(uint8_t ch_no, cal_ch_t *cal)
+{
+  if((ch_no >= ADSTASK_CH_MAX) || (cal == NULL)) return ERR_INVALID_PARAMETR;
+  taskENTER_CRITICAL();
+  *cal = m_table.ch[ch_no];
+  taskEXIT_CRITICAL();
+  return ERR_NOERROR;
+}
+
+
+/*
+* Запись калибровки канала
+*/
+uint16_t cal_set(uint8_t ch_no, const cal_ch_t *cal)
+{
+  if((ch_no >= ADSTASK_CH_MAX) && (ch_no != CAL_CH_ALL)) return ERR_INVALID_PARAMETR;
+  if((cal != NULL) && (cal->gain <= 0)) return ERR_INVALID_PARAMETR;
+  
+  uint8_t first = (ch_no == CAL_CH_ALL) ? 0 : ch_no;
+  uint8_t last = (ch_no == CAL_CH_ALL) ? (ADSTASK_CH_MAX - 1) : ch_no;
+  taskENTER_CRITICAL();
+  for(uint8_t i = first; i <= last; i++)
+  {
+    if(cal) m_table.ch[i] = *cal;
+    else table_reset(i);
+  }
+  taskEXIT_CRITICAL();
+  table_update_active();
+  return cal_save();
+}
+
+
+/*
+* Автоматическая калибровка
+*/
+uint16_t cal_auto(uint32_t *ok_mask)
+{
+  static int32_t shorted[ADSTASK_CH_MAX];
+  static int32_t test[ADSTASK_CH_MAX];
+  uint32_t mask = 0;
+  if(ok_mask) *ok_mask = 0;
+  if(m_busy || (m_done == NULL)) return ERR_INVALID_STATE;
+  if(ads_task_get_ch_cnt() == 0) return ERR_NOT_INITED;
+  ERROR_CHECK(inputs_save());
+  
+  m_busy = true;
+  uint16_t err = measure(&m_cal_steps[0], shorted, NULL);
+  if(err == ERR_NOERROR) err = measure(&m_cal_steps[1], test, NULL);
+  uint16_t err_restore = inputs_restore();
+  m_busy = false;
+  if(err == ERR_NOERROR) err = err_restore;
+  if(err != ERR_NOERROR)
+  {
+    RTT_LOG_INFO("CAL: Auto calibration error 0x%04X", err);
+    return err;
+  }
+  
+  uint8_t n = 0; // номер найденного АЦП (порядок каналов в отсчете)
+  for(uint8_t i = 0; i < ADS129X_CNT; i++)
+  {
+    const ads_chip_ops_t *ops = ads_task_get_chip((adstask_adc_no_e)i);
+    if(ops == NULL) continue;
+    for(uint8_t j = 0; j < ADS129X_CH_CNT; j++)
+    {
+      uint8_t k = n * ADS129X_CH_CNT + j;
+      uint8_t code = (m_saved[i][ADS129X_REG_CH1SET + j] >> 4) & 0x07;
+      if(code >= ops->gains_cnt) continue;
+      
+      int64_t nominal = ((int64_t)ops->gains[code] << 23) / CAL_TEST_DIV;
+      int64_t meas = (int64_t)test[k] - shorted[k];
+      if(meas < 0) meas = -meas; // полярность тестового сигнала у серии отрицательная
+      if(((meas * 4) < (nominal * 3)) || ((meas * 4) > (nominal * 5))) continue; // вне допуска (выключенный канал, обрыв)
+      
+      taskENTER_CRITICAL();
+      m_table.ch[k].offset = shorted[k];
+      m_table.ch[k].gain = (int32_t)((nominal << CAL_GAIN_SHIFT) / meas);
+      taskEXIT_CRITICAL();
+      mask |= 1UL << k;
+    }
+    n++;
+  }
+  
+  if(ok_mask) *ok_mask = mask;
+  RTT_LOG_INFO("CAL: Auto calibration done, channels 0x%04X", mask);
+  if(mask == 0) return ERR_DATA;
+  table_update_active();
+  return cal_save();
+}
+
+
+/*
+* Самопроверка
+*/
+uint16_t cal_selftest(cal_selftest_t *report)
+{
+  static int32_t avg[CAL_ST_CNT][ADSTASK_CH_MAX];
+  static cal_noise_t noise[ADSTASK_CH_MAX];
+  static uint8_t regs[ADS129X_REG_CNT];
+  if(report == NULL) return ERR_INVALID_PARAMETR;
+  memset(report, 0, sizeof(*report));
+  if(m_busy || (m_done == NULL)) return ERR_INVALID_STATE;
+  if(ads_task_get_ch_cnt() == 0) return ERR_NOT_INITED;
+  ERROR_CHECK(inputs_save());
+  
+  m_busy = true;
+  uint16_t err = ERR_NOERROR;
+  for(uint8_t s = 0; (s < CAL_ST_CNT) && (err == ERR_NOERROR); s++)
+  {
+    err = measure(&m_st_steps[s], avg[s], (s == CAL_ST_SHORT) ? noise : NULL);
+  }
+  uint16_t err_restore = inputs_restore();
+  m_busy = false;
+  if(err == ERR_NOERROR) err = err_restore;
+  if(err != ERR_NOERROR)
+  {
+    RTT_LOG_INFO("CAL: Self-test error 0x%04X", err);
+    return err;
+  }
+  
+  uint8_t n = 0; // номер найденного АЦП (порядок каналов в отсчете)
+  for(uint8_t i = 0; i < ADS129X_CNT; i++)
+  {
+    const ads_chip_ops_t *ops = ads_task_get_chip((adstask_adc_no_e)i);
+    if(ops == NULL) continue;
+    
+    // вес младшего разряда при усилении 1 (шаги MVDD и TEMP)
+    memcpy(regs, m_saved[i], sizeof(regs));
+    regs[ADS129X_REG_CH1SET] = ads_chip_chset(0, (uint8_t)ads_chip_gain_code(ops, 1), false);
+    float lsb1 = ads_chip_lsb_uv(ops, regs, 0);
+    uint8_t base = n * ADS129X_CH_CNT;
+    cal_st_adc_t *adc = &report->adc[n];
+    adc->avdd_mv = sat_u16(2.0f * avg[CAL_ST_MVDD][base] * lsb1 / 1000.0f);
+    adc->dvdd_mv = sat_u16(4.0f * avg[CAL_ST_MVDD][base + 2] * lsb1 / 1000.0f);
+    adc->temp = sat_i16((int64_t)((avg[CAL_ST_TEMP][base] * lsb1 - CAL_TEMP_OFFSET_UV) * 10.0f / CAL_TEMP_SLOPE_UV) + 250);
+    
+    for(uint8_t j = 0; j < ADS129X_CH_CNT; j++)
+    {
+      uint8_t k = base + j;
+      cal_st_ch_t *ch = &report->ch[k];
+      float lsb_nv = ads_chip_lsb_uv(ops, m_saved[i], j) * 1000.0f;
+      uint8_t code = (m_saved[i][ADS129X_REG_CH1SET + j] >> 4) & 0x07;
+      if((lsb_nv <= 0) || (code >= ops->gains_cnt))
+      { // неизвестный код усиления
+        report->fail_mask |= 1UL << k;
+        continue;
+      }
+      ch->noise_rms = sat_u16(noise[k].rms * lsb_nv);
+      ch->noise_pp = sat_u16(noise[k].pp * lsb_nv);
+      
+      // полярность тестового сигнала у серии отрицательная
+      int64_t nominal = ((int64_t)ops->gains[code] << 23) / CAL_TEST_DIV;
+      int64_t m1 = (int64_t)avg[CAL_ST_TEST1][k] - avg[CAL_ST_SHORT][k];
+      int64_t m2 = (int64_t)avg[CAL_ST_TEST2][k] - avg[CAL_ST_SHORT][k];
+      if(m1 < 0) m1 = -m1;
+      if(m2 < 0) m2 = -m2;
+      ch->gain_err = sat_i16(((m1 - nominal) * 10000) / nominal);
+      ch->lin_err = m1 ? sat_i16(((m2 - 2 * m1) * 10000) / (2 * m1)) : INT16_MAX;
+      
+      if((ch->noise_rms > CAL_ST_NOISE_MAX_NV) ||
+         (ch->gain_err > CAL_ST_GAIN_ERR_MAX) || (ch->gain_err < -CAL_ST_GAIN_ERR_MAX) ||
+         (ch->lin_err > CAL_ST_LIN_ERR_MAX) || (ch->lin_err < -CAL_ST_LIN_ERR_MAX))
+      {
+        report->fail_mask |= 1UL << k;
+      }
+    }
+    n++;
+  }
+  report->adc_cnt = n;
+  report->ch_cnt = n * ADS129X_CH_CNT;
+  
+  RTT_LOG_INFO("CAL: Self-test done, failed channels 0x%04X", report->fail_mask);
+  return ERR_NOERROR;
+}
+
+
+/*
+* Прием отсчета во время калибровки и самопроверки
+*/
+bool cal_feed(const adstask_data_t *data)
+{
+  if(!m_busy) return false;
+  if(m_cnt >= CAL_SAMPLES) return true; // серия набрана, ждем останова
+  if(m_skip)
+  {
+    m_skip--;
+    return true;
+  }
+  for(uint8_t i = 0; (i < data->ch_cnt) && (i < ADSTASK_CH_MAX); i++)
+  {
+    int32_t x = data->ch[i];
+    if(m_cnt == 0)
+    {
+      m_ref[i] = m_min[i] = m_max[i] = x;
+      m_sum[i] = 0;
+      m_sq[i] = 0;
+    }
+    int32_t d = x - m_ref[i];
+    m_sum[i] += d;
+    m_sq[i] += (uint64_t)((int64_t)d * d);
+    if(x < m_min[i]) m_min[i] = x;
+    if(x > m_max[i]) m_max[i] = x;
+  }
+  if(++m_cnt >= CAL_SAMPLES) xSemaphoreGive(m_done);
+  return true;
+}
@@ -0,0 +1,190 @@
+#ifndef CAL_H
+#define CAL_H
+
+/**
+ * Калибровка каналов АЦП
+ *
+ * Для каждого канала хранятся смещение (в кодах АЦП) и коэффициент усиления в формате Q2.30.
+ * Поправка применяется в потоке АЦП к каждому отсчету до передачи наверх:
+ *   ch = ((ch - offset) * gain) >> 30
+ * Коэффициент приводит канал к номинальному весу младшего разряда (ads_chip_lsb_uv), поэтому формат
+ * потока данных не меняется, а перевод в микровольты на телефоне остается одним умножением на номинальный вес.
+ *
+ * Таблица хранится во флеше (FDS, запись CAL_FDS_FILE_ID / CAL_FDS_REC_KEY) и загружается при инициализации.
+ * Автоматическая калибровка (cal_auto) измеряет смещение при закороченных входах (MUX = SHORT)
+ * и усиление по внутреннему тестовому сигналу постоянного тока (MUX = TEST, INT_TEST, TEST_FREQ = DC).
+ *
+ * Самопроверка (cal_selftest) теми же переключениями входов снимает шум при закороченных входах, ошибку усиления
+ * и нелинейность по тестовому сигналу двух амплитуд, напряжения питания и температуру АЦП. Поправка калибровки
+ * во время самопроверки не применяется, поэтому результат характеризует саму микросхему.
+*/
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "settings.h"
+#include "ads_task.h"
+
+
+// НАСТРОЙКИ МОДУЛЯ ************************************
+#ifndef CAL_SAMPLES
+#define CAL_SAMPLES         256     // количество усредняемых отсчетов на каждом шаге автоматической калибровки
+#endif // CAL_SAMPLES
+#ifndef CAL_SKIP
+#define CAL_SKIP            32      // отсчеты, отбрасываемые после переключения входов (установление фильтра АЦП)
+#endif // CAL_SKIP
+#ifndef CAL_ST_NOISE_MAX_NV
+#define CAL_ST_NOISE_MAX_NV 5000    // самопроверка: допустимый шум (СКЗ, приведенный ко входу), нВ
+#endif // CAL_ST_NOISE_MAX_NV
+#ifndef CAL_ST_GAIN_ERR_MAX
+#define CAL_ST_GAIN_ERR_MAX 300     // самопроверка: допустимая ошибка усиления, 0.01%
+#endif // CAL_ST_GAIN_ERR_MAX
+#ifndef CAL_ST_LIN_ERR_MAX
+#define CAL_ST_LIN_ERR_MAX  100     // самопроверка: допустимая нелинейность, 0.01%
+#endif // CAL_ST_LIN_ERR_MAX
+#ifndef CAL_FDS_FILE_ID
+#define CAL_FDS_FILE_ID     0x0CA1  // файл FDS таблицы калибровки (не пересекается с файлами Peer Manager 0xC000..0xFFFE)
+#endif // CAL_FDS_FILE_ID
+#ifndef CAL_FDS_REC_KEY
+#define CAL_FDS_REC_KEY     0x0001  // ключ записи FDS таблицы калибровки
+#endif // CAL_FDS_REC_KEY
+// *****************************************************
+
+#define CAL_GAIN_SHIFT      30                      ///< количество дробных бит коэффициента усиления
+#define CAL_GAIN_ONE        (1L << CAL_GAIN_SHIFT)  ///< коэффициент усиления 1.0
+#define CAL_CH_ALL          0xFF                    ///< номер канала: все каналы
+
+
+/// калибровка одного канала
+typedef struct {
+  int32_t   offset;     ///< смещение, коды АЦП
+  int32_t   gain;       ///< коэффициент усиления, Q2.30
+} cal_ch_t;
+
+/// результат самопроверки канала
+typedef struct {
+  uint16_t  noise_rms;  ///< шум при закороченных входах, СКЗ, нВ (приведенный ко входу, 0xFFFF - больше)
+  uint16_t  noise_pp;   ///< шум при закороченных входах, размах, нВ
+  int16_t   gain_err;   ///< ошибка усиления по тестовому сигналу относительно номинала, 0.01%
+  int16_t   lin_err;    ///< нелинейность: отклонение отклика на сигнал двойной амплитуды от удвоенного, 0.01%
+} cal_st_ch_t;
+
+/// результат самопроверки микросхемы АЦП
+typedef struct {
+  uint16_t  avdd_mv;    ///< аналоговое питание AVDD - AVSS, мВ
+  uint16_t  dvdd_mv;    ///< цифровое питание DVDD, мВ
+  int16_t   temp;       ///< температура кристалла, 0.1 °C
+} cal_st_adc_t;
+
+/// отчет самопроверки (АЦП и каналы в порядке adstask_data_t.ch)
+typedef struct {
+  uint8_t       adc_cnt;                ///< количество найденных АЦП
+  uint8_t       ch_cnt;                 ///< количество каналов
+  uint32_t      fail_mask;              ///< маска каналов вне допуска CAL_ST_* (бит n - канал n)
+  cal_st_adc_t  adc[ADS129X_CNT];       ///< результаты по АЦП
+  cal_st_ch_t   ch[ADSTASK_CH_MAX];     ///< результаты по каналам
+} cal_selftest_t;
+
+
+
+/**
+ * @brief Инициализация модуля и загрузка таблицы из флеша (вызывается после инициализации Peer Manager)
+ *
+ * Если FDS еще не готов, таблица загружается по событию окончания его инициализации
+ *
+ * @return
+ *  ERR_NOERROR - если ошибок нет
+ *  ERR_NOT_INITED - не удалось зарегистрироваться в FDS
+*/
+uint16_t cal_init(void);
+
+
+/**
+ * @brief Применение калибровки к каналам отсчета (вызывается из потока АЦП)
+ *
+ * @param ch - каналы отсчета в порядке adstask_data_t.ch
+ * @param cnt - количество каналов
+*/
+void cal_apply(int32_t *ch, uint8_t cnt);
+
+
+/**
+ * @brief Чтение калибровки канала
+ *
+ * @param ch_no - номер канала (0..ADSTASK_CH_MAX-1)
+ * @param cal - калибровка
+ *
+ * @return
+ *  ERR_NOERROR - если ошибок нет
+ *  ERR_INVALID_PARAMETR - неверный номер канала
+*/
+uint16_t cal_get(uint8_t ch_no, cal_ch_t *cal);
+
+
+/**
+ * @brief Запись калибровки канала с сохранением таблицы во флеш
+ *
+ * @param ch_no - номер канала (0..ADSTASK_CH_MAX-1) или CAL_CH_ALL
+ * @param cal - калибровка (NULL - сброс к смещению 0 и усилению 1.0)
+ *
+ * @return
+ *  ERR_NOERROR - если ошибок нет (запись во флеш идет в фоне)
+ *  ERR_INVALID_PARAMETR - неверный номер канала
+ *  ERR_WRITE - ошибка постановки записи в очередь FDS
+*/
+uint16_t cal_set(uint8_t ch_no, const cal_ch_t *cal);
+
+
+/**
+ * @brief Автоматическая калибровка всех каналов по внутренним сигналам АЦП с сохранением во флеш
+ *
+ * Блокирует вызывающую задачу на время двух серий по CAL_SAMPLES отсчетов. Измерения должны быть остановлены:
+ * функция сама запускает и останавливает АЦП, конфигурация входов после калибровки восстанавливается.
+ * Каналы, для которых результат вне допуска (усиление отличается от номинала больше чем на 25%), не меняются.
+ *
+ * @param ok_mask - маска успешно откалиброванных каналов (бит n - канал n)
+ *
+ * @return
+ *  ERR_NOERROR - если ошибок нет
+ *  ERR_INVALID_STATE - идут измерения или калибровка уже запущена
+ *  ERR_NOT_INITED - АЦП не найдены
+ *  ERR_TIMEOUT - отсчеты не пришли
+ *  остальные ошибки - от ads_task
+*/
+uint16_t cal_auto(uint32_t *ok_mask);
+
+
+/**
+ * @brief Самопроверка всех каналов по внутренним сигналам АЦП
+ *
+ * Пять серий по CAL_SAMPLES отсчетов: закороченные входы, тестовый сигнал постоянного тока одинарной и двойной
+ * амплитуды, питание (MUX = MVDD) и температура (MUX = TEMP) при усилении 1. Выключенные каналы на время
+ * самопроверки включаются. Требования к состоянию измерений - как у cal_auto, конфигурация после проверки
+ * восстанавливается, таблица калибровки не меняется.
+ *
+ * @param report - отчет
+ *
+ * @return
+ *  ERR_NOERROR - если ошибок нет (каналы вне допуска - в report->fail_mask)
+ *  ERR_INVALID_PARAMETR - report == NULL
+ *  ERR_INVALID_STATE - идут измерения, калибровка или самопроверка уже запущена
+ *  ERR_NOT_INITED - АЦП не найдены
+ *  ERR_TIMEOUT - отсчеты не пришли
+ *  остальные ошибки - от ads_task
+*/
+uint16_t cal_selftest(cal_selftest_t *report);
+
+
+/**
+ * @brief Прием отсчета во время автоматической калибровки или самопроверки (вызывается из функции обратного вызова ads_task)
+ *
+ * @param data - отсчет
+ *
+ * @return
+ *  true, если идет калибровка или самопроверка и отсчет забран (наверх его передавать не нужно)
+*/
+bool cal_feed(const adstask_data_t *data);
+
+
+#endif
@@ -0,0 +1,298 @@
+/*
+Разбор двоичных кадров команд управления и табличный диспетчер
+
+ОСОБЕННОСТИ
+- кадр может приходить частями: незавершенное начало кадра хранится до следующего вызова cmd_rx()
+- при ошибке CRC или неверном байте синхронизации пропускается один байт и ищется следующий CMD_FRAME_SYNC
+- ответы на все команды кадра собираются в один кадр ответа; если ответ не помещается, текущий кадр отправляется и начинается новый
+- все длины проверяются до обращения к данным, поэтому произвольный поток байтов не приводит к выходу за границы буферов
+- долгие команды не держат задачу приема: обработчик возвращает CMD_STATUS_PENDING (он уходит в ответе как подтверждение),
+  а результат передается позже отдельным кадром через cmd_reply() с тем же cmd и req_id
+
+ОГРАНИЧЕНИЯ
+- модуль не потокобезопасен, cmd_rx() вызывается только из одной задачи
+
+*/
+
+#include "cmd.h"
+#include <string.h>
+
+
+#if((CMD_RSP_LEN_MAX > CMD_FRAME_LEN_MAX) || (CMD_RSP_LEN_MAX < (CMD_FRAME_OVERHEAD + CMD_TLV_HDR_LEN + 1)))
+#error "CMD_RSP_LEN_MAX is out of range"
+#endif
+
+
+#define CMD_ITEM_LEN_MAX    CMD_REPLY_LEN_MAX // максимальная длина данных ответа одной команды
+
+
+static const cmd_entry_t  *m_table = NULL;              // таблица команд
+static uint16_t           m_table_cnt = 0;              // количество строк в таблице
+static cmd_tx_t           m_tx = NULL;                  // функция передачи ответа
+static cmd_tx_t           m_evt_tx = NULL;              // функция передачи события
+static uint8_t            m_rx[CMD_FRAME_LEN_MAX];      // приемный буфер (не больше одного кадра)
+static uint16_t           m_rx_len = 0;                 // количество данных в приемном буфере
+static uint8_t            m_rsp[CMD_RSP_LEN_MAX];       // формируемый кадр ответа
+static uint16_t           m_rsp_len = 0;                // длина TLV в кадре ответа
+static uint8_t            m_item[CMD_ITEM_LEN_MAX];     // буфер под ответ одной команды
+static uint8_t            m_reply[CMD_RSP_LEN_MAX];     // кадр отложенного ответа
+static uint8_t            m_req_id = 0;                 // req_id выполняемой команды
+static cmd_stat_t         m_stat;                       // статистика
+
+
+
+static uint16_t frame_build(uint8_t *frame, uint8_t cmd, uint8_t req_id, uint8_t status, uint8_t const *data, uint8_t len)
+{ // кадр из одного TLV (события и отложенные ответы), возвращает длину кадра
+  uint8_t tlv_len = CMD_TLV_HDR_LEN + 1 + len;
+  frame[0] = CMD_FRAME_SYNC;
+  frame[1] = tlv_len;
+  frame[2] = cmd;
+  frame[3] = req_id;
+  frame[4] = len + 1;
+  frame[5] = status;
+  if(len) memcpy(&frame[6], data, len);
+  uint16_t crc = cmd_crc16(&frame[1], tlv_len + 1);
+  frame[2 + tlv_len] = (uint8_t)crc;
+  frame[3 + tlv_len] = (uint8_t)(crc >> 8);
+  return tlv_len + CMD_FRAME_OVERHEAD;
+}
+
+static void rx_drop(uint16_t cnt)
+{ // удаление cnt байт из начала приемного буфера
+  if(cnt >= m_rx_len)
+  {
+    m_rx_len = 0;
+    return;
+  }
+  memmove(m_rx, &m_rx[cnt], m_rx_len - cnt);
+  m_rx_len -= cnt;
+}
+
+static void rsp_flush(void)
+{ // отправка накопленного кадра ответа
+  if(m_rsp_len == 0) return;
+
+  m_rsp[0] = CMD_FRAME_SYNC;
+  m_rsp[1] = (uint8_t)m_rsp_len;
+  uint16_t crc = cmd_crc16(&m_rsp[1], m_rsp_len + 1);
+  m_rsp[2 + m_rsp_len] = (uint8_t)crc;
+  m_rsp[3 + m_rsp_len] = (uint8_t)(crc >> 8);
+
+  if(m_tx) m_tx(m_rsp, m_rsp_len + CMD_FRAME_OVERHEAD);
+  m_rsp_len = 0;
+}
+
+static void rsp_add(uint8_t cmd, uint8_t req_id, uint8_t status, uint8_t const *data, uint8_t len)
+{ // добавление ответа на команду в кадр ответа
+  uint16_t item_len = CMD_TLV_HDR_LEN + 1 + len;
+  if((m_rsp_len + item_len + CMD_FRAME_OVERHEAD) > (uint16_t)sizeof(m_rsp)) rsp_flush(); // не помещается, отправляю то, что есть
+
+  uint8_t *p = &m_rsp[2 + m_rsp_len];
+  p[0] = cmd;
+  p[1] = req_id;
+  p[2] = len + 1;
+  p[3] = status;
+  if(len) memcpy(&p[4], data, len);
+  m_rsp_len += item_len;
+}
+
+static cmd_handler_t handler_find(uint8_t cmd)
+{ // поиск обработчика в таблице
+  for(uint16_t i = 0; i < m_table_cnt; i++)
+  {
+    if(m_table[i].cmd == cmd) return m_table[i].handler;
+  }
+  return NULL;
+}
+
+static void frame_exec(uint8_t const *tlv, uint8_t len)
+{ // выполнение всех команд кадра
+  uint16_t pos = 0;
+
+  while(pos < len)
+  {
+    if((len - pos) < CMD_TLV_HDR_LEN)
+    { // неполный заголовок TLV
+      m_stat.tlv_err++;
+      break;
+    }
+    uint8_t cmd = tlv[pos];
+    uint8_t req_id = tlv[pos + 1];
+    uint8_t arg_len = tlv[pos + 2];
+    if((len - pos - CMD_TLV_HDR_LEN) < arg_len)
+    { // аргументы выходят за границу кадра
+      m_stat.tlv_err++;
+      rsp_add(cmd, req_id, CMD_STATUS_BAD_ARG, NULL, 0);
+      break;
+    }
+
+    uint8_t const *arg = &tlv[pos + CMD_TLV_HDR_LEN];
+    pos += CMD_TLV_HDR_LEN + arg_len;
+
+    cmd_handler_t handler = handler_find(cmd);
+    if(handler == NULL)
+    {
+      rsp_add(cmd, req_id, CMD_STATUS_UNKNOWN, NULL, 0);
+      continue;
+    }
+
+    uint8_t item_len = sizeof(m_item);
+    m_req_id = req_id;
+    uint8_t status = handler(arg, arg_len, m_item, &item_len);
+    if(item_len > sizeof(m_item)) item_len = sizeof(m_item); // защита от ошибок в обработчике
+    rsp_add(cmd, req_id, status, m_item, item_len);
+    m_stat.cmds++;
+  }
+
+  rsp_flush(); // ответы на все команды кадра передаются вместе
+}
+
+static void rx_parse(void)
+{ // разбор всех завершенных кадров в приемном буфере
+  while(m_rx_len)
+  {
+    if(m_rx[0] != CMD_FRAME_SYNC)
+    { // ищу начало кадра
+      uint8_t *p = memchr(m_rx, CMD_FRAME_SYNC, m_rx_len);
+      uint16_t skip = (p == NULL) ? m_rx_len : (uint16_t)(p - m_rx);
+      m_stat.sync_err += skip;
+      rx_drop(skip);
+      continue;
+    }
+
+    if(m_rx_len < 2) break; // жду длину кадра
+    uint16_t frame_len = m_rx[1] + CMD_FRAME_OVERHEAD;
+    if(m_rx_len < frame_len) break; // жду окончание кадра
+
+    uint16_t crc = m_rx[frame_len - 2] | ((uint16_t)m_rx[frame_len - 1] << 8);
+    if(crc != cmd_crc16(&m_rx[1], m_rx[1] + 1))
+    { // кадр поврежден или синхронизация ложная
+      m_stat.crc_err++;
+      rx_drop(1);
+      continue;
+    }
+
+    m_stat.frames++;
+    frame_exec(&m_rx[2], m_rx[1]);
+    rx_drop(frame_len);
+  }
+}
+
+
+// %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+/*
+* Инициализация модуля
+*/
+void cmd_init(const cmd_entry_t *table, uint16_t cnt, cmd_tx_t tx, cmd_tx_t evt_tx)
+{
+  m_table = table;
+  m_table_cnt = (table == NULL) ? 0 : cnt;
+  m_tx = tx;
+  m_evt_tx = (evt_tx == NULL) ? tx : evt_tx;
+  memset(&m_stat, 0, sizeof(m_stat));
+  cmd_reset();
+}
+
+
+/*
+* Сброс приемного буфера
+*/
+void cmd_reset(void)
+{
+  m_rx_len = 0;
+  m_rsp_len = 0;
+}
+
+
+/*
+* Проверка, ожидается ли продолжение кадра
+*/
+bool cmd_pending(void)
+{
+  return (m_rx_len != 0);
+}
+
+
+/*
+* Прием очередной порции данных
+*/
+void cmd_rx(uint8_t const *data, uint16_t len)
+{
+  if(data == NULL) return;
+
+  while(len)
+  { // данные добавляются частями по размеру свободного места, после каждой части буфер разбирается
+    uint16_t part = sizeof(m_rx) - m_rx_len;
+    if(part > len) part = len;
+    memcpy(&m_rx[m_rx_len], data, part);
+    m_rx_len += part;
+    data += part;
+    len -= part;
+
+    rx_parse(); // после разбора в буфере остается не больше одного незавершенного кадра
+  }
+}
+
+
+/*
+* Передача кадра события
+*/
+void cmd_event(uint8_t evt, uint8_t const *data, uint8_t len)
+{
+  uint8_t frame[CMD_FRAME_OVERHEAD + CMD_TLV_HDR_LEN + 1 + CMD_EVT_LEN_MAX];
+  if((m_evt_tx == NULL) || (len > CMD_EVT_LEN_MAX) || ((data == NULL) && len)) return;
+
+  m_evt_tx(frame, frame_build(frame, evt, CMD_EVT_REQ_ID, CMD_STATUS_OK, data, len));
+}
+
+
+/*
+* req_id выполняемой команды
+*/
+uint8_t cmd_req_id(void)
+{
+  return m_req_id;
+}
+
+
+/*
+* Передача отложенного ответа
+*/
+bool cmd_reply(uint8_t cmd, uint8_t req_id, uint8_t status, uint8_t const *data, uint8_t len, cmd_tx_t tx)
+{
+  if(tx == NULL) tx = m_tx;
+  if((tx == NULL) || (len > CMD_ITEM_LEN_MAX) || ((data == NULL) && len)) return false;
+
+  tx(m_reply, frame_build(m_reply, cmd, req_id, status, data, len));
+  return true;
+}
+
+
+/*
+* Расчет CRC-16/CCITT-FALSE
+*/
+uint16_t cmd_crc16(uint8_t const *data, uint16_t len)
+{
+  uint16_t crc = 0xFFFF;
+
+  for(uint16_t i = 0; i < len; i++)
+  {
+    crc ^= (uint16_t)data[i] << 8;
+    for(uint8_t j = 0; j < 8; j++)
+    {
+      crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+    }
+  }
+  return crc;
+}
+
+
+/*
+* Запрос статистики
+*/
+void cmd_get_stat(cmd_stat_t *stat)
+{
+  if(stat == NULL) return;
+  memcpy(stat, &m_stat, sizeof(m_stat));
+}
@@ -3,10 +3,24 @@
 
 /*
 Модуль обработчика команд управления
+
+Поддерживаются два формата команд:
+- текстовый (старые приложения): первый байт - код команды cmd_cmd_e, далее аргументы через запятую, одна команда на запись
+- двоичный TLV: кадры с CRC, несколько команд в одном кадре, ответы на все команды кадра собираются в один кадр ответа
+
+Формат двоичного кадра (многобайтовые поля little-endian):
+  [CMD_FRAME_SYNC][len][TLV ... (len байт)][crc16]
+  crc16 - CRC-16/CCITT-FALSE (полином 0x1021, начальное значение 0xFFFF) по полям len и TLV
+  TLV запроса:  [cmd][req_id][arg_len][arg ...]
+  TLV ответа:   [cmd][req_id][rsp_len][status][rsp ...]    rsp_len учитывает байт status
+
+События передаются без запроса отдельным кадром с одним TLV ответа: cmd - код события cmd_evt_e,
+req_id = CMD_EVT_REQ_ID (приложение не должно использовать его в запросах), status = CMD_STATUS_OK.
 */
 
 #include <stdbool.h>
 #include <stdint.h>
+#include "settings.h"
 
 
 
@@ -14,6 +28,30 @@
 #define CMD_LEN_MAX           128 ///< максимальная длина любых данных, которые могут быть переданы одной командой (вместе со всеми служебными полями)
 #endif
 
+#ifndef CMD_RSP_LEN_MAX
+#define CMD_RSP_LEN_MAX       244 ///< максимальная длина кадра ответа (одна нотификация BLE при MTU 247), не более CMD_FRAME_LEN_MAX
+#endif
+
+#define CMD_FRAME_SYNC        0xA5  ///< первый байт двоичного кадра (не пересекается с кодами текстовых команд)
+#define CMD_FRAME_OVERHEAD    4     ///< служебные поля кадра: sync, len, crc16
+#define CMD_FRAME_LEN_MAX     (255 + CMD_FRAME_OVERHEAD) ///< максимальная длина кадра
+#define CMD_TLV_HDR_LEN       3     ///< заголовок TLV: cmd, req_id, len
+#define CMD_EVT_REQ_ID        0xFF  ///< req_id кадров событий
+#define CMD_EVT_LEN_MAX       64    ///< максимальная длина данных события
+#define CMD_REPLY_LEN_MAX     (CMD_RSP_LEN_MAX - CMD_FRAME_OVERHEAD - CMD_TLV_HDR_LEN - 1) ///< максимальная длина данных ответа одной команды
+
+
+/// @brief Статус выполнения команды в ответе
+typedef enum
+{
+    CMD_STATUS_OK         = 0x00, ///< команда выполнена
+    CMD_STATUS_UNKNOWN    = 0x01, ///< неизвестная команда
+    CMD_STATUS_BAD_ARG    = 0x02, ///< ошибка в аргументах
+    CMD_STATUS_BUSY       = 0x03, ///< команда не может быть выполнена в текущем состоянии
+    CMD_STATUS_ERROR      = 0x04, ///< ошибка при выполнении
+    CMD_STATUS_PENDING    = 0x05, ///< команда принята, результат придет отдельным кадром с тем же cmd и req_id (cmd_reply)
+} cmd_status_e;
+
 
 /// @brief Команды управления (все команды состоят из одного байта)
 typedef enum
@@ -26,7 +64,7 @@ typedef enum
     CMD_CMD_MAC     = 'm', ///< Выдача МАС-адреса устройства (текстом в шестнадцатиричном виде)
     CMD_CMD_TIME    = 't', ///< Запрос текущего времени
     CMD_CMD_PDOWN   = 'o', ///< Принудительное выключение устройства
-    CMD_CMD_CONSUM  = 'p', ///< Выдать текущее потребление устройства
+    CMD_CMD_CONSUM  = 'p', ///< Выдать профиль потребления устройства (время работы и сна, количество пробуждений)
     CMD_CMD_IND_ON  = 'l', ///< Зажечь светодиод индикации состояния
     CMD_CMD_BNT     = 'k', ///< Выдать текущее состояние кнопки включения
     CMD_CMD_DELTA   = 'd', ///< Сдвинуть время на дельту
@@ -36,27 +74,154 @@ typedef enum
     CMD_CMD_VIBRO   = 'v', ///< Инициировать виброиндикатор
     CMD_CMD_GET_CAL = 'y', ///< Считать калибровочный коэффициент по каналу
     CMD_CMD_SET_CAL = 'z', ///< Записать калибровочный коффициент по каналу
+    CMD_CMD_AUTO_CAL = 'A', ///< Автоматическая калибровка всех каналов по внутренним сигналам АЦП (сразу CMD_STATUS_PENDING, результат - отдельным кадром)
+    CMD_CMD_SELFTEST = 'T', ///< Самопроверка АЦП: шум, ошибка усиления, нелинейность, питание и температура (сразу CMD_STATUS_PENDING, результат - отдельным кадром)
     CMD_CMD_SHOT    = 'c', ///< Единичный отсчет АЦП
     CMD_CMD_RSSI    = 'i', ///< Выдать уровнь сигнала BLE
     CMD_CMD_FW      = 'u', ///< Перейти в режим обновления прошивки
     CMD_CMD_GET_CFG = 'G', ///< Запрос конфига (формат: G,n)
     CMD_CMD_SET_CFG = 'S', ///< Установка нового конфига (формат: S,n,rrvv,....,rrvv где n - номер АЦП (0 или 1), rrvv - uint16_t, где rr - адрес регистра, vv - значение регистра))
+    CMD_CMD_BOOT    = 'B', ///< Выдать времена этапов загрузки и флаг теплого старта
+    CMD_CMD_LINKS   = 'Q', ///< Выдать состояние и статистику передачи по каждому соединению BLE и время последнего переподключения
+    CMD_CMD_CREDIT  = 'C', ///< Выдача кредитов на передачу данных АЦП (формат: C,n где n - количество блоков, которое телефон готов принять, десятичное)
 } cmd_cmd_e;
 
 
+/// @brief События, передаваемые без запроса
+typedef enum
+{
+    CMD_EVT_LOFF    = 'L', ///< изменилось состояние электродов (данные: uint16_t (LOFF_STATP << 8) | LOFF_STATN по найденным АЦП, 1 - электрод отключен)
+    CMD_EVT_PACE    = 'P', ///< импульс кардиостимулятора (данные: uint32_t номер отсчета от запуска измерений (0xFFFFFFFF - неизвестен), uint32_t время устройства, мс)
+    CMD_EVT_RESP    = 'R', ///< отсчеты канала дыхания (данные: uint16_t частота дыхания, вдохов/мин * 10 (0 - не определена), затем int32_t отсчеты с частотой ADSTASK_RESP_SPS)
+} cmd_evt_e;
+
+
+/**
+ * @brief Тип обработчика двоичной команды
+ * 
+ * @param arg - аргументы команды
+ * @param arg_len - длина аргументов
+ * @param rsp - буфер под данные ответа (без статуса)
+ * @param rsp_len - на входе размер буфера rsp, на выходе длина данных ответа
+ * @return
+ *  статус выполнения cmd_status_e
+*/
+typedef uint8_t (*cmd_handler_t)(uint8_t const *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len);
+
+/// @brief Строка таблицы команд
+typedef struct
+{
+    uint8_t         cmd;      ///< код команды
+    cmd_handler_t   handler;  ///< обработчик
+} cmd_entry_t;
+
+/// @brief Функция передачи готового кадра ответа
+typedef void (*cmd_tx_t)(uint8_t const *data, uint16_t len);
 
+/// @brief Статистика разбора двоичных кадров
+typedef struct
+{
+    uint32_t    frames;     ///< принято кадров с правильной CRC
+    uint32_t    cmds;       ///< выполнено команд
+    uint32_t    crc_err;    ///< кадров с ошибкой CRC
+    uint32_t    sync_err;   ///< байтов, пропущенных при поиске начала кадра
+    uint32_t    tlv_err;    ///< кадров с ошибкой структуры TLV
+} cmd_stat_t;
+
+
+/**
+ * @brief Инициализация модуля: таблица обработчиков и функция передачи ответов
+ * 
+ * @param table - таблица команд (должна существовать все время работы)
+ * @param cnt - количество строк в таблице
+ * @param tx - функция передачи кадра ответа
+ * @param evt_tx - функция передачи кадра события (NULL - события передаются через tx)
+ *
+ * Ответ уходит только источнику команды, а событие может быть нужно всем подключенным приемникам,
+ * поэтому функции передачи разделены
+*/
+void cmd_init(const cmd_entry_t *table, uint16_t cnt, cmd_tx_t tx, cmd_tx_t evt_tx);
+
+
+/**
+ * @brief Сброс приемного буфера (например, при новом подключении)
+*/
+void cmd_reset(void);
 
 
+/**
+ * @brief Проверка, ожидается ли продолжение двоичного кадра
+ * 
+ * @return
+ *  true, если в приемном буфере есть начало незавершенного кадра
+*/
+bool cmd_pending(void);
 
 
+/**
+ * @brief Прием очередной порции двоичных данных: разбор всех завершенных кадров и выполнение команд
+ * 
+ * Функция не реентерабельна, вызывать только из одной задачи
+ * @param data - принятые данные
+ * @param len - длина данных
+*/
+void cmd_rx(uint8_t const *data, uint16_t len);
 
 
+/**
+ * @brief Передача кадра события
+ * 
+ * Кадр собирается в собственном буфере, поэтому функцию можно вызывать из другой задачи, чем cmd_rx()
+ * @param evt - код события cmd_evt_e
+ * @param data - данные события
+ * @param len - длина данных (не больше CMD_EVT_LEN_MAX)
+*/
+void cmd_event(uint8_t evt, uint8_t const *data, uint8_t len);
 
 
+/**
+ * @brief req_id выполняемой команды
+ * 
+ * Вызывается из обработчика, который возвращает CMD_STATUS_PENDING и отвечает позже через cmd_reply()
+ * @return
+ *  req_id команды, обработчик которой выполняется сейчас
+*/
+uint8_t cmd_req_id(void);
+
+
+/**
+ * @brief Передача отложенного ответа на команду, обработчик которой вернул CMD_STATUS_PENDING
+ * 
+ * Кадр ответа собирается в собственном буфере, вызывать только из одной задачи (той, что выполняет отложенные команды)
+ * @param cmd - код команды
+ * @param req_id - req_id запроса (см. cmd_req_id)
+ * @param status - статус выполнения cmd_status_e
+ * @param data - данные ответа
+ * @param len - длина данных (не больше CMD_REPLY_LEN_MAX)
+ * @param tx - функция передачи кадра (NULL - функция передачи ответов из cmd_init)
+ * @return
+ *  true, если кадр передан в функцию передачи
+*/
+bool cmd_reply(uint8_t cmd, uint8_t req_id, uint8_t status, uint8_t const *data, uint8_t len, cmd_tx_t tx);
 
 
+/**
+ * @brief Расчет CRC-16/CCITT-FALSE
+ * 
+ * @param data - данные
+ * @param len - длина данных
+ * @return
+ *  значение CRC
+*/
+uint16_t cmd_crc16(uint8_t const *data, uint16_t len);
 
 
+/**
+ * @brief Запрос статистики разбора кадров
+ * 
+ * @param stat - указатель на структуру для статистики
+*/
+void cmd_get_stat(cmd_stat_t *stat);
 
 
 #endif
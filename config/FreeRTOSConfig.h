@@ -63,7 +63,7 @@
 #define configTICK_RATE_HZ                                                        1000
 #define configMAX_PRIORITIES                                                      ( 3 )
 #define configMINIMAL_STACK_SIZE                                                  ( 96 )
-#define configTOTAL_HEAP_SIZE 																										81920 //    
+#define configTOTAL_HEAP_SIZE 																										16384 //     (   ,     SoftDevice   SDK)
 #define configMAX_TASK_NAME_LEN                                                   ( 10 )
 #define configUSE_16_BIT_TICKS                                                    0 //      24  (  16)
 #define configIDLE_SHOULD_YIELD                                                   1
@@ -76,6 +76,8 @@
 #define configUSE_TIME_SLICING                                                    0
 #define configUSE_NEWLIB_REENTRANT                                                0
 #define configENABLE_BACKWARD_COMPATIBILITY                                       1
+#define configSUPPORT_STATIC_ALLOCATION                                           1 // ,       .bss (. settings.h)
+#define configSUPPORT_DYNAMIC_ALLOCATION                                          1 //   nrf_sdh_freertos  app_timer
 
 /* Hook function related definitions. */
 #define configUSE_IDLE_HOOK 																											1
@@ -204,6 +206,12 @@ standard names - or at least those used in the unmodified vector table. */
 #define configUSE_DISABLE_TICK_AUTO_CORRECTION_DEBUG     0
 
 
+//       (sys.c)
+void sysPreSleep(void);
+void sysPostSleep(void);
+#define configPRE_SLEEP_PROCESSING(x)               sysPreSleep()
+#define configPOST_SLEEP_PROCESSING(x)              sysPostSleep()
+
 #if configGENERATE_RUN_TIME_STATS == 1
 void vConfigureTimerForRunTimeStats(void);
 uint32_t vGetTimerForRunTimeStats(void);
@@ -53,12 +53,18 @@ unsigned short usStackHighWaterMark;
 
 
 #include "debug_monitor.h"
+#include "sdk_config.h"
 #include "settings.h"
+#include "blk_pool.h"
 
 /* FreeRTOS related */
 #include "FreeRTOS.h"
 #include "task.h"
 
+#include "bleTask.h"
+#include "bleDriver.h"
+#include "ads_task.h"
+
 
 
 
@@ -152,6 +158,13 @@ static char *_task_state_to_char(eTaskState state)
   }
   return "UNKNOWN";
 }
+
+extern const uint32_t main_ram_size; // очередь суперзадачи (main.c)
+
+static uint32_t ram_buffers(void)
+{ // статически выделенные буферы модулей в байтах (sizeof реальных массивов, без служебных структур FreeRTOS)
+  return main_ram_size + bleTaskRamSize + bleDriverRamSize + ads_task_ram_size + blk_pool_ram_size;
+}
   
 
 
@@ -185,6 +198,12 @@ void printTasksStats(void)
   RTT_LOG_INFO("MONITOR: Current Heap Free Size: %u", xPortGetFreeHeapSize());
 
   RTT_LOG_INFO("MONITOR: Minimal Heap Free Size: %u", xPortGetMinimumEverFreeHeapSize());
+
+  RTT_LOG_INFO("MONITOR: Static RAM Budget: %u (stacks %u, buffers %u)", RAM_BUDGET_STACKS + ram_buffers(), RAM_BUDGET_STACKS, ram_buffers());
+
+  blk_pool_stat_t pool_stat;
+  blk_pool_get_stat(&pool_stat);
+  RTT_LOG_INFO("MONITOR: Block Pool: total %u, free %u, hwm %u, fail %u", pool_stat.total, pool_stat.free, pool_stat.hwm, pool_stat.alloc_fail);
                                  
   RTT_LOG_INFO("MONITOR: Total RunTime:  %u ms", _total_runtime / 1000);
 
@@ -202,6 +221,12 @@ void printTasksStats(void)
 
   RTT_LOG_INFO("MONITOR: Minimal Heap Free Size: %u", xPortGetMinimumEverFreeHeapSize());
 
+  RTT_LOG_INFO("MONITOR: Static RAM Budget: %u (stacks %u, buffers %u)", RAM_BUDGET_STACKS + ram_buffers(), RAM_BUDGET_STACKS, ram_buffers());
+
+  blk_pool_stat_t pool_stat;
+  blk_pool_get_stat(&pool_stat);
+  RTT_LOG_INFO("MONITOR: Block Pool: total %u, free %u, hwm %u, fail %u", pool_stat.total, pool_stat.free, pool_stat.hwm, pool_stat.alloc_fail);
+
   RTT_LOG_INFO("MONITOR: System Uptime:  %u ms\r\n", xTaskGetTickCount() * portTICK_PERIOD_MS);
 #endif // configGENERATE_RUN_TIME_STATS
 }
@@ -32,6 +32,14 @@
 #define LOGGER_STACK_SIZE           512
 #endif
 
+/**
+ * Minimum period between log flushes (ms). Idle task resumes the logger not more often,
+ * so flushes ride on wakeups that happen anyway and do not add their own (0 - flush on every idle entry).
+ */
+#ifndef LOGGER_FLUSH_PERIOD_MS
+#define LOGGER_FLUSH_PERIOD_MS      0
+#endif
+
 
 #define ERROR_CHECK(ERR_CODE)                           \
     do                                                      \
@@ -45,6 +53,9 @@
 
     
 static TaskHandle_t m_logger_thread;      /**< Logger thread. */
+static StackType_t  m_logger_stack[LOGGER_STACK_SIZE]; /**< Logger thread stack (static). */
+static StaticTask_t m_logger_tcb;         /**< Logger thread TCB (static). */
+static TickType_t   m_flush_tick = 0;     /**< Tick of the last flush. */
 
 
 /**@brief A function which is hooked to idle task.
@@ -52,6 +63,11 @@ static TaskHandle_t m_logger_thread;      /**< Logger thread. */
  */   
 static void appIdleHook(void)
 {
+#if(LOGGER_FLUSH_PERIOD_MS)
+  TickType_t now = xTaskGetTickCount();
+  if((now - m_flush_tick) < pdMS_TO_TICKS(LOGGER_FLUSH_PERIOD_MS)) return; // записи подождут следующего пробуждения
+  m_flush_tick = now;
+#endif
   vTaskResume(m_logger_thread);
 }
 
@@ -89,12 +105,14 @@ uint16_t log_init(void)
   sysSetLoggerAppIdleHook(appIdleHook); // устанавливаю обработчик для vApplicationIdleHook()
   
   // Создаю задачу
-  if (pdPASS != xTaskCreate(logger_thread,
-                            "LOGGER",
-                            LOGGER_STACK_SIZE,
-                            NULL,
-                            LOGGER_PRIORITY,
-                            &m_logger_thread))
+  m_logger_thread = xTaskCreateStatic(logger_thread,
+                                      "LOGGER",
+                                      LOGGER_STACK_SIZE,
+                                      NULL,
+                                      LOGGER_PRIORITY,
+                                      m_logger_stack,
+                                      &m_logger_tcb);
+  if (m_logger_thread == NULL)
   {
       err_code = NRF_ERROR_NO_MEM;
   }
@@ -3,7 +3,18 @@
  *  Реализация логики работы устройства
  * 
  *  ОГРАНИЧЕНИЯ
- * - если было приянято несколько команд управления, то будет обработана только одна (самая первая), все остальное будет удалено
+ * - текстовые команды (старые приложения): если было приянято несколько команд управления, то будет обработана только одна (самая первая), все остальное будет удалено
+ * - двоичные команды (cmd.h) выполняются все, ответы на команды одного кадра передаются одним кадром
+ * - команды выполняются в задаче BLE, а не в суперзадаче
+ * - к устройству одновременно могут быть подключены несколько приемников (NRF_BLE_LINK_COUNT, например телефон и
+ *   прикроватный шлюз): ответы на команды уходят в то соединение, из которого пришла команда, события - во все соединения
+ * - блок посылок АЦП кодируется один раз на формат (NUS или ECGS) и раздается соединениям этого формата по ссылкам на блок
+ *   из пула, поэтому второй приемник не удваивает работу потока АЦП; кредиты и статистика у каждого соединения свои
+ * - при недостатке кредитов кадры ECGS прореживаются (коэффициент - в заголовке кадра), а поток NUS пропускает целые блоки
+ * - незавершенный двоичный кадр одного соединения сбрасывается, если команда пришла из другого соединения
+ * - при BEACON_EN краткое состояние (измерения, электроды, дыхание, батарея) публикуется в данных производителя
+ *   эдвертайзинга; проверка раз в BEACON_UPDATE_MS в суперзадаче, пакет пересобирается только при изменениях
+ * - при BLE_ADV_EXT_EN эдвертайзинг расширенный, за состоянием идет история последних BEACON_HIST_LEN проверок
 */
 
 #include "settings.h"
@@ -11,9 +22,11 @@
 #include "sys.h"
 //#include "spim_freertos.h"
 #include "ads_task.h"
-#include "ads1298.h"  // берем только константу ADS1298_REG_LAST
 #include "bleTask.h"
+#include "blk_pool.h"
 #include "cmd.h"
+#include "pace.h"
+#include "cal.h"
 
 #include <stdint.h>
 #include <string.h>
@@ -35,6 +48,7 @@
 #include "FreeRTOS.h"
 #include "task.h"
 #include "semphr.h"
+#include "timers.h"
 
 
 #include "math.h"
@@ -42,7 +56,9 @@
 
 
 // НАСТРОЙКИ МОДУЛЯ ************************************
-#define MAIN_BLE_ACD_START_MARKER   0xFFFF  // маркер пакета данных от АЦП
+#define MAIN_BLE_ACD_START_MARKER   0xFFFF  // маркер пакета данных от АЦП (только старый формат через NUS, в кадрах ECGS не используется)
+#define MAIN_RESP_EVT_SAMPLES       12      // отсчетов дыхания в одном событии CMD_EVT_RESP (~0.5 с при 25 SPS)
+#define MAIN_RECONN_NONE            0xFFFFFFFF // время переподключения не измерено
 
 // программирую напряжение питания GPIO в 3.3V (по адресу 0x10001304 будет записано значение UICR_REGOUT0_VOUT_3V3)
 const uint32_t UICR_REGOUT0 __attribute__((at(0x10001304))) __attribute__((used)) = UICR_REGOUT0_VOUT_3V3; 
@@ -79,10 +95,15 @@ const uint32_t UICR_REGOUT0 __attribute__((at(0x10001304))) __attribute__((used)
 typedef enum
 { // идентификаторы сообщений для суперзадачи
   SUPER_MSG_NONE =0,
-  SUPER_MSG_RX_DATA,          // приняты данные
   SUPER_MSG_REBOOT,           // перезагрузка устройства
   SUPER_MSG_BLE_CONNECTED,    // подключение по BLE
   SUPER_MSG_BLE_DISCONNECTED, // отключение по BLE
+  SUPER_MSG_LOFF,             // изменилось состояние электродов (данные - adstask_data_t.loff)
+  SUPER_MSG_PACE,             // импульс кардиостимулятора (данные - pace_evt_t)
+  SUPER_MSG_RESP,             // набрана половина буфера отсчетов дыхания (данные - номер половины m_resp)
+  SUPER_MSG_BEACON,           // пора проверить состояние для эдвертайзинга
+  SUPER_MSG_RECONN_TIMEOUT,   // приемник не переподключился за BLE_RECONN_HOLD_MS
+  SUPER_MSG_CMD_JOB,          // выполнить долгую команду m_job (ответ - отдельным кадром)
 } superMsg_id_e;
   
   
@@ -90,56 +111,448 @@ typedef struct
 { // структура сообщения для суперзадачи
   superMsg_id_e       msgID;      // ID сообщения
   uint16_t            msgLen;     // длина сообщения
-  uint8_t             msg[4];     // размер сообщения взят с "потокла", при необходимости изменить)
+  uint8_t             msg[8];     // размер сообщения взят с "потокла", при необходимости изменить)
 } superMsg_t;
 
+#if(ADS129X_CNT * 2 > 8)
+#error "superMsg_t.msg is too small for SUPER_MSG_LOFF"
+#endif
+#if((2 + MAIN_RESP_EVT_SAMPLES * 4) > CMD_EVT_LEN_MAX)
+#error "MAIN_RESP_EVT_SAMPLES does not fit into one event"
+#endif
+
 __packed typedef struct
 { // формат данных от АЦП для передачи по BLE
   uint16_t startMarker;       // признак начала посылки
-  int16_t adc0[ADS129X_CH_CNT]; // каналы АЦП 0
-  int16_t adc1[ADS129X_CH_CNT]; // каналы АЦП 1
+  int16_t ch[ADSTASK_CH_MAX]; // каналы всех найденных АЦП, передаются только первые m_adcChCnt
+                              // (для платы с двумя АЦП посылка совпадает со старым форматом: 16 каналов)
 } adc_data_format_t;
+
+__packed typedef struct
+{ // заголовок кадра данных АЦП для сервиса ECGS (один кадр - одна нотификация, маркеры не нужны)
+  uint16_t seq;       // номер кадра (для контроля потерь на стороне телефона)
+  uint8_t  ch_cnt;    // количество каналов int16_t в одном отсчете
+  uint8_t  smpl_cnt;  // количество отсчетов в кадре
+  uint8_t  decim;     // коэффициент прореживания отсчетов кадра (1 - без прореживания, период отсчетов = decim / SPS)
+} adc_frame_hdr_t;
+
+enum
+{ // форматы посылок АЦП
+  ADC_FMT_NUS = 0,  // посылки с маркером через NUS (старые приложения)
+  ADC_FMT_ECGS,     // кадры сервиса ECGS
+  ADC_FMT_CNT
+};
+
+typedef struct
+{ // состояние соединения с одним приемником данных
+  bool      connected;  // соединение установлено (после авторизации)
+  bool      credit_en;  // включено кредитное управление потоком (включается первой выдачей кредитов)
+  uint16_t  credit;     // количество блоков, которое еще можно передать
+  uint32_t  blk_sent;   // блоков АЦП передано драйверу в текущем сеансе
+  uint32_t  blk_drop;   // блоков АЦП, пропущенных соединением (нет кредитов или очередь драйвера переполнена)
+} link_t;
+
+typedef struct
+{ // долгая команда, которую выполняет суперзадача (задача приема BLE не ждет ее окончания)
+  uint8_t         cmd;    // код команды (0 - команды нет)
+  uint8_t         req_id; // req_id запроса для отложенного ответа
+  conn_handle_t   conn;   // соединение, из которого пришел запрос (туда уходит ответ)
+} cmd_job_t;
+
+typedef struct
+{ // поток посылок АЦП одного формата: блок заполняется один раз и раздается всем соединениям этого формата
+  blk_t     *blk;       // блок из пула, в котором накапливаются посылки
+  uint16_t  cap;        // емкость блока (для ECGS кадр должен помещаться в одну нотификацию каждого соединения)
+  uint8_t   links;      // маска соединений, которым уйдет блок (бит n - соединение n)
+  uint8_t   factor;     // коэффициент прореживания текущего блока (фиксируется при начале блока)
+  uint8_t   decim;      // счетчик прореживания: посылок в кадре ECGS, блоков в потоке NUS
+  uint16_t  seq;        // номер следующего кадра ECGS
+} adc_stream_t;
+
+#if(NRF_BLE_LINK_COUNT > 8)
+#error "adc_stream_t.links is too small for NRF_BLE_LINK_COUNT"
+#endif
+
+#define MAIN_BEACON_VER           1     // версия формата beacon_t
+#define MAIN_BEACON_FLAG_RUN      0x01  // идут измерения
+#define MAIN_BEACON_FLAG_LOFF     0x02  // отключен хотя бы один электрод
+#define MAIN_BEACON_BATT_UNKNOWN  0xFF  // заряд батареи не измеряется
+
+__packed typedef struct
+{ // состояние устройства в данных производителя эдвертайзинга
+  uint8_t  ver;                 // версия формата (MAIN_BEACON_VER)
+  uint8_t  flags;               // MAIN_BEACON_FLAG_..., биты 4..7 - количество соединений
+  uint8_t  hr;                  // ЧСС, уд/мин (0 - не определена)
+  uint8_t  resp;                // частота дыхания, вдохов/мин (0 - не определена)
+  uint8_t  batt;                // заряд батареи, % (MAIN_BEACON_BATT_UNKNOWN - неизвестен)
+  uint8_t  loff[ADS129X_CNT];   // отключенные электроды по АЦП: бит n - канал n (LOFF_STATP | LOFF_STATN)
+} beacon_t;
+
+#if(5 + ADS129X_CNT > BLE_ADV_MANUF_DATA_MAX)
+#error "beacon_t does not fit into advertising manufacturer data"
+#endif
+
+#if(BLE_ADV_EXT_EN)
+__packed typedef struct
+{ // запись истории состояния (расширенный эдвертайзинг)
+  uint8_t  hr;                  // ЧСС, уд/мин (0 - не определена)
+  uint8_t  resp;                // частота дыхания, вдохов/мин (0 - не определена)
+  uint8_t  flags;               // MAIN_BEACON_FLAG_...
+} beacon_hist_t;
+
+__packed typedef struct
+{ // данные производителя расширенного эдвертайзинга
+  beacon_t      st;                     // текущее состояние
+  uint8_t       hist_cnt;               // количество записей истории
+  beacon_hist_t hist[BEACON_HIST_LEN];  // история, начиная с последней записи (передается только hist_cnt записей)
+} beacon_ext_t;
+
+#if(5 + ADS129X_CNT + 1 + 3 * BEACON_HIST_LEN > BLE_ADV_EXT_CONN_MANUF_DATA_MAX) // эдвертайзинг с подключением
+#error "beacon_ext_t does not fit into extended advertising manufacturer data"
+#endif
+#endif // BLE_ADV_EXT_EN
   
   
 static TaskHandle_t           m_superTask = NULL; // хендл суперзадачи для реализации всей логики работы  
 static QueueHandle_t          m_superMsgHandle = NULL; // хендл буфера сообщений для суперзадачи 
 static uint8_t                m_cmdBuff[CMD_LEN_MAX]; // буфер для принятой команды
 static adc_data_format_t      m_adcData; // буфер для формирования послыки от АЦП в канал BLE
-static conn_handle_t          m_conn_handle = NULL; // хендл канала связи BLE
+static link_t                 m_link[NRF_BLE_LINK_COUNT]; // соединения (индекс - conn_handle_t)
+static conn_handle_t          m_cmd_conn = -1; // соединение, из которого пришла выполняемая команда (туда уходят ответы)
+static cmd_job_t              m_job; // долгая команда в суперзадаче (пишет задача приема, очищает суперзадача)
 static bool                   m_adc_started = false; // флаг запущенного АЦП
 static uint32_t               m_adc_sample_cnt = 0; // счетчик сэмплов АЦП TEST
+static bool                   m_loff_pend = false; // событие состояния электродов не поместилось в очередь суперзадачи
+#if(PACE_EN)
+static pace_evt_t             m_pace; // импульс стимулятора, ожидающий передачи в суперзадачу
+static bool                   m_pace_pend = false; // m_pace не поместилось в очередь суперзадачи
+#endif // PACE_EN
+static adc_stream_t           m_adcStream[ADC_FMT_CNT]; // потоки посылок АЦП по форматам
+static uint8_t                m_fmtLinks[ADC_FMT_CNT]; // маски соединений по форматам (обновляются на границах блоков)
+static uint32_t               m_adc_drop_cnt = 0; // счетчик посылок АЦП, потерянных из-за отсутствия блоков в пуле
+static uint8_t                m_adcChCnt = 0; // количество каналов в посылке (по числу найденных АЦП)
+static int32_t                m_resp[2][MAIN_RESP_EVT_SAMPLES]; // отсчеты дыхания: пока суперзадача передает одну половину, набирается другая
+static uint16_t               m_resp_rate[2]; // частота дыхания на момент заполнения половины
+static uint8_t                m_resp_half = 0; // набираемая половина
+static uint8_t                m_resp_n = 0; // отсчетов в набираемой половине
+static TimerHandle_t          m_reconnTimer = NULL; // удержание АЦП после отключения последнего приемника
+static StaticTimer_t          m_reconnTimerStatic;
+static TickType_t             m_reconn_t0; // момент отключения последнего приемника
+static bool                   m_reconn_wait = false; // ни одного соединения, жду переподключения
+static volatile bool          m_reconn_data_pend = false; // переподключились, жду первого переданного блока АЦП
+static uint32_t               m_reconn_conn_ms = MAIN_RECONN_NONE; // от отключения до подключения, мс
+static uint32_t               m_reconn_data_ms = MAIN_RECONN_NONE; // от отключения до первого блока АЦП, мс
+#if(WDT_EN)
+static StaticTimer_t          m_wdtTimerStatic;
+#endif // WDT_EN
+#if(BEACON_EN)
+static beacon_t               m_beacon = {.ver = MAIN_BEACON_VER, .batt = MAIN_BEACON_BATT_UNKNOWN}; // текущее состояние (пишет только суперзадача)
+static beacon_t               m_beaconAdv; // состояние, переданное в эдвертайзинг (нулевая версия: первая проверка передает состояние)
+static TimerHandle_t          m_beaconTimer = NULL;
+static StaticTimer_t          m_beaconTimerStatic;
+#if(BLE_ADV_EXT_EN)
+static beacon_hist_t          m_beaconHist[BEACON_HIST_LEN]; // кольцо истории состояния
+static uint8_t                m_beaconHistHead = 0; // индекс следующей записи в кольце
+static uint8_t                m_beaconHistCnt = 0; // записей в кольце
+static beacon_ext_t           m_beaconExt; // собранные данные расширенного эдвертайзинга
+#endif // BLE_ADV_EXT_EN
+#endif // BEACON_EN
+
+// статически выделенная память под задачи и очередь суперзадачи
+static StackType_t            m_superTaskStack[SUPERTASK_STACK_SIZE];
+static StaticTask_t           m_superTaskTCB;
+static uint8_t                m_superMsgStorage[SUPERTASK_MSG_BUFF_LEN * sizeof(superMsg_t)];
+static StaticQueue_t          m_superMsgStatic;
+const uint32_t                main_ram_size = sizeof(m_superMsgStorage); // для бюджета ОЗУ (debug_monitor.c)
+#if BLE_EN
+static StackType_t            m_bleTaskStack[BLE_TASK_STACK];
+static StaticTask_t           m_bleTaskTCB;
+#endif // BLE_EN
 
 // TEST
 #define TEST_ARR_SIZE     1024
 static TaskHandle_t       m_testTask = NULL;
+static StackType_t        m_testTaskStack[TEST_TASK_STACK_SIZE];
+static StaticTask_t       m_testTaskTCB;
 static uint8_t test_array1[TEST_ARR_SIZE]; // для тестирования скорости передачи
 static uint8_t test_array2[TEST_ARR_SIZE]; // для тестирования скорости передачи
 
+static void execCmdBle(conn_handle_t conn_handle); // парсер команд управления по каналу BLE
+static bool sendSuperMsgFunc(superMsg_id_e msgID, void *msgData, uint16_t msgSize, uint32_t timeout_ms); // сообщение суперзадаче
+
 // #############################  ВСПОМОГАТЕЛЬНЫЕ ФУНКЦИИ  ##############################################
+static void link_open(conn_handle_t conn)
+{ // новое соединение: кредиты выключены (новое приложение может их не поддерживать), статистика сброшена
+  taskENTER_CRITICAL();
+  memset(&m_link[conn], 0, sizeof(m_link[0]));
+  m_link[conn].connected = true;
+  taskEXIT_CRITICAL();
+}
+
+static uint8_t link_cnt(void)
+{ // количество установленных соединений
+  uint8_t cnt = 0;
+  for(conn_handle_t i = 0; i < NRF_BLE_LINK_COUNT; i++)
+  {
+    if(m_link[i].connected) cnt++;
+  }
+  return cnt;
+}
+
+static uint16_t link_interval_ms(void)
+{ // самый короткий интервал среди установленных соединений, мс (0 - соединений нет)
+  uint16_t res = 0;
+  for(conn_handle_t i = 0; i < NRF_BLE_LINK_COUNT; i++)
+  {
+    if(!m_link[i].connected) continue;
+    uint16_t ms = bleTaskGetConnIntervalMs(i);
+    if(ms && ((res == 0) || (ms < res))) res = ms;
+  }
+  return res;
+}
+
+static void credit_grant(conn_handle_t conn, uint16_t cnt)
+{ // приемник выдал кредиты на передачу cnt блоков
+  if((conn < 0) || (conn >= NRF_BLE_LINK_COUNT)) return;
+  taskENTER_CRITICAL();
+  m_link[conn].credit_en = true;
+  m_link[conn].credit = MIN(FLOW_CREDIT_MAX, m_link[conn].credit + cnt);
+  taskEXIT_CRITICAL();
+}
+
+static bool credit_take(conn_handle_t conn)
+{ // списание одного кредита соединения перед передачей блока
+  // возвращает false, если кредитов нет
+  bool res = true;
+  taskENTER_CRITICAL();
+  if(m_link[conn].credit_en)
+  {
+    if(m_link[conn].credit != 0) m_link[conn].credit--;
+    else res = false;
+  }
+  taskEXIT_CRITICAL();
+  return res;
+}
+
+static bool credit_low(conn_handle_t conn)
+{ // кредиты соединения заканчиваются, приемник не успевает принимать данные
+  return (m_link[conn].credit_en && (m_link[conn].credit < FLOW_CREDIT_LOW));
+}
+
 #if ADS129X_EN
+static uint16_t adc_pkt_size(uint8_t fmt)
+{ // размер одной посылки АЦП в блоке формата fmt
+  uint16_t size = m_adcChCnt * sizeof(m_adcData.ch[0]);
+  return (fmt == ADC_FMT_ECGS) ? size : (sizeof(m_adcData.startMarker) + size);
+}
+
+static bool adc_blk_full(uint8_t fmt)
+{ // следующая посылка в блок потока не поместится
+  return ((m_adcStream[fmt].blk->len + adc_pkt_size(fmt)) > m_adcStream[fmt].cap);
+}
+
+static bool adc_ecgs_fits(conn_handle_t conn)
+{ // кадр ECGS хотя бы с одним отсчетом помещается в одну нотификацию соединения
+  return (bleTaskGetMaxDataLen(conn) >= (sizeof(adc_frame_hdr_t) + adc_pkt_size(ADC_FMT_ECGS)));
+}
+
+static void adc_links_update(void)
+{ // распределение соединений по форматам посылок (подписка на сервис ECGS проверяется на границе блока, а не на каждом отсчете)
+  // кадры ECGS не делятся на части: пока MTU соединения мал для заголовка и одного отсчета (обмен MTU еще не прошел),
+  // соединение получает посылки NUS
+  memset(m_fmtLinks, 0, sizeof(m_fmtLinks));
+  for(conn_handle_t i = 0; i < NRF_BLE_LINK_COUNT; i++)
+  {
+    if(!m_link[i].connected) continue;
+    m_fmtLinks[(bleTaskStreamEnabled(i) && adc_ecgs_fits(i)) ? ADC_FMT_ECGS : ADC_FMT_NUS] |= 1U << i;
+  }
+}
+
+static bool adc_stream_low(uint8_t fmt)
+{ // ни одно соединение потока не успевает принимать данные (прореживание включается по самому быстрому приемнику)
+  uint8_t links = (m_adcStream[fmt].blk != NULL) ? m_adcStream[fmt].links : m_fmtLinks[fmt];
+  if(links == 0) return false;
+  for(conn_handle_t i = 0; i < NRF_BLE_LINK_COUNT; i++)
+  {
+    if((links & (1U << i)) && !credit_low(i)) return false;
+  }
+  return true;
+}
+
+static void adc_stream_drop(void)
+{ // освобождение недозаполненных блоков всех потоков
+  for(uint8_t f = 0; f < ADC_FMT_CNT; f++)
+  {
+    blk_pool_free(m_adcStream[f].blk);
+    m_adcStream[f].blk = NULL;
+  }
+}
+
+static void adc_blk_start(uint8_t fmt)
+{ // подготовка нового блока потока: состав получателей фиксируется до отправки блока
+  adc_stream_t *s = &m_adcStream[fmt];
+  adc_links_update();
+  s->links = m_fmtLinks[fmt];
+  s->cap = sizeof(s->blk->data);
+  s->factor = adc_stream_low(fmt) ? FLOW_DECIM_FACTOR : 1;
+  if(fmt != ADC_FMT_ECGS)
+  { // в посылках NUS нет поля прореживания: вместо прореживания внутри блока пропускаются целые блоки,
+    // отсчеты внутри переданного блока идут с обычной частотой
+    if((s->factor > 1) && (s->decim++ % s->factor))
+    {
+      for(conn_handle_t i = 0; i < NRF_BLE_LINK_COUNT; i++)
+      {
+        if(s->links & (1U << i)) m_link[i].blk_drop++;
+      }
+      s->links = 0;
+    }
+    return;
+  }
+  s->decim = 0;
+  
+  // кадр должен целиком помещаться в одну нотификацию каждого получателя (заголовок и отсчет помещаются - adc_links_update)
+  for(conn_handle_t i = 0; i < NRF_BLE_LINK_COUNT; i++)
+  {
+    if(!(s->links & (1U << i))) continue;
+    uint16_t max_len = bleTaskGetMaxDataLen(i);
+    if(max_len < s->cap) s->cap = max_len;
+  }
+  
+  adc_frame_hdr_t *hdr = (adc_frame_hdr_t *)s->blk->data;
+  hdr->seq = s->seq++;
+  hdr->ch_cnt = m_adcChCnt;
+  hdr->smpl_cnt = 0;
+  hdr->decim = s->factor;
+  s->blk->len = sizeof(adc_frame_hdr_t);
+}
+
+static void adc_blk_send(uint8_t fmt)
+{ // раздача заполненного блока соединениям потока: каждое получает свою ссылку на тот же блок
+  // соединение без кредитов пропускает блок (остальные его не ждут), пропуск виден приемнику по номеру кадра
+  adc_stream_t *s = &m_adcStream[fmt];
+  blk_t *blk = s->blk;
+  s->blk = NULL;
+  for(conn_handle_t i = 0; i < NRF_BLE_LINK_COUNT; i++)
+  {
+    if(!(s->links & (1U << i)) || !m_link[i].connected) continue;
+    if(!credit_take(i))
+    {
+      m_link[i].blk_drop++;
+      continue;
+    }
+    blk_pool_ref(blk);
+    if(bleTaskTxBlock(i, blk, fmt == ADC_FMT_ECGS))
+    {
+      m_link[i].blk_sent++;
+      if(m_reconn_data_pend)
+      { // первый блок после переподключения
+        m_reconn_data_ms = (uint32_t)(xTaskGetTickCount() - m_reconn_t0) * 1000 / configTICK_RATE_HZ;
+        m_reconn_data_pend = false;
+        RTT_LOG_INFO("MAIN: Reconnect: link %d ms, data %d ms", m_reconn_conn_ms, m_reconn_data_ms);
+      }
+    }else{ // очередь драйвера переполнена, соединение пропускает блок
+      RTT_LOG_INFO("MAIN: BLE tx queue ovf, link %d", i);
+      blk_pool_free(blk);
+      m_link[i].blk_drop++;
+    }
+  }
+  blk_pool_free(blk); // ссылка потока
+}
+
+static void adc_stream_put(uint8_t fmt)
+{ // добавление текущей посылки в блок потока, заполненный блок сразу раздается
+  adc_stream_t *s = &m_adcStream[fmt];
+  if(s->blk == NULL)
+  {
+    s->blk = blk_pool_alloc();
+    if(s->blk == NULL)
+    { // свободных блоков нет, пакет данных будет потерян
+      RTT_LOG_INFO("MAIN: Block pool empty, adc data lost");
+      m_adc_drop_cnt++;
+      return;
+    }
+    adc_blk_start(fmt);
+  }
+  
+  if(fmt == ADC_FMT_ECGS)
+  { // кадр ECGS: только данные каналов, без маркера; прореживание по коэффициенту из заголовка кадра
+    uint8_t skip = s->decim;
+    if(++s->decim >= s->factor) s->decim = 0;
+    if(skip) return;
+    memcpy(&s->blk->data[s->blk->len], m_adcData.ch, adc_pkt_size(fmt));
+    ((adc_frame_hdr_t *)s->blk->data)->smpl_cnt++;
+  }else{
+    memcpy(&s->blk->data[s->blk->len], &m_adcData, adc_pkt_size(fmt));
+  }
+  s->blk->len += adc_pkt_size(fmt);
+  
+  if(adc_blk_full(fmt)) adc_blk_send(fmt);
+}
+
 static void ads_task_callback(adstask_data_t *ads_data)
-{ // в эту функцию прилетают данные от двух АЦП в формате adstask_data_t
+{ // в эту функцию прилетают данные от всех АЦП в формате adstask_data_t
+  if(cal_feed(ads_data)) return; // идет автоматическая калибровка, отсчеты телефону не передаются
+  
 //  if(m_adc_sample_cnt == 3) 
 //  { // TEST
 //    NRF_LOG_INFO("ads_data:");
 //    NRF_LOG_HEXDUMP_INFO(ads_data, sizeof(adstask_data_t));
 //  }
+  if(ads_data->ch_cnt != m_adcChCnt)
+  { // разметка посылки не совпадает с составом АЦП (одиночное измерение или запуск до окончания инициализации АЦП):
+    // блоки с посылками другой длины не отправляются
+    adc_stream_drop();
+    m_adcChCnt = ads_data->ch_cnt;
+  }
+  
   // формирую пакет для отправки
-  for(uint8_t i=0; i < ADS129X_CH_CNT; i++)
+  for(uint8_t i=0; i < m_adcChCnt; i++)
   { // преобразую 32 бит в 16
-//    m_adcData.adc0[i] = (int16_t)(ads_data->adc0[i] >> 8);
-//    m_adcData.adc1[i] = (int16_t)(ads_data->adc1[i] >> 8);
+//    m_adcData.ch[i] = (int16_t)(ads_data->ch[i] >> 8);
     // новое хитрое преобразование
-    m_adcData.adc0[i] = (int16_t)(ads_data->adc0[i] >> 5);
-    m_adcData.adc1[i] = (int16_t)(ads_data->adc1[i] >> 5);
+    m_adcData.ch[i] = (int16_t)(ads_data->ch[i] >> 5);
   }
   m_adcData.startMarker = MAIN_BLE_ACD_START_MARKER;
-
-  if(m_conn_handle >= 0)
-  { // соединение все еще установлено
-    if(!bleTaskTxDataWait(m_conn_handle, (uint8_t *)&m_adcData, sizeof(m_adcData), BLE_SEND_TIMEOUT_MS))
-    { // передающий буфер переполнен, пакет данных будет потерян
-      RTT_LOG_INFO("MAIN: BLE tx queue ovf, adc data lost");
+  
+  if(ads_data->loff_changed || m_loff_pend)
+  { // состояние электродов уходит событием через суперзадачу, поток АЦП передачу не ждет;
+    // если очередь занята, попытка повторяется на следующем отсчете
+    m_loff_pend = !sendSuperMsgFunc(SUPER_MSG_LOFF, ads_data->loff, ads_data->adc_cnt * sizeof(ads_data->loff[0]), 0);
+  }
+  
+  if(ads_data->resp_ready)
+  { // канал дыхания идет событиями по MAIN_RESP_EVT_SAMPLES отсчетов, мимо потока ЭКГ
+    m_resp[m_resp_half][m_resp_n++] = ads_data->resp;
+    if(m_resp_n >= MAIN_RESP_EVT_SAMPLES)
+    { // если очередь занята, половина отбрасывается
+      m_resp_rate[m_resp_half] = ads_data->resp_rate;
+      sendSuperMsgFunc(SUPER_MSG_RESP, &m_resp_half, sizeof(m_resp_half), 0);
+      m_resp_half ^= 1;
+      m_resp_n = 0;
+    }
+  }
+  
+#if(PACE_EN)
+  if(m_pace_pend || pace_get(&m_pace))
+  { // импульсы стимулятора забираются из кольца не больше одного на отсчет, передача так же через суперзадачу
+    m_pace_pend = !sendSuperMsgFunc(SUPER_MSG_PACE, &m_pace, sizeof(m_pace), 0);
+  }
+#endif // PACE_EN
+
+  if(link_cnt() != 0)
+  { // есть хотя бы одно соединение
+    // посылки накапливаются в блоках из пула (один блок на формат), заполненный блок передается драйверу BLE
+    // без копирования и ожидания; каждое соединение расходует на блок свой кредит
+    bool idle = true;
+    for(uint8_t f = 0; f < ADC_FMT_CNT; f++)
+    {
+      if(m_adcStream[f].blk != NULL) idle = false;
+    }
+    if(idle) adc_links_update(); // блоков нет - состав получателей проверяется на каждом отсчете
+    
+    for(uint8_t f = 0; f < ADC_FMT_CNT; f++)
+    {
+      if((m_adcStream[f].blk != NULL) || m_fmtLinks[f]) adc_stream_put(f);
     }
     
 //    if(m_adc_sample_cnt == 3) 
@@ -168,6 +581,7 @@ static bool sendSuperMsgFunc(superMsg_id_e msgID, void *msgData, uint16_t msgSiz
   {
     if(msgSize > sizeof(msg.msg)) msgSize = sizeof(msg.msg);
     memcpy(&msg.msg, msgData, msgSize);
+    msg.msgLen = msgSize;
   }
   
   if(0 == xQueueSend(m_superMsgHandle, (const void *)&msg, pdMS_TO_TICKS(timeout_ms))) return false;
@@ -186,18 +600,95 @@ static bool sendSuperMsgSrc(superMsg_id_e msg_id, uint8_t src)
 }
 
 
+#if(BEACON_EN)
+static void beacon_timer_timeout(TimerHandle_t timer)
+{ // периодическая проверка состояния для эдвертайзинга (задача таймеров очередь суперзадачи не ждет)
+  sendSuperMsgFunc(SUPER_MSG_BEACON, NULL, 0, 0);
+}
+
+static void beacon_loff(uint8_t const *loff, uint16_t len)
+{ // состояние электродов из SUPER_MSG_LOFF: (LOFF_STATP << 8) | LOFF_STATN по каждому АЦП
+  for(uint8_t i = 0; (i < ADS129X_CNT) && (((i + 1) * sizeof(uint16_t)) <= len); i++)
+  {
+    uint16_t stat;
+    memcpy(&stat, &loff[i * sizeof(uint16_t)], sizeof(stat));
+    m_beacon.loff[i] = (uint8_t)(stat >> 8) | (uint8_t)stat; // канал отключен, если отключен любой из его электродов
+  }
+}
+
+static void beacon_publish(void)
+{ // передача состояния в эдвертайзинг, если оно изменилось с прошлой передачи
+  uint8_t flags = (uint8_t)(link_cnt() << 4);
+  if(m_adc_started)
+  {
+    flags |= MAIN_BEACON_FLAG_RUN;
+  }else{ // без измерений состояние электродов и дыхание неизвестны
+    memset(m_beacon.loff, 0, sizeof(m_beacon.loff));
+    m_beacon.resp = 0;
+  }
+  for(uint8_t i = 0; i < ADS129X_CNT; i++)
+  {
+    if(m_beacon.loff[i]) flags |= MAIN_BEACON_FLAG_LOFF;
+  }
+  m_beacon.flags = flags;
+  bool changed = (memcmp(&m_beacon, &m_beaconAdv, sizeof(m_beacon)) != 0);
+  
+#if(BLE_ADV_EXT_EN)
+  static bool hist_changed = false; // история изменилась, но еще не передана
+  if(m_adc_started)
+  { // история пишется только во время измерений, без них пакет не меняется
+    m_beaconHist[m_beaconHistHead].hr = m_beacon.hr;
+    m_beaconHist[m_beaconHistHead].resp = m_beacon.resp;
+    m_beaconHist[m_beaconHistHead].flags = flags;
+    m_beaconHistHead = (m_beaconHistHead + 1) % BEACON_HIST_LEN;
+    if(m_beaconHistCnt < BEACON_HIST_LEN) m_beaconHistCnt++;
+    hist_changed = true;
+  }
+  if(!changed && !hist_changed) return; // пакет эдвертайзинга не пересобирается
+  
+  m_beaconExt.st = m_beacon;
+  m_beaconExt.hist_cnt = m_beaconHistCnt;
+  for(uint8_t i = 0, idx = m_beaconHistHead; i < m_beaconHistCnt; i++)
+  { // от последней записи к первой
+    idx = (idx + BEACON_HIST_LEN - 1) % BEACON_HIST_LEN;
+    m_beaconExt.hist[i] = m_beaconHist[idx];
+  }
+  ret_code_t err = bleAdvManufDataUpdate(&m_beaconExt, sizeof(beacon_t) + 1 + m_beaconHistCnt * sizeof(beacon_hist_t));
+#else
+  if(!changed) return; // пакет эдвертайзинга не пересобирается
+  ret_code_t err = bleAdvManufDataUpdate(&m_beacon, sizeof(m_beacon));
+#endif // BLE_ADV_EXT_EN
+  if(err != NRF_SUCCESS)
+  { // попытка повторится на следующей проверке
+    RTT_LOG_INFO("SUPER: Beacon update error %d", err);
+    return;
+  }
+  m_beaconAdv = m_beacon;
+#if(BLE_ADV_EXT_EN)
+  hist_changed = false;
+#endif // BLE_ADV_EXT_EN
+}
+#endif // BEACON_EN
+
+
 // #############################  BLE  ##################################################################
 #if BLE_EN
-static uint16_t ble_advRestart(void)
-{
+static uint16_t ble_advRestart(bool fast)
+{ // fast - после разрыва связи: направленный эдвертайзинг и эдвертайзинг по белому списку (быстрое переподключение)
 #if(BLE_NO_ADV == 0)            
   // ПЕРЕЗАПУСКАЮ ЭДВЕРТАЙЗИНГ в зависимости от флага GF_EXT_PWR_PRESENT
   uint32_t repCnt = 0;
   do{ // делаю несколько попыток запустить эдвертайзинг в случае неуспеха
     uint16_t err;
     RTT_LOG_INFO("MAIN: Restart advertising ...");
-    err = bleAdvStart(DEVICE_NAME, TIME_ADV_INTERVAL_MS, TIME_ADV_DURATION_MS, BLE_ADV_POWER_MAX, 
-            TIME_CONN_INTERVAL_MIN_MS, TIME_CONN_INTERVAL_MAX_MS, BLE_CONN_POWER_MAX, NULL, 0, true);
+    // данные производителя (состояние для маяка) драйвер сохраняет сам
+    if(fast)
+    {
+      err = bleAdvFastStart();
+    }else{
+      err = bleAdvStart(DEVICE_NAME, TIME_ADV_INTERVAL_MS, TIME_ADV_DURATION_MS, BLE_ADV_POWER_MAX, 
+              TIME_CONN_INTERVAL_MIN_MS, TIME_CONN_INTERVAL_MAX_MS, BLE_CONN_POWER_MAX, NULL, 0, true);
+    }
     if(err == NRF_SUCCESS) break;
     
     RTT_LOG_INFO("MAIN: Restart advertising error %d", err);
@@ -246,6 +737,7 @@ static void ble_thread(void *args)
     vTaskDelete(NULL);
     return;
   }
+  sysBootMark(SYS_BOOT_BLE_ADV); // bleTaskInit() запускает эдвертайзинг
 
   bleParingEn(true); // паринг разрешен
   
@@ -256,17 +748,46 @@ static void ble_thread(void *args)
 
     switch(evt.evtID)
     {
-      case BLE_TASK_CONNECTED: // подключение установлено (телефон или любое другое устройство)
-        m_conn_handle = evt.conn_handle;
+      case BLE_TASK_CONNECTED: // подключение установлено (телефон, шлюз или любое другое устройство)
+        if((evt.conn_handle < 0) || (evt.conn_handle >= NRF_BLE_LINK_COUNT)) break;
+        link_open(evt.conn_handle);
+        if(m_reconn_wait)
+        { // время переподключения; время до данных фиксирует первая передача блока АЦП
+          m_reconn_conn_ms = (uint32_t)(xTaskGetTickCount() - m_reconn_t0) * 1000 / configTICK_RATE_HZ;
+          m_reconn_wait = false;
+          m_reconn_data_pend = true;
+        }
+        if(m_cmd_conn == evt.conn_handle)
+        { // остатки двоичных кадров от прошлого подключения не нужны
+          cmd_reset();
+          m_cmd_conn = -1;
+        }
         sendSuperMsg(SUPER_MSG_BLE_CONNECTED);
+        if((link_cnt() < NRF_BLE_LINK_COUNT) && (ble_advRestart(false) != NRF_SUCCESS))
+        { // подключиться может еще один приемник, но без эдвертайзинга он устройство не найдет
+          RTT_LOG_INFO("BLE_THREAD: Start advertising error");
+        }
       break;
       
       case BLE_TASK_DISCONNECTED:
         // произошло отключение
+        if((evt.conn_handle >= 0) && (evt.conn_handle < NRF_BLE_LINK_COUNT)) m_link[evt.conn_handle].connected = false;
+        if((link_cnt() == 0) && !m_reconn_wait)
+        { // отсчет времени переподключения
+          m_reconn_t0 = xTaskGetTickCount();
+          m_reconn_wait = true;
+          m_reconn_data_pend = false;
+          m_reconn_conn_ms = MAIN_RECONN_NONE;
+          m_reconn_data_ms = MAIN_RECONN_NONE;
+        }
+        if(m_cmd_conn == evt.conn_handle)
+        {
+          cmd_reset();
+          m_cmd_conn = -1;
+        }
         sendSuperMsg(SUPER_MSG_BLE_DISCONNECTED);
 
-        m_conn_handle = -1;        
-        if(ble_advRestart() != NRF_SUCCESS)
+        if(ble_advRestart(true) != NRF_SUCCESS)
         {
           RTT_LOG_INFO("BLE_THREAD: Start advertising error! Rebooting...");
           sendSuperMsg(SUPER_MSG_REBOOT);
@@ -278,11 +799,10 @@ static void ble_thread(void *args)
       break;
       
       case BLE_TASK_RX: // приняты какие-то данные 
-        sendSuperMsg(SUPER_MSG_RX_DATA);
+        execCmdBle(evt.conn_handle);
       break;
       
-      case BLE_TASK_TX: // очередная порция данных передана
-        // НЕ РЕАЛИЗОВАНО НА УРОВНЕ ДРАЙВЕРА
+      case BLE_TASK_TX: // все данные соединения переданы (по BLE_GATTS_EVT_HVN_TX_COMPLETE)
       break;
       
       default:
@@ -294,14 +814,437 @@ static void ble_thread(void *args)
 #endif // BLE_EN
 
 // #############################  CMD  ################################################################
-void execCmdBle(int16_t conn_handle)
+static uint16_t adc_start(void)
+{ // запуск измерений с подготовкой буферов передачи
+  m_adcChCnt = ads_task_get_ch_cnt(); // разметка посылок до прихода первого отсчета
+  // отсчеты уходят пачкой раз на событие соединения, поэтому и поток АЦП будить чаще незачем
+  // при нескольких соединениях - по самому короткому интервалу
+  ads_task_set_batch_ms(link_interval_ms());
+  
+  if(m_job.cmd) return ERR_INVALID_STATE; // АЦП заняты калибровкой или самопроверкой
+  uint16_t err = ads_task_start(false);
+  if(err != ERR_NOERROR) return err;
+  
+  m_adc_started = true;
+#if(PACE_EN)
+  m_pace_pend = false;
+  err = pace_start();
+  if(err != ERR_NOERROR) RTT_LOG_INFO("CMD: Pace detection not started, err %d", err);
+#endif // PACE_EN
+  m_adc_sample_cnt = 0;
+  m_resp_n = 0;
+  m_adc_drop_cnt = 0;
+  adc_stream_drop(); // недоотправленные данные прошлого сеанса не нужны
+  for(uint8_t f = 0; f < ADC_FMT_CNT; f++)
+  {
+    m_adcStream[f].seq = 0;
+    m_adcStream[f].decim = 0;
+  }
+  for(conn_handle_t i = 0; i < NRF_BLE_LINK_COUNT; i++)
+  {
+    m_link[i].blk_sent = 0;
+    m_link[i].blk_drop = 0;
+  }
+  return ERR_NOERROR;
+}
+
+static uint16_t adc_stop(void)
+{ // останов измерений
+  uint16_t err = ads_task_stop();
+  if(err != ERR_NOERROR) return err;
+  
+#if(PACE_EN)
+  pace_stop();
+#endif // PACE_EN
+  m_adc_started = false;
+  RTT_LOG_INFO("CMD: ADC sample was %d, dropped %d", m_adc_sample_cnt, m_adc_drop_cnt); // TEST
+  return ERR_NOERROR;
+}
+
+static void adc_idle_off(void)
+{ // приемников нет: измерения останавливаются, АЦП выключаются
+  if(m_adc_started)
+  {
+    uint16_t err = adc_stop();
+    if(err != ERR_NOERROR) RTT_LOG_INFO("SUPER: ADS Stop error: 0x%04X", err);
+  }
+  ads_task_set_idle_power(ADS_TASK_PWR_OFF); // без подключения АЦП не нужны
+}
+
+static void reconn_timer_timeout(TimerHandle_t timer)
+{ // приемник не вернулся за BLE_RECONN_HOLD_MS
+  sendSuperMsgFunc(SUPER_MSG_RECONN_TIMEOUT, NULL, 0, 0);
+}
+
+static uint8_t cmdStatus(uint16_t err)
+{ // преобразование кода ошибки errors.h в статус ответа
+  switch(err)
+  {
+    case ERR_NOERROR:           return CMD_STATUS_OK;
+    case ERR_INVALID_PARAMETR:  return CMD_STATUS_BAD_ARG;
+    case ERR_INVALID_STATE:     return CMD_STATUS_BUSY;
+    default:                    return CMD_STATUS_ERROR;
+  }
+}
+
+static void cmdTx(uint8_t const *data, uint16_t len)
+{ // передача кадра ответа на двоичные команды (в соединение, из которого пришла команда)
+  if(!bleTaskTxDataWait(m_cmd_conn, (uint8_t *)data, len, BLE_SEND_TIMEOUT_MS))
+  {
+    RTT_LOG_INFO("CMD: Response tx fail");
+  }
+}
+
+static void cmdJobTx(uint8_t const *data, uint16_t len)
+{ // передача отложенного ответа в соединение, из которого пришла долгая команда
+  if(!bleTaskTxDataWait(m_job.conn, (uint8_t *)data, len, BLE_SEND_TIMEOUT_MS))
+  {
+    RTT_LOG_INFO("CMD: Job response tx fail");
+  }
+}
+
+static uint8_t cmd_job_post(uint8_t cmd, uint8_t *rsp_len)
+{ // передача долгой команды суперзадаче; в ответе кадра - CMD_STATUS_PENDING, результат придет отдельным кадром
+  *rsp_len = 0;
+  if(m_adc_started || m_job.cmd) return CMD_STATUS_BUSY;
+  m_job.req_id = cmd_req_id();
+  m_job.conn = m_cmd_conn;
+  m_job.cmd = cmd;
+  if(!sendSuperMsg(SUPER_MSG_CMD_JOB))
+  {
+    m_job.cmd = 0;
+    return CMD_STATUS_ERROR;
+  }
+  return CMD_STATUS_PENDING;
+}
+
+static void cmdEvtTx(uint8_t const *data, uint16_t len)
+{ // передача кадра события во все соединения (кадр собирается один раз)
+  for(conn_handle_t i = 0; i < NRF_BLE_LINK_COUNT; i++)
+  {
+    if(!m_link[i].connected) continue;
+    if(!bleTaskTxDataWait(i, (uint8_t *)data, len, BLE_SEND_TIMEOUT_MS))
+    {
+      RTT_LOG_INFO("CMD: Event tx fail, link %d", i);
+    }
+  }
+}
+
+// ***** обработчики двоичных команд (формат аргументов и ответов описан у каждого обработчика) *****
+
+static uint8_t cmdStatusHandler(uint8_t const *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{ // ответ: uint64_t ID устройства, uint8_t флаг запущенного АЦП, строка версии прошивки (без завершающего нуля)
+  uint64_t uid = GET_DEVICE_ID();
+  uint8_t fw_len = strlen(FW_VER);
+  if(*rsp_len < (sizeof(uid) + 1 + fw_len)) return CMD_STATUS_ERROR;
+  
+  memcpy(rsp, &uid, sizeof(uid));
+  rsp[sizeof(uid)] = m_adc_started;
+  memcpy(&rsp[sizeof(uid) + 1], FW_VER, fw_len);
+  *rsp_len = sizeof(uid) + 1 + fw_len;
+  return CMD_STATUS_OK;
+}
+
+static uint8_t cmdStartHandler(uint8_t const *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{ // без аргументов и данных ответа
+  *rsp_len = 0;
+  if(m_adc_started) return CMD_STATUS_BUSY;
+  return cmdStatus(adc_start());
+}
+
+static uint8_t cmdStopHandler(uint8_t const *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{ // без аргументов и данных ответа
+  *rsp_len = 0;
+  return cmdStatus(adc_stop());
+}
+
+static uint8_t cmdRebootHandler(uint8_t const *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{ // без аргументов и данных ответа, перезагрузка выполняется суперзадачей после отправки ответа
+  *rsp_len = 0;
+  return sendSuperMsg(SUPER_MSG_REBOOT) ? CMD_STATUS_OK : CMD_STATUS_ERROR;
+}
+
+static uint8_t cmdMacHandler(uint8_t const *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{ // ответ: uint64_t ID устройства
+  uint64_t uid = GET_DEVICE_ID();
+  if(*rsp_len < sizeof(uid)) return CMD_STATUS_ERROR;
+  memcpy(rsp, &uid, sizeof(uid));
+  *rsp_len = sizeof(uid);
+  return CMD_STATUS_OK;
+}
+
+static uint8_t cmdGetCfgHandler(uint8_t const *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{ // аргумент: uint8_t номер АЦП; ответ: номер АЦП и значения всех регистров (адрес равен индексу)
+  uint8_t len = *rsp_len;
+  *rsp_len = 0;
+  if((arg_len != 1) || (arg[0] >= ADS129X_CNT)) return CMD_STATUS_BAD_ARG;
+  if(len < (ADS129X_REG_CNT + 1)) return CMD_STATUS_ERROR;
+  
+  rsp[0] = arg[0];
+  uint16_t err = ads_task_get_regs((adstask_adc_no_e)arg[0], &rsp[1], ADS129X_REG_CNT, TIME_CMD_MS);
+  // длина ответа зависит от типа микросхемы (ADS1298 - 26 регистров, ADS1299 - 24)
+  if(err == ERR_NOERROR) *rsp_len = ads_task_get_reg_cnt((adstask_adc_no_e)arg[0]) + 1;
+  return cmdStatus(err);
+}
+
+static uint8_t cmdSetCfgHandler(uint8_t const *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{ // аргументы: uint8_t номер АЦП, далее пары (адрес регистра, значение); ответ: количество принятых регистров
+  // все пары применяются одним заданием: либо записываются все, либо ни одной
+  static ads_task_cfg_image_t image;
+  uint8_t len = *rsp_len;
+  *rsp_len = 0;
+  if((arg_len < 3) || ((arg_len - 1) & 1) || (arg[0] >= ADS129X_CNT)) return CMD_STATUS_BAD_ARG;
+  if(len < 1) return CMD_STATUS_ERROR;
+  
+  memset(&image, 0, sizeof(image));
+  uint8_t cnt = 0;
+  for(uint8_t i = 1; i < arg_len; i += 2)
+  {
+    if(arg[i] >= ADS129X_REG_CNT) return CMD_STATUS_BAD_ARG;
+    image.regs[arg[0]][arg[i]] = arg[i + 1];
+    image.mask[arg[0]] |= 1UL << arg[i];
+    cnt++;
+  }
+  uint16_t err = ads_task_apply_config(&image, TIME_CMD_MS);
+  rsp[0] = (err == ERR_NOERROR) ? cnt : 0;
+  *rsp_len = 1;
+  return cmdStatus(err);
+}
+
+static uint8_t cmdShotHandler(uint8_t const *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{ // без аргументов и данных ответа
+  *rsp_len = 0;
+  if(m_job.cmd) return CMD_STATUS_BUSY; // АЦП заняты калибровкой или самопроверкой
+  return cmdStatus(ads_task_start(true));
+}
+
+static uint8_t cmdCreditHandler(uint8_t const *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{ // аргумент: uint8_t количество блоков; без данных ответа
+  *rsp_len = 0;
+  if((arg_len != 1) || (arg[0] == 0) || (arg[0] > FLOW_CREDIT_MAX)) return CMD_STATUS_BAD_ARG;
+  credit_grant(m_cmd_conn, arg[0]);
+  return CMD_STATUS_OK;
+}
+
+static uint8_t cmdConsumHandler(uint8_t const *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{ // без аргументов; ответ (uint32_t): время работы, мс, время сна, мс, пробуждений из сна, пробуждений потока АЦП,
+  // отсчетов АЦП в текущем сеансе, время от запуска АЦП до первого отсчета, мс, уровень питания АЦП (ads_task_pwr_e)
+  sys_pwr_profile_t profile;
+  uint32_t val[7];
+  if(*rsp_len < sizeof(val)) return CMD_STATUS_ERROR;
+  
+  sysGetPwrProfile(&profile);
+  val[0] = profile.uptime_ms;
+  val[1] = profile.sleep_ms;
+  val[2] = profile.wakeups;
+  val[3] = ads_task_get_wakeup_cnt();
+  val[4] = m_adc_sample_cnt;
+  val[5] = ads_task_get_wake_latency_ms();
+  val[6] = ads_task_get_power();
+  memcpy(rsp, val, sizeof(val));
+  *rsp_len = sizeof(val);
+  return CMD_STATUS_OK;
+}
+
+static uint8_t cmdLinksHandler(uint8_t const *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{ // без аргументов; ответ - по каждому соединению (NRF_BLE_LINK_COUNT записей): uint8_t флаги (бит 0 - подключено,
+  // бит 1 - подписка ECGS, бит 2 - кредиты включены, бит 3 - запрос пришел из этого соединения), uint16_t кредиты,
+  // uint16_t интервал соединения, мс, uint32_t передано блоков АЦП, uint32_t пропущено блоков АЦП;
+  // в конце - последнее переподключение: uint32_t от отключения всех приемников до подключения, мс,
+  // uint32_t от отключения до первого переданного блока АЦП, мс (0xFFFFFFFF - не измерено)
+  const uint8_t rec_len = 1 + 2 * sizeof(uint16_t) + 2 * sizeof(uint32_t);
+  if(*rsp_len < NRF_BLE_LINK_COUNT * rec_len + 2 * sizeof(uint32_t)) return CMD_STATUS_ERROR;
+  
+  uint8_t *p = rsp;
+  for(conn_handle_t i = 0; i < NRF_BLE_LINK_COUNT; i++)
+  {
+    link_t link;
+    taskENTER_CRITICAL();
+    link = m_link[i];
+    taskEXIT_CRITICAL();
+    
+    uint16_t interval = link.connected ? bleTaskGetConnIntervalMs(i) : 0;
+    *p = (link.connected ? 0x01 : 0) | ((link.connected && bleTaskStreamEnabled(i)) ? 0x02 : 0) |
+         (link.credit_en ? 0x04 : 0) | ((i == m_cmd_conn) ? 0x08 : 0);
+    p++;
+    memcpy(p, &link.credit, sizeof(uint16_t));      p += sizeof(uint16_t);
+    memcpy(p, &interval, sizeof(uint16_t));         p += sizeof(uint16_t);
+    memcpy(p, &link.blk_sent, sizeof(uint32_t));    p += sizeof(uint32_t);
+    memcpy(p, &link.blk_drop, sizeof(uint32_t));    p += sizeof(uint32_t);
+  }
+  memcpy(p, &m_reconn_conn_ms, sizeof(uint32_t));   p += sizeof(uint32_t);
+  memcpy(p, &m_reconn_data_ms, sizeof(uint32_t));   p += sizeof(uint32_t);
+  *rsp_len = p - rsp;
+  return CMD_STATUS_OK;
+}
+
+static uint8_t cmdGetCalHandler(uint8_t const *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{ // аргумент: uint8_t номер канала (без аргумента - все каналы);
+  // ответ: по каждому каналу int32_t смещение в кодах АЦП, int32_t коэффициент усиления Q2.30
+  uint8_t len = *rsp_len;
+  *rsp_len = 0;
+  if(arg_len > 1) return CMD_STATUS_BAD_ARG;
+  uint8_t first = arg_len ? arg[0] : 0;
+  uint8_t cnt = arg_len ? 1 : ADSTASK_CH_MAX;
+  if(first >= ADSTASK_CH_MAX) return CMD_STATUS_BAD_ARG;
+  if(len < (cnt * sizeof(cal_ch_t))) return CMD_STATUS_ERROR;
+  
+  for(uint8_t i = 0; i < cnt; i++)
+  {
+    cal_ch_t cal;
+    cal_get(first + i, &cal);
+    memcpy(&rsp[i * sizeof(cal)], &cal, sizeof(cal));
+  }
+  *rsp_len = cnt * sizeof(cal_ch_t);
+  return CMD_STATUS_OK;
+}
+
+static uint8_t cmdSetCalHandler(uint8_t const *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{ // аргументы: uint8_t номер канала (0xFF - все каналы), int32_t смещение, int32_t коэффициент усиления Q2.30;
+  // только номер канала - сброс калибровки; без данных ответа. Таблица сохраняется во флеш
+  *rsp_len = 0;
+  if(arg_len == 1) return cmdStatus(cal_set(arg[0], NULL));
+  if(arg_len != (1 + sizeof(cal_ch_t))) return CMD_STATUS_BAD_ARG;
+  
+  cal_ch_t cal;
+  memcpy(&cal, &arg[1], sizeof(cal));
+  return cmdStatus(cal_set(arg[0], &cal));
+}
+
+static uint8_t cmdAutoCalHandler(uint8_t const *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{ // без аргументов; сразу - CMD_STATUS_PENDING, затем отдельный ответ (autoCalExec)
+  // измерения должны быть остановлены, команда выполняется суперзадачей около секунды
+  return cmd_job_post(CMD_CMD_AUTO_CAL, rsp_len);
+}
+
+static uint8_t autoCalExec(uint8_t *rsp, uint8_t *rsp_len)
+{ // отложенный ответ на CMD_CMD_AUTO_CAL: uint32_t маска откалиброванных каналов (бит n - канал n)
+  uint32_t mask = 0;
+  if(*rsp_len < sizeof(mask)) return CMD_STATUS_ERROR;
+  *rsp_len = 0;
+  if(m_adc_started) return CMD_STATUS_BUSY;
+  
+  uint16_t err = cal_auto(&mask);
+  memcpy(rsp, &mask, sizeof(mask));
+  *rsp_len = sizeof(mask);
+  return cmdStatus(err);
+}
+
+static uint8_t cmdSelfTestHandler(uint8_t const *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{ // без аргументов; сразу - CMD_STATUS_PENDING, затем отдельный ответ (selfTestExec)
+  // измерения должны быть остановлены, команда выполняется суперзадачей несколько секунд
+  return cmd_job_post(CMD_CMD_SELFTEST, rsp_len);
+}
+
+static uint8_t selfTestExec(uint8_t *rsp, uint8_t *rsp_len)
+{ // отложенный ответ на CMD_CMD_SELFTEST: uint8_t количество АЦП, uint8_t количество каналов, uint32_t маска каналов
+  // вне допуска, далее по каждому АЦП cal_st_adc_t, по каждому каналу cal_st_ch_t
+  static cal_selftest_t report;
+  uint8_t len = *rsp_len;
+  *rsp_len = 0;
+  if(m_adc_started) return CMD_STATUS_BUSY;
+  
+  uint16_t err = cal_selftest(&report);
+  if(err != ERR_NOERROR) return cmdStatus(err);
+  uint8_t adc_len = report.adc_cnt * sizeof(cal_st_adc_t);
+  uint8_t ch_len = report.ch_cnt * sizeof(cal_st_ch_t);
+  if(len < (2 + sizeof(report.fail_mask) + adc_len + ch_len)) return CMD_STATUS_ERROR;
+  
+  rsp[0] = report.adc_cnt;
+  rsp[1] = report.ch_cnt;
+  memcpy(&rsp[2], &report.fail_mask, sizeof(report.fail_mask));
+  uint8_t pos = 2 + sizeof(report.fail_mask);
+  memcpy(&rsp[pos], report.adc, adc_len);
+  pos += adc_len;
+  memcpy(&rsp[pos], report.ch, ch_len);
+  *rsp_len = pos + ch_len;
+  return CMD_STATUS_OK;
+}
+
+static uint8_t cmdBootHandler(uint8_t const *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{ // без аргументов; ответ: uint8_t флаг теплого старта, далее uint32_t время этапов загрузки в мс по sys_boot_phase_e
+  // (от запуска планировщика, SYS_BOOT_NONE - этап не пройден)
+  uint8_t len = 1 + SYS_BOOT_PHASE_CNT * sizeof(uint32_t);
+  if(*rsp_len < len) return CMD_STATUS_ERROR;
+  
+  rsp[0] = ads_task_is_warm_start();
+  for(uint8_t i = 0; i < SYS_BOOT_PHASE_CNT; i++)
+  {
+    uint32_t ms = sysBootTime((sys_boot_phase_e)i);
+    memcpy(&rsp[1 + i * sizeof(ms)], &ms, sizeof(ms));
+  }
+  *rsp_len = len;
+  return CMD_STATUS_OK;
+}
+
+static void cmd_job_exec(void)
+{ // выполнение долгой команды в суперзадаче и отложенный ответ источнику
+  static uint8_t rsp[CMD_REPLY_LEN_MAX];
+  uint8_t len = sizeof(rsp);
+  uint8_t status;
+  
+  switch(m_job.cmd)
+  {
+    case CMD_CMD_AUTO_CAL:  status = autoCalExec(rsp, &len); break;
+    case CMD_CMD_SELFTEST:  status = selfTestExec(rsp, &len); break;
+    default:                status = CMD_STATUS_UNKNOWN; len = 0; break;
+  }
+  
+  // источник мог отключиться за время выполнения
+  if((m_job.conn >= 0) && (m_job.conn < NRF_BLE_LINK_COUNT) && m_link[m_job.conn].connected)
+  {
+    cmd_reply(m_job.cmd, m_job.req_id, status, rsp, len, cmdJobTx);
+  }
+  m_job.cmd = 0;
+}
+
+static const cmd_entry_t m_cmdTable[] =
+{ // таблица двоичных команд
+  {CMD_CMD_STATUS,  cmdStatusHandler},
+  {CMD_CMD_START,   cmdStartHandler},
+  {CMD_CMD_STOP,    cmdStopHandler},
+  {CMD_CMD_REBOOT,  cmdRebootHandler},
+  {CMD_CMD_MAC,     cmdMacHandler},
+  {CMD_CMD_GET_CFG, cmdGetCfgHandler},
+  {CMD_CMD_SET_CFG, cmdSetCfgHandler},
+  {CMD_CMD_SHOT,    cmdShotHandler},
+  {CMD_CMD_CREDIT,  cmdCreditHandler},
+  {CMD_CMD_CONSUM,  cmdConsumHandler},
+  {CMD_CMD_LINKS,   cmdLinksHandler},
+  {CMD_CMD_BOOT,    cmdBootHandler},
+  {CMD_CMD_GET_CAL, cmdGetCalHandler},
+  {CMD_CMD_SET_CAL, cmdSetCalHandler},
+  {CMD_CMD_AUTO_CAL, cmdAutoCalHandler},
+  {CMD_CMD_SELFTEST, cmdSelfTestHandler},
+};
+
+static void execCmdBle(conn_handle_t conn_handle)
 { // парсер команд управления по каналу BLE
-  // команда лежит в приемном буфере BLE: первый байт - код комадны, далее могут идти дополнительные данные
-  // будет обработана только первая команда, остальное - в утиль
+  // двоичные кадры (начинаются с CMD_FRAME_SYNC) передаются в диспетчер cmd.c целиком, все команды выполняются
+  // текстовая команда лежит в приемном буфере BLE: первый байт - код комадны, далее могут идти дополнительные данные
+  // для текстовых команд будет обработана только первая команда, остальное - в утиль
   uint32_t cnt = bleGetRxDataSize(conn_handle); // размер данных в буфере
   if(cnt == 0) return;
   uint32_t cmdLen = MIN(CMD_LEN_MAX, cnt);
-  bleGetRxData(conn_handle, m_cmdBuff, cmdLen, 0); // вычитываю все
+  bleGetRxData(conn_handle, m_cmdBuff, cmdLen, 0);
+  
+  if(conn_handle != m_cmd_conn)
+  { // команда из другого соединения: незавершенный кадр предыдущего источника не продолжится
+    if(cmd_pending()) cmd_reset();
+    m_cmd_conn = conn_handle;
+  }
+  
+  if(cmd_pending() || (m_cmdBuff[0] == CMD_FRAME_SYNC))
+  { // двоичный протокол: вычитываю и разбираю все принятые данные
+    do{
+      cmd_rx(m_cmdBuff, cmdLen);
+      cnt = bleGetRxDataSize(conn_handle);
+      cmdLen = MIN(CMD_LEN_MAX, cnt);
+      if(cmdLen) bleGetRxData(conn_handle, m_cmdBuff, cmdLen, 0);
+    }while(cmdLen);
+    return;
+  }
+  
   if(cnt >= CMD_LEN_MAX)
   { // если данных буфере больше максимальной длины команды - удаляю все
     bleResetRxBuff(conn_handle); // очищаю буфер принятых сообщений
@@ -313,36 +1256,30 @@ void execCmdBle(int16_t conn_handle)
     {
       char buff[50];
       snprintf(buff, sizeof(buff), "Multichannel cardiograph\n");
-      bleTaskTxDataWait(m_conn_handle, (uint8_t *)buff, strlen(buff), BLE_SEND_TIMEOUT_MS);
+      bleTaskTxDataWait(conn_handle, (uint8_t *)buff, strlen(buff), BLE_SEND_TIMEOUT_MS);
       snprintf(buff, sizeof(buff), "Firmware:%s\n", FW_VER);
-      bleTaskTxDataWait(m_conn_handle, (uint8_t *)buff, strlen(buff), BLE_SEND_TIMEOUT_MS);
+      bleTaskTxDataWait(conn_handle, (uint8_t *)buff, strlen(buff), BLE_SEND_TIMEOUT_MS);
       uint64_t uid = GET_DEVICE_ID();
       snprintf(buff, sizeof(buff), "SerialNO:ECL-Cardio18.v%s-%08X%08X\n", HW_VER, (uint32_t)(uid >> 32), (uint32_t)uid);
-      bleTaskTxDataWait(m_conn_handle, (uint8_t *)buff, strlen(buff), BLE_SEND_TIMEOUT_MS);
+      bleTaskTxDataWait(conn_handle, (uint8_t *)buff, strlen(buff), BLE_SEND_TIMEOUT_MS);
       snprintf(buff, sizeof(buff), "battery_status:OK 100\n"); // TODO подставить реальное значение
-      bleTaskTxDataWait(m_conn_handle, (uint8_t *)buff, strlen(buff), BLE_SEND_TIMEOUT_MS);
+      bleTaskTxDataWait(conn_handle, (uint8_t *)buff, strlen(buff), BLE_SEND_TIMEOUT_MS);
       snprintf(buff, sizeof(buff), "Custom made for EC-Leasing\n");
-      bleTaskTxDataWait(m_conn_handle, (uint8_t *)buff, strlen(buff), BLE_SEND_TIMEOUT_MS);
+      bleTaskTxDataWait(conn_handle, (uint8_t *)buff, strlen(buff), BLE_SEND_TIMEOUT_MS);
     }
     break;
 
     case CMD_CMD_START  : // Запуск процесса измерения с указанием времени съема
       if(m_adc_started) break; // на выход, АЦП уже запущено
-      if(ERR_NOERROR == ads_task_start(false))
+      if(ERR_NOERROR != adc_start())
       {
-        m_adc_started = true;
-        m_adc_sample_cnt = 0;
-      }else{
         RTT_LOG_INFO("CMD: ADC start fail");
       }
     break;
 
     case CMD_CMD_STOP   : // Останов процесса измерения
-      if(ERR_NOERROR == ads_task_stop())
+      if(ERR_NOERROR != adc_stop())
       {
-        m_adc_started = false;
-        RTT_LOG_INFO("CMD: ADC sample was %d", m_adc_sample_cnt); // TEST
-      }else{
         RTT_LOG_INFO("CMD: ADC stop fail");
       }
     break;
@@ -359,7 +1296,7 @@ void execCmdBle(int16_t conn_handle)
       char buff[30];
       uint64_t uid = GET_DEVICE_ID();
       snprintf(buff, sizeof(buff), "MAC:%08X%08X\n", (uint32_t)(uid >> 32), (uint32_t)uid);
-      bleTaskTxDataWait(m_conn_handle, (uint8_t *)buff, strlen(buff), BLE_SEND_TIMEOUT_MS);
+      bleTaskTxDataWait(conn_handle, (uint8_t *)buff, strlen(buff), BLE_SEND_TIMEOUT_MS);
     }
     break;
 
@@ -383,9 +1320,9 @@ void execCmdBle(int16_t conn_handle)
     break;
     case CMD_CMD_VIBRO  : // Инициировать виброиндикатор
     break;
-    case CMD_CMD_GET_CAL: // Считать калибровочный коэффициент по каналу
+    case CMD_CMD_GET_CAL: // Считать калибровочный коэффициент по каналу (только двоичная команда)
     break;
-    case CMD_CMD_SET_CAL: // Записать калибровочный коффициент по каналу
+    case CMD_CMD_SET_CAL: // Записать калибровочный коффициент по каналу (только двоичная команда)
     break;
     
     case CMD_CMD_GET_CFG: // Запрос конфига (формат: G,n где n - номер АЦП: 0 или 1)
@@ -406,7 +1343,7 @@ void execCmdBle(int16_t conn_handle)
           break;
         }
         // в str сформирован ответ вида: G,n,rrvv,....,rrvv где n - номер АЦП (0 или 1), rrvv - uint16_t, где rr - адрес регистра, vv - значение регистра
-        bleTaskTxDataWait(m_conn_handle, (uint8_t *)str, strlen(str), BLE_SEND_TIMEOUT_MS);
+        bleTaskTxDataWait(conn_handle, (uint8_t *)str, strlen(str), BLE_SEND_TIMEOUT_MS);
     }
     break;
     
@@ -418,10 +1355,13 @@ void execCmdBle(int16_t conn_handle)
         RTT_LOG_INFO("CMD: Wrong ADC number: it can be either 0 or 1");
         break;
       }
+      // все пары собираются в один образ и применяются одним заданием
+      static ads_task_cfg_image_t image;
+      memset(&image, 0, sizeof(image));
       // начиная с позиции 4 идут uint16 разделенные запятой
       char *pVal = strtok((char *)&m_cmdBuff[4],",");
       while(pVal)
-      { // запись принятых значений в АЦП
+      { // разбор принятых значений
         uint16_t val = strtol(pVal, NULL, 16); // выделяю значение очередной пары
         if(val == 0) 
         {
@@ -430,20 +1370,42 @@ void execCmdBle(int16_t conn_handle)
         }
         uint8_t regAddr = val >> 8; // значение адреса регистра
         uint8_t regVal = (uint8_t)val; // значение регистра
-        // отправляю новое значение в АЦП
-        uint16_t err = ads_task_set_reg((adstask_adc_no_e)adc_no, regAddr, regVal, TIME_CMD_MS);
-        if(err != ERR_NOERROR)
+        if(regAddr >= ADS129X_REG_CNT)
         {
-          RTT_LOG_INFO("CMD: Set new val 0x%02X to addr 0x%02X error 0x%04X", regVal, regAddr, err);
+          RTT_LOG_INFO("CMD: Wrong reg addr 0x%02X", regAddr);
+        }else{
+          image.regs[adc_no][regAddr] = regVal;
+          image.mask[adc_no] |= 1UL << regAddr;
         }
         // переходим к следующей паре значений
         pVal = strtok(NULL, ",");
       }
+      // отправляю новые значения в АЦП
+      uint16_t err = ads_task_apply_config(&image, TIME_CMD_MS);
+      if(err != ERR_NOERROR)
+      {
+        RTT_LOG_INFO("CMD: Apply config error 0x%04X", err);
+      }
+    }
+    break;
+
+    case CMD_CMD_CREDIT : // Выдача кредитов на передачу данных АЦП (формат: C,n где n - количество блоков)
+    {
+      // буфер команды не завершается нулем, поэтому число разбираю в пределах cmdLen
+      uint32_t cnt = 0;
+      for(uint32_t i = 2; (i < cmdLen) && (m_cmdBuff[i] >= '0') && (m_cmdBuff[i] <= '9') && (cnt <= FLOW_CREDIT_MAX); i++)
+        cnt = cnt * 10 + (m_cmdBuff[i] - '0');
+      if((cnt == 0) || (cnt > FLOW_CREDIT_MAX))
+      {
+        RTT_LOG_INFO("CMD: Wrong credit count");
+        break;
+      }
+      credit_grant(conn_handle, (uint16_t)cnt);
     }
     break;
 
     case CMD_CMD_SHOT   : // Единичный отсчет АЦП
-      if(ERR_NOERROR != ads_task_start(true))
+      if(m_job.cmd || (ERR_NOERROR != ads_task_start(true))) // АЦП заняты калибровкой или самопроверкой
       {
         RTT_LOG_INFO("CMD: ADC start single shot fail");
       }
@@ -559,16 +1521,28 @@ static void super_task_thread(void *args)
         // настройка WDT и запуск
         WDT_Run(WDT_TIME_CYCLE_MS); // таймер будет срабатывать каждые WDT_TIME_CYCLE_MS миллисекунды
         WDT_Reset();
-        wdt_timer = xTimerCreate("WDTIMER", pdMS_TO_TICKS(WDT_TIME_CYCLE_MS - 5000), true, NULL, wdt_timer_timeout);     
+        wdt_timer = xTimerCreateStatic("WDTIMER", pdMS_TO_TICKS(WDT_TIME_CYCLE_MS - 5000), pdTRUE, NULL, wdt_timer_timeout, &m_wdtTimerStatic);
         xTimerStart(wdt_timer, portMAX_DELAY);
 #endif // WDT_EN
+
+#if(BLE_RECONN_HOLD_MS)
+        // удержание измерений на время переподключения приемника
+        m_reconnTimer = xTimerCreateStatic("RECONN", pdMS_TO_TICKS(BLE_RECONN_HOLD_MS), pdFALSE, NULL, reconn_timer_timeout, &m_reconnTimerStatic);
+        if(m_reconnTimer == NULL) RTT_LOG_INFO("SUPER: Can't create reconnect timer");
+#endif // BLE_RECONN_HOLD_MS
+
+#if(BEACON_EN)
+        // проверка состояния для эдвертайзинга; на отсчетах АЦП пакет эдвертайзинга не пересобирается
+        m_beaconTimer = xTimerCreateStatic("BEACON", pdMS_TO_TICKS(BEACON_UPDATE_MS), pdTRUE, NULL, beacon_timer_timeout, &m_beaconTimerStatic);
+        if((m_beaconTimer == NULL) || (xTimerStart(m_beaconTimer, 0) != pdPASS)) RTT_LOG_INFO("SUPER: Can't start beacon timer");
+#endif // BEACON_EN
         
         // читаю и сбрасываю все флаги причины сброса
         uint32_t reg_reser_reason = NRF_POWER->RESETREAS;
         NRF_POWER->RESETREAS = 0xFFFFFFFF; // после включения Softdevice этой командой флаги уже не сбросить - буде ошибка SOFTDEVICE: INVALID MEMORY ACCESS
         
         // инициализирую буфер сообщений
-        m_superMsgHandle = xQueueCreate(SUPERTASK_MSG_BUFF_LEN, sizeof(superMsg_t));
+        m_superMsgHandle = xQueueCreateStatic(SUPERTASK_MSG_BUFF_LEN, sizeof(superMsg_t), m_superMsgStorage, &m_superMsgStatic);
         if(m_superMsgHandle == NULL)
         {
           RTT_LOG_INFO("SUPER: Memory not enough for supertask queue");
@@ -578,10 +1552,16 @@ static void super_task_thread(void *args)
         
    
         // НАСТРОЙКА ПЕРЕФИРИИ И ЗАПУСК ПРОЦЕССОВ
+        
+        // пул блоков для передачи данных между задачами
+        blk_pool_init();
+        
+        // табличный диспетчер двоичных команд
+        cmd_init(m_cmdTable, sizeof(m_cmdTable) / sizeof(m_cmdTable[0]), cmdTx, cmdEvtTx);
 
 #if BLE_EN
         // запускаю задачу обработки данных от BLE
-        if (pdPASS != xTaskCreate(ble_thread, "BLE", BLE_TASK_STACK, NULL, BLE_TASK_PRIORITY, NULL))
+        if (NULL == xTaskCreateStatic(ble_thread, "BLE", BLE_TASK_STACK, NULL, BLE_TASK_PRIORITY, m_bleTaskStack, &m_bleTaskTCB))
         {
           RTT_LOG_INFO("SUPER: Can't create ble_thread");
         }
@@ -600,10 +1580,15 @@ static void super_task_thread(void *args)
           state = STATE_NONE;
           break;
         }
+        
+        // калибровка каналов из флеша (FDS инициализирован Peer Manager до запуска планировщика)
+        err = cal_init();
+        if(err != ERR_NOERROR) RTT_LOG_INFO("SUPER: Init CAL error 0x%02X", err);
 #endif // ADS129X_EN
 
         // запускаю задачу тестирования скорости передачи
-        if (pdPASS != xTaskCreate(nusSpeedTest, "TEST", 256, NULL, 2, &m_testTask))
+        m_testTask = xTaskCreateStatic(nusSpeedTest, "TEST", TEST_TASK_STACK_SIZE, NULL, 2, m_testTaskStack, &m_testTaskTCB);
+        if (m_testTask == NULL)
         {
           RTT_LOG_INFO("SUPER: Can't create testTask");
         }
@@ -625,38 +1610,80 @@ static void super_task_thread(void *args)
         
         switch(msg.msgID)
         {
-// *********************************************************************************************
-          case SUPER_MSG_RX_DATA: // приняты данные
-            execCmdBle(m_conn_handle);
-          break;
 // *********************************************************************************************
           case SUPER_MSG_REBOOT: // требуется перезагрузка устройства
             // TODO выполнить все необходимые действия перед перезагрузкой
             RTT_LOG_INFO("SUPER_MSG_REBOOT");
+            // измерения останавливаю: АЦП уходят на уровень питания вне измерений и при теплом старте
+            // не требуют установления аналоговой части
+            if(m_adc_started) adc_stop();
             vTaskDelay(pdMS_TO_TICKS(1000));
             systemReset();
           break;
 // *********************************************************************************************
           case SUPER_MSG_BLE_CONNECTED:
             RTT_LOG_INFO("SUPER_MSG_BLE_CONNECTED");
+            if(m_reconnTimer) xTimerStop(m_reconnTimer, 0); // приемник вернулся, измерения продолжаются
+            // АЦП держу в STANDBY: запуск измерений по команде не ждет включения питания и установления опорного напряжения
+            ads_task_set_idle_power(ADS_TASK_PWR_STANDBY);
             //if(m_testTask) xTaskNotifyGive(m_testTask);
           break;
+// *********************************************************************************************
+          case SUPER_MSG_LOFF:
+            RTT_LOG_INFO("SUPER_MSG_LOFF");
+#if(BEACON_EN)
+            beacon_loff(msg.msg, msg.msgLen);
+#endif // BEACON_EN
+            if(link_cnt() != 0) cmd_event(CMD_EVT_LOFF, msg.msg, msg.msgLen);
+          break;
+// *********************************************************************************************
+          case SUPER_MSG_PACE:
+            if(link_cnt() != 0) cmd_event(CMD_EVT_PACE, msg.msg, msg.msgLen);
+          break;
+// *********************************************************************************************
+          case SUPER_MSG_RESP:
+          {
+            uint8_t half = msg.msg[0] & 1;
+#if(BEACON_EN)
+            m_beacon.resp = (uint8_t)MIN(UINT8_MAX, (m_resp_rate[half] + 5) / 10); // в эдвертайзинге - целые вдохи/мин
+#endif // BEACON_EN
+            if(link_cnt() != 0)
+            {
+              uint8_t evt[sizeof(uint16_t) + sizeof(m_resp[0])];
+              memcpy(evt, &m_resp_rate[half], sizeof(uint16_t));
+              memcpy(&evt[sizeof(uint16_t)], m_resp[half], sizeof(m_resp[0]));
+              cmd_event(CMD_EVT_RESP, evt, sizeof(evt));
+            }
+          }
+          break;
+// *********************************************************************************************
+#if(BEACON_EN)
+          case SUPER_MSG_BEACON:
+            beacon_publish();
+          break;
+#endif // BEACON_EN
 // *********************************************************************************************
           case SUPER_MSG_BLE_DISCONNECTED:
             RTT_LOG_INFO("SUPER_MSG_BLE_DISCONNECTED");
 
             // соединене по BLE разорвано
-            if(m_adc_started)
-            { // если АЦП запущено, то останавливаю его
-              uint16_t err = ads_task_stop();
-              if(err != ERR_NOERROR)
-              {
-                RTT_LOG_INFO("SUPER: ADS Stop error: 0x%04X", err);
-              }else{
-                // команда помещена в очередь без ошибок
-                m_adc_started = false;
-              }
+            if(link_cnt() != 0) break; // другие приемники продолжают получать данные
+            if(m_adc_started && m_reconnTimer && (xTimerReset(m_reconnTimer, 0) == pdPASS))
+            { // короткий разрыв связи не прерывает измерения: АЦП работает, пока приемник переподключается
+              RTT_LOG_INFO("SUPER: ADC hold %d ms", BLE_RECONN_HOLD_MS);
+              break;
             }
+            adc_idle_off();
+          break;
+// *********************************************************************************************
+          case SUPER_MSG_CMD_JOB:
+            RTT_LOG_INFO("SUPER_MSG_CMD_JOB %c", m_job.cmd);
+            cmd_job_exec();
+          break;
+// *********************************************************************************************
+          case SUPER_MSG_RECONN_TIMEOUT:
+            RTT_LOG_INFO("SUPER_MSG_RECONN_TIMEOUT");
+            if(link_cnt() == 0) adc_idle_off();
           break;
 // *********************************************************************************************
 // *********************************************************************************************
@@ -804,8 +1831,14 @@ int main(void)
     ret = nrf_drv_clock_init();
     APP_ERROR_CHECK(ret);
   
+#if ADS129X_EN
+    // питание аналоговой части подаю сразу: установление АЦП идет параллельно с запуском SoftDevice и BLE
+    ads_task_pwr_on();
+#endif // ADS129X_EN
+  
     // запуск суперзадачи
-    if (pdPASS != xTaskCreate(super_task_thread, "SUPERTASK", SUPERTASK_STACK_SIZE, NULL, SUPERTASK_PRIORITY, &m_superTask))
+    m_superTask = xTaskCreateStatic(super_task_thread, "SUPERTASK", SUPERTASK_STACK_SIZE, NULL, SUPERTASK_PRIORITY, m_superTaskStack, &m_superTaskTCB);
+    if (m_superTask == NULL)
     {
       RTT_LOG_INFO("MAIN: Can't create super_task_thread");
       APP_ERROR_CHECK(NRF_ERROR_NO_MEM); // генерю ошибку
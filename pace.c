@@ -0,0 +1,132 @@
+/*
+Обнаружение импульсов кардиостимулятора
+
+Компаратор COMP работает в режиме с одним входом: порог срабатывания - VDD * (PACE_TH_UP + 1) / 64,
+гистерезис задается нижним порогом PACE_TH_DOWN. Прерывание вызывается только по фронту (EVENTS_UP),
+фронты в течение PACE_BLANK_MS после импульса отбрасываются (звон и возврат сигнала к изолинии).
+
+*/
+
+#include "pace.h"
+#include "ads_stream.h"
+#include "custom_board.h"
+#include "errors.h"
+#include "sys.h"
+#include "nrf_nvic.h"
+
+// FreeRTOS
+#include "FreeRTOS.h"
+#include "task.h"
+
+
+#if(PACE_TH_DOWN > PACE_TH_UP) || (PACE_TH_UP > 63)
+#error "PACE_TH_DOWN must not exceed PACE_TH_UP (0..63)"
+#endif
+
+
+static pace_evt_t         m_ring[PACE_QUEUE_SIZE]; // кольцо событий
+static volatile uint8_t   m_head = 0;             // запись (прерывание)
+static volatile uint8_t   m_tail = 0;             // чтение (поток)
+static volatile uint32_t  m_lost_cnt = 0;         // потеряно событий
+static TickType_t         m_last_tick = 0;        // время последнего импульса в тиках
+static bool               m_last_valid = false;   // m_last_tick задано
+static bool               m_started = false;      // компаратор запущен
+
+
+
+#if defined(ADS129X_PACE_AIN)
+static void comp_isr(void)
+{ // фронт импульса (приоритет прерывания не выше ADS129X_TIMER_PRIORITY, см. ads_stream_get_pos)
+  TickType_t now = xTaskGetTickCountFromISR();
+  if(m_last_valid && ((now - m_last_tick) < pdMS_TO_TICKS(PACE_BLANK_MS))) return; // повторное срабатывание того же импульса
+  m_last_tick = now;
+  m_last_valid = true;
+
+  uint8_t next = (m_head + 1) % PACE_QUEUE_SIZE;
+  if(next == m_tail)
+  { // поток не забирает события
+    m_lost_cnt++;
+    return;
+  }
+  m_ring[m_head].sample = ads_stream_get_pos();
+  m_ring[m_head].time_ms = (uint32_t)(((uint64_t)now * 1000) / configTICK_RATE_HZ);
+  m_head = next;
+}
+#endif // ADS129X_PACE_AIN
+
+
+// %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
+
+/*
+* Запуск компаратора
+*/
+uint16_t pace_start(void)
+{
+#if defined(ADS129X_PACE_AIN)
+  if(m_started) return ERR_INVALID_STATE;
+
+  m_head = m_tail = 0;
+  m_last_valid = false;
+
+  NRF_COMP->PSEL = ADS129X_PACE_AIN << COMP_PSEL_PSEL_Pos;
+  NRF_COMP->REFSEL = COMP_REFSEL_REFSEL_VDD << COMP_REFSEL_REFSEL_Pos;
+  NRF_COMP->MODE = (COMP_MODE_SP_Normal << COMP_MODE_SP_Pos) | (COMP_MODE_MAIN_SE << COMP_MODE_MAIN_Pos);
+  NRF_COMP->TH = (PACE_TH_UP << COMP_TH_THUP_Pos) | (PACE_TH_DOWN << COMP_TH_THDOWN_Pos);
+  NRF_COMP->SHORTS = 0;
+  NRF_COMP->INTENCLR = 0xFFFFFFFF;
+  NRF_COMP->EVENTS_UP = 0;
+  NRF_COMP->INTENSET = COMP_INTENSET_UP_Msk;
+
+  sysSetCompHook(comp_isr);
+  sd_nvic_SetPriority(COMP_LPCOMP_IRQn, PACE_COMP_PRIORITY);
+  sd_nvic_ClearPendingIRQ(COMP_LPCOMP_IRQn);
+  sd_nvic_EnableIRQ(COMP_LPCOMP_IRQn);
+
+  NRF_COMP->ENABLE = COMP_ENABLE_ENABLE_Enabled << COMP_ENABLE_ENABLE_Pos;
+  NRF_COMP->TASKS_START = 1;
+  m_started = true;
+  return ERR_NOERROR;
+#else
+  return ERR_DISABLED;
+#endif // ADS129X_PACE_AIN
+}
+
+
+/*
+* Останов компаратора
+*/
+void pace_stop(void)
+{
+#if defined(ADS129X_PACE_AIN)
+  if(!m_started) return;
+
+  NRF_COMP->TASKS_STOP = 1;
+  NRF_COMP->INTENCLR = 0xFFFFFFFF;
+  sd_nvic_DisableIRQ(COMP_LPCOMP_IRQn);
+  NRF_COMP->ENABLE = COMP_ENABLE_ENABLE_Disabled << COMP_ENABLE_ENABLE_Pos;
+  sysSetCompHook(NULL);
+  m_head = m_tail = 0;
+  m_started = false;
+#endif // ADS129X_PACE_AIN
+}
+
+
+/*
+* Выборка события из кольца
+*/
+bool pace_get(pace_evt_t *evt)
+{
+  if(m_tail == m_head) return false;
+  *evt = m_ring[m_tail];
+  m_tail = (m_tail + 1) % PACE_QUEUE_SIZE;
+  return true;
+}
+
+
+/*
+* Количество потерянных событий
+*/
+uint32_t pace_get_lost_cnt(void)
+{
+  return m_lost_cnt;
+}
@@ -0,0 +1,83 @@
+#ifndef PACE_H
+#define PACE_H
+
+/**
+ * Обнаружение импульсов кардиостимулятора
+ *
+ * Импульс стимулятора короче периода выборки (0.1..2 мс при 2 мс на 500 SPS) и в потоке отсчетов теряется.
+ * Выход буфера PACE ведущего АЦП (ADS1298, регистр PACE) заведен на вход компаратора COMP, фронт импульса
+ * через порог вызывает прерывание, в котором фиксируются номер текущего отсчета потока (ads_stream_get_pos)
+ * и время устройства. События складываются в кольцо и забираются потоком через pace_get().
+ *
+ * Вход компаратора и приоритет прерывания задаются в файле платы (ADS129X_PACE_AIN, PACE_COMP_PRIORITY).
+*/
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "settings.h"
+
+
+// НАСТРОЙКИ МОДУЛЯ ************************************
+#ifndef PACE_EN
+#define PACE_EN             0       // если =1, обнаружение импульсов стимулятора включено
+#endif // PACE_EN
+#ifndef PACE_TH_UP
+#define PACE_TH_UP          40      // верхний порог компаратора в 1/64 VDD (срабатывание)
+#endif // PACE_TH_UP
+#ifndef PACE_TH_DOWN
+#define PACE_TH_DOWN        36      // нижний порог компаратора в 1/64 VDD (гистерезис, не больше PACE_TH_UP)
+#endif // PACE_TH_DOWN
+#ifndef PACE_BLANK_MS
+#define PACE_BLANK_MS       10      // время нечувствительности после импульса (подавление повторных срабатываний на спаде)
+#endif // PACE_BLANK_MS
+#ifndef PACE_QUEUE_SIZE
+#define PACE_QUEUE_SIZE     8       // длина кольца событий
+#endif // PACE_QUEUE_SIZE
+// *****************************************************
+
+
+/// событие импульса стимулятора
+typedef struct {
+  uint32_t  sample;     ///< номер отсчета потока АЦП от запуска измерений (ADS_STREAM_POS_NONE - неизвестен)
+  uint32_t  time_ms;    ///< время устройства, мс
+} pace_evt_t;
+
+
+
+/**
+ * @brief Запуск компаратора (вызывается после запуска измерений)
+ *
+ * @return
+ *  ERR_NOERROR - если ошибок нет
+ *  ERR_DISABLED - вход компаратора на плате не описан
+ *  ERR_INVALID_STATE - компаратор уже запущен
+*/
+uint16_t pace_start(void);
+
+
+/**
+ * @brief Останов компаратора, необработанные события отбрасываются
+*/
+void pace_stop(void);
+
+
+/**
+ * @brief Выборка события из кольца
+ *
+ * @param evt - событие
+ *
+ * @return
+ *  true, если событие получено
+*/
+bool pace_get(pace_evt_t *evt);
+
+
+/**
+ * @brief Количество событий, потерянных из-за переполнения кольца
+*/
+uint32_t pace_get_lost_cnt(void);
+
+
+#endif
@@ -46,10 +46,12 @@
 #define SUPERTASK_PRIORITY					2					// приоритет суперзадачи (TODO возможно, что стоит увеличить приоритет всех остальных задач на 1)
 #define SUPERTASK_MSG_BUFF_LEN			10 			  // размер очереди сообщений для суперзадачи
 #define SUPERTASK_MSG_MAX						512				// максимальный размер одного сообщения (если сообщение будет длинее, то оно будет потеряно)
+#define TEST_TASK_STACK_SIZE				256				// стек задачи тестирования скорости передачи
 
 // ******** LOGGER RTT ******** 
 #define LOGGER_PRIORITY 						1					// приоритет задачи
 #define LOGGER_STACK_SIZE 					512				// The size of the stack for the Logger task (in 32-bit words)
+#define LOGGER_FLUSH_PERIOD_MS			200				// минимальный период вывода лога: лог выводится в пробуждениях по другим причинам, а не при каждом входе в idle
 
 // ******** SPIM **************
 #define SPIM_TASK_TIMEOUT_MS      1000  // максимальное время выполнения одной задачи по SPI (при передаче больших объемов на маленькой скорости надо будет увеличивать)
@@ -59,14 +61,42 @@
 #define ADSTASK_PRIORITY					3					// приоритет 
 #define ADSTASK_DATA_QUEUE_SIZE             3           // длина очереди принятых данных в блоках данных
 #define ADSTASK_CMD_QUEUE_SIZE             5           // длина очереди управляющих команд
+#define ADS129X_DEV_MAX                    2           // максимальное количество АЦП на шинах SPI (описания устройств размещаются статически, не меньше ADS129X_CNT)
+#define ADSTASK_SCRUB_PERIOD_MS            1000        // период сверки регистров АЦП с теневой копией (0 - сверка выключена)
+#define ADSTASK_PWRUP_TIMEOUT_MS           1000        // максимальное время ожидания ответа АЦП (регистр ID) после подачи аналогового питания
+#define ADSTASK_ANA_SETTLE_MS              200         // установление аналоговой части АЦП после подачи питания до запуска измерений
+#define ADSTASK_LOFF_EN                    1           // если =1, включено обнаружение обрыва электродов (компараторы LOFF)
+#define ADSTASK_LOFF_AC                    0           // если =1, обрыв определяется на переменном токе (fDR / 4), иначе на постоянном
+#define ADSTASK_LOFF_DEBOUNCE              50          // антидребезг состояния электродов в отсчетах (100 мс при 500 SPS)
+#define ADSTASK_PACE_EN                    0           // если =1, у ведущего АЦП включен буфер PACE (выход на компаратор, см. PACE)
+#define ADSTASK_RESP_EN                    1           // если =1 и ведущий АЦП - ADS1298R, канал 1 измеряет дыхание (25 SPS событиями, канал в потоке ЭКГ не меняется)
+#define ADSTASK_HW_TRIG_EN                 1           // если =1, при непрерывных измерениях кадры читаются аппаратно по DRDY (ads_stream)
+#define ADS_STREAM_BATCH                   25          // максимальная пачка аппаратного чтения в отсчетах (500 SPS при интервале соединения 50 мс)
+
+// ******** PACE **************
+// включать вместе с ADSTASK_PACE_EN только после проверки по схеме, что TESTP_PACE_OUT1 заведен на ADS129X_PACE_AIN (board_v1-0.h):
+// без этого компаратор ловит помехи и шлет ложные события 'P'
+#define PACE_EN                            0           // если =1, импульсы кардиостимулятора обнаруживаются компаратором и передаются событиями
+#define PACE_BLANK_MS                      10          // время нечувствительности после импульса
+
+// ******** CAL ***************
+#define CAL_SAMPLES                        256         // количество усредняемых отсчетов на шаге автоматической калибровки и самопроверки
+#define CAL_ST_NOISE_MAX_NV                5000        // самопроверка: допустимый шум при закороченных входах (СКЗ), нВ
+#define CAL_ST_GAIN_ERR_MAX                300         // самопроверка: допустимая ошибка усиления, 0.01%
+#define CAL_ST_LIN_ERR_MAX                 100         // самопроверка: допустимая нелинейность, 0.01%
+
+// ******** BLK POOL **********
+#define BLK_POOL_BLOCK_SIZE				244				// размер данных одного блока (одна нотификация BLE: NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3)
+#define BLK_POOL_BLOCK_CNT				32				// количество блоков в пуле (подбирается по статистике hwm)
 
 // ******** WDT ***************
 #define WDT_TIME_CYCLE_MS						30000			// время срабатывания WDT-таймера
 
 // ******** BLE NUS ******** 
-#define NUS_RX_SIZE_MAX				      64			  // размер приемного фифо для телефона
+#define NUS_RX_SIZE_MAX				      256			  // размер приемного фифо для телефона (не меньше длины двоичного кадра команд с несколькими командами)
 #define NUS_TX_SIZE_MAX				      2048			// размер передающего потокового буфера для телефона
 #define UNIT_NUS_EVT_QUEUE_SIZE			10				// размер очереди сообщений на верхний уровень
+#define BLE_TX_BLK_QUEUE_SIZE				16				// длина очереди блоков из пула на передачу для каждого соединения
 
 #define NUSTX_PRIORITY							2
 #define NUSTX_STACK_SIZE						512				// стек для процесса передачи данных по BLE (нижний уровень драйвера)
@@ -81,10 +111,42 @@
 #define TIME_CONN_INTERVAL_MAX_MS   30        // максимальный интервал после соединения
 #define BLE_ADV_START_DELAY_MS      1000      // таймаут между попытками запуска эдвертайзинга
 #define BLE_ADV_ERROR_MAX           10        // максимальное количество ошибок при запуске эдвертайзинга
+#define BLE_ADV_FAST_INTERVAL_MS    20        // периодичность эдвертайзинга по белому списку после разрыва связи
+#define BLE_ADV_FAST_DURATION_MS    3000      // длительность эдвертайзинга по белому списку, дальше - обычный
+#define BLE_RECONN_HOLD_MS          5000      // сколько АЦП продолжает измерения после отключения последнего приемника (0 - останов сразу)
 #define BLE_SEND_TIMEOUT_MS         1000      // максимальное вермя ожидания свободного места в очереди передающего буфера
 
+// ******** FLOW CONTROL ********
+// кредитное управление потоком данных АЦП: телефон командой C,n разрешает передать n блоков
+// пока телефон ни разу не выдал кредиты, управление потоком выключено (совместимость со старыми приложениями)
+#define FLOW_CREDIT_MAX             64        // максимальное количество накопленных кредитов (лишние отбрасываются)
+#define FLOW_CREDIT_LOW             4         // при остатке кредитов меньше этого значения включается прореживание
+#define FLOW_DECIM_FACTOR           2         // коэффициент прореживания при недостатке кредитов (ECGS - отсчеты в кадре, NUS - блоки)
+
+// ******** BEACON ********
+// краткое состояние устройства в данных производителя эдвертайзинга: шлюз следит за несколькими устройствами без подключения
+#define BEACON_EN                   1         // публиковать состояние в эдвертайзинге
+#define BEACON_UPDATE_MS            2000      // период проверки состояния; данные эдвертайзинга пересобираются не чаще и только при изменениях
+// расширенный эдвертайзинг (Bluetooth 5): в маяк добавляется история состояния, шлюз палаты слушает устройства без подключений;
+// центральные устройства без Bluetooth 5 (старые телефоны) такой эдвертайзинг не видят
+#define BLE_ADV_EXT_EN              0         // включить расширенный эдвертайзинг
+#define BLE_ADV_EXT_PRIMARY_PHY     BLE_GAP_PHY_1MBPS // PHY первичных каналов (BLE_GAP_PHY_CODED - большая дальность)
+#define BLE_ADV_EXT_SECONDARY_PHY   BLE_GAP_PHY_2MBPS // PHY вторичного канала с данными
+#define BEACON_HIST_LEN             55        // длина истории состояния, записей (одна запись за BEACON_UPDATE_MS во время измерений;
+                                              // эдвертайзинг с подключением, весь маяк - не больше BLE_ADV_EXT_CONN_MANUF_DATA_MAX)
+
 // ******** CMD ************
 #define CMD_LEN_MAX									NUS_RX_SIZE_MAX 			// максимальная длина любых данных, которые могут быть переданы одной командой (вместе со всеми служебными полями)
 
+// ******** БЮДЖЕТ ОЗУ ********
+// все задачи, очереди, мьютексы и потоковые буферы приложения размещаются статически (configSUPPORT_STATIC_ALLOCATION = 1),
+// куча FreeRTOS (configTOTAL_HEAP_SIZE) остается только для задачи SoftDevice и таймеров SDK
+// фактическое распределение смотреть в карте линкера arm5_no_packs\_build\ecg_afe.map: раздел "Image component sizes",
+// столбец ZI Data по модулям (main.o, ads_task.o, bleTask.o, bleDriver.o, logger_freertos.o, sys.o)
+#define RAM_BUDGET_STACKS					((SUPERTASK_STACK_SIZE + ADSTASK_STACK_SIZE + LOGGER_STACK_SIZE + NUSTX_STACK_SIZE + \
+                                      BLE_TASK_STACK + TEST_TASK_STACK_SIZE) * 4) // стеки задач приложения в байтах
+// буферы (очереди, потоковые буферы NUS всех соединений, пул блоков) считаются по sizeof реальных массивов в модулях:
+// main_ram_size, bleTaskRamSize, bleDriverRamSize, ads_task_ram_size, blk_pool_ram_size (сумму выводит debug_monitor.c)
+
 
 #endif
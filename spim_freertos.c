@@ -2,12 +2,20 @@
 Модуль мастера SPIM с easyDMA
 
 ОГРАНИЧЕНИЯ
-- модуль работает только с портом SPIM3 (настраивается по дейфайнам из board_v1-0)
+- поддерживаются порты SPIM1, SPIM2 и SPIM3; выводы берутся из файла платы (SPIMn_SCK_PIN, SPIMn_MISO_PIN, SPIMn_MOSI_PIN,
+  SPIMn_PINS_INIT()), порт без описания выводов на плате не поддерживается
 - SPIM работает в режиме SPI_MODE_1, SPI_BIT_ORDER_MSB_FIRST
 
 ОСОБЕННОСТИ
 - пока идет передача данных, прием данных не осуществляется (все, что будет принято, дропается)
 - если код ошибки от модуля, то к нем добавляется ERR_SPIM_MODULE, если от Softdevice, то ничего не добавляется
+- все задания интерфейса проходят через кольцевую очередь: следующее задание запускается из прерывания SPIM
+  сразу после окончания предыдущего; блокирующие функции (spiTaskExecute, spiTaskStart/spiTaskWait) ставят задание
+  в ту же очередь и ждут его окончания, поэтому их можно смешивать с асинхронными заданиями (spiTaskSubmit)
+- spiTaskStart()/spiTaskWait() позволяют запустить обмен сразу на нескольких шинах и дождаться окончания всех обменов,
+  пока DMA разных портов работает параллельно
+- spiHwAcquire()/spiHwRelease() отдают порт внешнему модулю для обмена, запускаемого по PPI без участия процессора;
+  задания, поставленные в очередь в это время, ждут освобождения порта
 
 */
 
@@ -22,6 +30,7 @@
 
 // FreeRTOS
 #include "FreeRTOS.h"
+#include "task.h"
 #include "semphr.h"
 
 
@@ -130,12 +139,22 @@ typedef struct
   NRF_SPIM_Type         *spim; // указатель на интерфейс
   mode_t                mode;  // режим работы
   spi_queue_t           *q;    // укатель на текущее задание
+  spi_queue_t           *pendTask; // задание, запущенное spiTaskStart()
   IRQn_Type             IRQn;  // номер вектора прерывания
+  uint8_t               spimNo; // номер порта SPIM (для обработчика прерывания в sys.c)
   uint32_t              irqPrior; // приоритет прерывания от SPIM
   uint8_t               isInited:1; // флаг, что интерфейс проинициализирован
+  uint8_t               isPending:1; // флаг, что задание запущено через spiTaskStart() и ожидает spiTaskWait()
   uint8_t               fake_buff[1]; // фейковый буфер для работы SPIM (используется, когда нет необходимости передавать или принимать данные)
+  spi_queue_t           *ring[SPIM_JOB_QUEUE_SIZE]; // кольцевая очередь заданий
+  uint8_t               ringRd; // индекс первого задания в очереди
+  uint8_t               ringCnt; // количество заданий в очереди
+  volatile uint8_t      isBusy; // флаг, что идет обмен по заданию q (меняется и в прерывании, поэтому не битовое поле)
+  volatile uint8_t      isHwOwned; // флаг, что порт захвачен spiHwAcquire() (очередь заданий не запускается)
   SemaphoreHandle_t     mutex;  // мьютекс занятости устройства
   SemaphoreHandle_t     irqSema; // бинарный семафор выхода из прерывания
+  StaticSemaphore_t     mutexStatic; // память под мьютекс (выделяется статически)
+  StaticSemaphore_t     irqSemaStatic; // память под семафор
 } spim_instance_t;
 
 
@@ -144,7 +163,74 @@ static spim_instance_t spim_instance[SPIM_INSTANCE_CNT]; // хранение о
 
 
 static void irqHandler(void *instance); // обработчик прерываний
-static bool spiStartWriteRead(void *instance, uint32_t wait_ticks); // запуск операции записи/чтения
+static void spiStartWriteRead(void *instance); // запуск операции записи/чтения
+
+
+static void ringNext(spim_instance_t *dev)
+{ // запуск следующего задания из очереди, если интерфейс свободен (из потока или прерывания)
+  UBaseType_t key = portSET_INTERRUPT_MASK_FROM_ISR();
+  if(!dev->isBusy && !dev->isHwOwned && dev->ringCnt)
+  {
+    dev->q = dev->ring[dev->ringRd];
+    dev->ringRd = (dev->ringRd + 1) % SPIM_JOB_QUEUE_SIZE;
+    dev->ringCnt--;
+    dev->isBusy = 1;
+    spiStartWriteRead(dev);
+  }
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(key);
+}
+
+static uint16_t ringPut(spim_instance_t *dev, spi_queue_t *task)
+{ // постановка задания в очередь и запуск, если интерфейс свободен
+  uint16_t err = ERR_NOERROR;
+  UBaseType_t key = portSET_INTERRUPT_MASK_FROM_ISR();
+  if(dev->ringCnt >= SPIM_JOB_QUEUE_SIZE)
+  {
+    err = ERR_FIFO_OVF;
+  }else{
+    dev->ring[(dev->ringRd + dev->ringCnt) % SPIM_JOB_QUEUE_SIZE] = task;
+    dev->ringCnt++;
+  }
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(key);
+  if(err == ERR_NOERROR) ringNext(dev);
+  return err;
+}
+
+static void ringCancel(spim_instance_t *dev, spi_queue_t *task)
+{ // удаление еще не запущенного задания из очереди (после таймаута ожидания)
+  UBaseType_t key = portSET_INTERRUPT_MASK_FROM_ISR();
+  uint8_t cnt = 0;
+  for(uint8_t i = 0; i < dev->ringCnt; i++)
+  { // очередь уплотняется с сохранением порядка остальных заданий
+    spi_queue_t *t = dev->ring[(dev->ringRd + i) % SPIM_JOB_QUEUE_SIZE];
+    if(t == task) continue;
+    dev->ring[(dev->ringRd + cnt) % SPIM_JOB_QUEUE_SIZE] = t;
+    cnt++;
+  }
+  dev->ringCnt = cnt;
+  portCLEAR_INTERRUPT_MASK_FROM_ISR(key);
+}
+
+static void syncDone(void *ctx)
+{ // окончание задания, которое ждет поток (spiTaskExecute, spiTaskStart)
+  spim_instance_t *dev = (spim_instance_t *)ctx;
+  UNUSED_RETURN_VALUE(xSemaphoreGiveFromISR(dev->irqSema, NULL));
+}
+
+static uint16_t syncStart(spim_instance_t *dev, spi_queue_t *task)
+{ // постановка в очередь задания, окончание которого ждет поток (вызывается под мьютексом)
+  task->done = syncDone;
+  task->ctx = dev;
+  xSemaphoreTake(dev->irqSema, 0); // сбрасываю семафор (на всякий случай)
+  return ringPut(dev, task);
+}
+
+static uint16_t syncWait(spim_instance_t *dev, spi_queue_t *task)
+{ // ожидание окончания задания, поставленного syncStart()
+  if(pdTRUE == xSemaphoreTake(dev->irqSema, SPIM_TASK_TIMEOUT_MS)) return ERR_NOERROR;
+  ringCancel(dev, task); // задание не должно запуститься после возврата (буферы могут быть на стеке)
+  return ERR_TIMEOUT;
+}
 
 
 
@@ -166,11 +252,13 @@ static void SPIM_TransactionStop(void *instance)
         NRF_P1->OUTSET = (1 << (dev->q->csPin - 32));
       else NRF_P0->OUTSET = (1 << dev->q->csPin);
     }
-    // устанавливаю семафор выхода из прерывания
-//    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-//    UNUSED_RETURN_VALUE(xSemaphoreGiveFromISR(dev->irqSema, &xHigherPriorityTaskWoken));
-    UNUSED_RETURN_VALUE(xSemaphoreGiveFromISR(dev->irqSema, NULL));
-//    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+    // сообщаю об окончании задания и запускаю следующее задание из очереди
+    spi_queue_t *task = dev->q;
+    UBaseType_t key = portSET_INTERRUPT_MASK_FROM_ISR();
+    dev->isBusy = 0;
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(key);
+    if(task->done) task->done(task->ctx);
+    ringNext(dev);
 }
 
 static void irqHandler(void *instance)
@@ -232,8 +320,8 @@ static void irqHandler(void *instance)
   }
 }
 
-static bool spiStartWriteRead(void *instance, uint32_t wait_ticks)
-{ // запуск операции записи/чтения через DMA
+static void spiStartWriteRead(void *instance)
+{ // запуск операции записи/чтения через DMA (окончание - по семафору irqSema)
   // все необходимые данные по транзакции лежат в структуре spim_instance_t
   
   spim_instance_t *dev = (spim_instance_t *)instance;
@@ -278,12 +366,8 @@ static bool spiStartWriteRead(void *instance, uint32_t wait_ticks)
     dev->spim->RXD.MAXCNT = dev->q->rxDataLen;
   }
   
-  xSemaphoreTake(dev->irqSema, 0); // сбрасываю семафор (на всякий случай)
-  
   dev->spim->INTENSET = SPIM_INTENSET_END_Msk; // разрешаю прерывание
   dev->spim->TASKS_START = 1; // стартую транзакцию
-  
-  return xSemaphoreTake(dev->irqSema, wait_ticks); // жду окончания выполнения команды
 }
 
 
@@ -314,51 +398,66 @@ uint16_t spiInit(uint8_t *devID, NRF_SPIM_Type *spim, IRQn_Type irqn, uint8_t ir
   ERROR_CHECK(err_code);
   
   // настройки в соответсвии с интерфейсами
-if(spim == NRF_SPIM3){
-    
-    sysSetSpim3Hook(irqHandler, dev); // обработчик SPIM3
-    
+  if(spim == NRF_SPIM3){
+    dev->spimNo = 3;
+    sysSetSpimHook(3, irqHandler, dev); // обработчик SPIM3
     // "подключаем" пины
     spim->PSEL.SCK = SPIM3_SCK_PIN;
     spim->PSEL.MISO = SPIM3_MISO_PIN;
     spim->PSEL.MOSI = SPIM3_MOSI_PIN;
-    // пины CS подключается при необходимости
-    
-    // задаем скорость обмена по шине
-    spim->FREQUENCY = freq;
-    
-    // режим работы и очередность сдвига бит
-    spi_configure(spim, SPI_MODE_1, SPI_BIT_ORDER_MSB_FIRST);
-    
-    // использую списки
-    spim->RXD.LIST = 1;
-    spim->TXD.LIST = 1;
-    
-    // шоткаты не использую
-    spim->SHORTS = 0;
-    
-    spim->ORC = 0x00; // этот байт будет передаваться, когда принять нужно больше, чем передать
-    
-    spim->INTENCLR = 0xFFFFFFFF; // запрещаем все прерывания
-    
-    // настраиваю пины
     SPIM3_PINS_INIT();
+#if defined(SPIM2_SCK_PIN)
+  }else if(spim == NRF_SPIM2){
+    dev->spimNo = 2;
+    sysSetSpimHook(2, irqHandler, dev); // обработчик SPIM2
+    spim->PSEL.SCK = SPIM2_SCK_PIN;
+    spim->PSEL.MISO = SPIM2_MISO_PIN;
+    spim->PSEL.MOSI = SPIM2_MOSI_PIN;
+    SPIM2_PINS_INIT();
+#endif // SPIM2_SCK_PIN
+#if defined(SPIM1_SCK_PIN)
+  }else if(spim == NRF_SPIM1){
+    dev->spimNo = 1;
+    sysSetSpimHook(1, irqHandler, dev); // обработчик SPIM1
+    spim->PSEL.SCK = SPIM1_SCK_PIN;
+    spim->PSEL.MISO = SPIM1_MISO_PIN;
+    spim->PSEL.MOSI = SPIM1_MOSI_PIN;
+    SPIM1_PINS_INIT();
+#endif // SPIM1_SCK_PIN
   }else{
     return ERR_DATA;
   }
+  // пины CS подключается при необходимости
+  
+  // задаем скорость обмена по шине (SPIM1 и SPIM2 - не выше 8M)
+  spim->FREQUENCY = freq;
+  
+  // режим работы и очередность сдвига бит
+  spi_configure(spim, SPI_MODE_1, SPI_BIT_ORDER_MSB_FIRST);
+  
+  // использую списки
+  spim->RXD.LIST = 1;
+  spim->TXD.LIST = 1;
+  
+  // шоткаты не использую
+  spim->SHORTS = 0;
+  
+  spim->ORC = 0x00; // этот байт будет передаваться, когда принять нужно больше, чем передать
+  
+  spim->INTENCLR = 0xFFFFFFFF; // запрещаем все прерывания
   
   dev->spim = spim;
   dev->IRQn = irqn;
   dev->irqPrior = irqPrior;
   
   // создаю мьютекс окончания выполнения текущей задачи
-  dev->mutex = xSemaphoreCreateMutex();
+  dev->mutex = xSemaphoreCreateMutexStatic(&dev->mutexStatic);
   if(dev->mutex == NULL) err_code = ERR_OUT_OF_MEMORY;
   ERROR_CHECK(err_code);
   xSemaphoreGive(dev->mutex); // никаких задач не выполняется
   
   // создаю семафор выхода из прерывания
-  dev->irqSema = xSemaphoreCreateBinary();
+  dev->irqSema = xSemaphoreCreateBinaryStatic(&dev->irqSemaStatic);
   if(dev->irqSema == NULL) err_code = ERR_OUT_OF_MEMORY;
   ERROR_CHECK(err_code);
   
@@ -384,6 +483,7 @@ uint16_t spiDeInit(uint8_t devID)
   
   dev->isInited = false;
   sd_nvic_DisableIRQ(dev->IRQn);
+  sysSetSpimHook(dev->spimNo, NULL, NULL);
   // "отключаем" пины
   dev->spim->PSEL.SCK = 0;
   dev->spim->PSEL.MISO = 0;
@@ -402,17 +502,106 @@ uint16_t spiTaskExecute(uint8_t devID, spi_queue_t *task, uint32_t wait_ticks)
   if(pdFALSE == xSemaphoreTake(dev->mutex, wait_ticks))
     return ERR_TIMEOUT; // выход по таймауту ожидания мьтекса
   
-  uint16_t err = ERR_NOERROR;
+  // ставлю задачу в очередь и жду ее окончания
+  uint16_t err = syncStart(dev, task);
+  if(err == ERR_NOERROR) err = syncWait(dev, task);
   
-  dev->q = task; // текущая задача
+  xSemaphoreGive(dev->mutex);
+  return err;
+}
+
+uint16_t spiTaskStart(uint8_t devID, spi_queue_t *task, uint32_t wait_ticks)
+{ // запуск задачи без ожидания окончания
+  if((devID >= SPIM_INSTANCE_CNT)||(!spim_instance[devID].isInited)) return (ERR_NOT_INITED);
+  spim_instance_t *dev = (spim_instance_t *)&spim_instance[devID];
+  
+  if(pdFALSE == xSemaphoreTake(dev->mutex, wait_ticks))
+    return ERR_TIMEOUT; // выход по таймауту ожидания мьтекса
+  
+  // интерфейс остается занятым до вызова spiTaskWait()
+  uint16_t err = syncStart(dev, task);
+  if(err != ERR_NOERROR)
+  {
+    xSemaphoreGive(dev->mutex);
+    return err;
+  }
+  dev->pendTask = task;
+  dev->isPending = 1;
+  return ERR_NOERROR;
+}
+
+uint16_t spiTaskWait(uint8_t devID)
+{ // ожидание окончания задачи, запущенной spiTaskStart()
+  if((devID >= SPIM_INSTANCE_CNT)||(!spim_instance[devID].isInited)) return (ERR_NOT_INITED);
+  spim_instance_t *dev = (spim_instance_t *)&spim_instance[devID];
+  if(!dev->isPending) return ERR_INVALID_STATE;
   
-  // стартую выполнение задачи
-  if(pdFALSE == spiStartWriteRead(dev, SPIM_TASK_TIMEOUT_MS)) err = ERR_TIMEOUT;
+  uint16_t err = syncWait(dev, dev->pendTask);
   
+  dev->isPending = 0;
   xSemaphoreGive(dev->mutex);
   return err;
 }
 
+uint16_t spiTaskSubmit(uint8_t devID, spi_queue_t *task)
+{ // постановка задачи в очередь без ожидания (из потока или прерывания)
+  if((devID >= SPIM_INSTANCE_CNT)||(!spim_instance[devID].isInited)) return (ERR_NOT_INITED);
+  if(task == NULL) return ERR_INVALID_PARAMETR;
+  
+  return ringPut(&spim_instance[devID], task);
+}
+
+uint16_t spiHwAcquire(uint8_t devID, NRF_SPIM_Type **spim, uint32_t wait_ticks)
+{ // захват порта для обмена, запускаемого по PPI
+  if((devID >= SPIM_INSTANCE_CNT)||(!spim_instance[devID].isInited)) return (ERR_NOT_INITED);
+  if(spim == NULL) return ERR_INVALID_PARAMETR;
+  spim_instance_t *dev = (spim_instance_t *)&spim_instance[devID];
+  
+  TickType_t start = xTaskGetTickCount();
+  if(pdFALSE == xSemaphoreTake(dev->mutex, wait_ticks))
+    return ERR_TIMEOUT; // выход по таймауту ожидания мьтекса
+  
+  // жду окончания асинхронных заданий (блокирующие задания уже закончены - мьютекс у меня)
+  for(;;)
+  {
+    UBaseType_t key = portSET_INTERRUPT_MASK_FROM_ISR();
+    bool idle = !dev->isBusy && (dev->ringCnt == 0);
+    if(idle) dev->isHwOwned = 1;
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(key);
+    if(idle) break;
+    if((xTaskGetTickCount() - start) >= wait_ticks)
+    {
+      xSemaphoreGive(dev->mutex);
+      return ERR_TIMEOUT;
+    }
+    vTaskDelay(1);
+  }
+  
+  dev->spim->INTENCLR = 0xFFFFFFFF; // прерывания SPIM не нужны: окончание обмена отслеживает владелец порта
+  *spim = dev->spim;
+  return ERR_NOERROR;
+}
+
+uint16_t spiHwRelease(uint8_t devID)
+{ // освобождение порта, захваченного spiHwAcquire()
+  if((devID >= SPIM_INSTANCE_CNT)||(!spim_instance[devID].isInited)) return (ERR_NOT_INITED);
+  spim_instance_t *dev = (spim_instance_t *)&spim_instance[devID];
+  if(!dev->isHwOwned) return ERR_INVALID_STATE;
+  
+  // возвращаю настройки порта, которые мог поменять владелец
+  dev->spim->INTENCLR = 0xFFFFFFFF;
+  dev->spim->SHORTS = 0;
+  dev->spim->RXD.LIST = 1;
+  dev->spim->TXD.LIST = 1;
+  dev->spim->EVENTS_END = 0;
+  dev->spim->EVENTS_STOPPED = 0;
+  
+  dev->isHwOwned = 0;
+  xSemaphoreGive(dev->mutex);
+  ringNext(dev); // запускаю задания, накопившиеся за время захвата
+  return ERR_NOERROR;
+}
+
 
 
 
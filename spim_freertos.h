@@ -6,7 +6,10 @@
 */
 
 // НАСТРОЙКИ МОДУЛЯ ************************************
-#define SPIM_INSTANCE_CNT   2     // максимальное количество интерфейсов SPIM 
+#define SPIM_INSTANCE_CNT   3     // максимальное количество интерфейсов SPIM (SPIM1, SPIM2, SPIM3)
+#ifndef SPIM_JOB_QUEUE_SIZE
+#define SPIM_JOB_QUEUE_SIZE 8     // длина кольцевой очереди заданий одного интерфейса
+#endif // SPIM_JOB_QUEUE_SIZE
 // *****************************************************
 
 
@@ -28,6 +31,8 @@
 #define SPI_PIN_NOT_USED  0xFF
 
 
+typedef void (*spi_done_t)(void *ctx); // функция окончания задания (вызывается из прерывания SPIM)
+
 typedef struct
 { // структура очереди задач для SPIM
   uint16_t        delay_ms; // задержка возврата управления (если =0, то задержки нет)
@@ -39,12 +44,14 @@ typedef struct
   uint8_t         *txData;  // указатель буфер данных для записи
   uint16_t        txDataLen; // сколько данных нужно записать
   uint8_t         csPin;    // номер пина chip select 
+  spi_done_t      done;     // вызывается из прерывания SPIM по окончании задания (может быть NULL; в spiTaskExecute/spiTaskStart перезаписывается)
+  void            *ctx;     // аргумент для done
 } spi_queue_t;
 
 
 /*
 ВХОД:
-spim - указатель на адрес интерфейса SPI (поддерживаются SPIM2 и SPIM3)
+spim - указатель на адрес интерфейса SPI (поддерживаются SPIM1, SPIM2 и SPIM3, если их выводы описаны в файле платы)
 irqn - номер прерывания
 irqPrior - приоритет прерывания
 boudrate - скорость обмена по SPI (максималка для SPIM2 - 8M, для SPIM3 - 32M)
@@ -67,6 +74,55 @@ uint16_t spiDeInit(uint8_t devID);
 uint16_t spiTaskExecute(uint8_t devID, spi_queue_t *task, uint32_t wait_ticks); // помещает новую задачу (прием или передача данных по SPI) в буфер и запускает ее исполнение
 
 
+/*
+* Запускает исполнение задачи обмена данными по SPI без ожидания окончания (для параллельной работы нескольких шин)
+* devID - ID интерфейса
+* task - указатель на задачу для SPI (задача и ее буферы должны существовать до вызова spiTaskWait)
+* wait_ticks - максимальное время ожидания начала выполнения задачи, если интерфейс занят
+* ВЫХОД: код ошибки из errors.h
+* Интерфейс остается занятым до вызова spiTaskWait(), который должен сделать тот же поток
+*/
+uint16_t spiTaskStart(uint8_t devID, spi_queue_t *task, uint32_t wait_ticks);
+
+
+/*
+* Ожидание окончания задачи, запущенной spiTaskStart(), и освобождение интерфейса
+* devID - ID интерфейса
+* ВЫХОД: код ошибки из errors.h (ERR_INVALID_STATE - задача не запускалась)
+*/
+uint16_t spiTaskWait(uint8_t devID);
+
+
+/*
+* Помещает задачу в кольцевую очередь интерфейса без ожидания (можно вызывать из прерывания)
+* devID - ID интерфейса
+* task - указатель на задачу для SPI (задача и ее буферы должны существовать до вызова task->done)
+* ВЫХОД: код ошибки из errors.h (ERR_FIFO_OVF - очередь заполнена)
+* Задачи выполняются по порядку, следующая задача запускается из прерывания SPIM сразу после окончания
+* предыдущей, без участия потоков. Об окончании задачи сообщает task->done (из прерывания SPIM).
+*/
+uint16_t spiTaskSubmit(uint8_t devID, spi_queue_t *task);
+
+
+/*
+* Захват порта SPIM для обмена, который запускается аппаратно (по PPI) в обход очереди заданий
+* devID - ID интерфейса
+* spim - адрес порта SPIM для настройки владельцем
+* wait_ticks - максимальное время ожидания окончания текущих заданий
+* ВЫХОД: код ошибки из errors.h
+* Прерывание SPIM запрещается, задания очереди не запускаются до вызова spiHwRelease(), который должен сделать тот же поток
+*/
+uint16_t spiHwAcquire(uint8_t devID, NRF_SPIM_Type **spim, uint32_t wait_ticks);
+
+
+/*
+* Освобождение порта, захваченного spiHwAcquire() (аппаратный запуск обмена к этому моменту должен быть отключен)
+* devID - ID интерфейса
+* ВЫХОД: код ошибки из errors.h (ERR_INVALID_STATE - порт не захвачен)
+*/
+uint16_t spiHwRelease(uint8_t devID);
+
+
 
 
 
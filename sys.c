@@ -5,6 +5,12 @@
 #include "nrf.h"
 #include "custom_board.h"
 #include "nrf_power.h"
+#include "nrf_sdh.h"
+#include "nrf_soc.h"
+
+// FreeRTOS
+#include "FreeRTOS.h"
+#include "task.h"
 
 #if(WDT_EN)
 #include "nrf_drv_wdt.h"
@@ -20,6 +26,7 @@
 */
 
 #define GPIOTE_CH_CNT     8   // максимальное количество каналов GPIOTE
+#define SPIM_CNT          4   // количество интерфейсов SPIM (SPIM0..SPIM3)
 
 
 
@@ -27,14 +34,31 @@
 static TPTR m_loggerHook = NULL;    // указатель на функцию в logger
 #endif
 
-static TPTA m_spim3HookA = NULL; // указатель на функци обработчик прерывания от SPIM3
-static void *m_spim3Args = NULL; // указатель на аргументы обработчика прерывания от SPIM3
+static TPTA m_spimHookA[SPIM_CNT]; // указатели на функции обработчики прерывания от SPIM по номеру интерфейса
+static void *m_spimArgs[SPIM_CNT]; // указатели на аргументы обработчиков прерывания от SPIM
 
 #if(WDT_EN)
 static nrf_drv_wdt_channel_id m_wdt_id; // для обращению к wdt
 #endif
 
 static TPTR m_gpioteChHook[GPIOTE_CH_CNT];  // для хранения указателей на обработчики для каждого канала GPIOTE
+static TPTR m_adsTimerHook = NULL; // обработчик таймера-счетчика кадров АЦП
+static TPTR m_compHook = NULL; // обработчик фронта компаратора COMP
+
+static uint32_t m_sleepStart = 0; // значение счетчика RTC1 (тики FreeRTOS) при уходе в сон
+static volatile uint32_t m_sleepTicks = 0; // суммарное время сна в тиках
+static volatile uint32_t m_sleepCnt = 0; // количество уходов в сон (пробуждений) в tickless idle
+
+static uint32_t m_bootMs[SYS_BOOT_PHASE_CNT] = {SYS_BOOT_NONE, SYS_BOOT_NONE, SYS_BOOT_NONE, SYS_BOOT_NONE, SYS_BOOT_NONE}; // времена этапов загрузки
+
+#if(configSUPPORT_STATIC_ALLOCATION == 1)
+static StaticTask_t m_idleTaskTCB; // TCB задачи IDLE
+static StackType_t  m_idleTaskStack[configMINIMAL_STACK_SIZE]; // стек задачи IDLE
+#if(configUSE_TIMERS == 1)
+static StaticTask_t m_timerTaskTCB; // TCB задачи таймеров FreeRTOS
+static StackType_t  m_timerTaskStack[configTIMER_TASK_STACK_DEPTH]; // стек задачи таймеров FreeRTOS
+#endif // configUSE_TIMERS
+#endif // configSUPPORT_STATIC_ALLOCATION
 
 
 
@@ -52,6 +76,42 @@ void vApplicationIdleHook( void )
 #endif
 }
 
+/**@brief Учет времени сна tickless idle (configPRE_SLEEP_PROCESSING / configPOST_SLEEP_PROCESSING в FreeRTOSConfig.h)
+ * @note Вызываются из vPortSuppressTicksAndSleep() при запрещенных прерываниях. Тики FreeRTOS считает RTC1.
+ */
+void sysPreSleep(void)
+{
+  m_sleepStart = NRF_RTC1->COUNTER;
+}
+
+void sysPostSleep(void)
+{
+  m_sleepTicks += (NRF_RTC1->COUNTER - m_sleepStart) & RTC_COUNTER_COUNTER_Msk; // счетчик RTC 24-битный
+  m_sleepCnt++;
+}
+
+#if(configSUPPORT_STATIC_ALLOCATION == 1)
+/**@brief Память для задачи IDLE (требуется FreeRTOS при configSUPPORT_STATIC_ALLOCATION = 1)
+ */
+void vApplicationGetIdleTaskMemory(StaticTask_t **ppxIdleTaskTCBBuffer, StackType_t **ppxIdleTaskStackBuffer, uint32_t *pulIdleTaskStackSize)
+{
+  *ppxIdleTaskTCBBuffer = &m_idleTaskTCB;
+  *ppxIdleTaskStackBuffer = m_idleTaskStack;
+  *pulIdleTaskStackSize = configMINIMAL_STACK_SIZE;
+}
+
+#if(configUSE_TIMERS == 1)
+/**@brief Память для задачи таймеров (требуется FreeRTOS при configSUPPORT_STATIC_ALLOCATION = 1)
+ */
+void vApplicationGetTimerTaskMemory(StaticTask_t **ppxTimerTaskTCBBuffer, StackType_t **ppxTimerTaskStackBuffer, uint32_t *pulTimerTaskStackSize)
+{
+  *ppxTimerTaskTCBBuffer = &m_timerTaskTCB;
+  *ppxTimerTaskStackBuffer = m_timerTaskStack;
+  *pulTimerTaskStackSize = configTIMER_TASK_STACK_DEPTH;
+}
+#endif // configUSE_TIMERS
+#endif // configSUPPORT_STATIC_ALLOCATION
+
 void GPIOTE_IRQHandler(void)
 { // обработчик прерывания от GPIOTE
 #if BOARD_V1_0
@@ -64,13 +124,55 @@ void GPIOTE_IRQHandler(void)
 } // GPIOTE_IRQHandler
 
 
+static void spimIrq(uint8_t spimNo, NRF_SPIM_Type *spim)
+{ // общий обработчик SPIM: вызывает обработчик модуля, за которым закреплен интерфейс
+  if(spim->ENABLE == (SPIM_ENABLE_ENABLE_Enabled << SPIM_ENABLE_ENABLE_Pos))
+  {
+    if(m_spimHookA[spimNo]) m_spimHookA[spimNo](m_spimArgs[spimNo]);
+  }
+}
+
+// SPIM1 и SPIM2 делят вектор с TWI/SPIS, поэтому обработчики объявляются, только если на плате есть такая шина SPI
+#if defined(SPIM1_SCK_PIN)
+void SPIM1_SPIS1_TWIM1_TWIS1_SPI1_TWI1_IRQHandler(void)
+{ // обработчик SPIM1
+  spimIrq(1, NRF_SPIM1);
+}
+#endif // SPIM1_SCK_PIN
+
+#if defined(SPIM2_SCK_PIN)
+void SPIM2_SPIS2_SPI2_IRQHandler(void)
+{ // обработчик SPIM2
+  spimIrq(2, NRF_SPIM2);
+}
+#endif // SPIM2_SCK_PIN
+
 void SPIM3_IRQHandler(void)
 { // обработчик SPIM3
-  if(NRF_SPIM3->ENABLE == (SPIM_ENABLE_ENABLE_Enabled << SPIM_ENABLE_ENABLE_Pos))
+  spimIrq(3, NRF_SPIM3);
+}
+
+#if defined(ADS129X_TIMER)
+void ADS129X_TIMER_IRQHandler(void)
+{ // обработчик таймера-счетчика кадров АЦП (набрана очередная пачка отсчетов)
+  if(ADS129X_TIMER->EVENTS_COMPARE[0])
   {
-    if(m_spim3HookA) m_spim3HookA((void *)m_spim3Args);
+    ADS129X_TIMER->EVENTS_COMPARE[0] = 0;
+    if(m_adsTimerHook) m_adsTimerHook();
   }
 }
+#endif // ADS129X_TIMER
+
+#if defined(ADS129X_PACE_AIN)
+void COMP_LPCOMP_IRQHandler(void)
+{ // обработчик компаратора (фронт импульса стимулятора)
+  if(NRF_COMP->EVENTS_UP)
+  {
+    NRF_COMP->EVENTS_UP = 0;
+    if(m_compHook) m_compHook();
+  }
+}
+#endif // ADS129X_PACE_AIN
 
 
 // %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -82,10 +184,24 @@ void sysSetLoggerAppIdleHook(TPTR hook)
 #endif // RTTLOG_EN
 }
 
-void sysSetSpim3Hook(TPTA hookA, void *args)
-{ // установка обработчика от шины SPIM3
-  m_spim3HookA = hookA;
-  m_spim3Args = args;
+bool sysSetSpimHook(uint8_t spimNo, TPTA hookA, void *args)
+{ // установка обработчика от шины SPIM
+  if(spimNo >= SPIM_CNT) return false;
+  
+  m_spimHookA[spimNo] = NULL; // обработчик и аргументы меняются при запрещенном обработчике
+  m_spimArgs[spimNo] = args;
+  m_spimHookA[spimNo] = hookA;
+  return true;
+}
+
+void sysSetAdsTimerHook(TPTR hook)
+{ // установка обработчика таймера-счетчика кадров АЦП
+  m_adsTimerHook = hook;
+}
+
+void sysSetCompHook(TPTR hook)
+{ // установка обработчика фронта компаратора COMP
+  m_compHook = hook;
 }
 
 bool sysSetGpioteHook(uint8_t gpioteChannel, TPTR hook)
@@ -96,6 +212,53 @@ bool sysSetGpioteHook(uint8_t gpioteChannel, TPTR hook)
   return true;
 }
 
+void sysGetPwrProfile(sys_pwr_profile_t *profile)
+{ // профиль потребления: время работы и сна, количество пробуждений
+  if(profile == NULL) return;
+  
+  taskENTER_CRITICAL();
+  uint32_t uptime = xTaskGetTickCount();
+  uint32_t sleep = m_sleepTicks;
+  profile->wakeups = m_sleepCnt;
+  taskEXIT_CRITICAL();
+  
+  profile->uptime_ms = (uint32_t)(((uint64_t)uptime * 1000) / configTICK_RATE_HZ);
+  profile->sleep_ms = (uint32_t)(((uint64_t)sleep * 1000) / configTICK_RATE_HZ);
+}
+
+void sysBootMark(sys_boot_phase_e phase)
+{ // отметка времени этапа загрузки (до запуска планировщика время 0)
+  if(phase >= SYS_BOOT_PHASE_CNT) return;
+  if(m_bootMs[phase] != SYS_BOOT_NONE) return; // этап уже пройден
+  m_bootMs[phase] = (uint32_t)(((uint64_t)xTaskGetTickCount() * 1000) / configTICK_RATE_HZ);
+}
+
+uint32_t sysBootTime(sys_boot_phase_e phase)
+{ // время этапа загрузки в мс
+  if(phase >= SYS_BOOT_PHASE_CNT) return SYS_BOOT_NONE;
+  return m_bootMs[phase];
+}
+
+uint8_t sysRetainedGet(void)
+{ // флаги в GPREGRET2: при включенном SoftDevice регистры POWER доступны только через его API
+  uint32_t val = 0;
+  if(nrf_sdh_is_enabled()) sd_power_gpregret_get(1, &val);
+  else val = NRF_POWER->GPREGRET2;
+  return (uint8_t)val;
+}
+
+void sysRetainedSet(uint8_t flags, bool set)
+{ // установка/сброс флагов в GPREGRET2
+  if(nrf_sdh_is_enabled())
+  {
+    if(set) sd_power_gpregret_set(1, flags);
+    else sd_power_gpregret_clr(1, flags);
+  }else{
+    if(set) NRF_POWER->GPREGRET2 |= flags;
+    else NRF_POWER->GPREGRET2 &= ~(uint32_t)flags;
+  }
+}
+
 void systemReset(void)
 { // перезагрузка системы
   __sd_nvic_irq_disable();
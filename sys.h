@@ -12,13 +12,46 @@
 typedef void (*TPTR)(void);
 typedef void (*TPTA)(void *args);
 
+typedef struct
+{ // профиль потребления (с момента запуска)
+  uint32_t  uptime_ms;  // время работы
+  uint32_t  sleep_ms;   // время сна в tickless idle
+  uint32_t  wakeups;    // количество пробуждений из сна
+} sys_pwr_profile_t;
+
+typedef enum
+{ // этапы загрузки (время отсчитывается от запуска планировщика)
+  SYS_BOOT_ANA_PWR = 0, // подано аналоговое питание АЦП
+  SYS_BOOT_ADC_READY,   // АЦП отвечает (прочитан регистр ID)
+  SYS_BOOT_ADC_CFG,     // конфигурация АЦП загружена
+  SYS_BOOT_BLE_ADV,     // стек BLE инициализирован, идет эдвертайзинг
+  SYS_BOOT_FIRST_SAMPLE,// получен первый отсчет АЦП
+  SYS_BOOT_PHASE_CNT
+} sys_boot_phase_e;
+
+#define SYS_BOOT_NONE           0xFFFFFFFF  // этап еще не пройден
+
+// флаги в регистре GPREGRET2 (сохраняется при программном сбросе)
+#define SYS_RETAINED_ANA_PWR    0x01        // аналоговое питание АЦП было включено, АЦП не в Power Down
+
 
 
 
 
 void sysSetLoggerAppIdleHook(TPTR hook); // установка обработчика от модуля logger в системную функцию vApplicationIdleHook()
-void sysSetSpim3Hook(TPTA hookA, void *args); // установка обработчика от шины SPIM3
+bool sysSetSpimHook(uint8_t spimNo, TPTA hookA, void *args); // установка обработчика от шины SPIM с номером spimNo (1..3)
 bool sysSetGpioteHook(uint8_t gpioteChannel, TPTR hook); // установка обработчика для выбранного канала GPIO
+void sysSetAdsTimerHook(TPTR hook); // установка обработчика таймера-счетчика кадров АЦП (ADS129X_TIMER)
+void sysSetCompHook(TPTR hook); // установка обработчика фронта компаратора COMP (обнаружение импульсов стимулятора)
+
+void sysGetPwrProfile(sys_pwr_profile_t *profile); // профиль потребления: время работы и сна, количество пробуждений
+void sysPreSleep(void); // вызывается FreeRTOS перед сном tickless idle (configPRE_SLEEP_PROCESSING)
+void sysPostSleep(void); // вызывается FreeRTOS после сна tickless idle (configPOST_SLEEP_PROCESSING)
+
+void sysBootMark(sys_boot_phase_e phase); // отметка времени этапа загрузки (запоминается только первая отметка)
+uint32_t sysBootTime(sys_boot_phase_e phase); // время этапа загрузки в мс (SYS_BOOT_NONE - этап не пройден)
+uint8_t sysRetainedGet(void); // флаги SYS_RETAINED_*, сохраняемые при программном сбросе
+void sysRetainedSet(uint8_t flags, bool set); // установка/сброс флагов SYS_RETAINED_*
 
 void systemReset(void); // перезагрузка системы
 
@@ -0,0 +1,102 @@
+/*
+Фаззинг разбора двоичных кадров команд (cmd.c)
+
+Вход фаззера - поток байтов, который подается в cmd_rx() частями произвольной длины. Проверяется,
+что все переданные кадры ответа правильно сформированы, а обработчики получают аргументы внутри кадра.
+Выход за границы буферов ловят санитайзеры.
+
+make -C test fuzz       - libFuzzer (нужен clang)
+make -C test test       - короткий прогон на псевдослучайных данных (FUZZ_MAIN) вместе с остальными тестами
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cmd.h"
+
+
+static uint8_t dummy_handler(uint8_t const *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{ // читает все аргументы и заполняет весь буфер ответа
+  uint8_t sum = 0;
+  for(uint16_t i = 0; i < arg_len; i++) sum += arg[i];
+  memset(rsp, sum, *rsp_len);
+  if(arg_len && (arg[0] == 0)) *rsp_len = 0;
+  return (arg_len & 1) ? CMD_STATUS_OK : CMD_STATUS_BAD_ARG;
+}
+
+static const cmd_entry_t m_table[] = {
+  {'a', dummy_handler},
+  {'b', dummy_handler},
+  {CMD_FRAME_SYNC, dummy_handler},
+};
+
+
+static void tx(uint8_t const *data, uint16_t len)
+{ // каждый кадр ответа должен быть правильным
+  uint16_t crc;
+  if((len < CMD_FRAME_OVERHEAD) || (len > CMD_RSP_LEN_MAX) || (data[0] != CMD_FRAME_SYNC) ||
+     ((data[1] + CMD_FRAME_OVERHEAD) != len)) abort();
+  crc = data[len - 2] | ((uint16_t)data[len - 1] << 8);
+  if(crc != cmd_crc16(&data[1], data[1] + 1)) abort();
+}
+
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  cmd_init(m_table, sizeof(m_table) / sizeof(m_table[0]), tx, NULL);
+
+  // первый байт задает размер частей, на которые делится поток
+  uint8_t part = size ? (data[0] | 1) : 1;
+  size_t pos = size ? 1 : 0;
+  while(pos < size)
+  {
+    uint16_t len = (uint16_t)(((size - pos) < part) ? (size - pos) : part);
+    cmd_rx(&data[pos], len);
+    pos += len;
+  }
+  if(size) cmd_event(data[0], &data[1], (uint8_t)((size - 1) % (CMD_EVT_LEN_MAX + 1)));
+  return 0;
+}
+
+
+#ifdef FUZZ_MAIN
+#define FUZZ_RUNS     20000
+#define FUZZ_LEN_MAX  1024
+
+static uint32_t m_seed = 12345;
+
+static uint8_t rnd(void)
+{ // линейный конгруэнтный генератор (воспроизводимый прогон)
+  m_seed = m_seed * 1103515245 + 12345;
+  return (uint8_t)(m_seed >> 16);
+}
+
+int main(void)
+{ // псевдослучайные потоки: чистый шум и шум с правильными кадрами внутри
+  static uint8_t buf[FUZZ_LEN_MAX];
+  for(uint32_t run = 0; run < FUZZ_RUNS; run++)
+  {
+    uint16_t len = rnd() | ((uint16_t)(rnd() & 0x03) << 8);
+    for(uint16_t i = 0; i < len; i++) buf[i] = rnd();
+
+    if(run & 1)
+    { // вставляю правильные кадры с командами из таблицы
+      for(uint16_t pos = 1 + (rnd() & 0x0F); (pos + CMD_FRAME_OVERHEAD + 3) < len; pos += CMD_FRAME_OVERHEAD + buf[pos + 1] + (rnd() & 0x07))
+      {
+        uint8_t tlv_len = rnd() % (len - pos - CMD_FRAME_OVERHEAD);
+        buf[pos] = CMD_FRAME_SYNC;
+        buf[pos + 1] = tlv_len;
+        if(tlv_len) buf[pos + 2] = (rnd() & 1) ? 'a' : 'b';
+        uint16_t crc = cmd_crc16(&buf[pos + 1], tlv_len + 1);
+        buf[pos + 2 + tlv_len] = (uint8_t)crc;
+        buf[pos + 3 + tlv_len] = (uint8_t)(crc >> 8);
+      }
+    }
+    LLVMFuzzerTestOneInput(buf, len);
+  }
+
+  printf("fuzz_cmd: OK (%d runs)\n", FUZZ_RUNS);
+  return 0;
+}
+#endif // FUZZ_MAIN
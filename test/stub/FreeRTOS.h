@@ -0,0 +1,19 @@
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+/*
+Заглушка FreeRTOS для сборки модулей на хосте (тесты)
+Критические секции не нужны: тесты выполняются в одном потоке без прерываний
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef unsigned long UBaseType_t;
+
+#define portSET_INTERRUPT_MASK_FROM_ISR()       0
+#define portCLEAR_INTERRUPT_MASK_FROM_ISR(x)    ((void)(x))
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef TASK_H
+#define TASK_H
+
+/*
+Заглушка task.h FreeRTOS для сборки модулей на хосте (все нужное - в FreeRTOS.h)
+*/
+
+#include "FreeRTOS.h"
+
+#endif
@@ -0,0 +1,144 @@
+/*
+Тест пула блоков на хосте: выделение, освобождение, счетчик ссылок, исчерпание пула и статистика
+
+Сборка и запуск: make -C test
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "blk_pool.h"
+#include "errors.h"
+
+
+static int m_fail = 0; // количество неудачных проверок
+
+#define CHECK(cond)                                                     \
+  do{                                                                   \
+    if(!(cond))                                                         \
+    {                                                                   \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);            \
+      m_fail++;                                                         \
+    }                                                                   \
+  }while(0)
+
+
+static void test_alloc_free(void)
+{ // выделенный блок пустой, после освобождения возвращается в пул
+  blk_pool_stat_t stat;
+  CHECK(blk_pool_init() == ERR_NOERROR);
+
+  blk_t *blk = blk_pool_alloc();
+  CHECK(blk != NULL);
+  CHECK(blk->len == 0);
+  blk_pool_get_stat(&stat);
+  CHECK(stat.total == BLK_POOL_BLOCK_CNT);
+  CHECK(stat.free == BLK_POOL_BLOCK_CNT - 1);
+
+  blk->len = 10;
+  blk_pool_free(blk);
+  blk_pool_get_stat(&stat);
+  CHECK(stat.free == BLK_POOL_BLOCK_CNT);
+
+  blk_t *again = blk_pool_alloc(); // стек индексов: освобожденный блок выдается первым, длина сброшена
+  CHECK(again == blk);
+  CHECK(again->len == 0);
+  blk_pool_free(again);
+}
+
+static void test_ref(void)
+{ // блок возвращается в пул после освобождения последней ссылки
+  blk_pool_stat_t stat;
+  blk_pool_init();
+
+  blk_t *blk = blk_pool_alloc();
+  blk_pool_ref(blk);
+  blk_pool_ref(blk);
+
+  blk_pool_free(blk);
+  blk_pool_free(blk);
+  blk_pool_get_stat(&stat);
+  CHECK(stat.free == BLK_POOL_BLOCK_CNT - 1); // осталась одна ссылка
+
+  blk_pool_free(blk);
+  blk_pool_get_stat(&stat);
+  CHECK(stat.free == BLK_POOL_BLOCK_CNT);
+
+  blk_pool_free(blk); // повторное освобождение свободного блока игнорируется
+  blk_pool_ref(blk);  // ссылка на свободный блок не появляется
+  blk_pool_get_stat(&stat);
+  CHECK(stat.free == BLK_POOL_BLOCK_CNT);
+
+  blk_t foreign;
+  blk_pool_free(&foreign); // чужие указатели и NULL игнорируются
+  blk_pool_ref(&foreign);
+  blk_pool_free(NULL);
+  blk_pool_get_stat(&stat);
+  CHECK(stat.free == BLK_POOL_BLOCK_CNT);
+}
+
+static void test_exhaust(void)
+{ // все блоки разные, при исчерпании пула - NULL и счетчик отказов
+  blk_t *blk[BLK_POOL_BLOCK_CNT];
+  blk_pool_stat_t stat;
+  blk_pool_init();
+
+  for(uint16_t i = 0; i < BLK_POOL_BLOCK_CNT; i++)
+  {
+    blk[i] = blk_pool_alloc();
+    CHECK(blk[i] != NULL);
+    for(uint16_t j = 0; j < i; j++) CHECK(blk[i] != blk[j]);
+  }
+  CHECK(blk_pool_alloc() == NULL);
+  CHECK(blk_pool_alloc() == NULL);
+  blk_pool_get_stat(&stat);
+  CHECK(stat.free == 0);
+  CHECK(stat.alloc_fail == 2);
+
+  blk_pool_free(blk[3]);
+  blk_t *last = blk_pool_alloc();
+  CHECK(last == blk[3]);
+  CHECK(blk_pool_alloc() == NULL);
+
+  for(uint16_t i = 0; i < BLK_POOL_BLOCK_CNT; i++) blk_pool_free(blk[i]);
+  blk_pool_get_stat(&stat);
+  CHECK(stat.free == BLK_POOL_BLOCK_CNT);
+  CHECK(stat.alloc_fail == 3);
+}
+
+static void test_hwm(void)
+{ // максимум одновременно занятых блоков сохраняется после освобождения, сбрасывается инициализацией
+  blk_t *blk[5];
+  blk_pool_stat_t stat;
+  blk_pool_init();
+
+  for(uint8_t i = 0; i < 5; i++) blk[i] = blk_pool_alloc();
+  for(uint8_t i = 0; i < 5; i++) blk_pool_free(blk[i]);
+  blk[0] = blk_pool_alloc();
+  blk[1] = blk_pool_alloc();
+  blk_pool_get_stat(&stat);
+  CHECK(stat.hwm == 5);
+  CHECK(stat.free == BLK_POOL_BLOCK_CNT - 2);
+
+  blk_pool_ref(blk[0]); // дополнительные ссылки не занимают блоков
+  blk_pool_get_stat(&stat);
+  CHECK(stat.hwm == 5);
+
+  blk_pool_init();
+  blk_pool_get_stat(&stat);
+  CHECK(stat.hwm == 0);
+  CHECK(stat.alloc_fail == 0);
+  CHECK(stat.free == BLK_POOL_BLOCK_CNT);
+}
+
+
+int main(void)
+{
+  test_alloc_free();
+  test_ref();
+  test_exhaust();
+  test_hwm();
+
+  printf("blk_pool: %s\n", m_fail ? "FAILED" : "OK");
+  return m_fail ? 1 : 0;
+}
@@ -0,0 +1,272 @@
+/*
+Тест разбора двоичных кадров команд на хосте: CRC, TLV, кадры по частям, ресинхронизация, разбиение ответа, события,
+отложенные ответы
+
+Сборка и запуск: make -C test
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cmd.h"
+
+
+static int m_fail = 0; // количество неудачных проверок
+
+#define CHECK(cond)                                                     \
+  do{                                                                   \
+    if(!(cond))                                                         \
+    {                                                                   \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);            \
+      m_fail++;                                                         \
+    }                                                                   \
+  }while(0)
+
+
+#define TX_FRAMES_MAX   8
+
+static uint8_t  m_tx[TX_FRAMES_MAX][CMD_FRAME_LEN_MAX]; // переданные кадры
+static uint16_t m_tx_len[TX_FRAMES_MAX];
+static uint8_t  m_tx_cnt = 0;
+static uint8_t  m_item_len = 0;   // длина ответа обработчика 'x'
+static uint8_t  m_last_arg[255];  // аргументы последнего вызова обработчика
+static uint8_t  m_last_arg_len = 0;
+
+
+static void tx(uint8_t const *data, uint16_t len)
+{
+  if(m_tx_cnt >= TX_FRAMES_MAX) return;
+  CHECK(len <= CMD_FRAME_LEN_MAX);
+  memcpy(m_tx[m_tx_cnt], data, len);
+  m_tx_len[m_tx_cnt++] = len;
+}
+
+static uint8_t echo_handler(uint8_t const *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{ // ответ - аргументы
+  memcpy(m_last_arg, arg, arg_len);
+  m_last_arg_len = arg_len;
+  if(arg_len > *rsp_len) return CMD_STATUS_ERROR;
+  memcpy(rsp, arg, arg_len);
+  *rsp_len = arg_len;
+  return CMD_STATUS_OK;
+}
+
+static uint8_t big_handler(uint8_t const *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{ // ответ заданной длины
+  (void)arg;
+  (void)arg_len;
+  if(m_item_len > *rsp_len) return CMD_STATUS_ERROR;
+  memset(rsp, 0x5A, m_item_len);
+  *rsp_len = m_item_len;
+  return CMD_STATUS_OK;
+}
+
+static uint8_t m_pend_req_id = 0; // req_id, запомненный отложенной командой
+
+static uint8_t pend_handler(uint8_t const *arg, uint8_t arg_len, uint8_t *rsp, uint8_t *rsp_len)
+{ // отложенная команда: ответ придет через cmd_reply()
+  (void)arg;
+  (void)arg_len;
+  (void)rsp;
+  *rsp_len = 0;
+  m_pend_req_id = cmd_req_id();
+  return CMD_STATUS_PENDING;
+}
+
+static const cmd_entry_t m_table[] = {
+  {'e', echo_handler},
+  {'x', big_handler},
+  {'w', pend_handler},
+};
+
+
+static void reset(void)
+{
+  cmd_init(m_table, sizeof(m_table) / sizeof(m_table[0]), tx, NULL);
+  m_tx_cnt = 0;
+}
+
+static uint16_t frame_build(uint8_t *frame, uint8_t const *tlv, uint8_t len)
+{ // кадр: sync, len, TLV, crc16 (младший байт первым)
+  frame[0] = CMD_FRAME_SYNC;
+  frame[1] = len;
+  memcpy(&frame[2], tlv, len);
+  uint16_t crc = cmd_crc16(&frame[1], len + 1);
+  frame[2 + len] = (uint8_t)crc;
+  frame[3 + len] = (uint8_t)(crc >> 8);
+  return len + CMD_FRAME_OVERHEAD;
+}
+
+static bool frame_valid(uint8_t const *frame, uint16_t len)
+{ // проверка структуры переданного кадра
+  if((len < CMD_FRAME_OVERHEAD) || (frame[0] != CMD_FRAME_SYNC) || ((frame[1] + CMD_FRAME_OVERHEAD) != len)) return false;
+  uint16_t crc = frame[len - 2] | ((uint16_t)frame[len - 1] << 8);
+  return (crc == cmd_crc16(&frame[1], frame[1] + 1));
+}
+
+
+static void test_crc(void)
+{ // контрольное значение CRC-16/CCITT-FALSE
+  CHECK(cmd_crc16((uint8_t const *)"123456789", 9) == 0x29B1);
+  CHECK(cmd_crc16(NULL, 0) == 0xFFFF);
+}
+
+static void test_frame(void)
+{ // две команды в кадре - один кадр ответа
+  uint8_t tlv[] = {'e', 7, 2, 0x11, 0x22,  'q', 8, 0};
+  uint8_t frame[CMD_FRAME_LEN_MAX];
+  cmd_stat_t stat;
+  reset();
+
+  cmd_rx(frame, frame_build(frame, tlv, sizeof(tlv)));
+  CHECK(m_tx_cnt == 1);
+  CHECK(frame_valid(m_tx[0], m_tx_len[0]));
+  uint8_t rsp[] = {'e', 7, 3, CMD_STATUS_OK, 0x11, 0x22,  'q', 8, 1, CMD_STATUS_UNKNOWN};
+  CHECK(m_tx[0][1] == sizeof(rsp));
+  CHECK(memcmp(&m_tx[0][2], rsp, sizeof(rsp)) == 0);
+  CHECK(!cmd_pending());
+
+  cmd_get_stat(&stat);
+  CHECK(stat.frames == 1);
+  CHECK(stat.cmds == 1);
+  CHECK(stat.crc_err == 0);
+}
+
+static void test_parts(void)
+{ // кадр по одному байту
+  uint8_t tlv[] = {'e', 1, 1, 0xA5};
+  uint8_t frame[CMD_FRAME_LEN_MAX];
+  reset();
+
+  uint16_t len = frame_build(frame, tlv, sizeof(tlv));
+  for(uint16_t i = 0; i < len; i++)
+  {
+    CHECK(m_tx_cnt == 0);
+    cmd_rx(&frame[i], 1);
+    if(i + 1 < len) CHECK(cmd_pending());
+  }
+  CHECK(m_tx_cnt == 1);
+  CHECK((m_last_arg_len == 1) && (m_last_arg[0] == 0xA5));
+  CHECK(!cmd_pending());
+}
+
+static void test_resync(void)
+{ // мусор перед кадром и кадр с ошибкой CRC пропускаются, следующий кадр выполняется
+  uint8_t tlv[] = {'e', 2, 0};
+  uint8_t buf[2 * CMD_FRAME_LEN_MAX + 8];
+  cmd_stat_t stat;
+  reset();
+
+  uint16_t len = 0;
+  buf[len++] = 0x00;
+  buf[len++] = 0x13;
+  buf[len++] = 0x37;
+  uint16_t bad = frame_build(&buf[len], tlv, sizeof(tlv));
+  buf[len + bad - 1] ^= 0xFF;
+  len += bad;
+  len += frame_build(&buf[len], tlv, sizeof(tlv));
+
+  cmd_rx(buf, len);
+  CHECK(m_tx_cnt == 1);
+  cmd_get_stat(&stat);
+  CHECK(stat.frames == 1);
+  CHECK(stat.crc_err >= 1);
+  CHECK(stat.sync_err >= 3);
+  CHECK(!cmd_pending());
+}
+
+static void test_tlv_err(void)
+{ // аргументы выходят за границу кадра
+  uint8_t tlv[] = {'e', 3, 10, 0x01};
+  uint8_t frame[CMD_FRAME_LEN_MAX];
+  cmd_stat_t stat;
+  reset();
+
+  cmd_rx(frame, frame_build(frame, tlv, sizeof(tlv)));
+  CHECK(m_tx_cnt == 1);
+  uint8_t rsp[] = {'e', 3, 1, CMD_STATUS_BAD_ARG};
+  CHECK(memcmp(&m_tx[0][2], rsp, sizeof(rsp)) == 0);
+  cmd_get_stat(&stat);
+  CHECK(stat.tlv_err == 1);
+  CHECK(stat.cmds == 0);
+
+  uint8_t short_hdr[] = {'e', 3}; // неполный заголовок TLV
+  reset();
+  cmd_rx(frame, frame_build(frame, short_hdr, sizeof(short_hdr)));
+  cmd_get_stat(&stat);
+  CHECK(stat.tlv_err == 1);
+  CHECK(m_tx_cnt == 0);
+}
+
+static void test_rsp_split(void)
+{ // ответы, не помещающиеся в один кадр, уходят несколькими кадрами не длиннее CMD_RSP_LEN_MAX
+  uint8_t tlv[] = {'x', 1, 0,  'x', 2, 0,  'x', 3, 0};
+  uint8_t frame[CMD_FRAME_LEN_MAX];
+  reset();
+  m_item_len = CMD_RSP_LEN_MAX / 2;
+
+  cmd_rx(frame, frame_build(frame, tlv, sizeof(tlv)));
+  CHECK(m_tx_cnt == 3);
+  for(uint8_t i = 0; i < m_tx_cnt; i++)
+  {
+    CHECK(frame_valid(m_tx[i], m_tx_len[i]));
+    CHECK(m_tx_len[i] <= CMD_RSP_LEN_MAX);
+    CHECK(m_tx[i][3] == (i + 1)); // req_id по порядку
+  }
+}
+
+static void test_event(void)
+{ // кадр события с req_id CMD_EVT_REQ_ID, слишком длинное событие не передается
+  uint8_t data[CMD_EVT_LEN_MAX + 1] = {1, 2, 3};
+  reset();
+
+  cmd_event(CMD_EVT_LOFF, data, 3);
+  CHECK(m_tx_cnt == 1);
+  CHECK(frame_valid(m_tx[0], m_tx_len[0]));
+  uint8_t evt[] = {CMD_EVT_LOFF, CMD_EVT_REQ_ID, 4, CMD_STATUS_OK, 1, 2, 3};
+  CHECK(memcmp(&m_tx[0][2], evt, sizeof(evt)) == 0);
+
+  cmd_event(CMD_EVT_LOFF, data, sizeof(data));
+  cmd_event(CMD_EVT_LOFF, NULL, 1);
+  CHECK(m_tx_cnt == 1);
+}
+
+static void test_pending(void)
+{ // подтверждение CMD_STATUS_PENDING в ответе кадра, затем отдельный кадр с результатом и тем же req_id
+  uint8_t tlv[] = {'e', 4, 0,  'w', 42, 0};
+  uint8_t frame[CMD_FRAME_LEN_MAX];
+  uint8_t data[] = {9, 8, 7, 6};
+  reset();
+
+  cmd_rx(frame, frame_build(frame, tlv, sizeof(tlv)));
+  CHECK(m_tx_cnt == 1);
+  CHECK(m_pend_req_id == 42);
+  uint8_t ack[] = {'e', 4, 1, CMD_STATUS_OK,  'w', 42, 1, CMD_STATUS_PENDING};
+  CHECK(memcmp(&m_tx[0][2], ack, sizeof(ack)) == 0);
+
+  CHECK(cmd_reply('w', m_pend_req_id, CMD_STATUS_OK, data, sizeof(data), NULL));
+  CHECK(m_tx_cnt == 2);
+  CHECK(frame_valid(m_tx[1], m_tx_len[1]));
+  uint8_t rsp[] = {'w', 42, 5, CMD_STATUS_OK, 9, 8, 7, 6};
+  CHECK(memcmp(&m_tx[1][2], rsp, sizeof(rsp)) == 0);
+
+  CHECK(!cmd_reply('w', 1, CMD_STATUS_OK, NULL, 1, NULL)); // нет данных
+  CHECK(!cmd_reply('w', 1, CMD_STATUS_OK, frame, CMD_RSP_LEN_MAX, NULL)); // не помещается в кадр
+  CHECK(m_tx_cnt == 2);
+}
+
+
+int main(void)
+{
+  test_crc();
+  test_frame();
+  test_parts();
+  test_resync();
+  test_tlv_err();
+  test_rsp_split();
+  test_event();
+  test_pending();
+
+  printf("cmd: %s\n", m_fail ? "FAILED" : "OK");
+  return m_fail ? 1 : 0;
+}